@@ -0,0 +1,126 @@
+// Copyright (c) 2024 by Rockchip Electronics Co., Ltd. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _RKNN_DEMO_YOLOV8_POSE_DETECTIONS_H_
+#define _RKNN_DEMO_YOLOV8_POSE_DETECTIONS_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "common.h"
+
+#define POSE_KEYPOINT_NUM 17
+#define DETECTIONS_DEFAULT_MAX 128
+
+/**
+ * @brief Zero-copy view of one detection, pointers stay valid until the owning Detections changes
+ *
+ */
+struct DetectionView {
+    const image_rect_t* box;
+    float score;
+    int cls_id;
+    const float (*keypoints)[3];   // POSE_KEYPOINT_NUM x (x, y, conf)
+};
+
+/**
+ * @brief Variable-length detection results stored as structure of arrays
+ *
+ * Memory scales with the number of detections actually found; clear() keeps the capacity so a
+ * container reused across frames stops allocating once it reached its high-water mark.
+ */
+class Detections {
+public:
+    explicit Detections(size_t max_detections = DETECTIONS_DEFAULT_MAX) : max_detections_(max_detections) {}
+
+    size_t size() const { return scores_.size(); }
+    bool empty() const { return scores_.empty(); }
+    bool full() const { return scores_.size() >= max_detections_; }
+
+    void clear()
+    {
+        boxes_.clear();
+        scores_.clear();
+        class_ids_.clear();
+        keypoints_.clear();
+    }
+
+    void reserve(size_t n)
+    {
+        boxes_.reserve(n);
+        scores_.reserve(n);
+        class_ids_.reserve(n);
+        keypoints_.reserve(n * POSE_KEYPOINT_NUM * 3);
+    }
+
+    size_t max_detections() const { return max_detections_; }
+
+    /**
+     * @brief Change the maximum number of detections accepted by append(), drops the excess
+     */
+    void set_max_detections(size_t max_detections)
+    {
+        max_detections_ = max_detections;
+        if (size() > max_detections_)
+        {
+            boxes_.resize(max_detections_);
+            scores_.resize(max_detections_);
+            class_ids_.resize(max_detections_);
+            keypoints_.resize(max_detections_ * POSE_KEYPOINT_NUM * 3);
+        }
+    }
+
+    /**
+     * @brief Append one detection
+     *
+     * @return float* Keypoint slot (POSE_KEYPOINT_NUM x 3 floats) to fill, NULL if the container is full
+     */
+    float* append(const image_rect_t& box, float score, int cls_id)
+    {
+        if (full())
+        {
+            return NULL;
+        }
+        boxes_.push_back(box);
+        scores_.push_back(score);
+        class_ids_.push_back(cls_id);
+        keypoints_.resize(keypoints_.size() + POSE_KEYPOINT_NUM * 3);
+        return &keypoints_[keypoints_.size() - POSE_KEYPOINT_NUM * 3];
+    }
+
+    DetectionView operator[](size_t i) const
+    {
+        DetectionView view;
+        view.box = &boxes_[i];
+        view.score = scores_[i];
+        view.cls_id = class_ids_[i];
+        view.keypoints = (const float (*)[3])&keypoints_[i * POSE_KEYPOINT_NUM * 3];
+        return view;
+    }
+
+    const image_rect_t* boxes() const { return boxes_.data(); }
+    const float* scores() const { return scores_.data(); }
+    const int* class_ids() const { return class_ids_.data(); }
+    // size() x POSE_KEYPOINT_NUM x 3 floats
+    const float* keypoints() const { return keypoints_.data(); }
+
+private:
+    size_t max_detections_;
+    std::vector<image_rect_t> boxes_;
+    std::vector<float> scores_;
+    std::vector<int> class_ids_;
+    std::vector<float> keypoints_;
+};
+
+#endif //_RKNN_DEMO_YOLOV8_POSE_DETECTIONS_H_
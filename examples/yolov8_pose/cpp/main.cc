@@ -19,124 +19,549 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
-#include "yolov8-pose.h"
+#include "pose_detector.h"
 #include "image_utils.h"
+#include "image_prefetch.h"
+#include "image_async.h"
+#include "frame_source.h"
+#include "image_raw.h"
+#include "mjpeg_source.h"
+#include "image_writer.h"
+#include "image_pool.h"
+#include "rga_handle_cache.h"
 #include "file_utils.h"
 #include "image_drawing.h"
 int skeleton[38] ={16, 14, 14, 12, 17, 15, 15, 13, 12, 13, 6, 12, 7, 13, 6, 7, 6, 8, 
             7, 9, 8, 10, 9, 11, 2, 3, 1, 2, 1, 3, 2, 4, 3, 5, 4, 6, 5, 7}; 
 
+static void print_detections(const char *path, const Detections &detections)
+{
+    printf("%s: %d person\n", path, (int)detections.size());
+    for (size_t i = 0; i < detections.size(); i++)
+    {
+        DetectionView det_result = detections[i];
+        printf("    %s @ (%d %d %d %d) %.3f\n", coco_cls_to_name(det_result.cls_id),
+               det_result.box->left, det_result.box->top,
+               det_result.box->right, det_result.box->bottom,
+               det_result.score);
+    }
+}
+
+static void draw_detection(image_buffer_t *image, const DetectionView &det_result, float src_scale)
+{
+    char text[256];
+    int x1 = (int)(det_result.box->left * src_scale);
+    int y1 = (int)(det_result.box->top * src_scale);
+    int x2 = (int)(det_result.box->right * src_scale);
+    int y2 = (int)(det_result.box->bottom * src_scale);
+
+    draw_rectangle(image, x1, y1, x2 - x1, y2 - y1, COLOR_BLUE, 3);
+
+    sprintf(text, "%s %.1f%%", coco_cls_to_name(det_result.cls_id), det_result.score * 100);
+    draw_text(image, text, x1, y1 - 20, COLOR_RED, 10);
+
+    for (int j = 0; j < 38/2; ++j)
+    {
+        const float *p0 = det_result.keypoints[skeleton[2*j]-1];
+        const float *p1 = det_result.keypoints[skeleton[2*j+1]-1];
+        if ((p0[0] == 0 && p0[1] == 0) || (p1[0] == 0 && p1[1] == 0))
+        {
+            continue;
+        }
+        draw_line(image, (int)(p0[0] * src_scale), (int)(p0[1] * src_scale),
+         (int)(p1[0] * src_scale), (int)(p1[1] * src_scale), COLOR_ORANGE, 3);
+    }
+
+    for (int j = 0; j < POSE_KEYPOINT_NUM; ++j)
+    {
+        if (det_result.keypoints[j][0] == 0 && det_result.keypoints[j][1] == 0)
+        {
+            continue;
+        }
+        draw_circle(image, (int)(det_result.keypoints[j][0] * src_scale), (int)(det_result.keypoints[j][1] * src_scale), 1, COLOR_YELLOW, 1);
+    }
+}
+
+// Draw the detections on the decoded image and queue it as <save_dir>/<name>.jpg, the encoding
+// runs on the writer threads while the next image is processed
+static void save_detections(image_writer_t *writer, const char *save_dir, const char *name, image_buffer_t *image,
+                            const Detections &detections, float src_scale)
+{
+    for (size_t i = 0; i < detections.size(); i++)
+    {
+        draw_detection(image, detections[i], src_scale);
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.jpg", save_dir, name);
+    image_writer_submit(writer, path, image);
+}
+
+static int submit_item(PoseDetector &detector, image_async_t *async, image_prefetch_item_t *item)
+{
+    if (item->status != 0)
+    {
+        return item->status;
+    }
+    float src_scale = (float)item->image.width / item->info.orig_width;
+    return detector.submit(async, ImageView(item->image, src_scale));
+}
+
+// Images are decoded on background threads. The letterbox of image N+1 runs on the async engine
+// while image N is post processed, results are printed in list order
+static int run_batch(PoseDetector &detector, char **image_files, int num_images,
+                     const image_read_options_t &read_options, int decode_threads,
+                     image_writer_t *writer, const char *save_dir)
+{
+    image_prefetch_config_t config = {};
+    config.num_threads = decode_threads;
+    config.lookahead = decode_threads * 2;
+    config.ordered = 1;
+    config.read_options = read_options;
+
+    image_prefetcher_t *prefetcher = image_prefetcher_create(image_files, num_images, &config);
+    if (prefetcher == NULL)
+    {
+        return -1;
+    }
+    image_async_t *async = image_async_create(NULL);
+    if (async == NULL)
+    {
+        image_prefetcher_destroy(prefetcher);
+        return -1;
+    }
+
+    Detections detections;
+    image_prefetch_item_t *item = NULL;
+    image_prefetch_item_t *next_item = NULL;
+    int num_fail = 0;
+    int ret = image_prefetcher_next(prefetcher, &item);
+    int det_ret = ret == 0 ? submit_item(detector, async, item) : 0;
+    while (ret == 0)
+    {
+        if (det_ret == 0)
+        {
+            det_ret = detector.run(async);
+        }
+
+        // the model input is free again once the NPU has run, start the next letterbox
+        ret = image_prefetcher_next(prefetcher, &next_item);
+        int next_ret = ret == 0 ? submit_item(detector, async, next_item) : 0;
+
+        if (det_ret == 0)
+        {
+            det_ret = detector.collect(detections);
+        }
+        if (det_ret != 0)
+        {
+            printf("%s: fail ret=%d\n", item->path, det_ret);
+            num_fail++;
+        }
+        else
+        {
+            print_detections(item->path, detections);
+            if (writer != NULL)
+            {
+                char name[256];
+                const char *base = strrchr(item->path, '/');
+                snprintf(name, sizeof(name), "%s", base != NULL ? base + 1 : item->path);
+                char *ext = strrchr(name, '.');
+                if (ext != NULL)
+                {
+                    *ext = 0;
+                }
+                save_detections(writer, save_dir, name, &item->image, detections,
+                                (float)item->image.width / item->info.orig_width);
+            }
+        }
+        image_prefetcher_release(prefetcher, item);
+        item = next_item;
+        det_ret = next_ret;
+    }
+    image_async_destroy(async);
+    image_prefetcher_destroy(prefetcher);
+
+    printf("processed %d images, %d failed\n", num_images, num_fail);
+    return ret < 0 ? -1 : 0;
+}
+
+static int parse_raw_format(const char *name, image_format_t *format)
+{
+    static const struct { const char *name; image_format_t format; } formats[] = {
+        {"nv12", IMAGE_FORMAT_YUV420SP_NV12}, {"nv21", IMAGE_FORMAT_YUV420SP_NV21},
+        {"i420", IMAGE_FORMAT_YUV420P}, {"yuyv", IMAGE_FORMAT_YUYV},
+        {"rgb", IMAGE_FORMAT_RGB888}, {"bgr", IMAGE_FORMAT_BGR888}, {"rgb565", IMAGE_FORMAT_RGB565},
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        if (strcmp(name, formats[i].name) == 0)
+        {
+            *format = formats[i].format;
+            return 0;
+        }
+    }
+    printf("unknown raw format %s\n", name);
+    return -1;
+}
+
+// Pools of --dma-heap. The model input and raw frames are written once per frame and read by RGA
+// and the NPU, they can live in an uncached heap. Post process reads the outputs element by element,
+// they always come from the cached heap and are invalidated once per frame.
+static int create_io_pools(const char *heap, yolov8_pose_io_config_t *io_config)
+{
+    image_pool_config_t config = {};
+    if (strcmp(heap, "cached") == 0)
+    {
+        config.dma_heap = IMAGE_POOL_DMA_HEAP_CACHED;
+    }
+    else if (strcmp(heap, "uncached") == 0)
+    {
+        config.dma_heap = IMAGE_POOL_DMA_HEAP_UNCACHED;
+    }
+    else
+    {
+        printf("unknown dma heap %s, use cached or uncached\n", heap);
+        return -1;
+    }
+    // without /dev/dma_heap the pools hand out heap memory and the detector keeps the copy path
+    io_config->input_pool = image_pool_create(&config);
+    config.dma_heap = IMAGE_POOL_DMA_HEAP_CACHED;
+    io_config->output_pool = image_pool_create(&config);
+    if (io_config->input_pool == NULL || io_config->output_pool == NULL)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static void print_pool_stats(const char *name, image_pool_t *pool)
+{
+    image_pool_stats_t stats;
+    image_pool_get_stats(pool, &stats);
+    printf("%s pool: %s, %llu allocations, %llu reused, %llu cache syncs\n", name,
+           stats.dma_fallback ? "heap memory" : "dma-buf", (unsigned long long)(stats.hits + stats.misses),
+           (unsigned long long)stats.hits, (unsigned long long)stats.cache_syncs);
+}
+
+// Raw frames of a fixed layout from a file, pipe or FIFO. Files are read at inference speed,
+// live pipes drop their oldest frames when inference falls behind.
+static int run_stream(PoseDetector &detector, const char *path, const char *size, const char *format_name,
+                      image_pool_t *frame_pool)
+{
+    frame_source_config_t config = {};
+    config.pool = frame_pool;
+    if (sscanf(size, "%dx%d", &config.width, &config.height) != 2 || parse_raw_format(format_name, &config.format) != 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    int is_file = (strcmp(path, "-") == 0 ? fstat(0, &st) : stat(path, &st)) == 0 && S_ISREG(st.st_mode);
+    config.policy = is_file ? FRAME_SOURCE_BLOCK : FRAME_SOURCE_DROP_OLDEST;
+
+    frame_source_t *source = frame_source_create(path, &config);
+    if (source == NULL)
+    {
+        return -1;
+    }
+    Detections detections;
+    frame_source_frame_t *frame;
+    int ret;
+    while ((ret = frame_source_next(source, &frame)) == 0)
+    {
+        int det_ret = detector.detect(ImageView(frame->image), detections);
+        char name[32];
+        snprintf(name, sizeof(name), "frame %llu", (unsigned long long)frame->index);
+        if (det_ret != 0)
+        {
+            printf("%s: fail ret=%d\n", name, det_ret);
+        }
+        else
+        {
+            print_detections(name, detections);
+        }
+        frame_source_release(source, frame);
+    }
+
+    frame_source_stats_t stats;
+    frame_source_get_stats(source, &stats);
+    printf("read %llu frames, %llu dropped, %llu reads\n", (unsigned long long)stats.frames_read,
+           (unsigned long long)stats.frames_dropped, (unsigned long long)stats.read_calls);
+    frame_source_destroy(source);
+    return ret < 0 ? -1 : 0;
+}
+
+// Captured .data file with raw frame headers (image_raw.h). The file is mapped and every frame goes to
+// the detector in place, nothing is copied or read() into a buffer.
+static int run_raw_file(PoseDetector &detector, const char *path)
+{
+    image_raw_file_t *file = image_raw_open(path);
+    if (file == NULL)
+    {
+        return -1;
+    }
+    Detections detections;
+    int num_frames = image_raw_num_frames(file);
+    int num_fail = 0;
+    for (int i = 0; i < num_frames; i++)
+    {
+        image_buffer_t image;
+        uint64_t timestamp_us = 0;
+        char name[64];
+        int det_ret = image_raw_get_frame(file, i, &image, &timestamp_us);
+        if (det_ret == 0)
+        {
+            det_ret = detector.detect(ImageView(image), detections);
+        }
+        snprintf(name, sizeof(name), "frame %d @ %llu us", i, (unsigned long long)timestamp_us);
+        if (det_ret != 0)
+        {
+            printf("%s: fail ret=%d\n", name, det_ret);
+            num_fail++;
+        }
+        else
+        {
+            print_detections(name, detections);
+        }
+    }
+    image_raw_close(file);
+    printf("processed %d frames, %d failed\n", num_frames, num_fail);
+    return 0;
+}
+
+// Motion JPEG from a file, pipe, FIFO or HTTP camera. Frames are decoded close to the model
+// resolution on decode_threads threads and handed out in stream order.
+static int run_mjpeg(PoseDetector &detector, const char *url, const image_read_options_t &read_options,
+                     int decode_threads, image_writer_t *writer, const char *save_dir)
+{
+    mjpeg_source_config_t config = {};
+    config.num_threads = decode_threads;
+    config.read_options = read_options;
+    struct stat st;
+    int is_file = strncmp(url, "http://", 7) != 0 &&
+                  (strcmp(url, "-") == 0 ? fstat(0, &st) : stat(url, &st)) == 0 && S_ISREG(st.st_mode);
+    config.policy = is_file ? FRAME_SOURCE_BLOCK : FRAME_SOURCE_DROP_OLDEST;
+
+    mjpeg_source_t *source = mjpeg_source_create(url, &config);
+    if (source == NULL)
+    {
+        return -1;
+    }
+    Detections detections;
+    mjpeg_frame_t *frame;
+    int ret;
+    while ((ret = mjpeg_source_next(source, &frame)) == 0)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "frame %llu", (unsigned long long)frame->index);
+        int det_ret = frame->status;
+        float src_scale = 1.0f;
+        if (det_ret == 0)
+        {
+            src_scale = (float)frame->image.width / frame->info.orig_width;
+            det_ret = detector.detect(ImageView(frame->image, src_scale), detections);
+        }
+        if (det_ret != 0)
+        {
+            printf("%s: fail ret=%d\n", name, det_ret);
+        }
+        else
+        {
+            print_detections(name, detections);
+            if (writer != NULL)
+            {
+                snprintf(name, sizeof(name), "frame_%06llu", (unsigned long long)frame->index);
+                save_detections(writer, save_dir, name, &frame->image, detections, src_scale);
+            }
+        }
+        mjpeg_source_release(source, frame);
+    }
+
+    mjpeg_source_stats_t stats;
+    mjpeg_source_get_stats(source, &stats);
+    printf("found %llu frames, %llu dropped, %llu failed, %llu bytes skipped\n",
+           (unsigned long long)stats.frames_found, (unsigned long long)stats.frames_dropped,
+           (unsigned long long)stats.frames_failed, (unsigned long long)stats.bytes_skipped);
+    mjpeg_source_destroy(source);
+    return ret < 0 ? -1 : 0;
+}
+
 /*-------------------------------------------
                   Main Function
 -------------------------------------------*/
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    // annotated images of the batch and MJPEG modes are written in the background
+    const char *save_arg = NULL;
+    const char *dma_heap_arg = NULL;
+    while (argc >= 5)
+    {
+        if (strcmp(argv[argc - 2], "--save") == 0)
+        {
+            save_arg = argv[argc - 1];
+        }
+        else if (strcmp(argv[argc - 2], "--dma-heap") == 0)
+        {
+            dma_heap_arg = argv[argc - 1];
+        }
+        else
+        {
+            break;
+        }
+        argc -= 2;
+    }
+    int is_stream = argc == 6 && strcmp(argv[2], "--raw") == 0;
+    int is_mjpeg = (argc == 4 || argc == 5) && strcmp(argv[2], "--mjpeg") == 0;
+    int is_raw_file = argc == 4 && strcmp(argv[2], "--frames") == 0;
+    if (argc != 3 && argc != 4 && !is_stream && !is_mjpeg)
     {
-        printf("%s <model_path> <image_path>\n", argv[0]);
+        printf("%s <model_path> <image_path | image_dir | image_list.txt> [decode_threads] [--save <dir>] [--dma-heap <cached | uncached>]\n", argv[0]);
+        printf("%s <model_path> --raw <width>x<height> <nv12 | nv21 | i420 | yuyv | rgb | bgr | rgb565> <file | fifo | -> [--dma-heap <cached | uncached>]\n", argv[0]);
+        printf("%s <model_path> --mjpeg <file | fifo | - | http://host[:port]/path> [decode_threads] [--save <dir>] [--dma-heap <cached | uncached>]\n", argv[0]);
+        printf("%s <model_path> --frames <capture.data> [--dma-heap <cached | uncached>]\n", argv[0]);
         return -1;
     }
 
     const char *model_path = argv[1];
     const char *image_path = argv[2];
+    int decode_threads = 2;
+    if (!is_raw_file && argc == (is_mjpeg ? 5 : 4))
+    {
+        decode_threads = atoi(argv[argc - 1]);
+    }
 
     int ret;
-    rknn_app_context_t rknn_app_ctx;
-    memset(&rknn_app_ctx, 0, sizeof(rknn_app_context_t));
+    char **image_files = NULL;
+    int num_images = 0;
+    int is_batch;
+    PoseDetector detector;
+    Detections detections;
+    image_buffer_t src_image = {};
+    image_read_options_t read_options = {};
+    image_read_info_t read_info = {};
+    float src_scale = 1.0f;
+    image_writer_t *writer = NULL;
+    yolov8_pose_io_config_t io_config = {};
 
     init_post_process();
 
-    ret = init_yolov8_pose_model(model_path, &rknn_app_ctx);
+    // the model input and the decoder buffers are reused every frame, keep their RGA imports;
+    // every buffer that reaches convert_image is invalidated before it is freed
+    rga_handle_cache_set_capacity(8);
+
+    if (dma_heap_arg != NULL && create_io_pools(dma_heap_arg, &io_config) != 0)
+    {
+        ret = -1;
+        goto out;
+    }
+    ret = detector.init(model_path, dma_heap_arg != NULL ? &io_config : NULL);
     if (ret != 0)
     {
         printf("init_yolov8_pose_model fail! ret=%d model_path=%s\n", ret, model_path);
         goto out;
     }
 
-    image_buffer_t src_image;
-    memset(&src_image, 0, sizeof(image_buffer_t));
-    ret = read_image(image_path, &src_image);
+    // large JPEGs are decoded close to the model resolution, results stay in original image pixels
+    read_options.target_width = detector.model_width();
+    read_options.target_height = detector.model_height();
+
+    if (is_stream)
+    {
+        ret = run_stream(detector, argv[5], argv[3], argv[4], io_config.input_pool);
+        goto out;
+    }
+    if (is_raw_file)
+    {
+        ret = run_raw_file(detector, argv[3]);
+        goto out;
+    }
+    if (save_arg != NULL)
+    {
+        image_writer_config_t writer_config = {};
+        writer_config.options.jpeg_quality = 90;
+        writer = image_writer_create(&writer_config);
+        if (writer == NULL)
+        {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    if (is_mjpeg)
+    {
+        ret = run_mjpeg(detector, argv[3], read_options, decode_threads, writer, save_arg);
+        goto out;
+    }
 
+    is_batch = list_image_files(image_path, &image_files, &num_images);
+    if (is_batch < 0)
+    {
+        ret = -1;
+        goto out;
+    }
+    if (is_batch)
+    {
+        ret = run_batch(detector, image_files, num_images, read_options, decode_threads, writer, save_arg);
+        goto out;
+    }
+
+    ret = read_image_ex(image_path, &src_image, &read_options, &read_info);
     if (ret != 0)
     {
         printf("read image fail! ret=%d image_path=%s\n", ret, image_path);
         goto out;
     }
+    src_scale = (float)src_image.width / read_info.orig_width;
 
-    object_detect_result_list od_results;
-
-    ret = inference_yolov8_pose_model(&rknn_app_ctx, &src_image, &od_results);
+    ret = detector.detect(ImageView(src_image, src_scale), detections);
     if (ret != 0)
     {
         printf("inference_yolov8_pose_model fail! ret=%d\n", ret);
         goto out;
     }
-printf("DEBUG: src_image.width = %d, src_image.height = %d, src_image.format = %d\n",
-       src_image.width, src_image.height, src_image.format);
-printf("DEBUG: src_image.format = %d (0=NONE, 1=RGB888, 2=BGR888, 3=RGBA8888, 4=BGRA8888, 5=YUV420SP_NV21, ...)\n", src_image.format);
-// You might want to include the enum definition from image_utils.h for clarity.
-// For example:
-// typedef enum _image_format {
-//     IMAGE_FORMAT_NONE = 0,
-//     IMAGE_FORMAT_RGB888,
-//     IMAGE_FORMAT_BGR888,
-//     IMAGE_FORMAT_RGBA8888,
-//     IMAGE_FORMAT_BGRA8888,
-//     IMAGE_FORMAT_YUV420SP_NV21,
-//     IMAGE_FORMAT_YUV420SP_NV12,
-//     IMAGE_FORMAT_YUV420_PLANAR,
-//     IMAGE_FORMAT_YUV422P,
-//     IMAGE_FORMAT_GRAY8,
-// } image_format_t;
+
     // 画框和概率
-    char text[256];
-    
-    for (int i = 0; i < od_results.count; i++)
+    for (size_t i = 0; i < detections.size(); i++)
     {
-        object_detect_result *det_result = &(od_results.results[i]);
-        printf("%s @ (%d %d %d %d) %.3f\n", coco_cls_to_name(det_result->cls_id),
-               det_result->box.left, det_result->box.top,
-               det_result->box.right, det_result->box.bottom,
-               det_result->prop);
-        int x1 = det_result->box.left;
-        int y1 = det_result->box.top;
-        int x2 = det_result->box.right;
-        int y2 = det_result->box.bottom;
-
-        draw_rectangle(&src_image, x1, y1, x2 - x1, y2 - y1, COLOR_BLUE, 3);
-
-        sprintf(text, "%s %.1f%%", coco_cls_to_name(det_result->cls_id), det_result->prop * 100);
-        draw_text(&src_image, text, x1, y1 - 20, COLOR_RED, 10);
-
-        for (int j = 0; j < 38/2; ++j)
-        {
-            draw_line(&src_image, (int)(det_result->keypoints[skeleton[2*j]-1][0]),(int)(det_result->keypoints[skeleton[2*j]-1][1]),
-             (int)(det_result->keypoints[skeleton[2*j+1]-1][0]),(int)(det_result->keypoints[skeleton[2*j+1]-1][1]),COLOR_ORANGE,3);
-        }
-        
-        for (int j = 0; j < 17; ++j)
-        {
-            draw_circle(&src_image, (int)(det_result->keypoints[j][0]),(int)(det_result->keypoints[j][1]),1, COLOR_YELLOW,1);
-        }
+        DetectionView det_result = detections[i];
+        printf("%s @ (%d %d %d %d) %.3f\n", coco_cls_to_name(det_result.cls_id),
+               det_result.box->left, det_result.box->top,
+               det_result.box->right, det_result.box->bottom,
+               det_result.score);
+        draw_detection(&src_image, det_result, src_scale);
     }
 
     write_image("out.png", &src_image);
 
 out:
+    if (writer != NULL)
+    {
+        image_writer_stats_t writer_stats;
+        image_writer_flush(writer);
+        image_writer_get_stats(writer, &writer_stats);
+        printf("saved %llu images to %s, %llu dropped, %llu failed\n", (unsigned long long)writer_stats.images_written,
+               save_arg, (unsigned long long)writer_stats.images_dropped, (unsigned long long)writer_stats.images_failed);
+        image_writer_destroy(writer);
+    }
     deinit_post_process();
 
-    ret = release_yolov8_pose_model(&rknn_app_ctx);
-    if (ret != 0)
+    detector.release();
+    if (io_config.input_pool != NULL)
     {
-        printf("release_yolov5_model fail! ret=%d\n", ret);
+        print_pool_stats("input", io_config.input_pool);
+        print_pool_stats("output", io_config.output_pool);
     }
+    image_pool_destroy(io_config.input_pool);
+    image_pool_destroy(io_config.output_pool);
+
+    free_image_files(image_files, num_images);
 
     if (src_image.virt_addr != NULL)
     {
-
+        rga_handle_cache_invalidate(-1, src_image.virt_addr);
         free(src_image.virt_addr);
     }
+    rga_handle_cache_clear();
 
     return 0;
 }
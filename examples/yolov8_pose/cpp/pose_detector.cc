@@ -0,0 +1,106 @@
+// Copyright (c) 2024 by Rockchip Electronics Co., Ltd. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pose_detector.h"
+
+#include <string.h>
+
+PoseDetector::PoseDetector()
+{
+    memset(&ctx_, 0, sizeof(ctx_));
+    memset(&pending_input_, 0, sizeof(pending_input_));
+}
+
+PoseDetector::~PoseDetector()
+{
+    release();
+}
+
+// A submitted letterbox holds the addresses of other.ctx_ buffers and of other.pending_input_, it is
+// finished before they move so no queued job points into the moved-from object
+PoseDetector::PoseDetector(PoseDetector&& other) noexcept
+{
+    wait_yolov8_pose_input(&other.ctx_);
+    ctx_ = other.ctx_;
+    pending_input_ = other.pending_input_;
+    memset(&other.ctx_, 0, sizeof(other.ctx_));
+}
+
+PoseDetector& PoseDetector::operator=(PoseDetector&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        wait_yolov8_pose_input(&other.ctx_);
+        ctx_ = other.ctx_;
+        pending_input_ = other.pending_input_;
+        memset(&other.ctx_, 0, sizeof(other.ctx_));
+    }
+    return *this;
+}
+
+int PoseDetector::init(const char* model_path, const yolov8_pose_io_config_t* io_config)
+{
+    release();
+    int ret = init_yolov8_pose_model(model_path, &ctx_, io_config);
+    if (ret != 0)
+    {
+        release();
+    }
+    return ret;
+}
+
+void PoseDetector::release()
+{
+    release_yolov8_pose_model(&ctx_);
+    memset(&ctx_, 0, sizeof(ctx_));
+}
+
+int PoseDetector::detect(const ImageView& image, Detections& detections)
+{
+    if (!is_initialized())
+    {
+        return -1;
+    }
+    image_buffer_t src = image.buffer();
+    return inference_yolov8_pose_model(&ctx_, &src, detections, image.source_scale());
+}
+
+int PoseDetector::submit(image_async_t* async, const ImageView& image)
+{
+    if (!is_initialized())
+    {
+        return -1;
+    }
+    pending_input_ = image.buffer();
+    return submit_yolov8_pose_input(&ctx_, async, &pending_input_, image.source_scale());
+}
+
+int PoseDetector::run(image_async_t* async)
+{
+    if (!is_initialized())
+    {
+        return -1;
+    }
+    return run_yolov8_pose_model(&ctx_, async);
+}
+
+int PoseDetector::collect(Detections& detections)
+{
+    if (!is_initialized())
+    {
+        return -1;
+    }
+    return post_process_yolov8_pose_model(&ctx_, detections);
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2024 by Rockchip Electronics Co., Ltd. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _RKNN_DEMO_YOLOV8_POSE_DETECTOR_H_
+#define _RKNN_DEMO_YOLOV8_POSE_DETECTOR_H_
+
+#include <stddef.h>
+
+#include "yolov8-pose.h"
+
+/**
+ * @brief Non-owning view of an image, the pixels must outlive the view
+ *
+ * source_scale is image size / original size for images decoded downscaled (see read_image_ex),
+ * detections are then reported in original image pixels.
+ */
+class ImageView {
+public:
+    ImageView() : image_(), source_scale_(1.0f) {}
+    explicit ImageView(const image_buffer_t& image, float source_scale = 1.0f) : image_(image), source_scale_(source_scale) {}
+
+    const image_buffer_t& buffer() const { return image_; }
+    int width() const { return image_.width; }
+    int height() const { return image_.height; }
+    image_format_t format() const { return image_.format; }
+    float source_scale() const { return source_scale_; }
+
+private:
+    image_buffer_t image_;
+    float source_scale_;
+};
+
+/**
+ * @brief Owns the rknn context, the model input/output buffers and the post process workspace
+ *
+ * Move-only. All buffers are allocated by init(), detect() reuses them and the caller's
+ * Detections so that the steady state performs no heap allocation.
+ */
+class PoseDetector {
+public:
+    PoseDetector();
+    ~PoseDetector();
+
+    PoseDetector(PoseDetector&& other) noexcept;
+    PoseDetector& operator=(PoseDetector&& other) noexcept;
+    PoseDetector(const PoseDetector&) = delete;
+    PoseDetector& operator=(const PoseDetector&) = delete;
+
+    /**
+     * @brief Load model and allocate all buffers
+     *
+     * @param model_path [in] Path of the rknn model
+     * @param io_config [in] DMA heap pools for zero copy model IO, NULL: heap memory
+     * @return int 0: success; <0: error
+     */
+    int init(const char* model_path, const yolov8_pose_io_config_t* io_config = NULL);
+
+    /**
+     * @brief Release the model and all buffers, safe to call more than once
+     */
+    void release();
+
+    bool is_initialized() const { return ctx_.rknn_ctx != 0; }
+
+    /**
+     * @brief Detect persons and keypoints
+     *
+     * @param image [in] Source image
+     * @param detections [out] Results, previous content is replaced
+     * @return int 0: success; <0: error
+     */
+    int detect(const ImageView& image, Detections& detections);
+
+    /**
+     * @brief Pipelined detect: submit() letterboxes on the async engine, run() waits for it and runs
+     * the NPU, collect() post processes. The next frame can be submitted between run() and collect().
+     *
+     * The pixels of the submitted image must stay valid until run() returns. Moving, re-initializing
+     * or releasing the detector waits for a submitted letterbox first.
+     *
+     * @return int 0: success; <0: error
+     */
+    int submit(image_async_t* async, const ImageView& image);
+    int run(image_async_t* async);
+    int collect(Detections& detections);
+
+    /**
+     * @brief Post process parameters used by the following detect() calls
+     */
+    const post_process_config_t& config() const { return ctx_.pp_config; }
+    void set_config(const post_process_config_t& config) { ctx_.pp_config = config; }
+
+    /**
+     * @brief Region of interest in source image pixels, see set_post_process_roi_polygon/bitmap
+     */
+    int set_roi_polygon(const float* points, int num_points) { return set_post_process_roi_polygon(&ctx_, points, num_points); }
+    int set_roi_bitmap(const uint8_t* bitmap, int width, int height) { return set_post_process_roi_bitmap(&ctx_, bitmap, width, height); }
+    void clear_roi() { clear_post_process_roi(&ctx_); }
+
+    int model_width() const { return ctx_.model_width; }
+    int model_height() const { return ctx_.model_height; }
+
+    rknn_app_context_t* context() { return &ctx_; }
+
+private:
+    rknn_app_context_t ctx_;
+    image_buffer_t pending_input_;    // source of the submitted letterbox, read by the async worker
+};
+
+#endif //_RKNN_DEMO_YOLOV8_POSE_DETECTOR_H_
@@ -14,6 +14,7 @@
 
 #include "yolov8-pose.h"
 
+#include <float.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -29,7 +30,6 @@
 #include <cmath>
 #include <algorithm>
 
-#include <set>
 #include <vector>
 #define LABEL_NALE_TXT_PATH "./model/yolov8_pose_labels_list.txt"
 
@@ -37,6 +37,17 @@ static char *labels[OBJ_CLASS_NUM];
 
 inline static int clamp(float val, int min, int max) { return val > min ? (val < max ? val : max) : min; }
 
+// Candidate rejection applied inside the head decoders, sizes are in model input pixels
+typedef struct {
+    float conf_threshold;
+    float min_box_area;
+    float min_box_w;
+    float max_box_w;
+    float min_box_h;
+    float max_box_h;
+    const uint8_t *roi_mask;    // grid_h x grid_w of the current head, NULL means whole frame
+} candidate_filter_t;
+
 static char *readLine(FILE *fp, char *buffer, int *len) {
     int ch;
     int i = 0;
@@ -106,7 +117,7 @@ static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0
     return u <= 0.f ? 0.f : (i / u);
 }
 
-static int nms(int validCount, std::vector<float> &outputLocations, std::vector<int> classIds, std::vector<int> &order,
+static int nms(int validCount, std::vector<float> &outputLocations, const std::vector<int> &classIds, std::vector<int> &order,
                int filterId, float threshold)
 {
     for (int i = 0; i < validCount; ++i)
@@ -144,33 +155,12 @@ static int nms(int validCount, std::vector<float> &outputLocations, std::vector<
     return 0;
 }
 
-static int quick_sort_indice_inverse(std::vector<float> &input, int left, int right, std::vector<int> &indices) {
-    float key;
-    int key_index;
-    int low = left;
-    int high = right;
-    if (left < right) {
-        key_index = indices[left];
-        key = input[left];
-        while (low < high) {
-            while (low < high && input[high] <= key) {
-                high--;
-            }
-            input[low] = input[high];
-            indices[low] = indices[high];
-            while (low < high && input[low] >= key) {
-                low++;
-            }
-            input[high] = input[low];
-            indices[high] = indices[low];
-        }
-        input[low] = key;
-        indices[low] = key_index;
-        quick_sort_indice_inverse(input, left, low - 1, indices);
-        quick_sort_indice_inverse(input, low + 1, right, indices);
-    }
-    return low;
-}
+// orders candidate indices by descending score
+struct ScoreGreater {
+    const std::vector<float> &scores;
+    explicit ScoreGreater(const std::vector<float> &s) : scores(s) {}
+    bool operator()(int a, int b) const { return scores[a] > scores[b]; }
+};
 
 static float sigmoid(float x) {
     return 1.0 / (1.0 + expf(-x));
@@ -224,16 +214,67 @@ void softmax(float *input, int size) {
     }
 }
 
+static float dfl_expectation(float *dist) {
+    softmax(dist, 16);
+    float sum = 0;
+    for (int dfl = 0; dfl < 16; ++dfl) {
+        sum += dist[dfl] * dfl;
+    }
+    return sum;
+}
+
+// Softmax + DFL expectation of one cell, result is (x, y, w, h) in model input pixels.
+// The top/bottom distributions are decoded first so a box failing the height limits
+// never pays for the left/right softmax. Returns false when the box is rejected.
+static bool decode_box(float *loc, int h, int w, int stride, const candidate_filter_t *filter, float xywh[4]) {
+    float xywh_[4];
+    xywh_[1]=(h+0.5)-dfl_expectation(&loc[1 * 16]);
+    xywh_[3]=(h+0.5)+dfl_expectation(&loc[3 * 16]);
+    xywh[1]=((xywh_[1]+xywh_[3])/2)*stride;
+    xywh[3]=(xywh_[3]-xywh_[1])*stride;
+    if (xywh[3] < filter->min_box_h || xywh[3] > filter->max_box_h) {
+        return false;
+    }
+    xywh_[0]=(w+0.5)-dfl_expectation(&loc[0 * 16]);
+    xywh_[2]=(w+0.5)+dfl_expectation(&loc[2 * 16]);
+    xywh[0]=((xywh_[0]+xywh_[2])/2)*stride;
+    xywh[2]=(xywh_[2]-xywh_[0])*stride;
+    if (xywh[2] < filter->min_box_w || xywh[2] > filter->max_box_w) {
+        return false;
+    }
+    if (xywh[2] * xywh[3] < filter->min_box_area) {
+        return false;
+    }
+    xywh[0]=xywh[0]-xywh[2]/2;
+    xywh[1]=xywh[1]-xywh[3]/2;
+    return true;
+}
+
+static void push_candidate(const float xywh[4], int keypoints_index, float box_conf, int cls,
+                           std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId) {
+    boxes.push_back(xywh[0]);//x
+    boxes.push_back(xywh[1]);//y
+    boxes.push_back(xywh[2]);//w
+    boxes.push_back(xywh[3]);//h
+    boxes.push_back(float(keypoints_index));//keypoints index
+    boxScores.push_back(box_conf);
+    classId.push_back(cls);
+}
+
 static int process_i8(int8_t *input, int grid_h, int grid_w, int stride,
-                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale, int index) {
-    int input_loc_len = 64;
-    int tensor_len = input_loc_len + OBJ_CLASS_NUM;
+                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId,
+                      const candidate_filter_t *filter, int32_t zp, float scale, int index) {
+    const int input_loc_len = 64;
     int validCount = 0;
 
-    int8_t thres_i8 = qnt_f32_to_affine(unsigmoid(threshold), zp, scale);
+    // reject in the quantized domain, nothing is dequantized for cells below the threshold
+    int8_t thres_i8 = qnt_f32_to_affine(unsigmoid(filter->conf_threshold), zp, scale);
     for (int h = 0; h < grid_h; h++) {
         for (int w = 0; w < grid_w; w++) {
+            // cells outside the region of interest are never decoded
+            if (filter->roi_mask != NULL && !filter->roi_mask[h * grid_w + w]) {
+                continue;
+            }
             for (int a = 0; a < OBJ_CLASS_NUM; a++) {
                 if(input[(input_loc_len + a)*grid_w * grid_h + h * grid_w + w ] >= thres_i8) { //[1,tensor_len,grid_h,grid_w]
                     float box_conf_f32 = sigmoid(deqnt_affine_to_f32(input[(input_loc_len + a) * grid_w * grid_h + h * grid_w + w ],
@@ -242,35 +283,11 @@ static int process_i8(int8_t *input, int grid_h, int grid_w, int stride,
                     for (int i = 0; i < input_loc_len; ++i) {
                         loc[i] = deqnt_affine_to_f32(input[i * grid_w * grid_h + h * grid_w + w], zp, scale);
                     }
-
-                    for (int i = 0; i < input_loc_len / 16; ++i) {
-                        softmax(&loc[i * 16], 16);
+                    float xywh[4];
+                    if (!decode_box(loc, h, w, stride, filter, xywh)) {
+                        continue;
                     }
-                    float xywh_[4] = {0, 0, 0, 0};
-                    float xywh[4] = {0, 0, 0, 0};
-                    for (int dfl = 0; dfl < 16; ++dfl) {
-                        xywh_[0] += loc[dfl] * dfl;
-                        xywh_[1] += loc[1 * 16 + dfl] * dfl;
-                        xywh_[2] += loc[2 * 16 + dfl] * dfl;
-                        xywh_[3] += loc[3 * 16 + dfl] * dfl;
-                    }
-                    xywh_[0]=(w+0.5)-xywh_[0];
-                    xywh_[1]=(h+0.5)-xywh_[1];
-                    xywh_[2]=(w+0.5)+xywh_[2];
-                    xywh_[3]=(h+0.5)+xywh_[3];
-                    xywh[0]=((xywh_[0]+xywh_[2])/2)*stride;
-                    xywh[1]=((xywh_[1]+xywh_[3])/2)*stride;
-                    xywh[2]=(xywh_[2]-xywh_[0])*stride;
-                    xywh[3]=(xywh_[3]-xywh_[1])*stride;
-                    xywh[0]=xywh[0]-xywh[2]/2;
-                    xywh[1]=xywh[1]-xywh[3]/2;
-                    boxes.push_back(xywh[0]);//x
-                    boxes.push_back(xywh[1]);//y
-                    boxes.push_back(xywh[2]);//w
-                    boxes.push_back(xywh[3]);//h
-                    boxes.push_back(float(index + (h * grid_w) + w));//keypoints index
-                    boxScores.push_back(box_conf_f32);
-                    classId.push_back(a);
+                    push_candidate(xywh, index + (h * grid_w) + w, box_conf_f32, a, boxes, boxScores, classId);
                     validCount++;
                 }
             }
@@ -281,15 +298,19 @@ static int process_i8(int8_t *input, int grid_h, int grid_w, int stride,
 
 
 static int process_u8(uint8_t *input, int grid_h, int grid_w, int stride,
-                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale, int index) {
-    int input_loc_len = 64;
-    int tensor_len = input_loc_len + OBJ_CLASS_NUM;
+                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId,
+                      const candidate_filter_t *filter, int32_t zp, float scale, int index) {
+    const int input_loc_len = 64;
     int validCount = 0;
 
-    uint8_t thres_i8 = qnt_f32_to_affine_u8(unsigmoid(threshold), zp, scale);
+    // reject in the quantized domain, nothing is dequantized for cells below the threshold
+    uint8_t thres_i8 = qnt_f32_to_affine_u8(unsigmoid(filter->conf_threshold), zp, scale);
     for (int h = 0; h < grid_h; h++) {
         for (int w = 0; w < grid_w; w++) {
+            // cells outside the region of interest are never decoded
+            if (filter->roi_mask != NULL && !filter->roi_mask[h * grid_w + w]) {
+                continue;
+            }
             for (int a = 0; a < OBJ_CLASS_NUM; a++) {
                 if(input[(input_loc_len + a)*grid_w * grid_h + h * grid_w + w ] >= thres_i8) { //[1,tensor_len,grid_h,grid_w]
                     float box_conf_f32 = sigmoid(deqnt_affine_u8_to_f32(input[(input_loc_len + a) * grid_w * grid_h + h * grid_w + w ],
@@ -298,35 +319,11 @@ static int process_u8(uint8_t *input, int grid_h, int grid_w, int stride,
                     for (int i = 0; i < input_loc_len; ++i) {
                         loc[i] = deqnt_affine_u8_to_f32(input[i * grid_w * grid_h + h * grid_w + w], zp, scale);
                     }
-
-                    for (int i = 0; i < input_loc_len / 16; ++i) {
-                        softmax(&loc[i * 16], 16);
-                    }
-                    float xywh_[4] = {0, 0, 0, 0};
-                    float xywh[4] = {0, 0, 0, 0};
-                    for (int dfl = 0; dfl < 16; ++dfl) {
-                        xywh_[0] += loc[dfl] * dfl;
-                        xywh_[1] += loc[1 * 16 + dfl] * dfl;
-                        xywh_[2] += loc[2 * 16 + dfl] * dfl;
-                        xywh_[3] += loc[3 * 16 + dfl] * dfl;
+                    float xywh[4];
+                    if (!decode_box(loc, h, w, stride, filter, xywh)) {
+                        continue;
                     }
-                    xywh_[0]=(w+0.5)-xywh_[0];
-                    xywh_[1]=(h+0.5)-xywh_[1];
-                    xywh_[2]=(w+0.5)+xywh_[2];
-                    xywh_[3]=(h+0.5)+xywh_[3];
-                    xywh[0]=((xywh_[0]+xywh_[2])/2)*stride;
-                    xywh[1]=((xywh_[1]+xywh_[3])/2)*stride;
-                    xywh[2]=(xywh_[2]-xywh_[0])*stride;
-                    xywh[3]=(xywh_[3]-xywh_[1])*stride;
-                    xywh[0]=xywh[0]-xywh[2]/2;
-                    xywh[1]=xywh[1]-xywh[3]/2;
-                    boxes.push_back(xywh[0]);//x
-                    boxes.push_back(xywh[1]);//y
-                    boxes.push_back(xywh[2]);//w
-                    boxes.push_back(xywh[3]);//h
-                    boxes.push_back(float(index + (h * grid_w) + w));//keypoints index
-                    boxScores.push_back(box_conf_f32);
-                    classId.push_back(a);
+                    push_candidate(xywh, index + (h * grid_w) + w, box_conf_f32, a, boxes, boxScores, classId);
                     validCount++;
                 }
             }
@@ -336,14 +333,17 @@ static int process_u8(uint8_t *input, int grid_h, int grid_w, int stride,
 }
 
 static int process_fp32(float *input, int grid_h, int grid_w, int stride,
-                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId, float threshold,
-                      int32_t zp, float scale, int index) {
-    int input_loc_len = 64;
-    int tensor_len = input_loc_len + OBJ_CLASS_NUM;
+                      std::vector<float> &boxes, std::vector<float> &boxScores, std::vector<int> &classId,
+                      const candidate_filter_t *filter, int32_t zp, float scale, int index) {
+    const int input_loc_len = 64;
     int validCount = 0;
-    float thres_fp = unsigmoid(threshold);
+    float thres_fp = unsigmoid(filter->conf_threshold);
     for (int h = 0; h < grid_h; h++) {
         for (int w = 0; w < grid_w; w++) {
+            // cells outside the region of interest are never decoded
+            if (filter->roi_mask != NULL && !filter->roi_mask[h * grid_w + w]) {
+                continue;
+            }
             for (int a = 0; a < OBJ_CLASS_NUM; a++) {
                 if(input[(input_loc_len + a)*grid_w * grid_h + h * grid_w + w ] >= thres_fp) { //[1,tensor_len,grid_h,grid_w]
                     float box_conf_f32 = sigmoid(input[(input_loc_len + a) * grid_w * grid_h + h * grid_w + w ]);
@@ -351,35 +351,11 @@ static int process_fp32(float *input, int grid_h, int grid_w, int stride,
                     for (int i = 0; i < input_loc_len; ++i) {
                         loc[i] = input[i * grid_w * grid_h + h * grid_w + w];
                     }
-
-                    for (int i = 0; i < input_loc_len / 16; ++i) {
-                        softmax(&loc[i * 16], 16);
-                    }
-                    float xywh_[4] = {0, 0, 0, 0};
-                    float xywh[4] = {0, 0, 0, 0};
-                    for (int dfl = 0; dfl < 16; ++dfl) {
-                        xywh_[0] += loc[dfl] * dfl;
-                        xywh_[1] += loc[1 * 16 + dfl] * dfl;
-                        xywh_[2] += loc[2 * 16 + dfl] * dfl;
-                        xywh_[3] += loc[3 * 16 + dfl] * dfl;
+                    float xywh[4];
+                    if (!decode_box(loc, h, w, stride, filter, xywh)) {
+                        continue;
                     }
-                    xywh_[0]=(w+0.5)-xywh_[0];
-                    xywh_[1]=(h+0.5)-xywh_[1];
-                    xywh_[2]=(w+0.5)+xywh_[2];
-                    xywh_[3]=(h+0.5)+xywh_[3];
-                    xywh[0]=((xywh_[0]+xywh_[2])/2)*stride;
-                    xywh[1]=((xywh_[1]+xywh_[3])/2)*stride;
-                    xywh[2]=(xywh_[2]-xywh_[0])*stride;
-                    xywh[3]=(xywh_[3]-xywh_[1])*stride;
-                    xywh[0]=xywh[0]-xywh[2]/2;
-                    xywh[1]=xywh[1]-xywh[3]/2;
-                    boxes.push_back(xywh[0]);//x
-                    boxes.push_back(xywh[1]);//y
-                    boxes.push_back(xywh[2]);//w
-                    boxes.push_back(xywh[3]);//h
-                    boxes.push_back(float(index + (h * grid_w) + w));//keypoints index
-                    boxScores.push_back(box_conf_f32);
-                    classId.push_back(a);
+                    push_candidate(xywh, index + (h * grid_w) + w, box_conf_f32, a, boxes, boxScores, classId);
                     validCount++;
                 }
             }
@@ -388,81 +364,209 @@ static int process_fp32(float *input, int grid_h, int grid_w, int stride,
     return validCount;
 }
 
-int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold,
-                 object_detect_result_list *od_results) {
-#if defined(RV1106_1103)
-    rknn_tensor_mem **_outputs = (rknn_tensor_mem **)outputs;
-#else
-    rknn_output *_outputs = (rknn_output *)outputs;
-#endif
-    std::vector<float> filterBoxes;
-    std::vector<float> objProbs;
-    std::vector<int> classId;
+// Even-odd rule point in polygon test, points are (x, y) pairs
+static bool point_in_polygon(const std::vector<float> &poly, float x, float y) {
+    bool inside = false;
+    int n = (int)poly.size() / 2;
+    for (int i = 0, j = n - 1; i < n; j = i++) {
+        float xi = poly[i * 2], yi = poly[i * 2 + 1];
+        float xj = poly[j * 2], yj = poly[j * 2 + 1];
+        if (((yi > y) != (yj > y)) && (x < (xj - xi) * (y - yi) / (yj - yi) + xi)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// Rasterize the region of interest onto the cell centers of one head. The masks only depend on
+// the ROI and the letterbox geometry, so for a fixed camera they are built once and reused.
+static const uint8_t *get_roi_grid_mask(post_process_workspace *ws, int head, int grid_h, int grid_w, int stride,
+                                        const letterbox_t *letter_box) {
+    if (ws->roi_polygon.empty() && ws->roi_bitmap.empty()) {
+        return NULL;
+    }
+    std::vector<uint8_t> &mask = ws->roi_grid_masks[head];
+    if (ws->roi_mask_valid[head] && (int)mask.size() == grid_h * grid_w && ws->roi_letterbox[head].x_pad == letter_box->x_pad &&
+        ws->roi_letterbox[head].y_pad == letter_box->y_pad && ws->roi_letterbox[head].scale == letter_box->scale) {
+        return mask.data();
+    }
+
+    mask.resize(grid_h * grid_w);
+    for (int h = 0; h < grid_h; h++) {
+        for (int w = 0; w < grid_w; w++) {
+            // cell center mapped back to source image pixels
+            float x = ((w + 0.5f) * stride - letter_box->x_pad) / letter_box->scale;
+            float y = ((h + 0.5f) * stride - letter_box->y_pad) / letter_box->scale;
+            bool inside;
+            if (!ws->roi_polygon.empty()) {
+                inside = point_in_polygon(ws->roi_polygon, x, y);
+            } else {
+                int bx = (int)x;
+                int by = (int)y;
+                inside = x >= 0 && y >= 0 && bx < ws->roi_bitmap_width && by < ws->roi_bitmap_height &&
+                         ws->roi_bitmap[by * ws->roi_bitmap_width + bx] != 0;
+            }
+            mask[h * grid_w + w] = inside ? 1 : 0;
+        }
+    }
+    ws->roi_letterbox[head] = *letter_box;
+    ws->roi_mask_valid[head] = true;
+    return mask.data();
+}
+
+static void invalidate_roi_masks(post_process_workspace *ws) {
+    for (int i = 0; i < 3; i++) {
+        ws->roi_mask_valid[i] = false;
+    }
+}
+
+int set_post_process_roi_polygon(rknn_app_context_t *app_ctx, const float *points, int num_points) {
+    post_process_workspace *ws = app_ctx->pp_workspace;
+    if (ws == NULL || points == NULL || num_points < 3) {
+        return -1;
+    }
+    ws->roi_bitmap.clear();
+    ws->roi_polygon.assign(points, points + num_points * 2);
+    invalidate_roi_masks(ws);
+    return 0;
+}
+
+int set_post_process_roi_bitmap(rknn_app_context_t *app_ctx, const uint8_t *bitmap, int width, int height) {
+    post_process_workspace *ws = app_ctx->pp_workspace;
+    if (ws == NULL || bitmap == NULL || width <= 0 || height <= 0) {
+        return -1;
+    }
+    ws->roi_polygon.clear();
+    ws->roi_bitmap.assign(bitmap, bitmap + width * height);
+    ws->roi_bitmap_width = width;
+    ws->roi_bitmap_height = height;
+    invalidate_roi_masks(ws);
+    return 0;
+}
+
+void clear_post_process_roi(rknn_app_context_t *app_ctx) {
+    post_process_workspace *ws = app_ctx->pp_workspace;
+    if (ws == NULL) {
+        return;
+    }
+    ws->roi_polygon.clear();
+    ws->roi_bitmap.clear();
+    invalidate_roi_masks(ws);
+}
+
+void default_post_process_config(post_process_config_t *config) {
+    config->conf_threshold = BOX_THRESH;
+    config->nms_threshold = NMS_THRESH;
+    config->max_detections = OBJ_NUMB_MAX_SIZE;
+    config->min_keypoint_conf = 0.f;
+    config->min_box_area = 0.f;
+    config->pre_nms_topk = 0;
+    config->min_box_width = 0.f;
+    config->min_box_height = 0.f;
+    config->max_box_width = 0.f;
+    config->max_box_height = 0.f;
+}
+
+int post_process(rknn_app_context_t *app_ctx, void **output_bufs, letterbox_t *letter_box, const post_process_config_t *config,
+                 Detections &results) {
+    post_process_workspace *ws = app_ctx->pp_workspace;
+    std::vector<float> &filterBoxes = ws->filter_boxes;
+    std::vector<float> &objProbs = ws->obj_probs;
+    std::vector<int> &classId = ws->class_id;
+    std::vector<int> &indexArray = ws->index_array;
+    filterBoxes.clear();
+    objProbs.clear();
+    classId.clear();
+    indexArray.clear();
+    results.clear();
+
     int validCount = 0;
     int stride = 0;
     int grid_h = 0;
     int grid_w = 0;
     int model_in_w = app_ctx->model_width;
     int model_in_h = app_ctx->model_height;
-    memset(od_results, 0, sizeof(object_detect_result_list));
     int index = 0;
-#ifdef RKNPU1
+
+    candidate_filter_t filter;
+    filter.conf_threshold = config->conf_threshold;
+    // configured in source image pixels, the decoders work in model input pixels
+    filter.min_box_area = config->min_box_area * letter_box->scale * letter_box->scale;
+    filter.min_box_w = config->min_box_width * letter_box->scale;
+    filter.min_box_h = config->min_box_height * letter_box->scale;
+    filter.max_box_w = config->max_box_width > 0 ? config->max_box_width * letter_box->scale : FLT_MAX;
+    filter.max_box_h = config->max_box_height > 0 ? config->max_box_height * letter_box->scale : FLT_MAX;
+
     for (int i = 0; i < 3; i++) {
+#ifdef RKNPU1
         grid_h = app_ctx->output_attrs[i].dims[1];
         grid_w = app_ctx->output_attrs[i].dims[0];
-        stride = model_in_h / grid_h;
-        if (app_ctx->is_quant) {
-            validCount += process_u8((uint8_t *)_outputs[i].buf, grid_h, grid_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
-        }
-        else
-        {
-            validCount += process_fp32((float *)_outputs[i].buf, grid_h, grid_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
-        }
-        index += grid_h * grid_w;
-    }
 #else
-    for (int i = 0; i < 3; i++) {
         grid_h = app_ctx->output_attrs[i].dims[2];
         grid_w = app_ctx->output_attrs[i].dims[3];
+#endif
         stride = model_in_h / grid_h;
+        // a side is at most 2 * 15 cells, skip heads that cannot produce a box tall or wide enough
+        if (filter.min_box_h > 30 * stride || filter.min_box_w > 30 * stride) {
+            index += grid_h * grid_w;
+            continue;
+        }
+        filter.roi_mask = get_roi_grid_mask(ws, i, grid_h, grid_w, stride, letter_box);
         if (app_ctx->is_quant) {
-            validCount += process_i8((int8_t *)_outputs[i]->virt_addr, grid_h, grid_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale,index);
+#ifdef RKNPU1
+            validCount += process_u8((uint8_t *)output_bufs[i], grid_h, grid_w, stride, filterBoxes, objProbs,
+                                     classId, &filter, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
+#else
+            validCount += process_i8((int8_t *)output_bufs[i], grid_h, grid_w, stride, filterBoxes, objProbs,
+                                     classId, &filter, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
+#endif
         }
         else
         {
-            validCount += process_fp32((float *)_outputs[i]->virt_addr, grid_h, grid_w, stride, filterBoxes, objProbs,
-                                     classId, conf_threshold, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
+            validCount += process_fp32((float *)output_bufs[i], grid_h, grid_w, stride, filterBoxes, objProbs,
+                                     classId, &filter, app_ctx->output_attrs[i].zp, app_ctx->output_attrs[i].scale, index);
         }
         index += grid_h * grid_w;
     }
-#endif
+    // total number of anchors, the keypoint tensor is laid out as [17][3][num_anchors]
+    const int num_anchors = index;
+
     // no object detect
     if (validCount <= 0) {
         return 0;
     }
-    std::vector<int> indexArray;
+    bool class_seen[OBJ_CLASS_NUM] = {false};
     for (int i = 0; i < validCount; ++i) {
         indexArray.push_back(i);
+        class_seen[classId[i]] = true;
     }
-    quick_sort_indice_inverse(objProbs, 0, validCount - 1, indexArray);
-
-    std::set<int> class_set(std::begin(classId), std::end(classId));
 
-    for (auto c : class_set) {
-        nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
+    // sort by score, keeping only the best pre_nms_topk candidates so NMS stays bounded
+    ScoreGreater by_score(objProbs);
+    if (config->pre_nms_topk > 0 && validCount > config->pre_nms_topk) {
+        std::partial_sort(indexArray.begin(), indexArray.begin() + config->pre_nms_topk, indexArray.end(), by_score);
+        indexArray.resize(config->pre_nms_topk);
+        validCount = config->pre_nms_topk;
+    } else {
+        std::sort(indexArray.begin(), indexArray.end(), by_score);
     }
 
-    int last_count = 0;
-    od_results->count = 0;
+    for (int c = 0; c < OBJ_CLASS_NUM; c++) {
+        if (class_seen[c]) {
+            nms(validCount, filterBoxes, classId, indexArray, c, config->nms_threshold);
+        }
+    }
 
     /* box valid detect target */
+    // 0 means unlimited like pre_nms_topk, results.full() still bounds the output
+    size_t max_detections = config->max_detections > 0 ? (size_t)config->max_detections : SIZE_MAX;
     for (int i = 0; i < validCount; ++i) {
-        if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE) {
+        if (indexArray[i] == -1) {
             continue;
         }
+        if (results.full() || results.size() >= max_detections) {
+            break;
+        }
         int n = indexArray[i];
         float x1 = filterBoxes[n * 5 + 0] - letter_box->x_pad;
         float y1 = filterBoxes[n * 5 + 1] - letter_box->y_pad;
@@ -470,53 +574,98 @@ int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter
         float h = filterBoxes[n * 5 + 3];
         int keypoints_index = (int)filterBoxes[n * 5 + 4];
 
-        for (int j = 0; j < 17; ++j) {
+        image_rect_t box;
+        box.left = (int)(clamp(x1, 0, model_in_w) / letter_box->scale);
+        box.top = (int)(clamp(y1, 0, model_in_h) / letter_box->scale);
+        box.right = (int)(clamp(x1+w, 0, model_in_w) / letter_box->scale);
+        box.bottom = (int)(clamp(y1+h, 0, model_in_h) / letter_box->scale);
+        float (*keypoints)[3] = (float (*)[3])results.append(box, objProbs[n], classId[n]);
+
+        for (int j = 0; j < POSE_KEYPOINT_NUM; ++j) {
+            int kx = j * 3 * num_anchors + 0 * num_anchors + keypoints_index;
+            int ky = j * 3 * num_anchors + 1 * num_anchors + keypoints_index;
+            int kc = j * 3 * num_anchors + 2 * num_anchors + keypoints_index;
             if (app_ctx->is_quant) {
-                #ifdef RKNPU1
-                        od_results->results[last_count].keypoints[j][0] = (deqnt_affine_u8_to_f32(((uint8_t *)_outputs[3].buf)[j * 3 * 8400 + 0 * 8400 + keypoints_index],
-                                app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale)- letter_box->x_pad)/ letter_box->scale;
-                        od_results->results[last_count].keypoints[j][1] = (deqnt_affine_u8_to_f32(((uint8_t *)_outputs[3].buf)[j * 3 * 8400 + 1 * 8400 + keypoints_index],
-                                app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale)- letter_box->y_pad)/ letter_box->scale;
-                        od_results->results[last_count].keypoints[j][2] = deqnt_affine_u8_to_f32(((uint8_t *)_outputs[3].buf)[j * 3 * 8400 + 2 * 8400 + keypoints_index],
-                                app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale);       
-                #else
-                        od_results->results[last_count].keypoints[j][0] = ((float)((rknpu2::float16 *)_outputs[3]->virt_addr)[j*3*8400+0*8400+keypoints_index] 
-                                                                        - letter_box->x_pad)/ letter_box->scale;
-                        od_results->results[last_count].keypoints[j][1] = ((float)((rknpu2::float16 *)_outputs[3]->virt_addr)[j*3*8400+1*8400+keypoints_index] 
-                                                                            - letter_box->y_pad)/ letter_box->scale;
-                        od_results->results[last_count].keypoints[j][2] = (float)((rknpu2::float16 *)_outputs[3]->virt_addr)[j*3*8400+2*8400+keypoints_index];
-                #endif
+#ifdef RKNPU1
+                uint8_t *kpts = (uint8_t *)output_bufs[3];
+                keypoints[j][0] = (deqnt_affine_u8_to_f32(kpts[kx], app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale)
+                                      - letter_box->x_pad) / letter_box->scale;
+                keypoints[j][1] = (deqnt_affine_u8_to_f32(kpts[ky], app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale)
+                                      - letter_box->y_pad) / letter_box->scale;
+                keypoints[j][2] = deqnt_affine_u8_to_f32(kpts[kc], app_ctx->output_attrs[3].zp, app_ctx->output_attrs[3].scale);
+#else
+                rknpu2::float16 *kpts = (rknpu2::float16 *)output_bufs[3];
+                keypoints[j][0] = ((float)kpts[kx] - letter_box->x_pad) / letter_box->scale;
+                keypoints[j][1] = ((float)kpts[ky] - letter_box->y_pad) / letter_box->scale;
+                keypoints[j][2] = (float)kpts[kc];
+#endif
             }
             else
             {
-                od_results->results[last_count].keypoints[j][0] = (((float *)_outputs[3]->virt_addr)[j*3*8400+0*8400+keypoints_index] 
-                                                                - letter_box->x_pad)/ letter_box->scale;
-                od_results->results[last_count].keypoints[j][1] = (((float *)_outputs[3]->virt_addr)[j*3*8400+1*8400+keypoints_index] 
-                                                                    - letter_box->y_pad)/ letter_box->scale;
-                od_results->results[last_count].keypoints[j][2] = ((float *)_outputs[3]->virt_addr)[j*3*8400+2*8400+keypoints_index];
+                float *kpts = (float *)output_bufs[3];
+                keypoints[j][0] = (kpts[kx] - letter_box->x_pad) / letter_box->scale;
+                keypoints[j][1] = (kpts[ky] - letter_box->y_pad) / letter_box->scale;
+                keypoints[j][2] = kpts[kc];
+            }
+            // unreliable joints are reported at (0, 0), which drawing code skips
+            if (keypoints[j][2] < config->min_keypoint_conf) {
+                keypoints[j][0] = 0.f;
+                keypoints[j][1] = 0.f;
             }
         }
-
-        int id = classId[n];
-        float obj_conf = objProbs[i];
-        od_results->results[last_count].box.left = (int)(clamp(x1, 0, model_in_w) / letter_box->scale);
-        od_results->results[last_count].box.top = (int)(clamp(y1, 0, model_in_h) / letter_box->scale);
-        od_results->results[last_count].box.right = (int)(clamp(x1+w, 0, model_in_w) / letter_box->scale);
-        od_results->results[last_count].box.bottom = (int)(clamp(y1+h, 0, model_in_h) / letter_box->scale);
-        // od_results->results[last_count].box.angle = angle;
-        od_results->results[last_count].prop = obj_conf;
-        od_results->results[last_count].cls_id = id;
-        last_count++;
-    }
-    od_results->count = last_count;
+    }
     return 0;
 }
 
-int init_post_process() {
+void detection_to_result(const DetectionView &det, object_detect_result *result) {
+    result->box = *det.box;
+    result->prop = det.score;
+    result->cls_id = det.cls_id;
+    memcpy(result->keypoints, det.keypoints, sizeof(result->keypoints));
+}
+
+int detections_to_result_list(const Detections &detections, object_detect_result_list *od_results) {
+    int count = detections.size() < OBJ_NUMB_MAX_SIZE ? (int)detections.size() : OBJ_NUMB_MAX_SIZE;
+    // only the valid entries are written, the rest of the list is left untouched
+    for (int i = 0; i < count; i++) {
+        detection_to_result(detections[i], &od_results->results[i]);
+    }
+    od_results->count = count;
+    return count;
+}
+
+int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold,
+                 object_detect_result_list *od_results) {
+    if (outputs == NULL) {
+        return -1;
+    }
+    // same layout rules as run_yolov8_pose_model: tensor mems when the IO memory is bound
+    std::vector<void *> &bufs = app_ctx->pp_workspace->legacy_output_bufs;
+    bufs.resize(app_ctx->io_num.n_output);
+    for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++) {
+        if (app_ctx->io_mem) {
+            bufs[i] = ((rknn_tensor_mem **)outputs)[i]->virt_addr;
+        } else {
+            bufs[i] = ((rknn_output *)outputs)[i].buf;
+        }
+    }
+    post_process_config_t config = app_ctx->pp_config;
+    config.conf_threshold = conf_threshold;
+    config.nms_threshold = nms_threshold;
+    Detections &results = app_ctx->pp_workspace->results;
+    int ret = post_process(app_ctx, bufs.data(), letter_box, &config, results);
+    detections_to_result_list(results, od_results);
+    return ret;
+}
+
+int init_post_process(const char *label_path) {
     int ret = 0;
-    ret = loadLabelName(LABEL_NALE_TXT_PATH, labels);
+    if (label_path == NULL) {
+        label_path = LABEL_NALE_TXT_PATH;
+    }
+    ret = loadLabelName(label_path, labels);
     if (ret < 0) {
-        printf("Load %s failed!\n", LABEL_NALE_TXT_PATH);
+        printf("Load %s failed!\n", label_path);
         return -1;
     }
     return 0;
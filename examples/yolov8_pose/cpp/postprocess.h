@@ -6,6 +6,7 @@
 #include "rknn_api.h"
 #include "common.h"
 #include "image_utils.h"
+#include "detections.h"
 
 #define OBJ_NAME_MAX_SIZE 64
 #define OBJ_NUMB_MAX_SIZE 128
@@ -14,11 +15,28 @@
 #define BOX_THRESH 0.5
 #define PROP_BOX_SIZE (5 + OBJ_CLASS_NUM)
 
-// class rknn_app_context_t;
+typedef struct rknn_app_context_t rknn_app_context_t;
+
+/**
+ * @brief Post process parameters, kept per context so every stream can tune its own
+ *
+ */
+typedef struct {
+    float conf_threshold;       // box confidence, compared in the quantized domain
+    float nms_threshold;        // IoU above which the lower score box is suppressed
+    int max_detections;         // detections returned per frame, 0 keeps all up to the Detections capacity
+    float min_keypoint_conf;    // keypoints below this are reported at (0, 0)
+    float min_box_area;         // boxes smaller than this (source image pixels) are dropped before NMS
+    int pre_nms_topk;           // only the best K candidates enter NMS, 0 keeps all
+    float min_box_width;        // size limits in source image pixels, checked before the box is fully
+    float min_box_height;       // decoded; 0 disables a limit
+    float max_box_width;
+    float max_box_height;
+} post_process_config_t;
 
 typedef struct {
     image_rect_t box;
-    float keypoints[17][3];//keypoints x,y,conf
+    float keypoints[POSE_KEYPOINT_NUM][3];//keypoints x,y,conf
     float prop;
     int cls_id;
 } object_detect_result;
@@ -29,10 +47,75 @@ typedef struct {
     object_detect_result results[OBJ_NUMB_MAX_SIZE];
 } object_detect_result_list;
 
-int init_post_process();
+// Scratch storage kept in rknn_app_context_t, capacity is retained between frames
+struct post_process_workspace {
+    std::vector<float> filter_boxes;
+    std::vector<float> obj_probs;
+    std::vector<int> class_id;
+    std::vector<int> index_array;
+    Detections results;
+    std::vector<void *> legacy_output_bufs;    // buffers of the outputs passed to the legacy post_process
+
+    // region of interest, either a polygon or a bitmap in source image pixels
+    std::vector<float> roi_polygon;
+    std::vector<uint8_t> roi_bitmap;
+    int roi_bitmap_width;
+    int roi_bitmap_height;
+    // roi rasterized per head, rebuilt when the letterbox changes
+    std::vector<uint8_t> roi_grid_masks[3];
+    letterbox_t roi_letterbox[3];
+    bool roi_mask_valid[3];
+
+    post_process_workspace() : roi_bitmap_width(0), roi_bitmap_height(0)
+    {
+        for (int i = 0; i < 3; i++) {
+            roi_mask_valid[i] = false;
+        }
+    }
+};
+
+/**
+ * @brief Fill config with the defaults (BOX_THRESH, NMS_THRESH, OBJ_NUMB_MAX_SIZE, filters off)
+ */
+void default_post_process_config(post_process_config_t *config);
+
+/**
+ * @brief Only report persons whose anchor cell center lies inside the polygon
+ *
+ * @param app_ctx [in] Initialized context
+ * @param points [in] num_points (x, y) pairs in source image pixels
+ * @param num_points [in] Number of polygon vertices, at least 3
+ * @return int 0: success; -1: error
+ */
+int set_post_process_roi_polygon(rknn_app_context_t *app_ctx, const float *points, int num_points);
+
+/**
+ * @brief Only report persons whose anchor cell center falls on a non-zero bitmap pixel
+ *
+ * @param app_ctx [in] Initialized context
+ * @param bitmap [in] width x height mask, one byte per source image pixel, copied
+ * @param width [in] Bitmap width
+ * @param height [in] Bitmap height
+ * @return int 0: success; -1: error
+ */
+int set_post_process_roi_bitmap(rknn_app_context_t *app_ctx, const uint8_t *bitmap, int width, int height);
+
+/**
+ * @brief Remove the region of interest, the whole frame is decoded again
+ */
+void clear_post_process_roi(rknn_app_context_t *app_ctx);
+
+int init_post_process(const char *label_path = NULL);
 void deinit_post_process();
 char *coco_cls_to_name(int cls_id);
+// outputs: rknn_output array, or rknn_tensor_mem* array when the context binds its IO memory (io_mem)
 int post_process(rknn_app_context_t *app_ctx, void *outputs, letterbox_t *letter_box, float conf_threshold, float nms_threshold, object_detect_result_list *od_results);
+int post_process(rknn_app_context_t *app_ctx, void **output_bufs, letterbox_t *letter_box, const post_process_config_t *config,
+                 Detections &results);
+
+// Conversion shims for code still using the fixed size result structs
+void detection_to_result(const DetectionView &det, object_detect_result *result);
+int detections_to_result_list(const Detections &detections, object_detect_result_list *od_results);
 
 void deinitPostProcess();
 #endif //_RKNN_YOLOV5_DEMO_POSTPROCESS_H_
@@ -21,6 +21,7 @@
 #include "common.h"
 #include "file_utils.h"
 #include "image_utils.h"
+#include "image_pool.h"
 
 #include <sys/time.h>
 
@@ -40,12 +41,152 @@ static void dump_tensor_attr(rknn_tensor_attr *attr)
            get_qnt_type_string(attr->qnt_type), attr->zp, attr->scale);
 }
 
-int init_yolov8_pose_model(const char *model_path, rknn_app_context_t *app_ctx)
+// Both pools have to hand out dma-bufs, a pool that fell back to heap memory keeps the copy path
+static bool use_io_mem(const yolov8_pose_io_config_t *io_config)
+{
+    return io_config != NULL && image_pool_get_memory(io_config->input_pool) != IMAGE_POOL_MEMORY_HEAP &&
+           image_pool_get_memory(io_config->output_pool) != IMAGE_POOL_MEMORY_HEAP;
+}
+
+// Bind the letterbox target and the outputs to the NPU. Outputs are requested in the layout and type
+// rknn_outputs_get would return, so post process reads them the same way.
+static int bind_io_mem(rknn_app_context_t *app_ctx, const yolov8_pose_io_config_t *io_config)
+{
+    rknn_tensor_attr input_attr = app_ctx->input_attrs[0];
+    input_attr.type = RKNN_TENSOR_UINT8;
+    input_attr.fmt = RKNN_TENSOR_NHWC;
+    input_attr.pass_through = 0;
+    // the NPU may want padded rows, the letterbox writes with the same stride
+    if (input_attr.w_stride > (uint32_t)app_ctx->model_width)
+    {
+        app_ctx->input_image.width_stride = input_attr.w_stride;
+    }
+    if (image_pool_alloc_image(io_config->input_pool, &app_ctx->input_image) != 0 || app_ctx->input_image.fd < 0)
+    {
+        return -1;
+    }
+    app_ctx->input_mem = rknn_create_mem_from_fd(app_ctx->rknn_ctx, app_ctx->input_image.fd, app_ctx->input_image.virt_addr,
+                                                 app_ctx->input_image.size, 0);
+    if (app_ctx->input_mem == NULL)
+    {
+        printf("rknn_create_mem_from_fd input fail!\n");
+        return -1;
+    }
+    int ret = rknn_set_io_mem(app_ctx->rknn_ctx, app_ctx->input_mem, &input_attr);
+    if (ret < 0)
+    {
+        printf("rknn_set_io_mem input fail! ret=%d\n", ret);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+    {
+        rknn_tensor_attr output_attr = app_ctx->output_attrs[i];
+        if (!app_ctx->is_quant)
+        {
+            output_attr.type = RKNN_TENSOR_FLOAT32;
+        }
+        uint32_t size = app_ctx->is_quant ? output_attr.size : output_attr.n_elems * sizeof(float);
+        int fd = -1;
+        app_ctx->output_bufs[i] = image_pool_alloc(io_config->output_pool, size, &fd);
+        if (app_ctx->output_bufs[i] == NULL || fd < 0)
+        {
+            return -1;
+        }
+        app_ctx->output_mems[i] = rknn_create_mem_from_fd(app_ctx->rknn_ctx, fd, app_ctx->output_bufs[i], size, 0);
+        if (app_ctx->output_mems[i] == NULL)
+        {
+            printf("rknn_create_mem_from_fd output %u fail!\n", i);
+            return -1;
+        }
+        ret = rknn_set_io_mem(app_ctx->rknn_ctx, app_ctx->output_mems[i], &output_attr);
+        if (ret < 0)
+        {
+            printf("rknn_set_io_mem output %u fail! ret=%d\n", i, ret);
+            return -1;
+        }
+    }
+    app_ctx->io_mem = true;
+    return 0;
+}
+
+// Allocate the letterbox target, rknn_input/rknn_output arrays, pre-allocated output buffers and
+// the post process workspace once, so inference does not touch the heap per frame.
+static int alloc_io_buffers(rknn_app_context_t *app_ctx, const yolov8_pose_io_config_t *io_config)
+{
+    uint32_t n_input = app_ctx->io_num.n_input;
+    uint32_t n_output = app_ctx->io_num.n_output;
+
+    memset(&app_ctx->input_image, 0, sizeof(image_buffer_t));
+    memset(&app_ctx->letterbox_plan, 0, sizeof(letterbox_plan_t));
+    app_ctx->input_image.width = app_ctx->model_width;
+    app_ctx->input_image.height = app_ctx->model_height;
+    app_ctx->input_image.format = IMAGE_FORMAT_RGB888;
+
+    app_ctx->inputs = (rknn_input *)calloc(n_input, sizeof(rknn_input));
+    app_ctx->outputs = (rknn_output *)calloc(n_output, sizeof(rknn_output));
+    app_ctx->output_bufs = (void **)calloc(n_output, sizeof(void *));
+    if (app_ctx->inputs == NULL || app_ctx->outputs == NULL || app_ctx->output_bufs == NULL)
+    {
+        return -1;
+    }
+
+    if (io_config != NULL)
+    {
+        app_ctx->output_mems = (rknn_tensor_mem **)calloc(n_output, sizeof(rknn_tensor_mem *));
+        if (app_ctx->output_mems == NULL || bind_io_mem(app_ctx, io_config) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (image_pool_alloc_image(image_pool_default(), &app_ctx->input_image) != 0)
+        {
+            printf("alloc model input %dx%d fail!\n", app_ctx->model_width, app_ctx->model_height);
+            return -1;
+        }
+
+        app_ctx->inputs[0].index = 0;
+        app_ctx->inputs[0].type = RKNN_TENSOR_UINT8;
+        app_ctx->inputs[0].fmt = RKNN_TENSOR_NHWC;
+        app_ctx->inputs[0].size = app_ctx->model_width * app_ctx->model_height * app_ctx->model_channel;
+        app_ctx->inputs[0].buf = app_ctx->input_image.virt_addr;
+        app_ctx->inputs[0].pass_through = 0;
+
+        for (uint32_t i = 0; i < n_output; i++)
+        {
+            rknn_output *output = &app_ctx->outputs[i];
+            output->index = i;
+            output->want_float = (!app_ctx->is_quant);
+            output->is_prealloc = 1;
+            output->size = output->want_float ? app_ctx->output_attrs[i].n_elems * sizeof(float) : app_ctx->output_attrs[i].size;
+            output->buf = image_pool_alloc(image_pool_default(), output->size, NULL);
+            if (output->buf == NULL)
+            {
+                printf("malloc output buffer size:%d fail!\n", output->size);
+                return -1;
+            }
+            app_ctx->output_bufs[i] = output->buf;
+        }
+    }
+
+    default_post_process_config(&app_ctx->pp_config);
+    app_ctx->pp_workspace = new post_process_workspace;
+    app_ctx->pp_workspace->results.set_max_detections(OBJ_NUMB_MAX_SIZE);
+    return 0;
+}
+
+int init_yolov8_pose_model(const char *model_path, rknn_app_context_t *app_ctx, const yolov8_pose_io_config_t *io_config)
 {
     int ret;
     rknn_context ctx = 0;
 
-    ret = rknn_init(&ctx, (char *)model_path, 0, 0, NULL);
+    // with zero copy IO the runtime leaves the caches alone: the letterbox writes back the input
+    // only when the CPU produced it, post process invalidates the outputs right before reading them
+    bool io_mem = use_io_mem(io_config);
+    uint32_t flags = io_mem ? RKNN_FLAG_DISABLE_FLUSH_INPUT_MEM_CACHE | RKNN_FLAG_DISABLE_FLUSH_OUTPUT_MEM_CACHE : 0;
+    ret = rknn_init(&ctx, (char *)model_path, 0, flags, NULL);
     if (ret < 0)
     {
         printf("rknn_init fail! ret=%d\n", ret);
@@ -130,11 +271,77 @@ int init_yolov8_pose_model(const char *model_path, rknn_app_context_t *app_ctx)
     printf("model input height=%d, width=%d, channel=%d\n",
            app_ctx->model_height, app_ctx->model_width, app_ctx->model_channel);
 
+    ret = alloc_io_buffers(app_ctx, io_mem ? io_config : NULL);
+    if (ret != 0 && io_mem)
+    {
+        // the cache flags are fixed at rknn_init, the copy path needs a context without them
+        printf("zero copy IO not available, reload model with rknn_inputs_set/rknn_outputs_get\n");
+        release_yolov8_pose_model(app_ctx);
+        return init_yolov8_pose_model(model_path, app_ctx, NULL);
+    }
+    if (ret != 0)
+    {
+        printf("alloc_io_buffers fail! ret=%d\n", ret);
+        release_yolov8_pose_model(app_ctx);
+        return -1;
+    }
+
     return 0;
 }
 
 int release_yolov8_pose_model(rknn_app_context_t *app_ctx)
 {
+    // a queued letterbox still writes into the buffers released below
+    wait_yolov8_pose_input(app_ctx);
+    if (app_ctx->pp_workspace != NULL)
+    {
+        delete app_ctx->pp_workspace;
+        app_ctx->pp_workspace = NULL;
+    }
+    // the NPU mappings go before the memory they map
+    if (app_ctx->input_mem != NULL)
+    {
+        rknn_destroy_mem(app_ctx->rknn_ctx, app_ctx->input_mem);
+        app_ctx->input_mem = NULL;
+    }
+    if (app_ctx->output_mems != NULL)
+    {
+        for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+        {
+            if (app_ctx->output_mems[i] != NULL)
+            {
+                rknn_destroy_mem(app_ctx->rknn_ctx, app_ctx->output_mems[i]);
+            }
+        }
+        free(app_ctx->output_mems);
+        app_ctx->output_mems = NULL;
+    }
+    app_ctx->io_mem = false;
+    if (app_ctx->outputs != NULL)
+    {
+        free(app_ctx->outputs);
+        app_ctx->outputs = NULL;
+    }
+    if (app_ctx->output_bufs != NULL)
+    {
+        for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+        {
+            image_pool_release(app_ctx->output_bufs[i]);
+        }
+        free(app_ctx->output_bufs);
+        app_ctx->output_bufs = NULL;
+    }
+    if (app_ctx->inputs != NULL)
+    {
+        free(app_ctx->inputs);
+        app_ctx->inputs = NULL;
+    }
+    if (app_ctx->input_image.virt_addr != NULL)
+    {
+        image_pool_release(app_ctx->input_image.virt_addr);
+        app_ctx->input_image.virt_addr = NULL;
+    }
+    letterbox_plan_release(&app_ctx->letterbox_plan);
     if (app_ctx->input_attrs != NULL)
     {
         free(app_ctx->input_attrs);
@@ -154,68 +361,75 @@ int release_yolov8_pose_model(rknn_app_context_t *app_ctx)
 }
 
 
-int inference_yolov8_pose_model(rknn_app_context_t *app_ctx, image_buffer_t *img, object_detect_result_list *od_results)
+int submit_yolov8_pose_input(rknn_app_context_t *app_ctx, image_async_t *async, image_buffer_t *img, float src_scale)
 {
-    int ret;
-    image_buffer_t dst_img;
-    letterbox_t letter_box;
-    rknn_input inputs[app_ctx->io_num.n_input];
-    rknn_output outputs[app_ctx->io_num.n_output];
-    const float nms_threshold = NMS_THRESH;      // Default NMS threshold
-    const float box_conf_threshold = BOX_THRESH; // Default box threshold
-    int bg_color = 114;
-
-    if ((!app_ctx) || !(img) || (!od_results))
+    if ((!app_ctx) || (!async) || !(img) || (!app_ctx->pp_workspace) || app_ctx->input_token != 0)
     {
         return -1;
     }
+    int bg_color = 114;
+    // input_letterbox/input_src_scale still describe the frame waiting for post processing
+    app_ctx->pending_src_scale = src_scale;
+    int ret = image_async_letterbox(async, img, &app_ctx->input_image, &app_ctx->letterbox_plan,
+                                    &app_ctx->pending_letterbox, bg_color, &app_ctx->input_token);
+    if (ret < 0)
+    {
+        printf("image_async_letterbox fail! ret=%d\n", ret);
+        app_ctx->input_token = 0;
+        return ret;
+    }
+    app_ctx->input_async = async;
+    return ret;
+}
 
-    memset(od_results, 0x00, sizeof(*od_results));
-    memset(&letter_box, 0, sizeof(letterbox_t));
-    memset(&dst_img, 0, sizeof(image_buffer_t));
-    memset(inputs, 0, sizeof(inputs));
-    memset(outputs, 0, sizeof(outputs));
+void wait_yolov8_pose_input(rknn_app_context_t *app_ctx)
+{
+    if (app_ctx == NULL || app_ctx->input_token == 0)
+    {
+        return;
+    }
+    image_async_wait(app_ctx->input_async, app_ctx->input_token);
+    app_ctx->input_token = 0;
+    app_ctx->input_async = NULL;
+}
 
-    // Pre Process
-    dst_img.width = app_ctx->model_width;
-    dst_img.height = app_ctx->model_height;
-    dst_img.format = IMAGE_FORMAT_RGB888;
-    dst_img.size = get_image_size(&dst_img);
-    dst_img.virt_addr = (unsigned char *)malloc(dst_img.size);
-    if (dst_img.virt_addr == NULL)
+int run_yolov8_pose_model(rknn_app_context_t *app_ctx, image_async_t *async)
+{
+    int ret;
+    if ((!app_ctx) || (!app_ctx->pp_workspace))
     {
-        printf("malloc buffer size:%d fail!\n", dst_img.size);
-        goto out;
+        return -1;
     }
 
-    // letterbox
-    ret = convert_image_with_letterbox(img, &dst_img, &letter_box, bg_color);
-    if (ret < 0)
+    // the letterbox was overlapped with the previous frame, it has to be complete before the NPU reads the input
+    if (app_ctx->input_token != 0)
     {
-        printf("convert_image_with_letterbox fail! ret=%d\n", ret);
-        goto out;
-    }
-    // Set Input Data
-    inputs[0].index = 0;
-    inputs[0].type = RKNN_TENSOR_UINT8;
-    inputs[0].fmt = RKNN_TENSOR_NHWC;
-    inputs[0].size = app_ctx->model_width * app_ctx->model_height * app_ctx->model_channel;
-    inputs[0].buf = dst_img.virt_addr;
-    inputs[0].pass_through = 0;
-printf("DEBUG: Final input buffer before rknn_inputs_set (first 3 pixels, R,G,B order):\n");
-if (dst_img.virt_addr && dst_img.size >= 9) {
-    printf("Px1: R=%u, G=%u, B=%u\n", dst_img.virt_addr[0], dst_img.virt_addr[1], dst_img.virt_addr[2]);
-    printf("Px2: R=%u, G=%u, B=%u\n", dst_img.virt_addr[3], dst_img.virt_addr[4], dst_img.virt_addr[5]);
-    printf("Px3: R=%u, G=%u, B=%u\n", dst_img.virt_addr[6], dst_img.virt_addr[7], dst_img.virt_addr[8]);
-} else {
-    printf("Final buffer is NULL or too small.\n");
-}
+        if (async != NULL && async != app_ctx->input_async)
+        {
+            printf("run_yolov8_pose_model: async engine differs from the submit call\n");
+            return -1;
+        }
+        ret = image_async_wait(app_ctx->input_async, app_ctx->input_token);
+        app_ctx->input_token = 0;
+        app_ctx->input_async = NULL;
+        if (ret < 0)
+        {
+            printf("async letterbox fail! ret=%d\n", ret);
+            return ret;
+        }
+        app_ctx->input_letterbox = app_ctx->pending_letterbox;
+        app_ctx->input_src_scale = app_ctx->pending_src_scale;
+    }
 
-    ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, inputs);
-    if (ret < 0)
+    // Set Input Data, bound input memory is read by the NPU in place
+    if (!app_ctx->io_mem)
     {
-        printf("rknn_input_set fail! ret=%d\n", ret);
-        goto out;
+        ret = rknn_inputs_set(app_ctx->rknn_ctx, app_ctx->io_num.n_input, app_ctx->inputs);
+        if (ret < 0)
+        {
+            printf("rknn_input_set fail! ret=%d\n", ret);
+            return ret;
+        }
     }
 
     // Run
@@ -230,36 +444,96 @@ if (dst_img.virt_addr && dst_img.size >= 9) {
     if (ret < 0)
     {
         printf("rknn_run fail! ret=%d\n", ret);
-        goto out;
+        return ret;
     }
 
-    // Get Output
-    memset(outputs, 0, sizeof(outputs));
-    for (int i = 0; i < app_ctx->io_num.n_output; i++)
+    // Get Output, written into the pre-allocated buffers or by the NPU into the bound ones
+    if (!app_ctx->io_mem)
     {
-        outputs[i].index = i;
-        outputs[i].want_float = (!app_ctx->is_quant);
+        ret = rknn_outputs_get(app_ctx->rknn_ctx, app_ctx->io_num.n_output, app_ctx->outputs, NULL);
+        if (ret < 0)
+        {
+            printf("rknn_outputs_get fail! ret=%d\n", ret);
+            return ret;
+        }
     }
-    ret = rknn_outputs_get(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs, NULL);
-    if (ret < 0)
+    return ret;
+}
+
+int post_process_yolov8_pose_model(rknn_app_context_t *app_ctx, Detections &results)
+{
+    if ((!app_ctx) || (!app_ctx->pp_workspace))
     {
-        printf("rknn_outputs_get fail! ret=%d\n", ret);
-        goto out;
+        return -1;
     }
-    // Post Process
-    start_us = getCurrentTimeUs();
-    post_process(app_ctx, outputs, &letter_box, box_conf_threshold, nms_threshold, od_results);
-    end_us = getCurrentTimeUs() - start_us;
+    results.clear();
+
+    // Post Process, folding the decode scale into the letterbox maps results to original image pixels
+    letterbox_t letter_box = app_ctx->input_letterbox;
+    letter_box.scale *= app_ctx->input_src_scale;
+    int start_us = getCurrentTimeUs();
+    if (app_ctx->io_mem)
+    {
+        // the runtime did not invalidate the outputs, a no-op for an uncached heap
+        for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+        {
+            image_pool_begin_cpu_access(app_ctx->output_bufs[i]);
+        }
+    }
+    post_process(app_ctx, app_ctx->output_bufs, &letter_box, &app_ctx->pp_config, results);
+    int end_us = getCurrentTimeUs() - start_us;
     printf("post_process time=%.2fms, FPS = %.2f\n",end_us / 1000.f, 
             1000.f * 1000.f / end_us);
+    if (app_ctx->io_mem)
+    {
+        for (uint32_t i = 0; i < app_ctx->io_num.n_output; i++)
+        {
+            image_pool_end_cpu_access(app_ctx->output_bufs[i]);
+        }
+        return 0;
+    }
     // Remeber to release rknn output
-    rknn_outputs_release(app_ctx->rknn_ctx, app_ctx->io_num.n_output, outputs);
+    rknn_outputs_release(app_ctx->rknn_ctx, app_ctx->io_num.n_output, app_ctx->outputs);
+    return 0;
+}
+
+int inference_yolov8_pose_model(rknn_app_context_t *app_ctx, image_buffer_t *img, Detections &results, float src_scale)
+{
+    int ret;
+    int bg_color = 114;
+
+    if ((!app_ctx) || !(img) || (!app_ctx->pp_workspace) || app_ctx->input_token != 0)
+    {
+        return -1;
+    }
+    results.clear();
 
-out:
-    if (dst_img.virt_addr != NULL)
+    // letterbox
+    ret = convert_image_with_letterbox_plan(img, &app_ctx->input_image, &app_ctx->letterbox_plan, &app_ctx->input_letterbox, bg_color);
+    if (ret < 0)
     {
-        free(dst_img.virt_addr);
+        printf("convert_image_with_letterbox_plan fail! ret=%d\n", ret);
+        return ret;
+    }
+    app_ctx->input_src_scale = src_scale;
+
+    ret = run_yolov8_pose_model(app_ctx, NULL);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return post_process_yolov8_pose_model(app_ctx, results);
+}
+
+int inference_yolov8_pose_model(rknn_app_context_t *app_ctx, image_buffer_t *img, object_detect_result_list *od_results)
+{
+    if ((!app_ctx) || !(img) || (!od_results) || (!app_ctx->pp_workspace))
+    {
+        return -1;
     }
 
+    Detections &results = app_ctx->pp_workspace->results;
+    int ret = inference_yolov8_pose_model(app_ctx, img, results);
+    detections_to_result_list(results, od_results);
     return ret;
 }
@@ -18,10 +18,22 @@
 
 #include "rknn_api.h"
 #include "common.h"
+#include "detections.h"
+#include "postprocess.h"
+#include "image_async.h"
+#include "image_pool.h"
 
-
-
+/**
+ * @brief Memory of the model input and outputs, see init_yolov8_pose_model
+ *
+ */
 typedef struct {
+    image_pool_t* input_pool;       // letterboxed input, written by RGA or the CPU and read by the NPU
+    image_pool_t* output_pool;      // outputs, written by the NPU and read by post process. Reading an
+                                    // uncached heap element by element is slow, use a cached one
+} yolov8_pose_io_config_t;
+
+typedef struct rknn_app_context_t {
     rknn_context rknn_ctx;
     rknn_input_output_num io_num;
     rknn_tensor_attr* input_attrs;
@@ -30,15 +42,106 @@ typedef struct {
     int model_width;
     int model_height;
     bool is_quant;
-} rknn_app_context_t;
 
-#include "postprocess.h"
+    // Buffers allocated once by init_yolov8_pose_model and reused for every frame
+    image_buffer_t input_image;     // letterboxed model input
+    letterbox_plan_t letterbox_plan;    // rebuilt only when the source geometry changes
+    letterbox_t input_letterbox;    // letterbox of the frame in input_image
+    float input_src_scale;
+    image_async_token_t input_token;    // letterbox still running on the async engine, 0 if none
+    image_async_t* input_async;     // engine of input_token
+    letterbox_t pending_letterbox;  // written by the async letterbox, moved to input_letterbox by run
+    float pending_src_scale;
+    rknn_input* inputs;
+    rknn_output* outputs;           // pre-allocated, see output_bufs
+    void** output_bufs;
+    post_process_workspace* pp_workspace;
+    post_process_config_t pp_config;    // set to defaults by init_yolov8_pose_model
 
+    // Zero copy IO: input_image and output_bufs are dma-bufs bound with rknn_set_io_mem, the runtime
+    // does not flush them and the pipeline syncs only the buffers the CPU touches
+    bool io_mem;
+    rknn_tensor_mem* input_mem;
+    rknn_tensor_mem** output_mems;
+} rknn_app_context_t;
 
-int init_yolov8_pose_model(const char* model_path, rknn_app_context_t* app_ctx);
+
+/**
+ * @brief Load the model and allocate the buffers reused by every frame
+ *
+ * With io_config pools backed by a DMA heap the input and outputs are bound to the NPU with
+ * rknn_set_io_mem: rknn_inputs_set copies and the runtime cache flushes are skipped, the letterbox
+ * writes the input in place. Pools that fell back to heap memory keep the copy path.
+ *
+ * @param model_path [in] Path of the rknn model
+ * @param app_ctx [out] Context
+ * @param io_config [in] Memory of the model IO, NULL: heap memory with copies
+ * @return int 0: success; <0: error
+ */
+int init_yolov8_pose_model(const char* model_path, rknn_app_context_t* app_ctx, const yolov8_pose_io_config_t* io_config = NULL);
 
 int release_yolov8_pose_model(rknn_app_context_t* app_ctx);
 
 int inference_yolov8_pose_model(rknn_app_context_t* app_ctx, image_buffer_t* img, object_detect_result_list* od_results);
 
+/**
+ * @brief Run letterbox, NPU inference and post process, writing into caller owned storage
+ *
+ * Uses only the buffers allocated by init_yolov8_pose_model, so the steady state does not
+ * allocate. inference_yolov8_pose_model() is a thin wrapper around this function.
+ *
+ * @param app_ctx [in] Initialized context
+ * @param img [in] Source image
+ * @param results [out] Detections, cleared before being filled
+ * @param src_scale [in] img size / original image size when img was decoded downscaled, results
+ *                       are reported in original image pixels
+ * @return int 0: success; <0: error
+ */
+int inference_yolov8_pose_model(rknn_app_context_t* app_ctx, image_buffer_t* img, Detections& results, float src_scale = 1.0f);
+
+/**
+ * @brief Letterbox the next frame into the model input on the async engine and return at once
+ *
+ * Pipelined use: run_yolov8_pose_model(N), submit_yolov8_pose_input(N+1), post process and draw
+ * frame N while the letterbox runs, then run_yolov8_pose_model(N+1) waits for it right before the NPU.
+ * The letterbox and scale of N+1 are kept in pending_letterbox/pending_src_scale until that run, so
+ * the post process of N still sees the ones of N.
+ *
+ * @param app_ctx [in] Initialized context, no letterbox pending
+ * @param async [in] Async engine
+ * @param img [in] Source image, must stay valid until run_yolov8_pose_model returns
+ * @param src_scale [in] img size / original image size
+ * @return int 0: success; <0: error
+ */
+int submit_yolov8_pose_input(rknn_app_context_t* app_ctx, image_async_t* async, image_buffer_t* img, float src_scale = 1.0f);
+
+/**
+ * @brief Wait for a submitted letterbox if any, then run the NPU and fetch the outputs
+ *
+ * @param app_ctx [in] Initialized context
+ * @param async [in] Async engine of the submit call, NULL if input_image was filled synchronously
+ * @return int 0: success; <0: error
+ */
+int run_yolov8_pose_model(rknn_app_context_t* app_ctx, image_async_t* async);
+
+/**
+ * @brief Wait for a submitted letterbox and drop its result
+ *
+ * The async worker writes input_image, letterbox_plan and pending_letterbox of the context and
+ * reads the source image, none of them may be freed or moved while a letterbox is pending.
+ * release_yolov8_pose_model calls it first.
+ *
+ * @param app_ctx [in] Context
+ */
+void wait_yolov8_pose_input(rknn_app_context_t* app_ctx);
+
+/**
+ * @brief Decode the outputs of the last run_yolov8_pose_model and release them
+ *
+ * @param app_ctx [in] Context after a successful run_yolov8_pose_model
+ * @param results [out] Detections, cleared before being filled
+ * @return int 0: success; <0: error
+ */
+int post_process_yolov8_pose_model(rknn_app_context_t* app_ctx, Detections& results);
+
 #endif //_RKNN_DEMO_YOLOV8_POSE_H_
\ No newline at end of file
@@ -11,8 +11,23 @@ typedef enum {
     IMAGE_FORMAT_RGBA8888,
     IMAGE_FORMAT_YUV420SP_NV21,
     IMAGE_FORMAT_YUV420SP_NV12,
+    IMAGE_FORMAT_YUV420P,       // I420, Y then U then V planes
+    IMAGE_FORMAT_BGR888,
+    IMAGE_FORMAT_YUYV,          // YUV 4:2:2 packed, Y0 U Y1 V
+    IMAGE_FORMAT_RGB565,        // little endian, red in the high bits
 } image_format_t;
 
+/**
+ * @brief YUV color matrix and range, used when converting YUV images to RGB
+ * 
+ */
+typedef enum {
+    IMAGE_COLOR_SPACE_BT601_LIMITED,    // default, most cameras and video decoders
+    IMAGE_COLOR_SPACE_BT601_FULL,       // JPEG
+    IMAGE_COLOR_SPACE_BT709_LIMITED,
+    IMAGE_COLOR_SPACE_BT709_FULL,
+} image_color_space_t;
+
 /**
  * @brief Image buffer
  * 
@@ -20,14 +35,59 @@ typedef enum {
 typedef struct {
     int width;
     int height;
-    int width_stride;
-    int height_stride;
+    int width_stride;   // pixels per row in memory, 0: width
+    int height_stride;  // rows per plane in memory, 0: height
     image_format_t format;
     unsigned char* virt_addr;
     int size;
     int fd;
+    image_color_space_t color_space;    // YUV formats only
 } image_buffer_t;
 
+/**
+ * @brief Pixels from the start of one row to the next, width_stride 0 means packed rows
+ *
+ */
+static inline int image_width_stride(const image_buffer_t* image)
+{
+    return image->width_stride > 0 ? image->width_stride : image->width;
+}
+
+/**
+ * @brief Rows from the start of one plane to the next, height_stride 0 means packed planes
+ *
+ */
+static inline int image_height_stride(const image_buffer_t* image)
+{
+    return image->height_stride > 0 ? image->height_stride : image->height;
+}
+
+/**
+ * @brief Bytes from the start of one row to the next, for YUV the luma plane
+ *
+ */
+static inline int image_row_bytes(const image_buffer_t* image)
+{
+    int pixel_size = 1;
+    if (image->format == IMAGE_FORMAT_RGB888 || image->format == IMAGE_FORMAT_BGR888) {
+        pixel_size = 3;
+    } else if (image->format == IMAGE_FORMAT_RGBA8888) {
+        pixel_size = 4;
+    } else if (image->format == IMAGE_FORMAT_YUYV || image->format == IMAGE_FORMAT_RGB565) {
+        pixel_size = 2;
+    }
+    return image_width_stride(image) * pixel_size;
+}
+
+/**
+ * @brief First chroma plane of YUV420SP/YUV420P, it starts height_stride luma rows after virt_addr
+ *
+ */
+static inline unsigned char* image_uv_plane(const image_buffer_t* image)
+{
+    return image->virt_addr + image_width_stride(image) * image_height_stride(image);
+}
+
 /**
  * @brief Image rectangle
  * 
@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "frame_source.h"
+#include "image_pool.h"
+#include "image_utils.h"
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_FILLING,
+    SLOT_READY,
+    SLOT_HELD,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    int stolen;         // READY frame claimed for overwrite, dropped once its first byte is replaced
+    frame_source_frame_t frame;
+} source_slot_t;
+
+struct frame_source_t {
+    int fd;
+    int own_fd;
+    int wake_fds[2];            // written by destroy to interrupt a reader waiting on an idle pipe
+    frame_source_policy_t policy;
+    int frame_size;
+    int batch_frames;
+
+    source_slot_t* slots;       // pixels of every slot come from the configured image pool
+    int num_slots;
+    pthread_t thread;
+    int thread_started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t free_cond;   // a slot was released or stop was set
+    pthread_cond_t ready_cond;  // a frame is ready, or the stream ended
+    uint64_t next_index;
+    int eof;
+    int error;
+    int stop;
+    frame_source_stats_t stats;
+};
+
+static source_slot_t* oldest_slot(frame_source_t* source, slot_state_t state)
+{
+    source_slot_t* oldest = NULL;
+    for (int i = 0; i < source->num_slots; i++) {
+        source_slot_t* slot = &source->slots[i];
+        if (slot->state == state && (oldest == NULL || slot->frame.index < oldest->frame.index)) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+// Slots the next readv fills, caller holds the lock. Free slots first, then with steal the oldest
+// frame the consumer has not taken. A stolen frame keeps its index and is only counted as dropped
+// when read_batch writes into it, it goes back to READY if the stream ends first.
+static int claim_slots(frame_source_t* source, source_slot_t** batch, int steal)
+{
+    int n = 0;
+    for (int i = 0; i < source->num_slots && n < source->batch_frames; i++) {
+        if (source->slots[i].state == SLOT_FREE) {
+            batch[n++] = &source->slots[i];
+        }
+    }
+    if (n == 0 && steal) {
+        source_slot_t* oldest = oldest_slot(source, SLOT_READY);
+        if (oldest != NULL) {
+            oldest->stolen = 1;
+            batch[n++] = oldest;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        batch[i]->state = SLOT_FILLING;
+    }
+    return n;
+}
+
+// 0: readable; -1: stop requested or poll error
+static int wait_readable(frame_source_t* source)
+{
+    struct pollfd fds[2];
+    fds[0].fd = source->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = source->wake_fds[0];
+    fds[1].events = POLLIN;
+    while (1) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        int ret = poll(fds, 2, -1);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 || fds[1].revents != 0) {
+            return -1;
+        }
+        // POLLHUP without data means the writer is gone, readv then reports the end of stream
+        return 0;
+    }
+}
+
+// Fill the batch with as few readv calls as the descriptor allows. Every frame is published as
+// soon as its last byte arrives, so a slow writer does not hold back the first frames of a batch.
+// 0: batch filled; 1: end of stream; -1: error or stop
+static int read_batch(frame_source_t* source, source_slot_t** batch, int n)
+{
+    struct iovec iov[n];
+    int done = 0;
+    int filled = 0;     // bytes of batch[done]
+    // readv writes the slots through the CPU cache, a slot from a cached DMA heap is written back
+    // before it is published to RGA or the NPU
+    for (int i = 0; i < n; i++) {
+        image_pool_begin_cpu_access(batch[i]->frame.image.virt_addr);
+    }
+    int ret = 0;
+    while (done < n) {
+        if (wait_readable(source) != 0) {
+            ret = -1;
+            break;
+        }
+        int num_iov = 0;
+        for (int i = done; i < n; i++) {
+            int offset = i == done ? filled : 0;
+            iov[num_iov].iov_base = batch[i]->frame.image.virt_addr + offset;
+            iov[num_iov].iov_len = source->frame_size - offset;
+            num_iov++;
+        }
+        ssize_t bytes = readv(source->fd, iov, num_iov);
+        if (bytes < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            printf("ERROR: frame source read fail: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+        if (bytes == 0) {
+            if (filled > 0) {
+                printf("WARNING: frame source dropped a truncated last frame of %d bytes\n", filled);
+            }
+            ret = 1;
+            break;
+        }
+
+        int first = done;
+        while (bytes > 0) {
+            int take = source->frame_size - filled;
+            if (take > bytes) {
+                take = (int)bytes;
+            }
+            filled += take;
+            bytes -= take;
+            if (filled == source->frame_size) {
+                image_pool_end_cpu_access(batch[done]->frame.image.virt_addr);
+                done++;
+                filled = 0;
+            }
+        }
+
+        pthread_mutex_lock(&source->lock);
+        source->stats.read_calls++;
+        int touched = filled > 0 ? done + 1 : done;
+        for (int i = first; i < touched; i++) {
+            if (batch[i]->stolen) {
+                batch[i]->stolen = 0;
+                source->stats.frames_dropped++;
+            }
+        }
+        for (int i = first; i < done; i++) {
+            batch[i]->frame.index = source->next_index++;
+            batch[i]->state = SLOT_READY;
+            source->stats.frames_read++;
+        }
+        if (done > first) {
+            pthread_cond_broadcast(&source->ready_cond);
+        }
+        pthread_mutex_unlock(&source->lock);
+    }
+    for (int i = done; i < n; i++) {
+        image_pool_end_cpu_access(batch[i]->frame.image.virt_addr);
+    }
+    return ret;
+}
+
+static void* source_reader(void* arg)
+{
+    frame_source_t* source = (frame_source_t*)arg;
+    source_slot_t* batch[source->num_slots];
+
+    pthread_mutex_lock(&source->lock);
+    while (1) {
+        int n = 0;
+        int ret = 0;
+        while (!source->stop) {
+            n = claim_slots(source, batch, 0);
+            if (n > 0) {
+                break;
+            }
+            if (source->policy != FRAME_SOURCE_DROP_OLDEST || oldest_slot(source, SLOT_READY) == NULL) {
+                pthread_cond_wait(&source->free_cond, &source->lock);
+                continue;
+            }
+            // every slot holds a frame, the oldest is only taken once the next frame has bytes to read
+            pthread_mutex_unlock(&source->lock);
+            ret = wait_readable(source);
+            pthread_mutex_lock(&source->lock);
+            if (ret != 0) {
+                break;
+            }
+            n = claim_slots(source, batch, 1);
+            if (n > 0) {
+                break;
+            }
+        }
+        if (source->stop) {
+            break;
+        }
+        if (ret == 0) {
+            pthread_mutex_unlock(&source->lock);
+            ret = read_batch(source, batch, n);
+            pthread_mutex_lock(&source->lock);
+        }
+        if (ret != 0) {
+            for (int i = 0; i < n; i++) {
+                if (batch[i]->state == SLOT_FILLING) {
+                    // a stolen frame nothing was written into is still complete
+                    batch[i]->state = batch[i]->stolen ? SLOT_READY : SLOT_FREE;
+                    batch[i]->stolen = 0;
+                }
+            }
+            source->eof = 1;
+            source->error = ret < 0 && !source->stop;
+            pthread_cond_broadcast(&source->ready_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&source->lock);
+    return NULL;
+}
+
+frame_source_t* frame_source_create_fd(int fd, const frame_source_config_t* config)
+{
+    if (fd < 0 || config == NULL || config->width <= 0 || config->height <= 0) {
+        printf("ERROR: invalid frame source config\n");
+        return NULL;
+    }
+    image_buffer_t layout;
+    memset(&layout, 0, sizeof(image_buffer_t));
+    layout.width = config->width;
+    layout.height = config->height;
+    layout.width_stride = config->width_stride;
+    layout.height_stride = config->height_stride;
+    layout.format = config->format;
+    layout.color_space = config->color_space;
+    layout.size = get_image_size(&layout);
+    if (layout.size <= 0 || image_width_stride(&layout) < layout.width || image_height_stride(&layout) < layout.height) {
+        printf("ERROR: invalid frame layout %dx%d stride %dx%d format %d\n", config->width, config->height,
+               config->width_stride, config->height_stride, config->format);
+        return NULL;
+    }
+
+    frame_source_t* source = (frame_source_t*)calloc(1, sizeof(frame_source_t));
+    if (source == NULL) {
+        return NULL;
+    }
+    source->fd = fd;
+    source->wake_fds[0] = -1;
+    source->wake_fds[1] = -1;
+    source->policy = config->policy;
+    source->frame_size = layout.size;
+    source->num_slots = config->num_slots > 0 ? config->num_slots : 4;
+    source->batch_frames = config->batch_frames > 0 ? config->batch_frames : 2;
+    if (source->batch_frames > source->num_slots) {
+        source->batch_frames = source->num_slots;
+    }
+    pthread_mutex_init(&source->lock, NULL);
+    pthread_cond_init(&source->free_cond, NULL);
+    pthread_cond_init(&source->ready_cond, NULL);
+
+    image_pool_t* pool = config->pool != NULL ? config->pool : image_pool_default();
+    source->slots = (source_slot_t*)calloc(source->num_slots, sizeof(source_slot_t));
+    if (source->slots == NULL) {
+        frame_source_destroy(source);
+        return NULL;
+    }
+    for (int i = 0; i < source->num_slots; i++) {
+        source->slots[i].frame.image = layout;
+        if (image_pool_alloc_image(pool, &source->slots[i].frame.image) != 0) {
+            printf("ERROR: allocate %d frame slots of %d bytes fail\n", source->num_slots, source->frame_size);
+            frame_source_destroy(source);
+            return NULL;
+        }
+    }
+
+    if (pipe(source->wake_fds) != 0) {
+        printf("ERROR: frame source pipe fail: %s\n", strerror(errno));
+        source->wake_fds[0] = -1;
+        source->wake_fds[1] = -1;
+        frame_source_destroy(source);
+        return NULL;
+    }
+    if (pthread_create(&source->thread, NULL, source_reader, source) != 0) {
+        printf("ERROR: create frame source thread fail\n");
+        frame_source_destroy(source);
+        return NULL;
+    }
+    source->thread_started = 1;
+    return source;
+}
+
+frame_source_t* frame_source_create(const char* path, const frame_source_config_t* config)
+{
+    if (path == NULL) {
+        return NULL;
+    }
+    if (strcmp(path, "-") == 0) {
+        return frame_source_create_fd(STDIN_FILENO, config);
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("ERROR: open %s fail: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    frame_source_t* source = frame_source_create_fd(fd, config);
+    if (source == NULL) {
+        close(fd);
+        return NULL;
+    }
+    source->own_fd = 1;
+    return source;
+}
+
+int frame_source_next(frame_source_t* source, frame_source_frame_t** frame)
+{
+    if (source == NULL || frame == NULL) {
+        return -1;
+    }
+    int ret;
+    pthread_mutex_lock(&source->lock);
+    while (1) {
+        source_slot_t* slot = oldest_slot(source, SLOT_READY);
+        if (slot != NULL) {
+            slot->state = SLOT_HELD;
+            *frame = &slot->frame;
+            ret = 0;
+            break;
+        }
+        if (source->eof) {
+            ret = source->error ? -1 : 1;
+            break;
+        }
+        pthread_cond_wait(&source->ready_cond, &source->lock);
+    }
+    pthread_mutex_unlock(&source->lock);
+    return ret;
+}
+
+void frame_source_release(frame_source_t* source, frame_source_frame_t* frame)
+{
+    if (source == NULL || frame == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    for (int i = 0; i < source->num_slots; i++) {
+        if (&source->slots[i].frame == frame && source->slots[i].state == SLOT_HELD) {
+            source->slots[i].state = SLOT_FREE;
+            pthread_cond_signal(&source->free_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&source->lock);
+}
+
+void frame_source_get_stats(frame_source_t* source, frame_source_stats_t* stats)
+{
+    if (source == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    *stats = source->stats;
+    pthread_mutex_unlock(&source->lock);
+}
+
+void frame_source_destroy(frame_source_t* source)
+{
+    if (source == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    source->stop = 1;
+    pthread_cond_broadcast(&source->free_cond);
+    pthread_mutex_unlock(&source->lock);
+    if (source->thread_started) {
+        char wake = 0;
+        if (write(source->wake_fds[1], &wake, 1) < 0) {
+            printf("WARNING: frame source wake fail: %s\n", strerror(errno));
+        }
+        pthread_join(source->thread, NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (source->wake_fds[i] >= 0) {
+            close(source->wake_fds[i]);
+        }
+    }
+    if (source->own_fd) {
+        close(source->fd);
+    }
+    pthread_cond_destroy(&source->free_cond);
+    pthread_cond_destroy(&source->ready_cond);
+    pthread_mutex_destroy(&source->lock);
+    if (source->slots != NULL) {
+        for (int i = 0; i < source->num_slots; i++) {
+            image_pool_release(source->slots[i].frame.image.virt_addr);
+        }
+    }
+    free(source->slots);
+    free(source);
+}
@@ -0,0 +1,115 @@
+#ifndef _RKNN_MODEL_ZOO_FRAME_SOURCE_H_
+#define _RKNN_MODEL_ZOO_FRAME_SOURCE_H_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "image_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct frame_source_t frame_source_t;
+
+/**
+ * @brief What the reader does when every slot holds a frame the consumer has not taken yet
+ *
+ */
+typedef enum {
+    FRAME_SOURCE_BLOCK = 0,         // stop reading until a slot is released, the writer is throttled
+    FRAME_SOURCE_DROP_OLDEST,       // overwrite the oldest waiting frame, the consumer always gets recent frames
+} frame_source_policy_t;
+
+/**
+ * @brief Configuration of frame_source_create, every frame of the stream has this layout
+ *
+ */
+typedef struct {
+    int width;
+    int height;
+    int width_stride;               // 0: width
+    int height_stride;              // 0: height
+    image_format_t format;
+    image_color_space_t color_space;
+    int num_slots;                  // frames in the ring, <= 0: 4
+    int batch_frames;               // frames one readv may fill, <= 0: 2
+    frame_source_policy_t policy;
+    image_pool_t* pool;             // where the slots are allocated, NULL: image_pool_default(). A DMA heap pool
+                                    // hands RGA and the NPU frames by dma-buf, slots are synced after each read
+} frame_source_config_t;
+
+/**
+ * @brief One frame in the ring, owned by the source until frame_source_release
+ *
+ */
+typedef struct {
+    uint64_t index;                 // position in the stream, dropped frames leave gaps
+    image_buffer_t image;
+} frame_source_frame_t;
+
+typedef struct {
+    uint64_t frames_read;
+    uint64_t frames_dropped;        // overwritten before the consumer took them
+    uint64_t read_calls;
+} frame_source_stats_t;
+
+/**
+ * @brief Open a raw stream of back to back frames and start reading it in the background
+ *
+ * Works on regular files, pipes and FIFOs. Opening a FIFO waits until a writer opens it.
+ *
+ * @param path [in] File or FIFO path, "-" for stdin
+ * @param config [in] Frame layout and ring configuration
+ * @return frame_source_t* Source, NULL on error
+ */
+frame_source_t* frame_source_create(const char* path, const frame_source_config_t* config);
+
+/**
+ * @brief Same as frame_source_create on an already open descriptor, which is not closed by the source
+ *
+ * @param fd [in] Readable descriptor
+ * @param config [in] Frame layout and ring configuration
+ * @return frame_source_t* Source, NULL on error
+ */
+frame_source_t* frame_source_create_fd(int fd, const frame_source_config_t* config);
+
+/**
+ * @brief Wait for the oldest frame that has not been delivered yet
+ *
+ * At most num_slots - 1 frames should be held at the same time, the reader needs a slot to make progress.
+ *
+ * @param source [in] Source
+ * @param frame [out] Frame
+ * @return int 0: frame returned; 1: end of stream; -1: read error
+ */
+int frame_source_next(frame_source_t* source, frame_source_frame_t** frame);
+
+/**
+ * @brief Give a frame back, its slot is refilled with a following frame
+ *
+ * @param source [in] Source
+ * @param frame [in] Frame from frame_source_next
+ */
+void frame_source_release(frame_source_t* source, frame_source_frame_t* frame);
+
+/**
+ * @brief Read and drop counters
+ *
+ * @param source [in] Source
+ * @param stats [out] Counters
+ */
+void frame_source_get_stats(frame_source_t* source, frame_source_stats_t* stats);
+
+/**
+ * @brief Stop the reader and free the ring, outstanding frames become invalid
+ *
+ * @param source [in] Source
+ */
+void frame_source_destroy(frame_source_t* source);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_FRAME_SOURCE_H_
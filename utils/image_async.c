@@ -0,0 +1,203 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "image_async.h"
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_QUEUED,
+    JOB_DONE,
+} job_state_t;
+
+typedef struct {
+    job_state_t state;
+    image_async_token_t token;
+    image_buffer_t* src;
+    image_buffer_t* dst;
+    letterbox_plan_t* plan;
+    letterbox_t* letterbox;
+    char color;
+    int result;
+} async_job_t;
+
+struct image_async_t {
+    async_job_t* jobs;          // job of token t lives in jobs[(t - 1) % queue_depth]
+    int queue_depth;
+    int mock_delay_us;
+    pthread_t thread;
+    int thread_started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // a job was queued or stop was set
+    pthread_cond_t done_cond;   // a job completed
+    image_async_token_t next_token;
+    image_async_token_t next_run;
+    int stop;
+};
+
+static async_job_t* job_of(image_async_t* async, image_async_token_t token)
+{
+    return &async->jobs[(token - 1) % async->queue_depth];
+}
+
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void* async_worker(void* arg)
+{
+    image_async_t* async = (image_async_t*)arg;
+
+    pthread_mutex_lock(&async->lock);
+    while (1) {
+        // jobs run in token order, the next one is always in the slot of next_run
+        async_job_t* job = job_of(async, async->next_run);
+        while (!(job->state == JOB_QUEUED && job->token == async->next_run) && !async->stop) {
+            pthread_cond_wait(&async->work_cond, &async->lock);
+        }
+        if (!(job->state == JOB_QUEUED && job->token == async->next_run)) {
+            break;
+        }
+        pthread_mutex_unlock(&async->lock);
+
+        long long start = now_us();
+        int result = convert_image_with_letterbox_plan(job->src, job->dst, job->plan, job->letterbox, job->color);
+        if (async->mock_delay_us > 0) {
+            long long left = async->mock_delay_us - (now_us() - start);
+            if (left > 0) {
+                usleep((useconds_t)left);
+            }
+        }
+
+        pthread_mutex_lock(&async->lock);
+        job->result = result;
+        job->state = JOB_DONE;
+        async->next_run++;
+        pthread_cond_broadcast(&async->done_cond);
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+image_async_t* image_async_create(const image_async_config_t* config)
+{
+    image_async_t* async = (image_async_t*)calloc(1, sizeof(image_async_t));
+    if (async == NULL) {
+        return NULL;
+    }
+    async->queue_depth = config != NULL && config->queue_depth > 0 ? config->queue_depth : 4;
+    async->mock_delay_us = config != NULL ? config->mock_delay_us : 0;
+    async->next_token = 1;
+    async->next_run = 1;
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->work_cond, NULL);
+    pthread_cond_init(&async->done_cond, NULL);
+
+    async->jobs = (async_job_t*)calloc(async->queue_depth, sizeof(async_job_t));
+    if (async->jobs == NULL) {
+        printf("ERROR: allocate async jobs fail\n");
+        image_async_destroy(async);
+        return NULL;
+    }
+    if (pthread_create(&async->thread, NULL, async_worker, async) != 0) {
+        printf("ERROR: create async thread fail\n");
+        image_async_destroy(async);
+        return NULL;
+    }
+    async->thread_started = 1;
+    return async;
+}
+
+void image_async_destroy(image_async_t* async)
+{
+    if (async == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_broadcast(&async->work_cond);
+    pthread_mutex_unlock(&async->lock);
+    if (async->thread_started) {
+        pthread_join(async->thread, NULL);
+    }
+    pthread_cond_destroy(&async->work_cond);
+    pthread_cond_destroy(&async->done_cond);
+    pthread_mutex_destroy(&async->lock);
+    free(async->jobs);
+    free(async);
+}
+
+int image_async_letterbox(image_async_t* async, image_buffer_t* src_image, image_buffer_t* dst_image,
+                          letterbox_plan_t* plan, letterbox_t* letterbox, char color, image_async_token_t* token)
+{
+    if (async == NULL || src_image == NULL || dst_image == NULL || plan == NULL || token == NULL) {
+        return -1;
+    }
+    if (dst_image->virt_addr == NULL && dst_image->fd <= 0) {
+        // convert_image_with_letterbox_plan would allocate it on the worker, the caller could not see it
+        printf("ERROR: async letterbox needs a destination buffer\n");
+        return -1;
+    }
+    pthread_mutex_lock(&async->lock);
+    async_job_t* job = job_of(async, async->next_token);
+    if (job->state != JOB_FREE) {
+        pthread_mutex_unlock(&async->lock);
+        printf("ERROR: %d async jobs outstanding, wait for earlier tokens first\n", async->queue_depth);
+        return -1;
+    }
+    job->token = async->next_token++;
+    job->src = src_image;
+    job->dst = dst_image;
+    job->plan = plan;
+    job->letterbox = letterbox;
+    job->color = color;
+    job->result = -1;
+    job->state = JOB_QUEUED;
+    *token = job->token;
+    pthread_cond_signal(&async->work_cond);
+    pthread_mutex_unlock(&async->lock);
+    return 0;
+}
+
+int image_async_poll(image_async_t* async, image_async_token_t token)
+{
+    if (async == NULL || token == 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&async->lock);
+    async_job_t* job = job_of(async, token);
+    int ret = -1;
+    if (job->token == token && job->state != JOB_FREE) {
+        ret = job->state == JOB_DONE;
+    }
+    pthread_mutex_unlock(&async->lock);
+    return ret;
+}
+
+int image_async_wait(image_async_t* async, image_async_token_t token)
+{
+    if (async == NULL || token == 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&async->lock);
+    async_job_t* job = job_of(async, token);
+    if (job->token != token || job->state == JOB_FREE) {
+        pthread_mutex_unlock(&async->lock);
+        printf("ERROR: invalid async token %llu\n", token);
+        return -1;
+    }
+    while (job->state != JOB_DONE) {
+        pthread_cond_wait(&async->done_cond, &async->lock);
+    }
+    int result = job->result;
+    job->state = JOB_FREE;
+    pthread_mutex_unlock(&async->lock);
+    return result;
+}
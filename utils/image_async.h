@@ -0,0 +1,86 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_ASYNC_H_
+#define _RKNN_MODEL_ZOO_IMAGE_ASYNC_H_
+
+#include "image_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Completion token of a submitted job, 0 is never a valid token
+ *
+ */
+typedef unsigned long long image_async_token_t;
+
+/**
+ * @brief Config of image_async_create
+ *
+ */
+typedef struct {
+    int queue_depth;        // jobs that can be outstanding (submitted and not waited), default 4
+    int mock_delay_us;      // > 0: a job completes no earlier than this long after it started, to try
+                            // pipelines against RGA-like latency on hosts without RGA
+} image_async_config_t;
+
+typedef struct image_async_t image_async_t;
+
+/**
+ * @brief Start the worker thread that runs submitted conversions in submission order
+ *
+ * The calling thread only queues the job and goes on (post processing, drawing of the previous
+ * frame) while the conversion runs on the backend selected by convert_image (RGA when available).
+ *
+ * @param config [in] Config, NULL for defaults
+ * @return image_async_t* Async engine, NULL on error
+ */
+image_async_t* image_async_create(const image_async_config_t* config);
+
+/**
+ * @brief Wait for the queued jobs and stop the worker, tokens become invalid
+ *
+ * @param async [in] Async engine
+ */
+void image_async_destroy(image_async_t* async);
+
+/**
+ * @brief Queue convert_image_with_letterbox_plan and return at once, fails when queue_depth jobs are outstanding
+ *
+ * src, dst, plan and letterbox must stay valid and untouched until the job is waited for. Jobs on
+ * the same plan run one after the other, so consecutive frames can share a plan.
+ *
+ * @param async [in] Async engine
+ * @param src_image [in] Source Image
+ * @param dst_image [out] Target Image, must have a buffer
+ * @param plan [in/out] Letterbox plan
+ * @param letterbox [out] Letterbox, filled when the job completes, can be NULL
+ * @param color [in] Fill color on target image
+ * @param token [out] Completion token
+ * @return int 0: success; -1: error
+ */
+int image_async_letterbox(image_async_t* async, image_buffer_t* src_image, image_buffer_t* dst_image,
+                          letterbox_plan_t* plan, letterbox_t* letterbox, char color, image_async_token_t* token);
+
+/**
+ * @brief Check whether a job has completed, without blocking
+ *
+ * @param async [in] Async engine
+ * @param token [in] Token from a submit call
+ * @return int 1: completed; 0: still queued or running; -1: invalid or already waited token
+ */
+int image_async_poll(image_async_t* async, image_async_token_t token);
+
+/**
+ * @brief Block until a job has completed and release its token
+ *
+ * @param async [in] Async engine
+ * @param token [in] Token from a submit call
+ * @return int Result of the conversion, 0: success; -1: error or invalid token
+ */
+int image_async_wait(image_async_t* async, image_async_token_t token);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_ASYNC_H_
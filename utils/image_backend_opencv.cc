@@ -0,0 +1,125 @@
+#include <stdio.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "image_backend_opencv.h"
+
+namespace {
+
+bool is_yuv420sp(image_format_t format)
+{
+    return format == IMAGE_FORMAT_YUV420SP_NV12 || format == IMAGE_FORMAT_YUV420SP_NV21;
+}
+
+int mat_type(image_format_t format)
+{
+    switch (format) {
+    case IMAGE_FORMAT_GRAY8:
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        return CV_8UC1;     // Y plane
+    case IMAGE_FORMAT_RGB888:
+        return CV_8UC3;
+    case IMAGE_FORMAT_RGBA8888:
+        return CV_8UC4;
+    default:
+        return -1;
+    }
+}
+
+// Pixels of the image (Y plane for YUV420SP) without copying
+cv::Mat wrap_image(const image_buffer_t* image)
+{
+    return cv::Mat(image->height, image->width, mat_type(image->format), image->virt_addr, image_row_bytes(image));
+}
+
+// Interleaved UV plane of a YUV420SP image
+cv::Mat wrap_uv_plane(const image_buffer_t* image)
+{
+    return cv::Mat(image->height / 2, image->width / 2, CV_8UC2, image_uv_plane(image), image_row_bytes(image));
+}
+
+cv::Rect to_rect(const image_rect_t* box, const image_buffer_t* image)
+{
+    if (box == NULL) {
+        return cv::Rect(0, 0, image->width, image->height);
+    }
+    return cv::Rect(box->left, box->top, box->right - box->left + 1, box->bottom - box->top + 1);
+}
+
+cv::Rect half_rect(const cv::Rect& rect)
+{
+    return cv::Rect(rect.x / 2, rect.y / 2, rect.width / 2, rect.height / 2);
+}
+
+}  // namespace
+
+int opencv_backend_supports(const image_buffer_t* src, const image_buffer_t* dst)
+{
+    if (src->virt_addr == NULL || dst->virt_addr == NULL || mat_type(src->format) < 0 || mat_type(dst->format) < 0) {
+        return 0;
+    }
+    if (is_yuv420sp(src->format) && dst->format == IMAGE_FORMAT_RGB888) {
+        // cv::cvtColor only knows the BT.601 limited range matrix
+        return src->color_space == IMAGE_COLOR_SPACE_BT601_LIMITED;
+    }
+    return src->format == dst->format;
+}
+
+int opencv_backend_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box)
+{
+    try {
+        cv::Rect src_rect = to_rect(src_box, src) & cv::Rect(0, 0, src->width, src->height);
+        cv::Rect dst_rect = to_rect(dst_box, dst);
+        cv::Mat src_mat = wrap_image(src);
+        cv::Mat dst_mat = wrap_image(dst);
+        if (!is_yuv420sp(src->format)) {
+            cv::resize(src_mat(src_rect), dst_mat(dst_rect), dst_rect.size(), 0, 0, cv::INTER_LINEAR);
+            return 0;
+        }
+        if (dst->format != IMAGE_FORMAT_RGB888) {
+            cv::resize(src_mat(src_rect), dst_mat(dst_rect), dst_rect.size(), 0, 0, cv::INTER_LINEAR);
+            cv::Mat dst_uv = wrap_uv_plane(dst)(half_rect(dst_rect));
+            cv::resize(wrap_uv_plane(src)(half_rect(src_rect)), dst_uv, dst_uv.size(), 0, 0, cv::INTER_LINEAR);
+            return 0;
+        }
+
+        // scale both planes into a small contiguous NV12/NV21 image, then convert it into the box
+        int width = dst_rect.width & ~1;
+        int height = dst_rect.height & ~1;
+        thread_local cv::Mat yuv;
+        yuv.create(height * 3 / 2, width, CV_8UC1);
+        cv::resize(src_mat(src_rect), yuv.rowRange(0, height), cv::Size(width, height), 0, 0, cv::INTER_LINEAR);
+        cv::Mat uv(height / 2, width / 2, CV_8UC2, yuv.ptr(height), yuv.step);
+        cv::resize(wrap_uv_plane(src)(half_rect(src_rect)), uv, uv.size(), 0, 0, cv::INTER_LINEAR);
+        int code = src->format == IMAGE_FORMAT_YUV420SP_NV21 ? cv::COLOR_YUV2RGB_NV21 : cv::COLOR_YUV2RGB_NV12;
+        cv::Mat rgb = dst_mat(cv::Rect(dst_rect.x, dst_rect.y, width, height));
+        cv::cvtColor(yuv, rgb, code);
+        return 0;
+    } catch (const cv::Exception& e) {
+        printf("ERROR: OpenCV convert fail: %s\n", e.what());
+        return -1;
+    }
+}
+
+int opencv_backend_fill(image_buffer_t* dst, const image_rect_t* rects, int num_rects, char color)
+{
+    try {
+        cv::Mat dst_mat = wrap_image(dst);
+        cv::Scalar value = cv::Scalar::all((unsigned char)color);
+        for (int i = 0; i < num_rects; i++) {
+            cv::Rect rect = to_rect(&rects[i], dst);
+            dst_mat(rect).setTo(value);
+            if (is_yuv420sp(dst->format)) {
+                // chroma rows cover two luma rows, bands start on even coordinates
+                cv::Rect uv_rect(rect.x / 2, rect.y / 2, (rect.width + 1) / 2, rects[i].bottom / 2 - rects[i].top / 2 + 1);
+                wrap_uv_plane(dst)(uv_rect & cv::Rect(0, 0, dst->width / 2, dst->height / 2)).setTo(value);
+            }
+        }
+        return 0;
+    } catch (const cv::Exception& e) {
+        printf("ERROR: OpenCV fill fail: %s\n", e.what());
+        return -1;
+    }
+}
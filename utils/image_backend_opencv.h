@@ -0,0 +1,47 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_BACKEND_OPENCV_H_
+#define _RKNN_MODEL_ZOO_IMAGE_BACKEND_OPENCV_H_
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Check whether cv::resize/cv::cvtColor can do this conversion
+ *
+ * Same format GRAY8/RGB888/RGBA8888/NV12/NV21 resize, and BT.601 limited range NV12/NV21 to RGB888.
+ *
+ * @param src [in] Source Image
+ * @param dst [in] Target Image
+ * @return int 1: supported; 0: not supported
+ */
+int opencv_backend_supports(const image_buffer_t* src, const image_buffer_t* dst);
+
+/**
+ * @brief Crop, scale and convert src_box of the source into dst_box of the target, bilinear
+ *
+ * @param src [in] Source Image
+ * @param dst [out] Target Image
+ * @param src_box [in] Crop rectangle on source image, NULL for the whole image
+ * @param dst_box [in] Rectangle on target image, NULL for the whole image
+ * @return int 0: success; -1: error
+ */
+int opencv_backend_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box);
+
+/**
+ * @brief Fill rectangles with a color, both planes for YUV420SP
+ *
+ * @param dst [out] Target Image
+ * @param rects [in] Rectangles
+ * @param num_rects [in] Number of rectangles
+ * @param color [in] Value of every channel
+ * @return int 0: success; -1: error
+ */
+int opencv_backend_fill(image_buffer_t* dst, const image_rect_t* rects, int num_rects, char color);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_BACKEND_OPENCV_H_
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "image_drawing.h"
 #include "font.h"
@@ -36,6 +37,11 @@ static unsigned int convert_color(unsigned int src_color, image_format_t dst_fmt
         p_dst_color[1] = g;
         p_dst_color[2] = b;
         break;
+    case IMAGE_FORMAT_BGR888:
+        p_dst_color[0] = b;
+        p_dst_color[1] = g;
+        p_dst_color[2] = r;
+        break;
     case IMAGE_FORMAT_RGBA8888:
         p_dst_color[0] = r;
         p_dst_color[1] = g;
@@ -58,11 +64,10 @@ static unsigned int convert_color(unsigned int src_color, image_format_t dst_fmt
     return dst_color;
 }
 
-static void draw_rectangle_c1(unsigned char* pixels, int w, int h, int rx, int ry, int rw, int rh, unsigned int color,
+static void draw_rectangle_c1(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color,
                               int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w;
 
     if (thickness == -1) {
         // filled
@@ -181,11 +186,10 @@ static void draw_rectangle_c1(unsigned char* pixels, int w, int h, int rx, int r
     }
 }
 
-static void draw_rectangle_c2(unsigned char* pixels, int w, int h, int rx, int ry, int rw, int rh, unsigned int color,
+static void draw_rectangle_c2(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color,
                               int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 2;
 
     if (thickness == -1) {
         // filled
@@ -309,11 +313,10 @@ static void draw_rectangle_c2(unsigned char* pixels, int w, int h, int rx, int r
     }
 }
 
-static void draw_rectangle_c3(unsigned char* pixels, int w, int h, int rx, int ry, int rw, int rh, unsigned int color,
+static void draw_rectangle_c3(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color,
                               int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 3;
 
     if (thickness == -1) {
         // filled
@@ -442,11 +445,10 @@ static void draw_rectangle_c3(unsigned char* pixels, int w, int h, int rx, int r
     }
 }
 
-static void draw_rectangle_c4(unsigned char* pixels, int w, int h, int rx, int ry, int rw, int rh, unsigned int color,
+static void draw_rectangle_c4(unsigned char* pixels, int w, int h, int stride, int rx, int ry, int rw, int rh, unsigned int color,
                               int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 4;
 
     if (thickness == -1) {
         // filled
@@ -580,7 +582,7 @@ static void draw_rectangle_c4(unsigned char* pixels, int w, int h, int rx, int r
     }
 }
 
-static void draw_rectangle_yuv420sp(unsigned char* yuv420sp, int w, int h, int rx, int ry, int rw, int rh,
+static void draw_rectangle_yuv420sp(unsigned char* yuv420sp, unsigned char* uv, int w, int h, int stride, int rx, int ry, int rw, int rh,
                                     unsigned int color, int thickness)
 {
     // assert w % 2 == 0
@@ -602,11 +604,11 @@ static void draw_rectangle_yuv420sp(unsigned char* yuv420sp, int w, int h, int r
     pen_color_uv[1] = pen_color[2];
 
     unsigned char* Y = yuv420sp;
-    draw_rectangle_c1(Y, w, h, rx, ry, rw, rh, v_y, thickness);
+    draw_rectangle_c1(Y, w, h, stride, rx, ry, rw, rh, v_y, thickness);
 
-    unsigned char* UV = yuv420sp + w * h;
+    unsigned char* UV = uv;
     int thickness_uv = thickness == -1 ? thickness : max(thickness / 2, 1);
-    draw_rectangle_c2(UV, w / 2, h / 2, rx / 2, ry / 2, rw / 2, rh / 2, v_uv, thickness_uv);
+    draw_rectangle_c2(UV, w / 2, h / 2, stride, rx / 2, ry / 2, rw / 2, rh / 2, v_uv, thickness_uv);
 }
 
 static inline int distance_lessequal(int x0, int y0, int x1, int y1, float r)
@@ -625,11 +627,10 @@ static inline int distance_inrange(int x0, int y0, int x1, int y1, float r0, flo
     return q >= r0 * r0 && q < r1 * r1;
 }
 
-static void draw_circle_c1(unsigned char* pixels, int w, int h, int cx, int cy, int radius, unsigned int color,
+static void draw_circle_c1(unsigned char* pixels, int w, int h, int stride, int cx, int cy, int radius, unsigned int color,
                            int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w;
 
     if (thickness == -1) {
         // filled
@@ -686,11 +687,10 @@ static void draw_circle_c1(unsigned char* pixels, int w, int h, int cx, int cy,
     }
 }
 
-static void draw_circle_c2(unsigned char* pixels, int w, int h, int cx, int cy, int radius, unsigned int color,
+static void draw_circle_c2(unsigned char* pixels, int w, int h, int stride, int cx, int cy, int radius, unsigned int color,
                            int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 2;
 
     if (thickness == -1) {
         // filled
@@ -749,11 +749,10 @@ static void draw_circle_c2(unsigned char* pixels, int w, int h, int cx, int cy,
     }
 }
 
-static void draw_circle_c3(unsigned char* pixels, int w, int h, int cx, int cy, int radius, unsigned int color,
+static void draw_circle_c3(unsigned char* pixels, int w, int h, int stride, int cx, int cy, int radius, unsigned int color,
                            int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 3;
 
     if (thickness == -1) {
         // filled
@@ -814,11 +813,10 @@ static void draw_circle_c3(unsigned char* pixels, int w, int h, int cx, int cy,
     }
 }
 
-static void draw_circle_c4(unsigned char* pixels, int w, int h, int cx, int cy, int radius, unsigned int color,
+static void draw_circle_c4(unsigned char* pixels, int w, int h, int stride, int cx, int cy, int radius, unsigned int color,
                            int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 4;
 
     if (thickness == -1) {
         // filled
@@ -881,7 +879,7 @@ static void draw_circle_c4(unsigned char* pixels, int w, int h, int cx, int cy,
     }
 }
 
-static void draw_circle_yuv420sp(unsigned char* yuv420sp, int w, int h, int cx, int cy, int radius, unsigned int color,
+static void draw_circle_yuv420sp(unsigned char* yuv420sp, unsigned char* uv, int w, int h, int stride, int cx, int cy, int radius, unsigned int color,
                                  int thickness)
 {
     // assert w % 2 == 0
@@ -902,11 +900,11 @@ static void draw_circle_yuv420sp(unsigned char* yuv420sp, int w, int h, int cx,
     pen_color_uv[1] = pen_color[2];
 
     unsigned char* Y = yuv420sp;
-    draw_circle_c1(Y, w, h, cx, cy, radius, v_y, thickness);
+    draw_circle_c1(Y, w, h, stride, cx, cy, radius, v_y, thickness);
 
-    unsigned char* UV = yuv420sp + w * h;
+    unsigned char* UV = uv;
     int thickness_uv = thickness == -1 ? thickness : max(thickness / 2, 1);
-    draw_circle_c2(UV, w / 2, h / 2, cx / 2, cy / 2, radius / 2, v_uv, thickness_uv);
+    draw_circle_c2(UV, w / 2, h / 2, stride, cx / 2, cy / 2, radius / 2, v_uv, thickness_uv);
 }
 
 static inline int distance_lessthan(int x, int y, int x0, int y0, int x1, int y1, float t)
@@ -929,11 +927,10 @@ static inline int distance_lessthan(int x, int y, int x0, int y0, int x1, int y1
     return p < t;
 }
 
-static void draw_line_c1(unsigned char* pixels, int w, int h, int x0, int y0, int x1, int y1, unsigned int color,
+static void draw_line_c1(unsigned char* pixels, int w, int h, int stride, int x0, int y0, int x1, int y1, unsigned int color,
                          int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w;
 
     const float t0 = thickness / 2.f;
     const float t1 = thickness - t0;
@@ -967,11 +964,10 @@ static void draw_line_c1(unsigned char* pixels, int w, int h, int x0, int y0, in
     }
 }
 
-static void draw_line_c2(unsigned char* pixels, int w, int h, int x0, int y0, int x1, int y1, unsigned int color,
+static void draw_line_c2(unsigned char* pixels, int w, int h, int stride, int x0, int y0, int x1, int y1, unsigned int color,
                          int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 2;
 
     const float t0 = thickness / 2.f;
     const float t1 = thickness - t0;
@@ -1006,11 +1002,10 @@ static void draw_line_c2(unsigned char* pixels, int w, int h, int x0, int y0, in
     }
 }
 
-static void draw_line_c3(unsigned char* pixels, int w, int h, int x0, int y0, int x1, int y1, unsigned int color,
+static void draw_line_c3(unsigned char* pixels, int w, int h, int stride, int x0, int y0, int x1, int y1, unsigned int color,
                          int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 3;
 
     const float t0 = thickness / 2.f;
     const float t1 = thickness - t0;
@@ -1046,11 +1041,10 @@ static void draw_line_c3(unsigned char* pixels, int w, int h, int x0, int y0, in
     }
 }
 
-static void draw_line_c4(unsigned char* pixels, int w, int h, int x0, int y0, int x1, int y1, unsigned int color,
+static void draw_line_c4(unsigned char* pixels, int w, int h, int stride, int x0, int y0, int x1, int y1, unsigned int color,
                          int thickness)
 {
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 4;
 
     const float t0 = thickness / 2.f;
     const float t1 = thickness - t0;
@@ -1087,7 +1081,7 @@ static void draw_line_c4(unsigned char* pixels, int w, int h, int x0, int y0, in
     }
 }
 
-static void draw_line_yuv420sp(unsigned char* yuv420sp, int w, int h, int x0, int y0, int x1, int y1,
+static void draw_line_yuv420sp(unsigned char* yuv420sp, unsigned char* uv, int w, int h, int stride, int x0, int y0, int x1, int y1,
                                unsigned int color, int thickness)
 {
     // assert w % 2 == 0
@@ -1109,11 +1103,11 @@ static void draw_line_yuv420sp(unsigned char* yuv420sp, int w, int h, int x0, in
     pen_color_uv[1] = pen_color[2];
 
     unsigned char* Y = yuv420sp;
-    draw_line_c1(Y, w, h, x0, y0, x1, y1, v_y, thickness);
+    draw_line_c1(Y, w, h, stride, x0, y0, x1, y1, v_y, thickness);
 
-    unsigned char* UV = yuv420sp + w * h;
+    unsigned char* UV = uv;
     int thickness_uv = thickness == -1 ? thickness : max(thickness / 2, 1);
-    draw_line_c2(UV, w / 2, h / 2, x0 / 2, y0 / 2, x1 / 2, y1 / 2, v_uv, thickness_uv);
+    draw_line_c2(UV, w / 2, h / 2, stride, x0 / 2, y0 / 2, x1 / 2, y1 / 2, v_uv, thickness_uv);
 }
 
 static void get_text_drawing_size(const char* text, int fontpixelsize, int* w, int* h)
@@ -1174,243 +1168,236 @@ static int resize_bilinear_c1(const unsigned char* src_pixels, int w, int h, uns
     return 0;
 }
 
-static void draw_text_c1(unsigned char* pixels, int w, int h, const char* text, int x, int y, int fontpixelsize,
-                         unsigned int color)
+// Glyph atlases: every glyph of mono_font_data is resized once per font pixel size and channel
+// count, with its alpha repeated per channel, so drawing a label is a blend of atlas rows into the
+// image. Glyphs are rasterized the first time they are drawn and kept for the process lifetime.
+#define GLYPH_COUNT 95
+#define GLYPH_ATLAS_MAX 64
+// bytes blended per kernel call, a multiple of every channel count so the pen color stays in phase
+#define TEXT_COLOR_ROW 768
+
+typedef struct {
+    int ready;
+    unsigned char* alpha;       // glyph_h rows of glyph_w * channels bytes, NULL for blank glyphs
+    int x0, y0, x1, y1;         // inked box in pixels, empty for blank glyphs
+} glyph_t;
+
+typedef struct {
+    int fontpixelsize;          // glyph_w, glyph_h is twice as large
+    int channels;
+    glyph_t glyphs[GLYPH_COUNT];
+} glyph_atlas_t;
+
+static pthread_mutex_t g_glyph_lock = PTHREAD_MUTEX_INITIALIZER;
+static glyph_atlas_t g_glyph_atlases[GLYPH_ATLAS_MAX];
+static int g_num_glyph_atlases = 0;
+
+static void glyph_build(const glyph_atlas_t* atlas, int index, glyph_t* glyph)
 {
-    const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w;
-
-    unsigned char* resized_font_bitmap = (unsigned char*)malloc(fontpixelsize * fontpixelsize * 2);
-
-    const int n = strlen(text);
-
-    int cursor_x = x;
-    int cursor_y = y;
-    for (int i = 0; i < n; i++) {
-        char ch = text[i];
-
-        if (ch == '\n') {
-            // newline
-            cursor_x = x;
-            cursor_y += fontpixelsize * 2;
-        }
-
-        if (isprint(ch) != 0) {
-            const unsigned char* font_bitmap = mono_font_data[ch - ' '];
-
-            // draw resized character
-            resize_bilinear_c1(font_bitmap, 20, 40, resized_font_bitmap, fontpixelsize, fontpixelsize * 2);
-
-            for (int j = cursor_y; j < cursor_y + fontpixelsize * 2; j++) {
-                if (j < 0)
-                    continue;
-
-                if (j >= h)
-                    break;
-
-                const unsigned char* palpha = resized_font_bitmap + (j - cursor_y) * fontpixelsize;
-                unsigned char* p = pixels + stride * j;
-
-                for (int k = cursor_x; k < cursor_x + fontpixelsize; k++) {
-                    if (k < 0)
-                        continue;
-
-                    if (k >= w)
-                        break;
-
-                    unsigned char alpha = palpha[k - cursor_x];
-
-                    p[k] = (p[k] * (255 - alpha) + pen_color[0] * alpha) / 255;
-                }
+    int gw = atlas->fontpixelsize;
+    int gh = atlas->fontpixelsize * 2;
+    int c = atlas->channels;
+    glyph->ready = 1;
+    glyph->x0 = gw;
+    glyph->y0 = gh;
+    glyph->x1 = 0;
+    glyph->y1 = 0;
+
+    unsigned char* resized = (unsigned char*)malloc(gw * gh);
+    if (resized == NULL) {
+        return;
+    }
+    resize_bilinear_c1(mono_font_data[index], 20, 40, resized, gw, gh);
+    for (int j = 0; j < gh; j++) {
+        for (int k = 0; k < gw; k++) {
+            if (resized[j * gw + k] != 0) {
+                glyph->x0 = min(glyph->x0, k);
+                glyph->y0 = min(glyph->y0, j);
+                glyph->x1 = max(glyph->x1, k + 1);
+                glyph->y1 = max(glyph->y1, j + 1);
             }
-
-            cursor_x += fontpixelsize;
         }
     }
-
-    free(resized_font_bitmap);
+    if (glyph->x0 < glyph->x1) {
+        glyph->alpha = (unsigned char*)malloc(gw * gh * c);
+    }
+    if (glyph->alpha == NULL) {
+        // blank, or drawn as blank when out of memory
+        glyph->x1 = 0;
+        free(resized);
+        return;
+    }
+    for (int i = 0; i < gw * gh; i++) {
+        memset(glyph->alpha + i * c, resized[i], c);
+    }
+    free(resized);
 }
 
-static void draw_text_c2(unsigned char* pixels, int w, int h, const char* text, int x, int y, int fontpixelsize,
-                         unsigned int color)
+// Rasterize the glyphs of text that the atlas does not have yet, caller holds g_glyph_lock
+static void glyph_atlas_prepare(glyph_atlas_t* atlas, const char* text)
 {
-    const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 2;
-
-    unsigned char* resized_font_bitmap = (unsigned char*)malloc(fontpixelsize * fontpixelsize * 2);
-
-    const int n = strlen(text);
-
-    int cursor_x = x;
-    int cursor_y = y;
-    for (int i = 0; i < n; i++) {
-        char ch = text[i];
-
-        if (ch == '\n') {
-            // newline
-            cursor_x = x;
-            cursor_y += fontpixelsize * 2;
+    for (const char* ch = text; *ch != '\0'; ch++) {
+        if (isprint(*ch) != 0 && !atlas->glyphs[*ch - ' '].ready) {
+            glyph_build(atlas, *ch - ' ', &atlas->glyphs[*ch - ' ']);
         }
+    }
+}
 
-        if (isprint(ch) != 0) {
-            int font_bitmap_index = ch - ' ';
-            const unsigned char* font_bitmap = mono_font_data[font_bitmap_index];
-
-            // draw resized character
-            resize_bilinear_c1(font_bitmap, 20, 40, resized_font_bitmap, fontpixelsize, fontpixelsize * 2);
-
-            for (int j = cursor_y; j < cursor_y + fontpixelsize * 2; j++) {
-                if (j < 0)
-                    continue;
-
-                if (j >= h)
-                    break;
-
-                const unsigned char* palpha = resized_font_bitmap + (j - cursor_y) * fontpixelsize;
-                unsigned char* p = pixels + stride * j;
-
-                for (int k = cursor_x; k < cursor_x + fontpixelsize; k++) {
-                    if (k < 0)
-                        continue;
-
-                    if (k >= w)
-                        break;
-
-                    unsigned char alpha = palpha[k - cursor_x];
-
-                    p[k * 2 + 0] = (p[k * 2 + 0] * (255 - alpha) + pen_color[0] * alpha) / 255;
-                    p[k * 2 + 1] = (p[k * 2 + 1] * (255 - alpha) + pen_color[1] * alpha) / 255;
-                }
-            }
+static void glyph_atlas_release(glyph_atlas_t* atlas)
+{
+    for (int i = 0; i < GLYPH_COUNT; i++) {
+        free(atlas->glyphs[i].alpha);
+    }
+}
 
-            cursor_x += fontpixelsize;
+// Cached atlas with every glyph of text rasterized. NULL when the cache is full, the caller then
+// draws from a temporary atlas.
+static glyph_atlas_t* glyph_atlas_get(int fontpixelsize, int channels, const char* text)
+{
+    glyph_atlas_t* atlas = NULL;
+    pthread_mutex_lock(&g_glyph_lock);
+    for (int i = 0; i < g_num_glyph_atlases; i++) {
+        if (g_glyph_atlases[i].fontpixelsize == fontpixelsize && g_glyph_atlases[i].channels == channels) {
+            atlas = &g_glyph_atlases[i];
+            break;
         }
     }
-
-    free(resized_font_bitmap);
+    if (atlas == NULL && g_num_glyph_atlases < GLYPH_ATLAS_MAX) {
+        atlas = &g_glyph_atlases[g_num_glyph_atlases++];
+        atlas->fontpixelsize = fontpixelsize;
+        atlas->channels = channels;
+    }
+    if (atlas != NULL) {
+        glyph_atlas_prepare(atlas, text);
+    }
+    pthread_mutex_unlock(&g_glyph_lock);
+    return atlas;
 }
 
-static void draw_text_c3(unsigned char* pixels, int w, int h, const char* text, int x, int y, int fontpixelsize,
-                         unsigned int color)
+// dst = (dst * (255 - alpha) + color * alpha) / 255 per byte. The SIMD kernels divide with
+// (x + 1 + (x >> 8)) >> 8, which equals x / 255 for every x the blend produces.
+static void blend_row_c(unsigned char* dst, const unsigned char* alpha, const unsigned char* color, int n)
 {
-    const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 3;
-
-    unsigned char* resized_font_bitmap = (unsigned char*)malloc(fontpixelsize * fontpixelsize * 2);
-
-    const int n = strlen(text);
-
-    int cursor_x = x;
-    int cursor_y = y;
     for (int i = 0; i < n; i++) {
-        char ch = text[i];
-
-        if (ch == '\n') {
-            // newline
-            cursor_x = x;
-            cursor_y += fontpixelsize * 2;
-        }
-
-        if (isprint(ch) != 0) {
-            int font_bitmap_index = ch - ' ';
-            const unsigned char* font_bitmap = mono_font_data[font_bitmap_index];
-
-            // draw resized character
-            resize_bilinear_c1(font_bitmap, 20, 40, resized_font_bitmap, fontpixelsize, fontpixelsize * 2);
-
-            for (int j = cursor_y; j < cursor_y + fontpixelsize * 2; j++) {
-                if (j < 0)
-                    continue;
-
-                if (j >= h)
-                    break;
+        dst[i] = (dst[i] * (255 - alpha[i]) + color[i] * alpha[i]) / 255;
+    }
+}
 
-                const unsigned char* palpha = resized_font_bitmap + (j - cursor_y) * fontpixelsize;
-                unsigned char* p = pixels + stride * j;
+#if defined(__SSE2__)
+#include <emmintrin.h>
 
-                for (int k = cursor_x; k < cursor_x + fontpixelsize; k++) {
-                    if (k < 0)
-                        continue;
+static __m128i blend_half_sse2(__m128i d, __m128i a, __m128i c)
+{
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)), _mm_mullo_epi16(c, a));
+    x = _mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(x, 8);
+}
 
-                    if (k >= w)
-                        break;
+static void blend_row(unsigned char* dst, const unsigned char* alpha, const unsigned char* color, int n)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i a = _mm_loadu_si128((const __m128i*)(alpha + i));
+        __m128i c = _mm_loadu_si128((const __m128i*)(color + i));
+        __m128i lo = blend_half_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i hi = blend_half_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    blend_row_c(dst + i, alpha + i, color + i, n - i);
+}
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
 
-                    unsigned char alpha = palpha[k - cursor_x];
+static uint8x8_t blend_half_neon(uint8x8_t d, uint8x8_t a, uint8x8_t c)
+{
+    uint16x8_t x = vmlal_u8(vmull_u8(d, vmvn_u8(a)), c, a);
+    x = vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8));
+    return vshrn_n_u16(x, 8);
+}
 
-                    p[k * 3 + 0] = (p[k * 3 + 0] * (255 - alpha) + pen_color[0] * alpha) / 255;
-                    p[k * 3 + 1] = (p[k * 3 + 1] * (255 - alpha) + pen_color[1] * alpha) / 255;
-                    p[k * 3 + 2] = (p[k * 3 + 2] * (255 - alpha) + pen_color[2] * alpha) / 255;
-                }
-            }
+static void blend_row(unsigned char* dst, const unsigned char* alpha, const unsigned char* color, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t d = vld1q_u8(dst + i);
+        uint8x16_t a = vld1q_u8(alpha + i);
+        uint8x16_t c = vld1q_u8(color + i);
+        uint8x8_t lo = blend_half_neon(vget_low_u8(d), vget_low_u8(a), vget_low_u8(c));
+        uint8x8_t hi = blend_half_neon(vget_high_u8(d), vget_high_u8(a), vget_high_u8(c));
+        vst1q_u8(dst + i, vcombine_u8(lo, hi));
+    }
+    blend_row_c(dst + i, alpha + i, color + i, n - i);
+}
+#else
+#define blend_row blend_row_c
+#endif
 
-            cursor_x += fontpixelsize;
+static void blit_glyph(unsigned char* pixels, int w, int h, int stride, const glyph_atlas_t* atlas,
+                       const glyph_t* glyph, int gx, int gy, const unsigned char* color_row)
+{
+    int c = atlas->channels;
+    int x0 = max(gx + glyph->x0, 0);
+    int x1 = min(gx + glyph->x1, w);
+    int y0 = max(gy + glyph->y0, 0);
+    int y1 = min(gy + glyph->y1, h);
+    if (glyph->alpha == NULL || x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    int row_bytes = atlas->fontpixelsize * c;
+    for (int j = y0; j < y1; j++) {
+        const unsigned char* palpha = glyph->alpha + (j - gy) * row_bytes + (x0 - gx) * c;
+        unsigned char* p = pixels + stride * j + x0 * c;
+        for (int done = 0, n = (x1 - x0) * c; done < n; done += TEXT_COLOR_ROW) {
+            blend_row(p + done, palpha + done, color_row, min(n - done, TEXT_COLOR_ROW));
         }
     }
-
-    free(resized_font_bitmap);
 }
 
-static void draw_text_c4(unsigned char* pixels, int w, int h, const char* text, int x, int y, int fontpixelsize,
-                         unsigned int color)
+static void draw_text_cn(unsigned char* pixels, int w, int h, int stride, int channels, const char* text, int x, int y,
+                         int fontpixelsize, unsigned int color)
 {
+    if (fontpixelsize <= 0) {
+        return;
+    }
     const unsigned char* pen_color = (const unsigned char*)&color;
-    int stride = w * 4;
-
-    unsigned char* resized_font_bitmap = (unsigned char*)malloc(fontpixelsize * fontpixelsize * 2);
+    unsigned char color_row[TEXT_COLOR_ROW];
+    for (int i = 0; i < TEXT_COLOR_ROW; i++) {
+        color_row[i] = pen_color[i % channels];
+    }
 
-    const int n = strlen(text);
+    glyph_atlas_t temp_atlas;
+    glyph_atlas_t* atlas = glyph_atlas_get(fontpixelsize, channels, text);
+    if (atlas == NULL) {
+        memset(&temp_atlas, 0, sizeof(temp_atlas));
+        temp_atlas.fontpixelsize = fontpixelsize;
+        temp_atlas.channels = channels;
+        glyph_atlas_prepare(&temp_atlas, text);
+        atlas = &temp_atlas;
+    }
 
     int cursor_x = x;
     int cursor_y = y;
-    for (int i = 0; i < n; i++) {
-        char ch = text[i];
-
-        if (ch == '\n') {
+    for (const char* ch = text; *ch != '\0'; ch++) {
+        if (*ch == '\n') {
             // newline
             cursor_x = x;
             cursor_y += fontpixelsize * 2;
         }
 
-        if (isprint(ch) != 0) {
-            const unsigned char* font_bitmap = mono_font_data[ch - ' '];
-
-            // draw resized character
-            resize_bilinear_c1(font_bitmap, 20, 40, resized_font_bitmap, fontpixelsize, fontpixelsize * 2);
-
-            for (int j = cursor_y; j < cursor_y + fontpixelsize * 2; j++) {
-                if (j < 0)
-                    continue;
-
-                if (j >= h)
-                    break;
-
-                const unsigned char* palpha = resized_font_bitmap + (j - cursor_y) * fontpixelsize;
-                unsigned char* p = pixels + stride * j;
-
-                for (int k = cursor_x; k < cursor_x + fontpixelsize; k++) {
-                    if (k < 0)
-                        continue;
-
-                    if (k >= w)
-                        break;
-
-                    unsigned char alpha = palpha[k - cursor_x];
-
-                    p[k * 4 + 0] = (p[k * 4 + 0] * (255 - alpha) + pen_color[0] * alpha) / 255;
-                    p[k * 4 + 1] = (p[k * 4 + 1] * (255 - alpha) + pen_color[1] * alpha) / 255;
-                    p[k * 4 + 2] = (p[k * 4 + 2] * (255 - alpha) + pen_color[2] * alpha) / 255;
-                    p[k * 4 + 3] = (p[k * 4 + 3] * (255 - alpha) + pen_color[3] * alpha) / 255;
-                }
-            }
-
+        if (isprint(*ch) != 0) {
+            blit_glyph(pixels, w, h, stride, atlas, &atlas->glyphs[*ch - ' '], cursor_x, cursor_y, color_row);
             cursor_x += fontpixelsize;
         }
     }
 
-    free(resized_font_bitmap);
+    if (atlas == &temp_atlas) {
+        glyph_atlas_release(&temp_atlas);
+    }
 }
 
-static void draw_text_yuv420sp(unsigned char* yuv420sp, int w, int h, const char* text, int x, int y, int fontpixelsize,
+static void draw_text_yuv420sp(unsigned char* yuv420sp, unsigned char* uv, int w, int h, int stride, const char* text, int x, int y, int fontpixelsize,
                                unsigned int color)
 {
     // assert w % 2 == 0
@@ -1430,45 +1417,39 @@ static void draw_text_yuv420sp(unsigned char* yuv420sp, int w, int h, const char
     pen_color_uv[1] = pen_color[2];
 
     unsigned char* Y = yuv420sp;
-    draw_text_c1(Y, w, h, text, x, y, fontpixelsize, v_y);
+    draw_text_cn(Y, w, h, stride, 1, text, x, y, fontpixelsize, v_y);
 
-    unsigned char* UV = yuv420sp + w * h;
-    draw_text_c2(UV, w / 2, h / 2, text, x / 2, y / 2, max(fontpixelsize / 2, 1), v_uv);
+    unsigned char* UV = uv;
+    draw_text_cn(UV, w / 2, h / 2, stride, 2, text, x / 2, y / 2, max(fontpixelsize / 2, 1), v_uv);
 }
 
-static void draw_image_c1(unsigned char* pixels, int w, int h, unsigned char* draw_img, int x, int y, int rw, int rh)
+static void draw_image_c1(unsigned char* pixels, int stride, unsigned char* draw_img, int x, int y, int rw, int rh)
 {
     for (int i = 0; i < rh; i++) {
-        memcpy(pixels + (y + i) * w + x,  draw_img + i * rw,  rw);
+        memcpy(pixels + (y + i) * stride + x,  draw_img + i * rw,  rw);
     }
 }
 
-static void draw_image_c2(unsigned char* pixels, int w, int h, unsigned char* draw_img, int x, int y, int rw, int rh)
+static void draw_image_c3(unsigned char* pixels, int stride, unsigned char* draw_img, int x, int y, int rw, int rh)
 {
     for (int i = 0; i < rh; i++) {
-        memcpy(pixels + ((y + i) * w + x) * 2,  draw_img + i * rw * 2,  rw * 2);
+        memcpy(pixels + (y + i) * stride + x * 3,  draw_img + i * rw * 3,  rw * 3);
     }
 }
 
-static void draw_image_c3(unsigned char* pixels, int w, int h, unsigned char* draw_img, int x, int y, int rw, int rh)
+static void draw_image_c4(unsigned char* pixels, int stride, unsigned char* draw_img, int x, int y, int rw, int rh)
 {
-    printf("draw_image_c3 pixels=%p wxh=%dx%d draw_img=%p pos=(%d %d) rwxrh=%dx%d\n", pixels, w, h, draw_img, x, y, rw, rh);
     for (int i = 0; i < rh; i++) {
-        memcpy(pixels + ((y + i) * w + x) * 3,  draw_img + i * rw * 3,  rw * 3);
+        memcpy(pixels + (y + i) * stride + x * 4,  draw_img + i * rw * 4,  rw * 4);
     }
 }
 
-static void draw_image_c4(unsigned char* pixels, int w, int h, unsigned char* draw_img, int x, int y, int rw, int rh)
+static void draw_image_yuv420sp(unsigned char* pixels, unsigned char* uv, int stride, unsigned char* draw_img,
+                                int x, int y, int rw, int rh)
 {
-    for (int i = 0; i < rh; i++) {
-        memcpy(pixels + ((y + i) * w + x) * 4,  draw_img + i * rw * 4,  rw * 4);
-    }
-}
-
-static void draw_image_yuv420sp(unsigned char* pixels, int w, int h, unsigned char* draw_img, int x, int y, int rw, int rh)
-{
-    draw_image_c1(pixels, w, h, draw_img, x, y, rw, rh);
-    draw_image_c2(pixels, w, h / 2, draw_img + rw * rh, x, y/2, rw, rh/2);
+    draw_image_c1(pixels, stride, draw_img, x, y, rw, rh);
+    // interleaved chroma rows are rw bytes wide and cover two luma rows
+    draw_image_c1(uv, stride, draw_img + rw * rh, x, y / 2, rw, rh / 2);
 }
 
 void draw_rectangle(image_buffer_t* image, int rx, int ry, int rw, int rh, unsigned int color,
@@ -1478,6 +1459,7 @@ void draw_rectangle(image_buffer_t* image, int rx, int ry, int rw, int rh, unsig
     unsigned char* pixels = image->virt_addr;
     int w = image->width;
     int h = image->height;
+    int stride = image_row_bytes(image);
 
     unsigned int draw_color = convert_color(color, format);
     // printf("draw_color=%x\n", draw_color);
@@ -1487,14 +1469,15 @@ void draw_rectangle(image_buffer_t* image, int rx, int ry, int rw, int rh, unsig
     switch (format)
     {
     case IMAGE_FORMAT_RGB888:
-        draw_rectangle_c3(pixels, w, h, rx, ry, rw, rh, draw_color, thickness);
+    case IMAGE_FORMAT_BGR888:
+        draw_rectangle_c3(pixels, w, h, stride, rx, ry, rw, rh, draw_color, thickness);
         break;
     case IMAGE_FORMAT_RGBA8888:
-        draw_rectangle_c4(pixels, w, h, rx, ry, rw, rh, draw_color, thickness);
+        draw_rectangle_c4(pixels, w, h, stride, rx, ry, rw, rh, draw_color, thickness);
         break;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        draw_rectangle_yuv420sp(pixels, w, h, rx, ry, rw, rh, draw_color, thickness);
+        draw_rectangle_yuv420sp(pixels, image_uv_plane(image), w, h, stride, rx, ry, rw, rh, draw_color, thickness);
         break;
     default:
         printf("no support format %d", format);
@@ -1509,20 +1492,22 @@ void draw_line(image_buffer_t* image, int x0, int y0, int x1, int y1, unsigned i
     unsigned char* pixels = image->virt_addr;
     int w = image->width;
     int h = image->height;
+    int stride = image_row_bytes(image);
 
     unsigned draw_color = convert_color(color, format);
 
     switch (format)
     {
     case IMAGE_FORMAT_RGB888:
-        draw_line_c3(pixels, w, h, x0, y0, x1, y1, draw_color, thickness);
+    case IMAGE_FORMAT_BGR888:
+        draw_line_c3(pixels, w, h, stride, x0, y0, x1, y1, draw_color, thickness);
         break;
     case IMAGE_FORMAT_RGBA8888:
-        draw_line_c4(pixels, w, h, x0, y0, x1, y1, draw_color, thickness);
+        draw_line_c4(pixels, w, h, stride, x0, y0, x1, y1, draw_color, thickness);
         break;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        draw_line_yuv420sp(pixels, w, h, x0, y0, x1, y1, draw_color, thickness);
+        draw_line_yuv420sp(pixels, image_uv_plane(image), w, h, stride, x0, y0, x1, y1, draw_color, thickness);
         break;
     default:
         printf("no support format %d", format);
@@ -1568,19 +1553,21 @@ void draw_text(image_buffer_t* image, const char* text, int x, int y, unsigned i
     unsigned char* pixels = image->virt_addr;
     int w = image->width;
     int h = image->height;
+    int stride = image_row_bytes(image);
     unsigned int draw_color = convert_color(color, format);
 
     switch (format)
     {
     case IMAGE_FORMAT_RGB888:
-        draw_text_c3(pixels, w, h, text, x, y, fontsize, draw_color);
+    case IMAGE_FORMAT_BGR888:
+        draw_text_cn(pixels, w, h, stride, 3, text, x, y, fontsize, draw_color);
         break;
     case IMAGE_FORMAT_RGBA8888:
-        draw_text_c4(pixels, w, h, text, x, y, fontsize, draw_color);
+        draw_text_cn(pixels, w, h, stride, 4, text, x, y, fontsize, draw_color);
         break;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        draw_text_yuv420sp(pixels, w, h, text, x, y, fontsize, draw_color);
+        draw_text_yuv420sp(pixels, image_uv_plane(image), w, h, stride, text, x, y, fontsize, draw_color);
         break;
     default:
         printf("no support format %d", format);
@@ -1595,19 +1582,21 @@ void draw_circle(image_buffer_t* image, int cx, int cy, int radius, unsigned int
     unsigned char* pixels = image->virt_addr;
     int w = image->width;
     int h = image->height;
+    int stride = image_row_bytes(image);
     unsigned draw_color = convert_color(color, format);
 
     switch (format)
     {
     case IMAGE_FORMAT_RGB888:
-        draw_circle_c3(pixels, w, h, cx, cy, radius, draw_color, thickness);
+    case IMAGE_FORMAT_BGR888:
+        draw_circle_c3(pixels, w, h, stride, cx, cy, radius, draw_color, thickness);
         break;
     case IMAGE_FORMAT_RGBA8888:
-        draw_circle_c4(pixels, w, h, cx, cy, radius, draw_color, thickness);
+        draw_circle_c4(pixels, w, h, stride, cx, cy, radius, draw_color, thickness);
         break;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        draw_circle_yuv420sp(pixels, w, h, cx, cy, radius, draw_color, thickness);
+        draw_circle_yuv420sp(pixels, image_uv_plane(image), w, h, stride, cx, cy, radius, draw_color, thickness);
         break;
     default:
         printf("no support format %d", format);
@@ -1619,20 +1608,20 @@ void draw_image(image_buffer_t* image, unsigned char* draw_img, int x, int y, in
 {
     image_format_t format = image->format;
     unsigned char* pixels = image->virt_addr;
-    int w = image->width;
-    int h = image->height;
+    int stride = image_row_bytes(image);
 
     switch (format)
     {
     case IMAGE_FORMAT_RGB888:
-        draw_image_c3(pixels, w, h, draw_img, x, y, rw, rh);
+    case IMAGE_FORMAT_BGR888:
+        draw_image_c3(pixels, stride, draw_img, x, y, rw, rh);
         break;
     case IMAGE_FORMAT_RGBA8888:
-        draw_image_c4(pixels, w, h, draw_img, x, y, rw, rh);
+        draw_image_c4(pixels, stride, draw_img, x, y, rw, rh);
         break;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        draw_image_yuv420sp(pixels, w, h, draw_img, x, y, rw, rh);
+        draw_image_yuv420sp(pixels, image_uv_plane(image), stride, draw_img, x, y, rw, rh);
         break;
     default:
         printf("no support format %d", format);
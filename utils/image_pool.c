@@ -0,0 +1,400 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image_pool.h"
+#include "image_utils.h"
+#include "rga_handle_cache.h"
+#ifdef ENABLE_DMA_HEAP
+#include "dma_alloc.h"
+#endif
+
+#define IMAGE_POOL_MIN_CLASS 4096
+#define IMAGE_POOL_DEFAULT_CACHE (64 * 1024 * 1024)
+#define REGISTRY_BUCKETS 256
+
+typedef struct pool_block_t {
+    image_pool_t* pool;
+    unsigned char* ptr;
+    size_t capacity;            // size class
+    int fd;                     // dma-buf, -1 for heap memory
+    int cpu_cached;             // dma-buf mapped through the CPU cache
+    int refcount;               // 0: cached in the free list of the pool
+    struct pool_block_t* next;  // free list
+    struct pool_block_t* hash_next;
+} pool_block_t;
+
+struct image_pool_t {
+    char dma_heap[128];
+    int use_dma_heap;
+    int cached_heap;
+    size_t max_cached_bytes;
+    pool_block_t* free_blocks;
+    size_t live_blocks;         // blocks with references, keep a destroyed pool alive
+    int destroyed;
+    image_pool_stats_t stats;
+};
+
+// One lock and one address registry for all pools, so any pool buffer can be released by pointer
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_block_t* g_registry[REGISTRY_BUCKETS];
+
+static image_pool_t* g_default_pool;
+static pthread_once_t g_default_pool_once = PTHREAD_ONCE_INIT;
+
+static size_t registry_bucket(const void* ptr)
+{
+    return (size_t)((((uintptr_t)ptr >> 6) * 2654435761u) >> 8) % REGISTRY_BUCKETS;
+}
+
+static pool_block_t* registry_find(const void* ptr)
+{
+    pool_block_t* block = g_registry[registry_bucket(ptr)];
+    while (block != NULL && block->ptr != ptr) {
+        block = block->hash_next;
+    }
+    return block;
+}
+
+static void registry_remove(pool_block_t* block)
+{
+    pool_block_t** link = &g_registry[registry_bucket(block->ptr)];
+    while (*link != block) {
+        link = &(*link)->hash_next;
+    }
+    *link = block->hash_next;
+}
+
+// Sizes between two powers of two are rounded up to quarter steps, a buffer is at most 25% larger
+// than requested and frames of nearby sizes share a class
+static size_t size_class(size_t size)
+{
+    if (size <= IMAGE_POOL_MIN_CLASS) {
+        return IMAGE_POOL_MIN_CLASS;
+    }
+    size_t top = IMAGE_POOL_MIN_CLASS;
+    while (top < size) {
+        top <<= 1;
+    }
+    size_t step = top / 8;
+    return (size + step - 1) / step * step;
+}
+
+static void update_peak(image_pool_t* pool)
+{
+    size_t held = pool->stats.bytes_in_use + pool->stats.cached_bytes;
+    if (held > pool->stats.peak_bytes) {
+        pool->stats.peak_bytes = held;
+    }
+}
+
+// New memory for a block, called without the lock
+static int block_alloc(image_pool_t* pool, int use_dma_heap, size_t capacity, unsigned char** ptr, int* fd)
+{
+#ifdef ENABLE_DMA_HEAP
+    if (use_dma_heap) {
+        void* va = NULL;
+        if (dma_buf_alloc(pool->dma_heap, capacity, fd, &va) == 0) {
+            *ptr = (unsigned char*)va;
+            return 0;
+        }
+        pthread_mutex_lock(&g_pool_lock);
+        if (pool->use_dma_heap) {
+            printf("WARNING: allocate from %s fail, image pool falls back to heap memory\n", pool->dma_heap);
+            pool->use_dma_heap = 0;
+            pool->stats.dma_fallback = 1;
+        }
+        pthread_mutex_unlock(&g_pool_lock);
+    }
+#else
+    (void)pool;
+    (void)use_dma_heap;
+#endif
+    void* mem = NULL;
+    if (posix_memalign(&mem, IMAGE_POOL_ALIGN, capacity) != 0) {
+        return -1;
+    }
+    *ptr = (unsigned char*)mem;
+    *fd = -1;
+    return 0;
+}
+
+static void block_free(pool_block_t* block)
+{
+    // an RGA import of this address or dma-buf would outlive the memory
+    rga_handle_cache_invalidate(block->fd, block->ptr);
+#ifdef ENABLE_DMA_HEAP
+    if (block->fd >= 0) {
+        dma_buf_free(block->capacity, &block->fd, block->ptr);
+        free(block);
+        return;
+    }
+#endif
+    free(block->ptr);
+    free(block);
+}
+
+image_pool_t* image_pool_create(const image_pool_config_t* config)
+{
+    image_pool_t* pool = (image_pool_t*)calloc(1, sizeof(image_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->max_cached_bytes = IMAGE_POOL_DEFAULT_CACHE;
+    if (config != NULL && config->max_cached_bytes > 0) {
+        pool->max_cached_bytes = config->max_cached_bytes;
+    }
+    if (config != NULL && config->dma_heap != NULL) {
+        snprintf(pool->dma_heap, sizeof(pool->dma_heap), "%s", config->dma_heap);
+        pool->cached_heap = strstr(pool->dma_heap, "uncached") == NULL;
+#ifdef ENABLE_DMA_HEAP
+        pool->use_dma_heap = access(pool->dma_heap, R_OK | W_OK) == 0;
+#endif
+        if (!pool->use_dma_heap) {
+            printf("WARNING: %s not available, image pool uses heap memory\n", pool->dma_heap);
+            pool->stats.dma_fallback = 1;
+        }
+    }
+    return pool;
+}
+
+void image_pool_destroy(image_pool_t* pool)
+{
+    if (pool == NULL || pool == g_default_pool) {
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    pool_block_t* cached = pool->free_blocks;
+    pool->free_blocks = NULL;
+    pool->stats.cached_bytes = 0;
+    for (pool_block_t* block = cached; block != NULL; block = block->next) {
+        registry_remove(block);
+    }
+    pool->destroyed = 1;
+    int free_pool = pool->live_blocks == 0;
+    pthread_mutex_unlock(&g_pool_lock);
+
+    while (cached != NULL) {
+        pool_block_t* next = cached->next;
+        block_free(cached);
+        cached = next;
+    }
+    if (free_pool) {
+        free(pool);
+    }
+}
+
+static void create_default_pool(void)
+{
+    g_default_pool = image_pool_create(NULL);
+}
+
+image_pool_t* image_pool_default(void)
+{
+    pthread_once(&g_default_pool_once, create_default_pool);
+    return g_default_pool;
+}
+
+void* image_pool_alloc(image_pool_t* pool, size_t size, int* fd)
+{
+    if (pool == NULL || size == 0) {
+        return NULL;
+    }
+    size_t capacity = size_class(size);
+
+    pthread_mutex_lock(&g_pool_lock);
+    pool_block_t** link = &pool->free_blocks;
+    while (*link != NULL && (*link)->capacity != capacity) {
+        link = &(*link)->next;
+    }
+    pool_block_t* block = *link;
+    if (block != NULL) {
+        *link = block->next;
+        block->next = NULL;
+        block->refcount = 1;
+        pool->live_blocks++;
+        pool->stats.hits++;
+        pool->stats.cached_bytes -= capacity;
+        pool->stats.bytes_in_use += capacity;
+        pthread_mutex_unlock(&g_pool_lock);
+        if (fd != NULL) {
+            *fd = block->fd;
+        }
+        return block->ptr;
+    }
+    int use_dma_heap = pool->use_dma_heap;
+    int cached_heap = pool->cached_heap;
+    pthread_mutex_unlock(&g_pool_lock);
+
+    block = (pool_block_t*)calloc(1, sizeof(pool_block_t));
+    if (block == NULL || block_alloc(pool, use_dma_heap, capacity, &block->ptr, &block->fd) != 0) {
+        printf("ERROR: image pool allocate %zu bytes fail\n", capacity);
+        free(block);
+        return NULL;
+    }
+    block->pool = pool;
+    block->capacity = capacity;
+    block->cpu_cached = block->fd >= 0 && cached_heap;
+    block->refcount = 1;
+
+    pthread_mutex_lock(&g_pool_lock);
+    size_t bucket = registry_bucket(block->ptr);
+    block->hash_next = g_registry[bucket];
+    g_registry[bucket] = block;
+    pool->live_blocks++;
+    pool->stats.misses++;
+    pool->stats.bytes_in_use += capacity;
+    update_peak(pool);
+    pthread_mutex_unlock(&g_pool_lock);
+    if (fd != NULL) {
+        *fd = block->fd;
+    }
+    return block->ptr;
+}
+
+int image_pool_alloc_image(image_pool_t* pool, image_buffer_t* image)
+{
+    if (image == NULL) {
+        return -1;
+    }
+    int size = get_image_size(image);
+    if (size <= 0) {
+        printf("ERROR: image pool: invalid image %dx%d format %d\n", image->width, image->height, image->format);
+        return -1;
+    }
+    int fd = -1;
+    unsigned char* pixels = (unsigned char*)image_pool_alloc(pool, (size_t)size, &fd);
+    if (pixels == NULL) {
+        return -1;
+    }
+    image->virt_addr = pixels;
+    image->size = size;
+    image->fd = fd;
+    return 0;
+}
+
+void image_pool_retain(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    pool_block_t* block = registry_find(ptr);
+    if (block != NULL && block->refcount > 0) {
+        block->refcount++;
+    } else {
+        printf("ERROR: image_pool_retain: %p is not an image pool buffer in use\n", ptr);
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+}
+
+void image_pool_release(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    pool_block_t* block = registry_find(ptr);
+    if (block == NULL || block->refcount <= 0) {
+        pthread_mutex_unlock(&g_pool_lock);
+        printf("ERROR: image_pool_release: %p is not an image pool buffer in use\n", ptr);
+        return;
+    }
+    if (--block->refcount > 0) {
+        pthread_mutex_unlock(&g_pool_lock);
+        return;
+    }
+    image_pool_t* pool = block->pool;
+    pool->live_blocks--;
+    pool->stats.bytes_in_use -= block->capacity;
+    int keep = !pool->destroyed && pool->stats.cached_bytes + block->capacity <= pool->max_cached_bytes;
+    if (keep) {
+        block->next = pool->free_blocks;
+        pool->free_blocks = block;
+        pool->stats.cached_bytes += block->capacity;
+    } else {
+        registry_remove(block);
+    }
+    int free_pool = pool->destroyed && pool->live_blocks == 0;
+    pthread_mutex_unlock(&g_pool_lock);
+
+    if (!keep) {
+        block_free(block);
+    }
+    if (free_pool) {
+        free(pool);
+    }
+}
+
+// dma-buf of a cached buffer in use, -1 if the buffer needs no sync
+static int cached_dma_fd(const void* ptr)
+{
+    if (ptr == NULL) {
+        return -1;
+    }
+    int fd = -1;
+    pthread_mutex_lock(&g_pool_lock);
+    pool_block_t* block = registry_find(ptr);
+    if (block != NULL && block->refcount > 0 && block->cpu_cached) {
+        fd = block->fd;
+        block->pool->stats.cache_syncs++;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+    return fd;
+}
+
+int image_pool_begin_cpu_access(const void* ptr)
+{
+    int fd = cached_dma_fd(ptr);
+    if (fd < 0) {
+        return 0;
+    }
+#ifdef ENABLE_DMA_HEAP
+    if (dma_sync_device_to_cpu(fd) != 0) {
+        printf("ERROR: dma-buf %d sync for CPU fail\n", fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+int image_pool_end_cpu_access(const void* ptr)
+{
+    int fd = cached_dma_fd(ptr);
+    if (fd < 0) {
+        return 0;
+    }
+#ifdef ENABLE_DMA_HEAP
+    if (dma_sync_cpu_to_device(fd) != 0) {
+        printf("ERROR: dma-buf %d sync for device fail\n", fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+image_pool_memory_t image_pool_get_memory(image_pool_t* pool)
+{
+    if (pool == NULL) {
+        return IMAGE_POOL_MEMORY_HEAP;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    image_pool_memory_t memory = IMAGE_POOL_MEMORY_HEAP;
+    if (pool->use_dma_heap) {
+        memory = pool->cached_heap ? IMAGE_POOL_MEMORY_DMA_CACHED : IMAGE_POOL_MEMORY_DMA_UNCACHED;
+    }
+    pthread_mutex_unlock(&g_pool_lock);
+    return memory;
+}
+
+void image_pool_get_stats(image_pool_t* pool, image_pool_stats_t* stats)
+{
+    if (pool == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_pool_lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&g_pool_lock);
+}
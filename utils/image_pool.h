@@ -0,0 +1,146 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_POOL_H_
+#define _RKNN_MODEL_ZOO_IMAGE_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_POOL_ALIGN 64
+
+// DMA heaps of image_pool_config_t, DMA_HEAP_PATH and DMA_HEAP_UNCACHE_PATH of dma_alloc.h
+#define IMAGE_POOL_DMA_HEAP_CACHED      "/dev/dma_heap/system"
+#define IMAGE_POOL_DMA_HEAP_UNCACHED    "/dev/dma_heap/system-uncached"
+
+typedef struct image_pool_t image_pool_t;
+
+typedef enum {
+    IMAGE_POOL_MEMORY_HEAP = 0,         // malloc memory, no dma-buf
+    IMAGE_POOL_MEMORY_DMA_CACHED,       // dma-buf mapped through the CPU cache, synced around CPU access
+    IMAGE_POOL_MEMORY_DMA_UNCACHED,     // dma-buf mapped uncached, CPU access needs no sync but is slow to read
+} image_pool_memory_t;
+
+/**
+ * @brief Configuration of image_pool_create
+ *
+ */
+typedef struct {
+    const char* dma_heap;       // DMA heap device (e.g. DMA_HEAP_PATH of dma_alloc.h) to back every buffer with
+                                // a dma-buf, NULL: heap memory. Falls back to heap memory when the heap is missing.
+                                // Heaps named *uncached* are mapped without the CPU cache
+    size_t max_cached_bytes;    // released buffers kept for reuse, 0: 64 MB
+} image_pool_config_t;
+
+typedef struct {
+    uint64_t hits;              // allocations served by a released buffer of the same size class
+    uint64_t misses;            // allocations that reached malloc or the DMA heap
+    size_t bytes_in_use;
+    size_t cached_bytes;
+    size_t peak_bytes;          // most memory held at once, in use and cached
+    uint64_t cache_syncs;       // begin/end CPU access calls that reached a cached dma-buf
+    int dma_fallback;           // the DMA heap could not be used, buffers are heap memory
+} image_pool_stats_t;
+
+/**
+ * @brief Create a pool of image buffers, sizes are rounded up to classes at most 25% apart
+ *
+ * Buffers are IMAGE_POOL_ALIGN aligned. A released buffer goes back to its size class and is handed
+ * out again by the next allocation of that class, so steady state frame loops do not reach malloc.
+ *
+ * @param config [in] Configuration, NULL: heap memory, 64 MB cache
+ * @return image_pool_t* Pool, NULL on error
+ */
+image_pool_t* image_pool_create(const image_pool_config_t* config);
+
+/**
+ * @brief Free the cached buffers, buffers still in use are freed by their last release
+ *
+ * @param pool [in] Pool
+ */
+void image_pool_destroy(image_pool_t* pool);
+
+/**
+ * @brief Process wide heap memory pool, used by the utils for their internal frame buffers
+ *
+ * @return image_pool_t* Pool, never destroyed
+ */
+image_pool_t* image_pool_default(void);
+
+/**
+ * @brief Allocate a buffer with a reference count of 1, contents are undefined
+ *
+ * @param pool [in] Pool
+ * @param size [in] Bytes
+ * @param fd [out] dma-buf of the buffer or -1 for heap memory, can be NULL
+ * @return void* Buffer, NULL on error
+ */
+void* image_pool_alloc(image_pool_t* pool, size_t size, int* fd);
+
+/**
+ * @brief Allocate the pixels of an image from its layout, sets virt_addr, size and fd
+ *
+ * @param pool [in] Pool
+ * @param image [in/out] Image with width, height, strides and format set
+ * @return int 0: success; -1: error
+ */
+int image_pool_alloc_image(image_pool_t* pool, image_buffer_t* image);
+
+/**
+ * @brief Take another reference, e.g. when a frame is shared by two pipeline stages
+ *
+ * @param ptr [in] Buffer from image_pool_alloc
+ */
+void image_pool_retain(void* ptr);
+
+/**
+ * @brief Drop a reference, the last one returns the buffer to its pool
+ *
+ * @param ptr [in] Buffer from image_pool_alloc of any pool, NULL is ignored
+ */
+void image_pool_release(void* ptr);
+
+/**
+ * @brief Start CPU access to a buffer the NPU, RGA or a camera may have written
+ *
+ * Invalidates the CPU cache of a dma-buf from a cached heap. Heap memory and uncached dma-bufs
+ * need nothing and return at once, so callers sync every buffer they touch with the CPU and
+ * buffers only passed between devices are never synced.
+ *
+ * @param ptr [in] Buffer from image_pool_alloc, other addresses are ignored
+ * @return int 0: success; -1: sync error
+ */
+int image_pool_begin_cpu_access(const void* ptr);
+
+/**
+ * @brief End CPU access, writes back the CPU cache of a cached dma-buf for the devices
+ *
+ * @param ptr [in] Buffer from image_pool_alloc, other addresses are ignored
+ * @return int 0: success; -1: sync error
+ */
+int image_pool_end_cpu_access(const void* ptr);
+
+/**
+ * @brief Memory that backs the buffers of a pool, HEAP after a DMA heap fallback
+ *
+ * @param pool [in] Pool
+ * @return image_pool_memory_t Memory type
+ */
+image_pool_memory_t image_pool_get_memory(image_pool_t* pool);
+
+/**
+ * @brief Allocation counters
+ *
+ * @param pool [in] Pool
+ * @param stats [out] Counters
+ */
+void image_pool_get_stats(image_pool_t* pool, image_pool_stats_t* stats);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_POOL_H_
@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_prefetch.h"
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_DECODING,
+    SLOT_READY,
+    SLOT_DELIVERED,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    image_decoder_t* decoder;   // the image pixels live in its pooled output
+    image_prefetch_item_t item;
+} prefetch_slot_t;
+
+struct image_prefetcher_t {
+    const char* const* paths;
+    int num_paths;
+    int ordered;
+    image_read_options_t read_options;
+
+    prefetch_slot_t* slots;
+    int num_slots;
+    pthread_t* threads;
+    int num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // a slot was freed or stop was set
+    pthread_cond_t ready_cond;  // a slot finished decoding
+    int next_claim;             // next path index to decode
+    int next_deliver;           // next path index to deliver in ordered mode
+    int delivered;
+    int stop;
+};
+
+static prefetch_slot_t* find_slot(image_prefetcher_t* prefetcher, slot_state_t state)
+{
+    for (int i = 0; i < prefetcher->num_slots; i++) {
+        if (prefetcher->slots[i].state == state) {
+            return &prefetcher->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void* prefetch_worker(void* arg)
+{
+    image_prefetcher_t* prefetcher = (image_prefetcher_t*)arg;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    while (1) {
+        prefetch_slot_t* slot = NULL;
+        while (!prefetcher->stop && prefetcher->next_claim < prefetcher->num_paths &&
+               (slot = find_slot(prefetcher, SLOT_FREE)) == NULL) {
+            pthread_cond_wait(&prefetcher->work_cond, &prefetcher->lock);
+        }
+        if (prefetcher->stop || prefetcher->next_claim >= prefetcher->num_paths) {
+            break;
+        }
+        // paths are claimed in list order, so the next image to deliver is always decoded first
+        int index = prefetcher->next_claim++;
+        slot->state = SLOT_DECODING;
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        image_prefetch_item_t* item = &slot->item;
+        item->index = index;
+        item->path = prefetcher->paths[index];
+        memset(&item->image, 0, sizeof(item->image));
+        memset(&item->info, 0, sizeof(item->info));
+        item->status = image_decoder_read(slot->decoder, item->path, &item->image, &prefetcher->read_options, &item->info);
+        if (item->status != 0) {
+            printf("ERROR: prefetch read image %s fail\n", item->path);
+            memset(&item->image, 0, sizeof(item->image));
+        }
+
+        pthread_mutex_lock(&prefetcher->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&prefetcher->ready_cond);
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+    return NULL;
+}
+
+// Ready slot to hand out next, NULL if it is still being decoded
+static prefetch_slot_t* next_ready_slot(image_prefetcher_t* prefetcher)
+{
+    prefetch_slot_t* best = NULL;
+    for (int i = 0; i < prefetcher->num_slots; i++) {
+        prefetch_slot_t* slot = &prefetcher->slots[i];
+        if (slot->state != SLOT_READY) {
+            continue;
+        }
+        if (prefetcher->ordered) {
+            if (slot->item.index == prefetcher->next_deliver) {
+                return slot;
+            }
+        } else if (best == NULL || slot->item.index < best->item.index) {
+            best = slot;
+        }
+    }
+    return best;
+}
+
+image_prefetcher_t* image_prefetcher_create(const char* const* paths, int num_paths, const image_prefetch_config_t* config)
+{
+    if (paths == NULL || num_paths < 0) {
+        printf("ERROR: invalid prefetch image list\n");
+        return NULL;
+    }
+    image_prefetch_config_t cfg;
+    if (config != NULL) {
+        cfg = *config;
+    } else {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.lookahead = 2;
+        cfg.ordered = 1;
+    }
+    if (cfg.num_threads <= 0) {
+        cfg.num_threads = 1;
+    }
+    if (cfg.lookahead < cfg.num_threads) {
+        cfg.lookahead = cfg.num_threads;
+    }
+
+    image_prefetcher_t* prefetcher = (image_prefetcher_t*)calloc(1, sizeof(image_prefetcher_t));
+    if (prefetcher == NULL) {
+        return NULL;
+    }
+    prefetcher->paths = paths;
+    prefetcher->num_paths = num_paths;
+    prefetcher->ordered = cfg.ordered;
+    prefetcher->read_options = cfg.read_options;
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->work_cond, NULL);
+    pthread_cond_init(&prefetcher->ready_cond, NULL);
+
+    prefetcher->slots = (prefetch_slot_t*)calloc(cfg.lookahead, sizeof(prefetch_slot_t));
+    prefetcher->threads = (pthread_t*)calloc(cfg.num_threads, sizeof(pthread_t));
+    if (prefetcher->slots == NULL || prefetcher->threads == NULL) {
+        printf("ERROR: allocate prefetch slots fail\n");
+        image_prefetcher_destroy(prefetcher);
+        return NULL;
+    }
+    for (int i = 0; i < cfg.lookahead; i++) {
+        prefetcher->slots[i].decoder = image_decoder_create();
+        if (prefetcher->slots[i].decoder == NULL) {
+            image_prefetcher_destroy(prefetcher);
+            return NULL;
+        }
+        prefetcher->num_slots++;
+    }
+    for (int i = 0; i < cfg.num_threads; i++) {
+        if (pthread_create(&prefetcher->threads[i], NULL, prefetch_worker, prefetcher) != 0) {
+            printf("ERROR: create prefetch thread %d fail\n", i);
+            image_prefetcher_destroy(prefetcher);
+            return NULL;
+        }
+        prefetcher->num_threads++;
+    }
+    return prefetcher;
+}
+
+int image_prefetcher_next(image_prefetcher_t* prefetcher, image_prefetch_item_t** item)
+{
+    if (prefetcher == NULL || item == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&prefetcher->lock);
+    if (prefetcher->delivered >= prefetcher->num_paths) {
+        ret = 1;
+        goto out;
+    }
+    prefetch_slot_t* slot;
+    while ((slot = next_ready_slot(prefetcher)) == NULL) {
+        if (find_slot(prefetcher, SLOT_DECODING) == NULL && find_slot(prefetcher, SLOT_FREE) == NULL) {
+            printf("ERROR: all %d prefetch slots are held by the consumer, release items first\n", prefetcher->num_slots);
+            ret = -1;
+            goto out;
+        }
+        pthread_cond_wait(&prefetcher->ready_cond, &prefetcher->lock);
+    }
+    slot->state = SLOT_DELIVERED;
+    if (slot->item.index == prefetcher->next_deliver) {
+        prefetcher->next_deliver++;
+    }
+    prefetcher->delivered++;
+    *item = &slot->item;
+
+out:
+    pthread_mutex_unlock(&prefetcher->lock);
+    return ret;
+}
+
+void image_prefetcher_release(image_prefetcher_t* prefetcher, image_prefetch_item_t* item)
+{
+    if (prefetcher == NULL || item == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&prefetcher->lock);
+    for (int i = 0; i < prefetcher->num_slots; i++) {
+        prefetch_slot_t* slot = &prefetcher->slots[i];
+        if (&slot->item == item && slot->state == SLOT_DELIVERED) {
+            slot->state = SLOT_FREE;
+            pthread_cond_signal(&prefetcher->work_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+void image_prefetcher_destroy(image_prefetcher_t* prefetcher)
+{
+    if (prefetcher == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->stop = 1;
+    pthread_cond_broadcast(&prefetcher->work_cond);
+    pthread_mutex_unlock(&prefetcher->lock);
+    for (int i = 0; i < prefetcher->num_threads; i++) {
+        pthread_join(prefetcher->threads[i], NULL);
+    }
+    for (int i = 0; i < prefetcher->num_slots; i++) {
+        image_decoder_destroy(prefetcher->slots[i].decoder);
+    }
+    pthread_cond_destroy(&prefetcher->work_cond);
+    pthread_cond_destroy(&prefetcher->ready_cond);
+    pthread_mutex_destroy(&prefetcher->lock);
+    free(prefetcher->threads);
+    free(prefetcher->slots);
+    free(prefetcher);
+}
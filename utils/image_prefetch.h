@@ -0,0 +1,79 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_PREFETCH_H_
+#define _RKNN_MODEL_ZOO_IMAGE_PREFETCH_H_
+
+#include "common.h"
+#include "image_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct image_prefetcher_t image_prefetcher_t;
+
+/**
+ * @brief Configuration of image_prefetcher_create
+ *
+ */
+typedef struct {
+    int num_threads;    // decode threads, <= 0: 1
+    int lookahead;      // decoded images that may wait for the consumer, < num_threads: num_threads
+    int ordered;        // 1: deliver in list order; 0: deliver as soon as decoded
+    image_read_options_t read_options;
+} image_prefetch_config_t;
+
+/**
+ * @brief One decoded image, owned by the prefetcher until image_prefetcher_release
+ *
+ */
+typedef struct {
+    int index;              // position in the path list
+    const char* path;
+    int status;             // 0: decoded; -1: read fail, image is empty
+    image_buffer_t image;
+    image_read_info_t info;
+} image_prefetch_item_t;
+
+/**
+ * @brief Start decoding a list of images in the background
+ *
+ * Every lookahead slot keeps its own image_decoder_t, so once the slots have seen the largest
+ * image, decoding performs no allocation in the prefetcher.
+ *
+ * @param paths [in] Image paths, must outlive the prefetcher
+ * @param num_paths [in] Number of paths
+ * @param config [in] Configuration, NULL: 1 thread, lookahead 2, ordered, full resolution
+ * @return image_prefetcher_t* Prefetcher, NULL on error
+ */
+image_prefetcher_t* image_prefetcher_create(const char* const* paths, int num_paths, const image_prefetch_config_t* config);
+
+/**
+ * @brief Wait for the next decoded image
+ *
+ * At most lookahead items can be held by the consumer at the same time, release them when done.
+ *
+ * @param prefetcher [in] Prefetcher
+ * @param item [out] Decoded image
+ * @return int 0: item returned; 1: all images delivered; -1: error
+ */
+int image_prefetcher_next(image_prefetcher_t* prefetcher, image_prefetch_item_t** item);
+
+/**
+ * @brief Give an item back, its pixels are reused for a following image
+ *
+ * @param prefetcher [in] Prefetcher
+ * @param item [in] Item from image_prefetcher_next
+ */
+void image_prefetcher_release(image_prefetcher_t* prefetcher, image_prefetch_item_t* item);
+
+/**
+ * @brief Stop the decode threads and free everything, outstanding items become invalid
+ *
+ * @param prefetcher [in] Prefetcher
+ */
+void image_prefetcher_destroy(image_prefetcher_t* prefetcher);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_PREFETCH_H_
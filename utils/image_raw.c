@@ -0,0 +1,245 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image_raw.h"
+
+struct image_raw_file_t {
+    unsigned char* data;
+    size_t size;
+    uint64_t* offsets;      // header offset of every frame
+    int num_frames;
+};
+
+struct image_raw_writer_t {
+    FILE* fp;
+};
+
+static uint64_t align_up(uint64_t size)
+{
+    return (size + IMAGE_RAW_ALIGN - 1) & ~(uint64_t)(IMAGE_RAW_ALIGN - 1);
+}
+
+// Bytes of one frame in memory, 0 for formats a raw frame cannot hold. Computed in 64 bit so a
+// corrupt header cannot wrap it below its payload_size.
+static uint64_t frame_bytes(uint32_t format, uint64_t width_stride, uint64_t height_stride)
+{
+    uint64_t pixels = width_stride * height_stride;
+    switch (format)
+    {
+    case IMAGE_FORMAT_GRAY8:
+        return pixels;
+    case IMAGE_FORMAT_RGB888:
+    case IMAGE_FORMAT_BGR888:
+        return pixels * 3;
+    case IMAGE_FORMAT_RGBA8888:
+        return pixels * 4;
+    case IMAGE_FORMAT_YUYV:
+    case IMAGE_FORMAT_RGB565:
+        return pixels * 2;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+    case IMAGE_FORMAT_YUV420P:
+        return pixels * 3 / 2;
+    default:
+        return 0;
+    }
+}
+
+// The header is stored little endian, same as every target this code runs on
+int image_raw_parse_header(const void* data, uint64_t size, image_raw_header_t* header)
+{
+    if (size < IMAGE_RAW_HEADER_SIZE) {
+        return -1;
+    }
+    memcpy(header, data, sizeof(*header));
+    if (header->magic != IMAGE_RAW_MAGIC || header->header_size < IMAGE_RAW_HEADER_SIZE ||
+        header->width == 0 || header->height == 0 ||
+        header->width_stride < header->width || header->height_stride < header->height ||
+        header->width_stride > IMAGE_RAW_MAX_DIM || header->height_stride > IMAGE_RAW_MAX_DIM) {
+        return -1;
+    }
+    uint64_t need = frame_bytes(header->format, header->width_stride, header->height_stride);
+    if (need == 0 || header->payload_size < need) {
+        return -1;
+    }
+    return 0;
+}
+
+image_raw_file_t* image_raw_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: open raw file %s fail\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < IMAGE_RAW_HEADER_SIZE) {
+        printf("ERROR: raw file %s is too small\n", path);
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    // private writable mapping: pixels are used in place and writes never reach the file
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("ERROR: mmap raw file %s fail\n", path);
+        return NULL;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    image_raw_file_t* file = (image_raw_file_t*)calloc(1, sizeof(image_raw_file_t));
+    if (file == NULL) {
+        munmap(data, size);
+        return NULL;
+    }
+    file->data = (unsigned char*)data;
+    file->size = size;
+
+    // first pass counts, second pass records the offsets
+    for (int pass = 0; pass < 2; pass++) {
+        uint64_t offset = 0;
+        int count = 0;
+        image_raw_header_t header;
+        while (image_raw_parse_header(file->data + offset, size - offset, &header) == 0) {
+            // compare against the bytes left instead of summing, a corrupt payload_size would wrap the sum
+            uint64_t left = size - offset;
+            if (header.header_size > left || header.payload_size > left - header.header_size) {
+                if (pass == 0) {
+                    printf("WARNING: raw file %s frame %d is truncated, ignored\n", path, count);
+                }
+                break;
+            }
+            if (pass == 1) {
+                file->offsets[count] = offset;
+            }
+            count++;
+            offset = align_up(offset + header.header_size + header.payload_size);
+            if (offset >= size) {
+                break;
+            }
+        }
+        if (pass == 0) {
+            if (count == 0) {
+                printf("ERROR: %s is not a raw frame file\n", path);
+                image_raw_close(file);
+                return NULL;
+            }
+            file->offsets = (uint64_t*)malloc(count * sizeof(uint64_t));
+            if (file->offsets == NULL) {
+                image_raw_close(file);
+                return NULL;
+            }
+        }
+        file->num_frames = count;
+    }
+    return file;
+}
+
+void image_raw_close(image_raw_file_t* file)
+{
+    if (file == NULL) {
+        return;
+    }
+    if (file->data != NULL) {
+        munmap(file->data, file->size);
+    }
+    free(file->offsets);
+    free(file);
+}
+
+int image_raw_num_frames(const image_raw_file_t* file)
+{
+    return file != NULL ? file->num_frames : 0;
+}
+
+int image_raw_get_frame(const image_raw_file_t* file, int index, image_buffer_t* image, uint64_t* timestamp_us)
+{
+    if (file == NULL || image == NULL || index < 0 || index >= file->num_frames) {
+        printf("ERROR: invalid raw frame index %d\n", index);
+        return -1;
+    }
+    image_raw_header_t header;
+    unsigned char* frame = file->data + file->offsets[index];
+    image_raw_parse_header(frame, file->size - file->offsets[index], &header);
+
+    memset(image, 0, sizeof(image_buffer_t));
+    image->width = (int)header.width;
+    image->height = (int)header.height;
+    image->width_stride = (int)header.width_stride;
+    image->height_stride = (int)header.height_stride;
+    image->format = (image_format_t)header.format;
+    image->color_space = (image_color_space_t)header.color_space;
+    image->virt_addr = frame + header.header_size;
+    // the pixels, payload_size may include trailing bytes and is not bounded by IMAGE_RAW_MAX_DIM
+    image->size = (int)frame_bytes(header.format, header.width_stride, header.height_stride);
+    if (timestamp_us != NULL) {
+        *timestamp_us = header.timestamp_us;
+    }
+    return 0;
+}
+
+image_raw_writer_t* image_raw_writer_open(const char* path)
+{
+    image_raw_writer_t* writer = (image_raw_writer_t*)calloc(1, sizeof(image_raw_writer_t));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->fp = fopen(path, "wb");
+    if (writer->fp == NULL) {
+        printf("ERROR: open raw file %s for write fail\n", path);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int image_raw_writer_append(image_raw_writer_t* writer, const image_buffer_t* image, uint64_t timestamp_us)
+{
+    static const unsigned char zeros[IMAGE_RAW_ALIGN] = {0};
+    if (writer == NULL || image == NULL || image->virt_addr == NULL) {
+        return -1;
+    }
+    image_raw_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IMAGE_RAW_MAGIC;
+    header.header_size = IMAGE_RAW_HEADER_SIZE;
+    header.width = (uint32_t)image->width;
+    header.height = (uint32_t)image->height;
+    header.width_stride = (uint32_t)(image->width_stride > 0 ? image->width_stride : image->width);
+    header.height_stride = (uint32_t)(image->height_stride > 0 ? image->height_stride : image->height);
+    header.format = (uint32_t)image->format;
+    header.color_space = (uint32_t)image->color_space;
+    header.timestamp_us = timestamp_us;
+    uint64_t bytes = frame_bytes(header.format, header.width_stride, header.height_stride);
+    if (bytes == 0 || header.width_stride > IMAGE_RAW_MAX_DIM || header.height_stride > IMAGE_RAW_MAX_DIM ||
+        (image->size > 0 && (uint64_t)image->size < bytes)) {
+        printf("ERROR: raw frame format %d or size %d not supported\n", image->format, image->size);
+        return -1;
+    }
+    header.payload_size = bytes;
+
+    size_t pad = (size_t)(align_up(header.payload_size) - header.payload_size);
+    if (fwrite(&header, sizeof(header), 1, writer->fp) != 1 ||
+        fwrite(image->virt_addr, 1, (size_t)bytes, writer->fp) != (size_t)bytes ||
+        (pad > 0 && fwrite(zeros, 1, pad, writer->fp) != pad)) {
+        printf("ERROR: write raw frame fail\n");
+        return -1;
+    }
+    return 0;
+}
+
+int image_raw_writer_close(image_raw_writer_t* writer)
+{
+    if (writer == NULL) {
+        return -1;
+    }
+    int ret = fclose(writer->fp) == 0 ? 0 : -1;
+    free(writer);
+    return ret;
+}
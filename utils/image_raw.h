@@ -0,0 +1,119 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_RAW_H_
+#define _RKNN_MODEL_ZOO_IMAGE_RAW_H_
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_RAW_MAGIC 0x46524b52u     // "RKRF" in file byte order
+#define IMAGE_RAW_HEADER_SIZE 64
+#define IMAGE_RAW_ALIGN 64              // payloads are padded so every header and payload is 64 byte aligned
+#define IMAGE_RAW_MAX_DIM 16384         // width_stride/height_stride limit, a frame always fits in an int size
+
+/**
+ * @brief Header in front of every frame of a raw .data file, little endian
+ *
+ * A file is a sequence of frames, each one is this header followed by payload_size pixel bytes and
+ * padding up to IMAGE_RAW_ALIGN. A single frame file is the same layout with one frame, files
+ * without the magic are legacy headerless .data.
+ */
+typedef struct {
+    uint32_t magic;             // IMAGE_RAW_MAGIC
+    uint32_t header_size;       // IMAGE_RAW_HEADER_SIZE, payload starts header_size bytes after the header
+    uint32_t width;
+    uint32_t height;
+    uint32_t width_stride;      // pixels per row in memory, >= width
+    uint32_t height_stride;     // rows per plane in memory, >= height
+    uint32_t format;            // image_format_t
+    uint32_t color_space;       // image_color_space_t
+    uint64_t payload_size;      // pixel bytes
+    uint64_t timestamp_us;      // capture time, 0 if unknown
+    uint8_t reserved[16];
+} image_raw_header_t;
+
+typedef struct image_raw_file_t image_raw_file_t;
+typedef struct image_raw_writer_t image_raw_writer_t;
+
+/**
+ * @brief Map a raw .data file and index its frames
+ *
+ * The mapping is private copy-on-write: frames are used in place without copying, writing into
+ * a frame (e.g. drawing) only touches a private copy of the page, the file is never modified.
+ * A truncated last frame (interrupted capture) is ignored.
+ *
+ * @param path [in] File path
+ * @return image_raw_file_t* Mapped file, NULL on error or when the file has no header
+ */
+image_raw_file_t* image_raw_open(const char* path);
+
+/**
+ * @brief Unmap the file, frames returned by image_raw_get_frame become invalid
+ *
+ * @param file [in] Mapped file
+ */
+void image_raw_close(image_raw_file_t* file);
+
+/**
+ * @brief Number of complete frames in the file
+ *
+ * @param file [in] Mapped file
+ * @return int Frame count
+ */
+int image_raw_num_frames(const image_raw_file_t* file);
+
+/**
+ * @brief Wrap one frame as an image without copying
+ *
+ * @param file [in] Mapped file
+ * @param index [in] Frame index
+ * @param image [out] Image pointing into the mapping
+ * @param timestamp_us [out] Capture time, can be NULL
+ * @return int 0: success; -1: error
+ */
+int image_raw_get_frame(const image_raw_file_t* file, int index, image_buffer_t* image, uint64_t* timestamp_us);
+
+/**
+ * @brief Check a buffer for a raw frame header
+ *
+ * @param data [in] Start of the file or frame
+ * @param size [in] Bytes available
+ * @param header [out] Parsed header
+ * @return int 0: valid header; -1: not a raw frame
+ */
+int image_raw_parse_header(const void* data, uint64_t size, image_raw_header_t* header);
+
+/**
+ * @brief Create (truncate) a raw .data file to append frames to
+ *
+ * @param path [in] File path
+ * @return image_raw_writer_t* Writer, NULL on error
+ */
+image_raw_writer_t* image_raw_writer_open(const char* path);
+
+/**
+ * @brief Append one frame, width_stride/height_stride of 0 mean width/height
+ *
+ * @param writer [in] Writer
+ * @param image [in] Frame
+ * @param timestamp_us [in] Capture time, 0 if unknown
+ * @return int 0: success; -1: error
+ */
+int image_raw_writer_append(image_raw_writer_t* writer, const image_buffer_t* image, uint64_t timestamp_us);
+
+/**
+ * @brief Flush and close the file
+ *
+ * @param writer [in] Writer
+ * @return int 0: success; -1: error
+ */
+int image_raw_writer_close(image_raw_writer_t* writer);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_RAW_H_
@@ -0,0 +1,783 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_resize.h"
+
+// vertical pass: Q11 weight x (value << 7) row, rounded back to 8 bit
+#define RESIZE_VERT_SHIFT (2 * RESIZE_WEIGHT_BITS - RESIZE_ROW_SHIFT)
+#define RESIZE_VERT_ROUND (1 << (RESIZE_VERT_SHIFT - 1))
+
+static void compute_axis(int src_size, int dst_size, int step, int* ofs, short* alpha)
+{
+    float ratio = (float)src_size / (float)dst_size;
+    for (int d = 0; d < dst_size; d++) {
+        float f = d * ratio;
+        int s0 = (int)f;
+        int a = (int)((f - s0) * RESIZE_WEIGHT_ONE + 0.5f);
+        if (a >= RESIZE_WEIGHT_ONE) {
+            s0++;
+            a = 0;
+        }
+        if (s0 > src_size - 1) {
+            s0 = src_size - 1;
+        }
+        int s1 = (s0 + 1 < src_size) ? s0 + 1 : s0;
+        if (s1 == s0) {
+            a = 0;
+        }
+        ofs[d * 2] = s0 * step;
+        ofs[d * 2 + 1] = s1 * step;
+        alpha[d] = (short)a;
+    }
+}
+
+int resize_table_init(resize_table_t* table, int channels, int src_width, int src_height, int dst_width, int dst_height)
+{
+    if (table == NULL || channels < 1 || channels > 4 || src_width <= 0 || src_height <= 0 ||
+        dst_width <= 0 || dst_height <= 0) {
+        printf("ERROR: invalid resize table geometry %dx%d -> %dx%d channel=%d\n",
+            src_width, src_height, dst_width, dst_height, channels);
+        return -1;
+    }
+    size_t x_bytes = (size_t)dst_width * (2 * sizeof(int) + sizeof(short));
+    size_t y_bytes = (size_t)dst_height * (2 * sizeof(int) + sizeof(short));
+    unsigned char* mem = (unsigned char*)malloc(x_bytes + y_bytes);
+    if (mem == NULL) {
+        printf("ERROR: malloc resize table fail!\n");
+        return -1;
+    }
+
+    table->channels = channels;
+    table->src_width = src_width;
+    table->src_height = src_height;
+    table->dst_width = dst_width;
+    table->dst_height = dst_height;
+    table->isa = RESIZE_ISA_AUTO;
+    // ints first so every array stays naturally aligned
+    table->x_ofs = (int*)mem;
+    table->y_ofs = table->x_ofs + dst_width * 2;
+    table->x_alpha = (short*)(table->y_ofs + dst_height * 2);
+    table->y_alpha = table->x_alpha + dst_width;
+
+    compute_axis(src_width, dst_width, channels, table->x_ofs, table->x_alpha);
+    compute_axis(src_height, dst_height, 1, table->y_ofs, table->y_alpha);
+    return 0;
+}
+
+void resize_table_release(resize_table_t* table)
+{
+    if (table == NULL) {
+        return;
+    }
+    // x_ofs is the start of the single allocation
+    if (table->x_ofs != NULL) {
+        free(table->x_ofs);
+    }
+    memset(table, 0, sizeof(resize_table_t));
+}
+
+int resize_scratch_size(const resize_table_t* table)
+{
+    return 2 * table->dst_width * table->channels;
+}
+
+// Horizontal pass, one loop per channel count so the inner loop is fully unrolled. The gathers
+// through x_ofs do not vectorize, the arithmetic is cheap next to the vertical pass which is SIMD.
+static void hresize_row(const resize_table_t* table, const uint8_t* src, short* out)
+{
+    const int* ofs = table->x_ofs;
+    const short* alpha = table->x_alpha;
+    int n = table->dst_width;
+
+#define HRESIZE_PIXEL(c) out[c] = (short)((s0[c] * b + s1[c] * a) >> RESIZE_ROW_SHIFT)
+    switch (table->channels) {
+    case 1:
+        for (int dx = 0; dx < n; dx++, out += 1) {
+            int a = alpha[dx], b = RESIZE_WEIGHT_ONE - a;
+            const uint8_t* s0 = src + ofs[dx * 2];
+            const uint8_t* s1 = src + ofs[dx * 2 + 1];
+            HRESIZE_PIXEL(0);
+        }
+        break;
+    case 2:
+        for (int dx = 0; dx < n; dx++, out += 2) {
+            int a = alpha[dx], b = RESIZE_WEIGHT_ONE - a;
+            const uint8_t* s0 = src + ofs[dx * 2];
+            const uint8_t* s1 = src + ofs[dx * 2 + 1];
+            HRESIZE_PIXEL(0);
+            HRESIZE_PIXEL(1);
+        }
+        break;
+    case 3:
+        for (int dx = 0; dx < n; dx++, out += 3) {
+            int a = alpha[dx], b = RESIZE_WEIGHT_ONE - a;
+            const uint8_t* s0 = src + ofs[dx * 2];
+            const uint8_t* s1 = src + ofs[dx * 2 + 1];
+            HRESIZE_PIXEL(0);
+            HRESIZE_PIXEL(1);
+            HRESIZE_PIXEL(2);
+        }
+        break;
+    default:
+        for (int dx = 0; dx < n; dx++, out += 4) {
+            int a = alpha[dx], b = RESIZE_WEIGHT_ONE - a;
+            const uint8_t* s0 = src + ofs[dx * 2];
+            const uint8_t* s1 = src + ofs[dx * 2 + 1];
+            HRESIZE_PIXEL(0);
+            HRESIZE_PIXEL(1);
+            HRESIZE_PIXEL(2);
+            HRESIZE_PIXEL(3);
+        }
+        break;
+    }
+#undef HRESIZE_PIXEL
+}
+
+// Vertical pass: dst = (r0 * (1 - a) + r1 * a + round) >> shift. Products fit in int32 so every
+// implementation below is bit-exact with the C one.
+typedef void (*vresize_fn)(const short* r0, const short* r1, int a, uint8_t* dst, int n);
+
+static void vresize_row_c(const short* r0, const short* r1, int a, uint8_t* dst, int n)
+{
+    int b = RESIZE_WEIGHT_ONE - a;
+    for (int i = 0; i < n; i++) {
+        dst[i] = (uint8_t)((r0[i] * b + r1[i] * a + RESIZE_VERT_ROUND) >> RESIZE_VERT_SHIFT);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static void vresize_row_sse2(const short* r0, const short* r1, int a, uint8_t* dst, int n)
+{
+    int b = RESIZE_WEIGHT_ONE - a;
+    // (b, a) pairs for madd against interleaved (r0, r1)
+    __m128i w = _mm_set1_epi32((a << 16) | (b & 0xffff));
+    __m128i round = _mm_set1_epi32(RESIZE_VERT_ROUND);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x0 = _mm_loadu_si128((const __m128i*)(r0 + i));
+        __m128i y0 = _mm_loadu_si128((const __m128i*)(r1 + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(r0 + i + 8));
+        __m128i y1 = _mm_loadu_si128((const __m128i*)(r1 + i + 8));
+        __m128i s0 = _mm_madd_epi16(_mm_unpacklo_epi16(x0, y0), w);
+        __m128i s1 = _mm_madd_epi16(_mm_unpackhi_epi16(x0, y0), w);
+        __m128i s2 = _mm_madd_epi16(_mm_unpacklo_epi16(x1, y1), w);
+        __m128i s3 = _mm_madd_epi16(_mm_unpackhi_epi16(x1, y1), w);
+        s0 = _mm_srai_epi32(_mm_add_epi32(s0, round), RESIZE_VERT_SHIFT);
+        s1 = _mm_srai_epi32(_mm_add_epi32(s1, round), RESIZE_VERT_SHIFT);
+        s2 = _mm_srai_epi32(_mm_add_epi32(s2, round), RESIZE_VERT_SHIFT);
+        s3 = _mm_srai_epi32(_mm_add_epi32(s3, round), RESIZE_VERT_SHIFT);
+        __m128i v = _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+    vresize_row_c(r0 + i, r1 + i, a, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void vresize_row_avx2(const short* r0, const short* r1, int a, uint8_t* dst, int n)
+{
+    int b = RESIZE_WEIGHT_ONE - a;
+    __m256i w = _mm256_set1_epi32((a << 16) | (b & 0xffff));
+    __m256i round = _mm256_set1_epi32(RESIZE_VERT_ROUND);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i*)(r0 + i));
+        __m256i y0 = _mm256_loadu_si256((const __m256i*)(r1 + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i*)(r0 + i + 16));
+        __m256i y1 = _mm256_loadu_si256((const __m256i*)(r1 + i + 16));
+        // unpack/pack work per 128-bit lane, so the halves come back in order after packs_epi32
+        __m256i s0 = _mm256_madd_epi16(_mm256_unpacklo_epi16(x0, y0), w);
+        __m256i s1 = _mm256_madd_epi16(_mm256_unpackhi_epi16(x0, y0), w);
+        __m256i s2 = _mm256_madd_epi16(_mm256_unpacklo_epi16(x1, y1), w);
+        __m256i s3 = _mm256_madd_epi16(_mm256_unpackhi_epi16(x1, y1), w);
+        s0 = _mm256_srai_epi32(_mm256_add_epi32(s0, round), RESIZE_VERT_SHIFT);
+        s1 = _mm256_srai_epi32(_mm256_add_epi32(s1, round), RESIZE_VERT_SHIFT);
+        s2 = _mm256_srai_epi32(_mm256_add_epi32(s2, round), RESIZE_VERT_SHIFT);
+        s3 = _mm256_srai_epi32(_mm256_add_epi32(s3, round), RESIZE_VERT_SHIFT);
+        __m256i v = _mm256_packus_epi16(_mm256_packs_epi32(s0, s1), _mm256_packs_epi32(s2, s3));
+        // packus interleaves the lanes as 0, 2, 1, 3
+        v = _mm256_permute4x64_epi64(v, 0xD8);
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+    vresize_row_sse2(r0 + i, r1 + i, a, dst + i, n - i);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+
+static void vresize_row_neon(const short* r0, const short* r1, int a, uint8_t* dst, int n)
+{
+    int16x4_t wa = vdup_n_s16((short)a);
+    int16x4_t wb = vdup_n_s16((short)(RESIZE_WEIGHT_ONE - a));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(r0 + i);
+        int16x8_t y = vld1q_s16(r1 + i);
+        int32x4_t lo = vmlal_s16(vmull_s16(vget_low_s16(x), wb), vget_low_s16(y), wa);
+        int32x4_t hi = vmlal_s16(vmull_s16(vget_high_s16(x), wb), vget_high_s16(y), wa);
+        // rounding shift adds 1 << (shift - 1) like RESIZE_VERT_ROUND
+        int16x8_t v = vcombine_s16(vmovn_s32(vrshrq_n_s32(lo, RESIZE_VERT_SHIFT)),
+                                   vmovn_s32(vrshrq_n_s32(hi, RESIZE_VERT_SHIFT)));
+        vst1_u8(dst + i, vqmovun_s16(v));
+    }
+    vresize_row_c(r0 + i, r1 + i, a, dst + i, n - i);
+}
+#endif
+
+static int isa_supported(resize_isa_t isa)
+{
+    switch (isa) {
+    case RESIZE_ISA_C:
+        return 1;
+#if defined(__x86_64__) || defined(__i386__)
+    case RESIZE_ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case RESIZE_ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    case RESIZE_ISA_NEON:
+        // compiled in only when the target guarantees NEON
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static vresize_fn isa_vresize(resize_isa_t isa)
+{
+    switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    case RESIZE_ISA_SSE2:
+        return vresize_row_sse2;
+    case RESIZE_ISA_AVX2:
+        return vresize_row_avx2;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    case RESIZE_ISA_NEON:
+        return vresize_row_neon;
+#endif
+    default:
+        return vresize_row_c;
+    }
+}
+
+// -1 until detected; detection is idempotent so a race only repeats it
+static volatile int g_resize_isa = -1;
+
+resize_isa_t resize_get_isa(void)
+{
+    if (g_resize_isa < 0) {
+        resize_isa_t isa = RESIZE_ISA_C;
+        if (isa_supported(RESIZE_ISA_NEON)) {
+            isa = RESIZE_ISA_NEON;
+        } else if (isa_supported(RESIZE_ISA_AVX2)) {
+            isa = RESIZE_ISA_AVX2;
+        } else if (isa_supported(RESIZE_ISA_SSE2)) {
+            isa = RESIZE_ISA_SSE2;
+        }
+        g_resize_isa = isa;
+    }
+    return (resize_isa_t)g_resize_isa;
+}
+
+int resize_set_isa(resize_isa_t isa)
+{
+    if (!isa_supported(isa)) {
+        printf("ERROR: resize isa %s not supported\n", resize_isa_name(isa));
+        return -1;
+    }
+    g_resize_isa = isa;
+    return 0;
+}
+
+int resize_table_set_isa(resize_table_t* table, resize_isa_t isa)
+{
+    if (isa != RESIZE_ISA_AUTO && !isa_supported(isa)) {
+        printf("ERROR: resize isa %s not supported\n", resize_isa_name(isa));
+        return -1;
+    }
+    table->isa = isa;
+    return 0;
+}
+
+static resize_isa_t table_isa(const resize_table_t* table)
+{
+    return table->isa == RESIZE_ISA_AUTO ? resize_get_isa() : table->isa;
+}
+
+const char* resize_isa_name(resize_isa_t isa)
+{
+    switch (isa) {
+    case RESIZE_ISA_AUTO:
+        return "auto";
+    case RESIZE_ISA_C:
+        return "c";
+    case RESIZE_ISA_SSE2:
+        return "sse2";
+    case RESIZE_ISA_AVX2:
+        return "avx2";
+    case RESIZE_ISA_NEON:
+        return "neon";
+    default:
+        return "unknown";
+    }
+}
+
+// Source rows of one plane for the horizontal pass. Packed layouts are unpacked one row at a time
+// into buf right before it, so no converted copy of the whole source is ever made.
+typedef void (*unpack_row_fn)(const uint8_t* row, const uint8_t* row2, uint8_t* out, int n);
+
+typedef struct {
+    const uint8_t* data;
+    const uint8_t* data2;   // second plane read by unpack (V of YUV420P), NULL otherwise
+    int stride;             // row pitch of data and data2
+    unpack_row_fn unpack;   // NULL: rows are sampled in place
+    uint8_t* buf;           // one unpacked row of table->src_width pixels
+} row_source_t;
+
+static void row_source_init(row_source_t* source, const uint8_t* data, int stride)
+{
+    memset(source, 0, sizeof(row_source_t));
+    source->data = data;
+    source->stride = stride;
+}
+
+static const uint8_t* row_source_get(const row_source_t* source, const resize_table_t* table, int y)
+{
+    const uint8_t* row = source->data + (size_t)y * source->stride;
+    if (source->unpack == NULL) {
+        return row;
+    }
+    const uint8_t* row2 = source->data2 != NULL ? source->data2 + (size_t)y * source->stride : NULL;
+    source->unpack(row, row2, source->buf, table->src_width);
+    return source->buf;
+}
+
+// Two horizontally resampled source rows: slot 0 holds the upper row and slot 1 the lower one.
+// Consecutive destination rows mostly share source rows so each one is resampled about once.
+typedef struct {
+    short* rows[2];
+    int row_y[2];
+} row_cache_t;
+
+static void row_cache_init(row_cache_t* cache, const resize_table_t* table, short* scratch)
+{
+    int row_len = table->dst_width * table->channels;
+    cache->rows[0] = scratch;
+    cache->rows[1] = scratch + row_len;
+    cache->row_y[0] = -1;
+    cache->row_y[1] = -1;
+}
+
+static void row_cache_fetch(row_cache_t* cache, const resize_table_t* table, const row_source_t* source, int dy)
+{
+    int y0 = table->y_ofs[dy * 2];
+    int y1 = table->y_ofs[dy * 2 + 1];
+    if (cache->row_y[0] != y0) {
+        if (cache->row_y[1] == y0) {
+            short* t = cache->rows[0];
+            cache->rows[0] = cache->rows[1];
+            cache->rows[1] = t;
+            cache->row_y[0] = y0;
+            cache->row_y[1] = -1;
+        } else {
+            hresize_row(table, row_source_get(source, table, y0), cache->rows[0]);
+            cache->row_y[0] = y0;
+        }
+    }
+    if (cache->row_y[1] != y1) {
+        hresize_row(table, row_source_get(source, table, y1), cache->rows[1]);
+        cache->row_y[1] = y1;
+    }
+}
+
+void resize_bilinear(const resize_table_t* table, const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                     int y_begin, int y_end, short* scratch)
+{
+    int row_len = table->dst_width * table->channels;
+    row_cache_t cache;
+    row_cache_init(&cache, table, scratch);
+    row_source_t source;
+    row_source_init(&source, src, src_stride);
+    vresize_fn vresize = isa_vresize(table_isa(table));
+
+    for (int dy = y_begin; dy < y_end; dy++) {
+        row_cache_fetch(&cache, table, &source, dy);
+        vresize(cache.rows[0], cache.rows[1], table->y_alpha[dy], dst + (size_t)dy * dst_stride, row_len);
+    }
+}
+
+// YUV -> RGB in Q13: Y' = (Y - y_off) * y_mul, R = Y' + rv * V', G = Y' - gu * U' - gv * V', B = Y' + bu * U'
+#define YUV_COEF_BITS 13
+#define YUV_COEF_ROUND (1 << (YUV_COEF_BITS - 1))
+
+typedef struct {
+    int y_off;
+    short y_mul;
+    short rv;
+    short gu;
+    short gv;
+    short bu;
+} yuv_coef_t;
+
+static const yuv_coef_t g_yuv_coefs[] = {
+    {16, 9539, 13075, 3209, 6660, 16525},   // IMAGE_COLOR_SPACE_BT601_LIMITED
+    {0, 8192, 11485, 2819, 5850, 14516},    // IMAGE_COLOR_SPACE_BT601_FULL
+    {16, 9539, 14686, 1747, 4366, 17305},   // IMAGE_COLOR_SPACE_BT709_LIMITED
+    {0, 8192, 12901, 1535, 3835, 15201},    // IMAGE_COLOR_SPACE_BT709_FULL
+};
+
+static inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+typedef void (*yuv_to_rgb_fn)(const uint8_t* y, const uint8_t* uv, int u_idx, const yuv_coef_t* coef, uint8_t* rgb, int n);
+
+static void yuv_to_rgb_row_c(const uint8_t* y, const uint8_t* uv, int u_idx, const yuv_coef_t* coef, uint8_t* rgb, int n)
+{
+    for (int i = 0; i < n; i++) {
+        int yy = (y[i] - coef->y_off) * coef->y_mul;
+        int u = uv[i * 2 + u_idx] - 128;
+        int v = uv[i * 2 + (u_idx ^ 1)] - 128;
+        rgb[i * 3 + 0] = clamp_u8((yy + coef->rv * v + YUV_COEF_ROUND) >> YUV_COEF_BITS);
+        rgb[i * 3 + 1] = clamp_u8((yy - coef->gu * u - coef->gv * v + YUV_COEF_ROUND) >> YUV_COEF_BITS);
+        rgb[i * 3 + 2] = clamp_u8((yy + coef->bu * u + YUV_COEF_ROUND) >> YUV_COEF_BITS);
+    }
+}
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+static inline uint8x8_t yuv_narrow(int32x4_t lo, int32x4_t hi)
+{
+    // rounding shift with unsigned saturation, same as the C clamp
+    return vqmovn_u16(vcombine_u16(vqrshrun_n_s32(lo, YUV_COEF_BITS), vqrshrun_n_s32(hi, YUV_COEF_BITS)));
+}
+
+static void yuv_to_rgb_row_neon(const uint8_t* y, const uint8_t* uv, int u_idx, const yuv_coef_t* coef, uint8_t* rgb, int n)
+{
+    int16x8_t y_off = vdupq_n_s16((short)coef->y_off);
+    int16x8_t c128 = vdupq_n_s16(128);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x2_t c = vld2_u8(uv + i * 2);
+        int16x8_t yv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i))), y_off);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(c.val[u_idx])), c128);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(c.val[u_idx ^ 1])), c128);
+
+        int32x4_t yl = vmull_n_s16(vget_low_s16(yv), coef->y_mul);
+        int32x4_t yh = vmull_n_s16(vget_high_s16(yv), coef->y_mul);
+        uint8x8x3_t out;
+        out.val[0] = yuv_narrow(vmlal_n_s16(yl, vget_low_s16(v), coef->rv), vmlal_n_s16(yh, vget_high_s16(v), coef->rv));
+        out.val[1] = yuv_narrow(vmlsl_n_s16(vmlsl_n_s16(yl, vget_low_s16(u), coef->gu), vget_low_s16(v), coef->gv),
+                                vmlsl_n_s16(vmlsl_n_s16(yh, vget_high_s16(u), coef->gu), vget_high_s16(v), coef->gv));
+        out.val[2] = yuv_narrow(vmlal_n_s16(yl, vget_low_s16(u), coef->bu), vmlal_n_s16(yh, vget_high_s16(u), coef->bu));
+        vst3_u8(rgb + i * 3, out);
+    }
+    yuv_to_rgb_row_c(y + i, uv + i * 2, u_idx, coef, rgb + i * 3, n - i);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void yuv_to_rgb_row_sse2(const uint8_t* y, const uint8_t* uv, int u_idx, const yuv_coef_t* coef, uint8_t* rgb, int n)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i y_off = _mm_set1_epi16((short)coef->y_off);
+    __m128i c128 = _mm_set1_epi16(128);
+    __m128i round = _mm_set1_epi32(YUV_COEF_ROUND);
+    __m128i uv_mask = _mm_set1_epi16(0xff);
+    // (y_mul, rv) against (Y', V'), (y_mul, bu) against (Y', U'), (-gu, -gv) against (U', V')
+    __m128i w_r = _mm_set1_epi32(((int)coef->rv << 16) | (coef->y_mul & 0xffff));
+    __m128i w_b = _mm_set1_epi32(((int)coef->bu << 16) | (coef->y_mul & 0xffff));
+    // shift as unsigned, -gv is negative and a signed left shift of it is undefined
+    __m128i w_g = _mm_set1_epi32((int)(((uint32_t)(-(int)coef->gv) << 16) | ((uint32_t)(-(int)coef->gu) & 0xffff)));
+    __m128i w_y = _mm_set1_epi32(coef->y_mul & 0xffff);
+    uint8_t r_buf[8], g_buf[8], b_buf[8];
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i yv = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + i)), zero), y_off);
+        __m128i c = _mm_loadu_si128((const __m128i*)(uv + i * 2));
+        __m128i c0 = _mm_sub_epi16(_mm_and_si128(c, uv_mask), c128);
+        __m128i c1 = _mm_sub_epi16(_mm_srli_epi16(c, 8), c128);
+        __m128i u = u_idx == 0 ? c0 : c1;
+        __m128i v = u_idx == 0 ? c1 : c0;
+
+        __m128i yv_lo = _mm_unpacklo_epi16(yv, v), yv_hi = _mm_unpackhi_epi16(yv, v);
+        __m128i yu_lo = _mm_unpacklo_epi16(yv, u), yu_hi = _mm_unpackhi_epi16(yv, u);
+        __m128i uv_lo = _mm_unpacklo_epi16(u, v), uv_hi = _mm_unpackhi_epi16(u, v);
+        __m128i y_lo = _mm_madd_epi16(_mm_unpacklo_epi16(yv, zero), w_y);
+        __m128i y_hi = _mm_madd_epi16(_mm_unpackhi_epi16(yv, zero), w_y);
+
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_lo, w_r), round), YUV_COEF_BITS),
+                                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv_hi, w_r), round), YUV_COEF_BITS));
+        __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu_lo, w_b), round), YUV_COEF_BITS),
+                                    _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu_hi, w_b), round), YUV_COEF_BITS));
+        __m128i g_lo = _mm_add_epi32(_mm_add_epi32(y_lo, _mm_madd_epi16(uv_lo, w_g)), round);
+        __m128i g_hi = _mm_add_epi32(_mm_add_epi32(y_hi, _mm_madd_epi16(uv_hi, w_g)), round);
+        __m128i g = _mm_packs_epi32(_mm_srai_epi32(g_lo, YUV_COEF_BITS), _mm_srai_epi32(g_hi, YUV_COEF_BITS));
+
+        // SSE2 has no 3-way interleave, store the planes and interleave in scalar
+        _mm_storel_epi64((__m128i*)r_buf, _mm_packus_epi16(r, r));
+        _mm_storel_epi64((__m128i*)g_buf, _mm_packus_epi16(g, g));
+        _mm_storel_epi64((__m128i*)b_buf, _mm_packus_epi16(b, b));
+        for (int k = 0; k < 8; k++) {
+            rgb[(i + k) * 3 + 0] = r_buf[k];
+            rgb[(i + k) * 3 + 1] = g_buf[k];
+            rgb[(i + k) * 3 + 2] = b_buf[k];
+        }
+    }
+    yuv_to_rgb_row_c(y + i, uv + i * 2, u_idx, coef, rgb + i * 3, n - i);
+}
+#endif
+
+static yuv_to_rgb_fn isa_yuv_to_rgb(resize_isa_t isa)
+{
+    switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    case RESIZE_ISA_SSE2:
+    case RESIZE_ISA_AVX2:
+        return yuv_to_rgb_row_sse2;
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    case RESIZE_ISA_NEON:
+        return yuv_to_rgb_row_neon;
+#endif
+    default:
+        return yuv_to_rgb_row_c;
+    }
+}
+
+int resize_yuv420sp_tables_init(resize_table_t* y_table, resize_table_t* uv_table, int src_width, int src_height,
+                                int dst_width, int dst_height)
+{
+    if (resize_table_init(y_table, 1, src_width, src_height, dst_width, dst_height) != 0) {
+        return -1;
+    }
+    // chroma is sampled at the full destination resolution so every output pixel has its own U/V
+    if (resize_table_init(uv_table, 2, src_width / 2, src_height / 2, dst_width, dst_height) != 0) {
+        resize_table_release(y_table);
+        return -1;
+    }
+    return 0;
+}
+
+int resize_yuv420sp_scratch_size(const resize_table_t* y_table, const resize_table_t* uv_table)
+{
+    // resampled rows of both planes, then one 8 bit row of Y and of UV
+    int size = resize_scratch_size(y_table) + resize_scratch_size(uv_table);
+    size += (y_table->dst_width + uv_table->dst_width * 2 + 1) / 2;
+    return size;
+}
+
+// Resampled luma and chroma rows to RGB888, the chroma source yields interleaved U/V (or V/U) pairs
+static void yuv_rows_to_rgb888(const resize_table_t* y_table, const resize_table_t* uv_table,
+                               const row_source_t* y_source, const row_source_t* uv_source, int u_idx,
+                               image_color_space_t color_space, uint8_t* dst, int dst_stride,
+                               int y_begin, int y_end, short* scratch)
+{
+    int width = y_table->dst_width;
+    row_cache_t y_cache, uv_cache;
+    row_cache_init(&y_cache, y_table, scratch);
+    row_cache_init(&uv_cache, uv_table, scratch + resize_scratch_size(y_table));
+    uint8_t* y_row = (uint8_t*)(scratch + resize_scratch_size(y_table) + resize_scratch_size(uv_table));
+    uint8_t* uv_row = y_row + width;
+
+    resize_isa_t isa = table_isa(y_table);
+    vresize_fn vresize = isa_vresize(isa);
+    yuv_to_rgb_fn yuv_to_rgb = isa_yuv_to_rgb(isa);
+    if ((unsigned)color_space >= sizeof(g_yuv_coefs) / sizeof(g_yuv_coefs[0])) {
+        color_space = IMAGE_COLOR_SPACE_BT601_LIMITED;
+    }
+    const yuv_coef_t* coef = &g_yuv_coefs[color_space];
+
+    for (int dy = y_begin; dy < y_end; dy++) {
+        row_cache_fetch(&y_cache, y_table, y_source, dy);
+        row_cache_fetch(&uv_cache, uv_table, uv_source, dy);
+        vresize(y_cache.rows[0], y_cache.rows[1], y_table->y_alpha[dy], y_row, width);
+        vresize(uv_cache.rows[0], uv_cache.rows[1], uv_table->y_alpha[dy], uv_row, width * 2);
+        yuv_to_rgb(y_row, uv_row, u_idx, coef, dst + (size_t)dy * dst_stride, width);
+    }
+}
+
+void resize_yuv420sp_to_rgb888(const resize_table_t* y_table, const resize_table_t* uv_table,
+                               const uint8_t* src_y, int y_stride, const uint8_t* src_uv, int uv_stride, int is_nv21,
+                               image_color_space_t color_space, uint8_t* dst, int dst_stride,
+                               int y_begin, int y_end, short* scratch)
+{
+    row_source_t y_source, uv_source;
+    row_source_init(&y_source, src_y, y_stride);
+    row_source_init(&uv_source, src_uv, uv_stride);
+    yuv_rows_to_rgb888(y_table, uv_table, &y_source, &uv_source, is_nv21 ? 1 : 0, color_space,
+                       dst, dst_stride, y_begin, y_end, scratch);
+}
+
+// RGB565 little endian, 5/6 bit fields widened by replicating their high bits
+static void unpack_rgb565_row(const uint8_t* row, const uint8_t* row2, uint8_t* out, int n)
+{
+    (void)row2;
+    for (int i = 0; i < n; i++, out += 3) {
+        int v = row[i * 2] | (row[i * 2 + 1] << 8);
+        int r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+        out[0] = (uint8_t)((r << 3) | (r >> 2));
+        out[1] = (uint8_t)((g << 2) | (g >> 4));
+        out[2] = (uint8_t)((b << 3) | (b >> 2));
+    }
+}
+
+// Y0 U Y1 V: luma of n pixels
+static void unpack_yuyv_luma_row(const uint8_t* row, const uint8_t* row2, uint8_t* out, int n)
+{
+    (void)row2;
+    for (int i = 0; i < n; i++) {
+        out[i] = row[i * 2];
+    }
+}
+
+// Y0 U Y1 V: U/V of n pixel pairs
+static void unpack_yuyv_chroma_row(const uint8_t* row, const uint8_t* row2, uint8_t* out, int n)
+{
+    (void)row2;
+    for (int i = 0; i < n; i++) {
+        out[i * 2] = row[i * 4 + 1];
+        out[i * 2 + 1] = row[i * 4 + 3];
+    }
+}
+
+// separate U and V rows of YUV420P to NV12 order
+static void unpack_i420_chroma_row(const uint8_t* row, const uint8_t* row2, uint8_t* out, int n)
+{
+    for (int i = 0; i < n; i++) {
+        out[i * 2] = row[i];
+        out[i * 2 + 1] = row2[i];
+    }
+}
+
+static void swap_rb_row(uint8_t* rgb, int n)
+{
+    for (int i = 0; i < n; i++, rgb += 3) {
+        uint8_t t = rgb[0];
+        rgb[0] = rgb[2];
+        rgb[2] = t;
+    }
+}
+
+int resize_to_rgb888_supported(image_format_t format)
+{
+    switch (format) {
+    case IMAGE_FORMAT_BGR888:
+    case IMAGE_FORMAT_RGB565:
+    case IMAGE_FORMAT_YUYV:
+    case IMAGE_FORMAT_YUV420P:
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int resize_to_rgb888_tables_init(image_format_t format, resize_table_t* table, resize_table_t* uv_table,
+                                 int src_width, int src_height, int dst_width, int dst_height)
+{
+    memset(uv_table, 0, sizeof(resize_table_t));
+    switch (format) {
+    case IMAGE_FORMAT_BGR888:
+    case IMAGE_FORMAT_RGB565:
+        return resize_table_init(table, 3, src_width, src_height, dst_width, dst_height);
+    case IMAGE_FORMAT_YUYV:
+        if (resize_table_init(table, 1, src_width, src_height, dst_width, dst_height) != 0) {
+            return -1;
+        }
+        // 4:2:2, chroma pairs at half width and full height
+        if (resize_table_init(uv_table, 2, src_width / 2, src_height, dst_width, dst_height) != 0) {
+            resize_table_release(table);
+            return -1;
+        }
+        return 0;
+    case IMAGE_FORMAT_YUV420P:
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        return resize_yuv420sp_tables_init(table, uv_table, src_width, src_height, dst_width, dst_height);
+    default:
+        printf("ERROR: no CPU conversion of format %d to RGB888\n", format);
+        return -1;
+    }
+}
+
+int resize_to_rgb888_scratch_size(image_format_t format, const resize_table_t* table, const resize_table_t* uv_table)
+{
+    switch (format) {
+    case IMAGE_FORMAT_BGR888:
+        return resize_scratch_size(table);
+    case IMAGE_FORMAT_RGB565:
+        return resize_scratch_size(table) + (table->src_width * 3 + 1) / 2;
+    case IMAGE_FORMAT_YUYV:
+        return resize_yuv420sp_scratch_size(table, uv_table) + (table->src_width + uv_table->src_width * 2 + 1) / 2;
+    case IMAGE_FORMAT_YUV420P:
+        return resize_yuv420sp_scratch_size(table, uv_table) + (uv_table->src_width * 2 + 1) / 2;
+    default:
+        return resize_yuv420sp_scratch_size(table, uv_table);
+    }
+}
+
+void resize_to_rgb888(image_format_t format, const resize_table_t* table, const resize_table_t* uv_table,
+                      const uint8_t* const planes[3], const int strides[3], image_color_space_t color_space,
+                      uint8_t* dst, int dst_stride, int y_begin, int y_end, short* scratch)
+{
+    if (format == IMAGE_FORMAT_BGR888 || format == IMAGE_FORMAT_RGB565) {
+        int width = table->dst_width;
+        row_cache_t cache;
+        row_cache_init(&cache, table, scratch);
+        row_source_t source;
+        row_source_init(&source, planes[0], strides[0]);
+        if (format == IMAGE_FORMAT_RGB565) {
+            source.unpack = unpack_rgb565_row;
+            source.buf = (uint8_t*)(scratch + resize_scratch_size(table));
+        }
+        vresize_fn vresize = isa_vresize(table_isa(table));
+        for (int dy = y_begin; dy < y_end; dy++) {
+            uint8_t* dst_row = dst + (size_t)dy * dst_stride;
+            row_cache_fetch(&cache, table, &source, dy);
+            vresize(cache.rows[0], cache.rows[1], table->y_alpha[dy], dst_row, width * 3);
+            if (format == IMAGE_FORMAT_BGR888) {
+                // the row was just written, swapping it here costs no extra pass over memory
+                swap_rb_row(dst_row, width);
+            }
+        }
+        return;
+    }
+
+    // unpack buffers follow what yuv_rows_to_rgb888 uses
+    uint8_t* unpack_buf = (uint8_t*)(scratch + resize_yuv420sp_scratch_size(table, uv_table));
+    row_source_t y_source, uv_source;
+    row_source_init(&y_source, planes[0], strides[0]);
+    row_source_init(&uv_source, planes[1], strides[1]);
+    int u_idx = 0;
+    switch (format) {
+    case IMAGE_FORMAT_YUYV:
+        y_source.unpack = unpack_yuyv_luma_row;
+        y_source.buf = unpack_buf;
+        uv_source.data = planes[0];
+        uv_source.stride = strides[0];
+        uv_source.unpack = unpack_yuyv_chroma_row;
+        uv_source.buf = unpack_buf + table->src_width;
+        break;
+    case IMAGE_FORMAT_YUV420P:
+        uv_source.data2 = planes[2];
+        uv_source.unpack = unpack_i420_chroma_row;
+        uv_source.buf = unpack_buf;
+        break;
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        u_idx = 1;
+        break;
+    default:
+        break;
+    }
+    yuv_rows_to_rgb888(table, uv_table, &y_source, &uv_source, u_idx, color_space, dst, dst_stride, y_begin, y_end, scratch);
+}
@@ -0,0 +1,227 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_RESIZE_H_
+#define _RKNN_MODEL_ZOO_IMAGE_RESIZE_H_
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bilinear weights are Q11 fixed point, horizontally resampled rows are stored as value << 7 in int16
+#define RESIZE_WEIGHT_BITS 11
+#define RESIZE_WEIGHT_ONE (1 << RESIZE_WEIGHT_BITS)
+#define RESIZE_ROW_SHIFT 4
+
+/**
+ * @brief Instruction set used by the vertical resize pass, all of them produce identical output
+ *
+ */
+typedef enum {
+    RESIZE_ISA_AUTO = -1,   // resize_get_isa()
+    RESIZE_ISA_C = 0,
+    RESIZE_ISA_SSE2,
+    RESIZE_ISA_AVX2,
+    RESIZE_ISA_NEON,
+} resize_isa_t;
+
+/**
+ * @brief Precomputed bilinear sampling tables for one (source area, destination area, channels) geometry
+ *
+ */
+typedef struct {
+    int channels;
+    int src_width;      // sampled source area
+    int src_height;
+    int dst_width;      // written destination area
+    int dst_height;
+    int* x_ofs;         // dst_width x 2, byte offsets of the left/right source pixel inside a row
+    short* x_alpha;     // dst_width, Q11 weight of the right source pixel
+    int* y_ofs;         // dst_height x 2, index of the upper/lower source row
+    short* y_alpha;     // dst_height, Q11 weight of the lower source row
+    resize_isa_t isa;   // instruction set for this table, RESIZE_ISA_AUTO after init
+} resize_table_t;
+
+/**
+ * @brief Build the sampling tables, the source position of destination pixel d is d * src_size / dst_size
+ *
+ * @param table [out] Tables, release with resize_table_release
+ * @param channels [in] Interleaved channels per pixel (1~4)
+ * @param src_width [in] Width of the sampled source area
+ * @param src_height [in] Height of the sampled source area
+ * @param dst_width [in] Width of the destination area
+ * @param dst_height [in] Height of the destination area
+ * @return int 0: success; -1: error
+ */
+int resize_table_init(resize_table_t* table, int channels, int src_width, int src_height, int dst_width, int dst_height);
+
+/**
+ * @brief Free the sampling tables, safe on a zeroed table
+ *
+ * @param table [in] Tables
+ */
+void resize_table_release(resize_table_t* table);
+
+/**
+ * @brief Number of int16 scratch elements resize_bilinear needs for this table
+ *
+ * @param table [in] Tables
+ * @return int Scratch element count
+ */
+int resize_scratch_size(const resize_table_t* table);
+
+/**
+ * @brief Bilinear resize of destination rows [y_begin, y_end) using precomputed tables
+ *
+ * @param table [in] Tables
+ * @param src [in] First pixel of the sampled source area
+ * @param src_stride [in] Source row pitch in bytes
+ * @param dst [out] First pixel of the destination area
+ * @param dst_stride [in] Destination row pitch in bytes
+ * @param y_begin [in] First destination row
+ * @param y_end [in] End destination row (exclusive)
+ * @param scratch [in] resize_scratch_size() int16 elements
+ */
+void resize_bilinear(const resize_table_t* table, const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                     int y_begin, int y_end, short* scratch);
+
+/**
+ * @brief Build the tables for resize_yuv420sp_to_rgb888
+ *
+ * @param y_table [out] Luma tables
+ * @param uv_table [out] Chroma tables, sampled at the destination resolution
+ * @param src_width [in] Width of the sampled source area (luma pixels)
+ * @param src_height [in] Height of the sampled source area (luma pixels)
+ * @param dst_width [in] Width of the destination area
+ * @param dst_height [in] Height of the destination area
+ * @return int 0: success; -1: error
+ */
+int resize_yuv420sp_tables_init(resize_table_t* y_table, resize_table_t* uv_table, int src_width, int src_height,
+                                int dst_width, int dst_height);
+
+/**
+ * @brief Number of int16 scratch elements resize_yuv420sp_to_rgb888 needs
+ *
+ * @param y_table [in] Luma tables
+ * @param uv_table [in] Chroma tables
+ * @return int Scratch element count
+ */
+int resize_yuv420sp_scratch_size(const resize_table_t* y_table, const resize_table_t* uv_table);
+
+/**
+ * @brief Resize NV12/NV21 and convert it to RGB888 in one pass over destination rows [y_begin, y_end)
+ *
+ * No full resolution RGB intermediate is produced, only a few destination sized rows of scratch.
+ *
+ * @param y_table [in] Luma tables
+ * @param uv_table [in] Chroma tables
+ * @param src_y [in] First pixel of the sampled area in the Y plane
+ * @param y_stride [in] Y plane row pitch in bytes
+ * @param src_uv [in] First pixel of the sampled area in the interleaved UV plane
+ * @param uv_stride [in] UV plane row pitch in bytes
+ * @param is_nv21 [in] 1: V comes before U (NV21); 0: NV12
+ * @param color_space [in] Color matrix and range of the source
+ * @param dst [out] First pixel of the RGB888 destination area
+ * @param dst_stride [in] Destination row pitch in bytes
+ * @param y_begin [in] First destination row
+ * @param y_end [in] End destination row (exclusive)
+ * @param scratch [in] resize_yuv420sp_scratch_size() int16 elements
+ */
+void resize_yuv420sp_to_rgb888(const resize_table_t* y_table, const resize_table_t* uv_table,
+                               const uint8_t* src_y, int y_stride, const uint8_t* src_uv, int uv_stride, int is_nv21,
+                               image_color_space_t color_space, uint8_t* dst, int dst_stride,
+                               int y_begin, int y_end, short* scratch);
+
+/**
+ * @brief Check whether resize_to_rgb888 can convert this source format
+ *
+ * @param format [in] Source format
+ * @return int 1: BGR888, RGB565, YUYV, YUV420P, NV12 or NV21; 0: otherwise
+ */
+int resize_to_rgb888_supported(image_format_t format);
+
+/**
+ * @brief Build the tables for resize_to_rgb888
+ *
+ * @param format [in] Source format, see resize_to_rgb888_supported
+ * @param table [out] Tables of the RGB or luma samples
+ * @param uv_table [out] Chroma tables of the YUV formats, zeroed for the RGB ones
+ * @param src_width [in] Width of the sampled source area (pixels)
+ * @param src_height [in] Height of the sampled source area (pixels)
+ * @param dst_width [in] Width of the destination area
+ * @param dst_height [in] Height of the destination area
+ * @return int 0: success; -1: error
+ */
+int resize_to_rgb888_tables_init(image_format_t format, resize_table_t* table, resize_table_t* uv_table,
+                                 int src_width, int src_height, int dst_width, int dst_height);
+
+/**
+ * @brief Number of int16 scratch elements resize_to_rgb888 needs
+ *
+ * @param format [in] Source format
+ * @param table [in] Tables
+ * @param uv_table [in] Chroma tables
+ * @return int Scratch element count
+ */
+int resize_to_rgb888_scratch_size(image_format_t format, const resize_table_t* table, const resize_table_t* uv_table);
+
+/**
+ * @brief Resize and convert to RGB888 in one pass over destination rows [y_begin, y_end)
+ *
+ * Packed sources (RGB565, YUYV) and the I420 chroma planes are unpacked one source row at a time
+ * right before sampling, BGR888 is swapped on the freshly written destination row.
+ *
+ * @param format [in] Source format, see resize_to_rgb888_supported
+ * @param table [in] Tables
+ * @param uv_table [in] Chroma tables
+ * @param planes [in] First pixel of the sampled area in each plane: Y/packed, U or UV, V (YUV420P only)
+ * @param strides [in] Row pitch in bytes of each plane, U and V of YUV420P share strides[1]
+ * @param color_space [in] Color matrix and range of YUV sources
+ * @param dst [out] First pixel of the RGB888 destination area
+ * @param dst_stride [in] Destination row pitch in bytes
+ * @param y_begin [in] First destination row
+ * @param y_end [in] End destination row (exclusive)
+ * @param scratch [in] resize_to_rgb888_scratch_size() int16 elements
+ */
+void resize_to_rgb888(image_format_t format, const resize_table_t* table, const resize_table_t* uv_table,
+                      const uint8_t* const planes[3], const int strides[3], image_color_space_t color_space,
+                      uint8_t* dst, int dst_stride, int y_begin, int y_end, short* scratch);
+
+/**
+ * @brief Instruction set currently used, detected from the running CPU on first use
+ *
+ * @return resize_isa_t Instruction set
+ */
+resize_isa_t resize_get_isa(void);
+
+/**
+ * @brief Force an instruction set, e.g. RESIZE_ISA_C as reference when comparing outputs
+ *
+ * @param isa [in] Instruction set
+ * @return int 0: success; -1: not supported by this build or CPU
+ */
+int resize_set_isa(resize_isa_t isa);
+
+/**
+ * @brief Use an instruction set for one table only, e.g. to compare backends without touching the global one
+ *
+ * @param table [in] Tables
+ * @param isa [in] Instruction set, RESIZE_ISA_AUTO follows resize_get_isa()
+ * @return int 0: success; -1: not supported by this build or CPU
+ */
+int resize_table_set_isa(resize_table_t* table, resize_isa_t isa);
+
+/**
+ * @brief Name of an instruction set for logs
+ *
+ * @param isa [in] Instruction set
+ * @return const char* Name
+ */
+const char* resize_isa_name(resize_isa_t isa);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_RESIZE_H_
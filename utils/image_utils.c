@@ -4,12 +4,17 @@
 #include <dirent.h>
 #include <string.h> // Added for memcpy, strstr, strrchr, strcmp
 #include <sys/time.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "im2d.h"
 #include "drmrga.h"
 
 #define STB_IMAGE_IMPLEMENTATION
-#define STBI_NO_THREAD_LOCALS
 #define STBI_ONLY_JPEG
 #define STBI_ONLY_PNG
 #include "stb_image.h"
@@ -18,6 +23,13 @@
 #include "stb_image_write.h"
 
 #include "image_utils.h"
+#include "image_raw.h"
+#include "image_pool.h"
+#include "rga_handle_cache.h"
+#if defined(ENABLE_OPENCV_BACKEND)
+#include "image_backend_opencv.h"
+#endif
+#include "thread_pool.h"
 #include "file_utils.h" // Assuming this provides write_data_to_file
 
 static const char* filter_image_names[] = {
@@ -33,180 +45,249 @@ static const char* filter_image_names[] = {
 
 #ifndef DISABLE_LIBJPEG
 #include "turbojpeg.h"
-static const char* subsampName[TJ_NUMSAMP] = {"4:4:4", "4:2:2", "4:2:0", "Grayscale", "4:4:0", "4:1:1"};
-static const char* colorspaceName[TJ_NUMCS] = {"RGB", "YCbCr", "GRAY", "CMYK", "YCCK"};
+#endif
+
+struct image_decoder_t {
+#ifndef DISABLE_LIBJPEG
+    tjhandle handle;            // created on the first JPEG
+#endif
+    unsigned char* file_buf;    // whole input file, grows to the largest file read
+    size_t file_cap;
+    unsigned char* out_buf;     // pooled output pixels, grows to the largest image decoded
+    size_t out_cap;
+    unsigned char* tmp_buf;     // chroma planes before NV12 interleaving
+    size_t tmp_cap;
+};
 
-static int read_image_jpeg(const char* path, image_buffer_t* image)
+// Decoder buffers come from the default image pool: aligned for the SIMD paths, and a buffer
+// outgrown by one decoder is reused by the next one that needs that size
+static int grow_buffer(unsigned char** buf, size_t* cap, size_t size)
 {
-    printf("DEBUG: Attempting to open JPEG file: '%s'\n", path);
-    FILE* jpegFile = NULL;
-    unsigned long jpegSize = 0; // Initialize for safety
-    int width, height;
-    int origin_width, origin_height;
-    unsigned char* jpegBuf = NULL;
-    unsigned long size = 0; // Initialize for safety
-    tjhandle handle = NULL; // Moved declaration up
-    int subsample, colorspace; // Moved declaration up
-    int ret = -1; // Default to error return, change to 0 on success
+    if (size <= *cap) {
+        return 0;
+    }
+    unsigned char* new_buf = (unsigned char*)image_pool_alloc(image_pool_default(), size, NULL);
+    if (new_buf == NULL) {
+        return -1;
+    }
+    image_pool_release(*buf);
+    *buf = new_buf;
+    *cap = size;
+    return 0;
+}
 
-    // 1. Open File
-    if ((jpegFile = fopen(path, "rb")) == NULL) {
+// Read the whole file into decoder->file_buf, plain open/read so no FILE or stdio buffer is allocated
+static int decoder_load_file(image_decoder_t* decoder, const char* path, size_t* size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         printf("ERROR: Failed to open input file '%s'\n", path);
-        goto out; // ⚠️ CRITICAL: Exit on failure
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("ERROR: Input file '%s' contains no data.\n", path);
+        close(fd);
+        return -1;
+    }
+    size_t file_size = (size_t)st.st_size;
+    if (grow_buffer(&decoder->file_buf, &decoder->file_cap, file_size) != 0) {
+        printf("ERROR: Failed to allocate file buffer of size %zu\n", file_size);
+        close(fd);
+        return -1;
+    }
+    size_t done = 0;
+    while (done < file_size) {
+        ssize_t n = read(fd, decoder->file_buf + done, file_size - done);
+        if (n <= 0) {
+            printf("ERROR: Failed to read %zu bytes from input file '%s'.\n", file_size, path);
+            close(fd);
+            return -1;
+        }
+        done += (size_t)n;
     }
-    printf("DEBUG: Successfully opened file '%s'.\n", path);
+    close(fd);
+    *size = file_size;
+    return 0;
+}
 
-    // 2. Determine File Size
-    if (fseek(jpegFile, 0, SEEK_END) < 0 || (size = ftell(jpegFile)) < 0 || fseek(jpegFile, 0, SEEK_SET) < 0) {
-        printf("ERROR: Determining input file size failure for '%s'.\n", path);
-        goto out; // ⚠️ CRITICAL: Exit on failure
+// Where decoded pixels go: the caller's buffer, the decoder's pooled buffer (pooled, or an image that
+// still points at it from the previous read) or a new malloc owned by the caller
+static unsigned char* decoder_output(image_decoder_t* decoder, image_buffer_t* image, int size, int pooled, int* allocated)
+{
+    *allocated = 0;
+    if (image->virt_addr != NULL && image->virt_addr != decoder->out_buf) {
+        if (image->size < size) {
+            printf("ERROR: Provided image buffer (size %d) is too small for required size (%d).\n", image->size, size);
+            return NULL;
+        }
+        return image->virt_addr;
     }
-    if (size == 0) {
-        printf("ERROR: Input file '%s' contains no data.\n", path);
-        goto out; // ⚠️ CRITICAL: Exit on failure
+    if (pooled || image->virt_addr != NULL) {
+        if (grow_buffer(&decoder->out_buf, &decoder->out_cap, (size_t)size) != 0) {
+            printf("ERROR: Failed to grow decoder output buffer to %d bytes\n", size);
+            return NULL;
+        }
+        return decoder->out_buf;
+    }
+    unsigned char* buf = (unsigned char*)malloc(size);
+    if (buf == NULL) {
+        printf("ERROR: Failed to allocate output buffer of size %d\n", size);
+        return NULL;
     }
-    jpegSize = (unsigned long)size;
-    printf("DEBUG: JPEG file size: %lu bytes.\n", jpegSize);
+    *allocated = 1;
+    return buf;
+}
+
+#ifndef DISABLE_LIBJPEG
 
-    // 3. Allocate JPEG Buffer
-    if ((jpegBuf = (unsigned char*)malloc(jpegSize)) == NULL) {
-        printf("ERROR: Failed to allocate JPEG buffer of size %lu\n", jpegSize);
-        goto out; // ⚠️ CRITICAL: Exit on failure
+// Largest 1/2, 1/4 or 1/8 reduction that keeps the decoded image at or above the size the letterbox
+// into target_width x target_height would scale it to
+static tjscalingfactor choose_jpeg_scale(int width, int height, int target_width, int target_height)
+{
+    static const int denoms[] = {8, 4, 2};
+    tjscalingfactor scale = {1, 1};
+    float ratio_w = (float)target_width / width;
+    float ratio_h = (float)target_height / height;
+    float ratio = ratio_w < ratio_h ? ratio_w : ratio_h;
+    if (ratio >= 1.0f) {
+        return scale;
     }
-    printf("DEBUG: Allocated jpegBuf at %p.\n", (void*)jpegBuf);
+    int need_w = (int)(width * ratio);
+    int need_h = (int)(height * ratio);
+    for (int i = 0; i < (int)(sizeof(denoms) / sizeof(denoms[0])); i++) {
+        tjscalingfactor s = {1, denoms[i]};
+        if (TJSCALED(width, s) >= need_w && TJSCALED(height, s) >= need_h) {
+            return s;
+        }
+    }
+    return scale;
+}
 
-    // 4. Read JPEG Data into Buffer
-    if (fread(jpegBuf, 1, jpegSize, jpegFile) < jpegSize) {
-        printf("ERROR: Failed to read %lu bytes from input file '%s' into buffer.\n", jpegSize, path);
-        goto out; // ⚠️ CRITICAL: Exit on failure
+// Decode a 4:2:0 JPEG without color conversion, Y/Cb/Cr planes go to I420 directly or get their
+// chroma interleaved for NV12 through the decoder's temporary buffer
+static int decompress_jpeg_yuv420(image_decoder_t* decoder, const unsigned char* jpeg_buf, unsigned long jpeg_size,
+                                  unsigned char* out, int width, int height, image_format_t format)
+{
+    int ret;
+    int chroma_size = (width / 2) * (height / 2);
+    unsigned char* planes[3];
+    int strides[3] = {width, width / 2, width / 2};
+    unsigned char* chroma = NULL;
+
+    planes[0] = out;
+    if (format == IMAGE_FORMAT_YUV420P) {
+        planes[1] = out + width * height;
+        planes[2] = planes[1] + chroma_size;
+    } else {
+        if (grow_buffer(&decoder->tmp_buf, &decoder->tmp_cap, (size_t)chroma_size * 2) != 0) {
+            printf("ERROR: Failed to allocate chroma buffer of size %d\n", chroma_size * 2);
+            return -1;
+        }
+        chroma = decoder->tmp_buf;
+        planes[1] = chroma;
+        planes[2] = chroma + chroma_size;
     }
-    printf("DEBUG: Successfully read JPEG data into buffer.\n");
+    ret = tjDecompressToYUVPlanes(decoder->handle, jpeg_buf, jpeg_size, planes, width, strides, height, 0);
+    if (ret == 0 && chroma != NULL) {
+        // NV12 interleaves Cb first, NV21 Cr first
+        const unsigned char* first = format == IMAGE_FORMAT_YUV420SP_NV21 ? planes[2] : planes[1];
+        const unsigned char* second = format == IMAGE_FORMAT_YUV420SP_NV21 ? planes[1] : planes[2];
+        unsigned char* uv = out + width * height;
+        for (int i = 0; i < chroma_size; i++) {
+            uv[i * 2] = first[i];
+            uv[i * 2 + 1] = second[i];
+        }
+    }
+    return ret;
+}
 
-    // Close the file immediately after reading its content
-    fclose(jpegFile);
-    jpegFile = NULL; // Set to NULL to prevent double-close in cleanup
+static int read_image_jpeg(image_decoder_t* decoder, const char* path, const unsigned char* jpegBuf, unsigned long size,
+                           image_buffer_t* image, const image_read_options_t* options, image_read_info_t* info, int pooled)
+{
+    int width, height;
+    int origin_width, origin_height;
+    int subsample, colorspace;
+    int allocated = 0;
+    int ret;
 
-    // 5. Initialize libjpeg-turbo Decompressor
-    printf("DEBUG: Attempting to initialize libjpeg-turbo decompressor.\n");
-    handle = tjInitDecompress();
-    if (handle == NULL) {
-        printf("ERROR: tjInitDecompress failed.\n");
-        goto out; // ⚠️ CRITICAL: Exit on failure
+    // The decompressor lives as long as the decoder, it is only created for the first JPEG
+    if (decoder->handle == NULL) {
+        decoder->handle = tjInitDecompress();
+        if (decoder->handle == NULL) {
+            printf("ERROR: tjInitDecompress failed.\n");
+            return -1;
+        }
     }
-    printf("DEBUG: tjInitDecompress successful, handle: %p\n", (void*)handle);
+    tjhandle handle = decoder->handle;
 
-    // 6. Decompress JPEG Header (First call)
-    printf("DEBUG: Calling tjDecompressHeader3 for JPEG data (size: %lu).\n", size);
     ret = tjDecompressHeader3(handle, jpegBuf, size, &origin_width, &origin_height, &subsample, &colorspace);
     if (ret < 0) {
         printf("ERROR: tjDecompressHeader3 failed for '%s'. ErrorStr: '%s', errorCode: %d\n", path, tjGetErrorStr(), tjGetErrorCode(handle)); // FIXED
-        goto out; // ⚠️ CRITICAL: Exit on failure
+        return -1;
     }
-    printf("DEBUG: tjDecompressHeader3 successful. Image dimensions: %dx%d, Subsampling: %s, Colorspace: %s\n",
-           origin_width, origin_height, subsampName[subsample], colorspaceName[colorspace]);
 
-    // Use original dimensions, no need for redundant tjDecompressHeader3 call
-    width = origin_width;
-    height = origin_height;
-
-    printf("DEBUG: Target image dimensions for decoding: %d x %d\n", width, height);
-
-    // 7. Allocate Output Buffer (sw_out_buf)
-    int sw_out_size = width * height * 3; // Assuming TJPF_RGB output (3 bytes per pixel)
-    unsigned char* sw_out_buf = image->virt_addr; // Check if caller provided buffer
-
-    if (sw_out_buf == NULL) {
-        printf("DEBUG: image->virt_addr is NULL, attempting to malloc %d bytes for sw_out_buf.\n", sw_out_size);
-        sw_out_buf = (unsigned char*)malloc(sw_out_size);
-        if (sw_out_buf == NULL) {
-            printf("ERROR: Failed to allocate sw_out_buf of size %d\n", sw_out_size);
-            goto out; // ⚠️ CRITICAL: Exit on malloc failure
-        }
-        printf("DEBUG: Successfully allocated new sw_out_buf at %p.\n", (void*)sw_out_buf);
-    } else {
-        printf("DEBUG: Using pre-allocated sw_out_buf at %p (caller-provided size: %d).\n", (void*)sw_out_buf, image->size);
-        // Optional: Add a check if image->size is sufficient
-        if (image->size < sw_out_size) {
-            printf("ERROR: Provided image buffer (size %d) is too small for required size (%d).\n", image->size, sw_out_size);
-            // If the buffer was provided by the caller and is too small, it's an error.
-            // Do NOT free sw_out_buf here, as it's not owned by this function if it was passed in.
-            goto out;
+    // Decode directly at a reduced size when the caller only needs target_width x target_height,
+    // libjpeg-turbo scales in the DCT domain so the dropped pixels are never reconstructed
+    tjscalingfactor scale = {1, 1};
+    if (options != NULL && options->target_width > 0 && options->target_height > 0) {
+        scale = choose_jpeg_scale(origin_width, origin_height, options->target_width, options->target_height);
+    }
+    width = TJSCALED(origin_width, scale);
+    height = TJSCALED(origin_height, scale);
+
+    // YUV output skips the color conversion, only for 4:2:0 YCbCr with even dimensions
+    image_format_t out_format = IMAGE_FORMAT_RGB888;
+    if (options != NULL && (options->yuv_format == IMAGE_FORMAT_YUV420SP_NV12 || options->yuv_format == IMAGE_FORMAT_YUV420SP_NV21 ||
+                            options->yuv_format == IMAGE_FORMAT_YUV420P)) {
+        if (subsample == TJSAMP_420 && colorspace == TJCS_YCbCr && width % 2 == 0 && height % 2 == 0) {
+            out_format = options->yuv_format;
         }
     }
 
-    // 8. CRITICAL: Fill buffer with a known value for debugging
-    memset(sw_out_buf, 0xCC, sw_out_size);
-    printf("DEBUG: sw_out_buf initialized to 0xCC. First 9 bytes before tjDecompress2: %02X %02X %02X %02X %02X %02X %02X %02X %02X\n",
-           sw_out_buf[0], sw_out_buf[1], sw_out_buf[2], sw_out_buf[3], sw_out_buf[4], sw_out_buf[5], sw_out_buf[6], sw_out_buf[7], sw_out_buf[8]);
+    // 7. Output Buffer (sw_out_buf): caller-provided, pooled in the decoder or newly allocated
+    int sw_out_size = out_format == IMAGE_FORMAT_RGB888 ? width * height * 3 : width * height * 3 / 2;
+    unsigned char* sw_out_buf = decoder_output(decoder, image, sw_out_size, pooled, &allocated);
+    if (sw_out_buf == NULL) {
+        return -1;
+    }
 
     int pixelFormat = TJPF_RGB; // Assuming RGB output for image_buffer_t
     int flags = 0; // Set appropriate flags if needed, otherwise 0
 
     // 9. Call tjDecompress2
-    printf("DEBUG: Calling tjDecompress2 with handle: %p, jpegBuf: %p, size: %lu, sw_out_buf: %p, width: %d, pitch: 0, height: %d, pixelFormat: TJPF_RGB, flags: %d\n",
-           (void*)handle, (void*)jpegBuf, size, (void*)sw_out_buf, width, height, pixelFormat, flags);
-    ret = tjDecompress2(handle, jpegBuf, size, sw_out_buf, width, 0, height, pixelFormat, flags);
-
-    printf("DEBUG: After tjDecompress2 call: returned 'ret' value: %d\n", ret);
-    printf("DEBUG: tjGetErrorCode(handle): %d, tjGetErrorStr(): '%s'\n", tjGetErrorCode(handle), tjGetErrorStr()); // FIXED
-
-    // 10. CRITICAL: Inspect Pixels After Decompression
-    printf("DEBUG: Pixels AFTER tjDecompress2, expecting RGB (0-255):\n");
-    if (sw_out_buf && sw_out_size >= 9) {
-        printf("Px1: R=%u, G=%u, B=%u\n", sw_out_buf[0], sw_out_buf[1], sw_out_buf[2]);
-        printf("Px2: R=%u, G=%u, B=%u\n", sw_out_buf[3], sw_out_buf[4], sw_out_buf[5]);
-        printf("Px3: R=%u, G=%u, B=%u\n", sw_out_buf[6], sw_out_buf[7], sw_out_buf[8]);
+    if (out_format != IMAGE_FORMAT_RGB888) {
+        ret = decompress_jpeg_yuv420(decoder, jpegBuf, size, sw_out_buf, width, height, out_format);
     } else {
-        printf("Buffer is NULL or too small after tjDecompress2.\n");
+        ret = tjDecompress2(handle, jpegBuf, size, sw_out_buf, width, 0, height, pixelFormat, flags);
     }
 
-    // 11. Comprehensive Error Handling for tjDecompress2
-    if (ret < 0) { // Only fail if tjDecompress2 returned a negative value (fatal error)
+    // tjGetErrorCode stays set after a successful decode, so only the return value is checked
+    if (ret < 0) {
         printf("ERROR: tjDecompress2 returned a fatal error for '%s'. ErrorStr: '%s', ErrorCode: %d\n",
                path, tjGetErrorStr(), tjGetErrorCode(handle));
-
-        if (image->virt_addr == NULL && sw_out_buf != NULL) {
+        if (allocated) {
             free(sw_out_buf);
-            sw_out_buf = NULL;
         }
-        ret = -1; // Ensure an error return
-        goto out;
-    } else if (tjGetErrorCode(handle) != 0) { // Log warnings but don't fail
-        printf("WARNING: tjDecompress2 encountered a non-fatal issue for '%s'. ErrorStr: '%s', ErrorCode: %d\n",
-               path, tjGetErrorStr(), tjGetErrorCode(handle));
-    // Do NOT set ret = -1 or goto out here, as decompression was successful.
-}
+        return -1;
+    }
 
     // 12. Success Path: Populate image_buffer_t struct
     image->width = width;
     image->height = height;
-    image->format = IMAGE_FORMAT_RGB888; // Explicitly set format
+    image->width_stride = 0; // decoded rows and planes are packed
+    image->height_stride = 0;
+    image->format = out_format; // Explicitly set format
+    image->color_space = IMAGE_COLOR_SPACE_BT601_FULL; // JFIF YCbCr is full range BT.601
     image->virt_addr = sw_out_buf; // Assign the decoded buffer
     image->size = sw_out_size;
-    ret = 0; // Set return value to success
-
-out: // Unified cleanup label
-    printf("DEBUG: Entering cleanup phase for read_image_jpeg. jpegFile: %p, jpegBuf: %p, handle: %p\n",
-           (void*)jpegFile, (void*)jpegBuf, (void*)handle);
-
-    if (jpegFile) {
-        fclose(jpegFile);
-        // jpegFile = NULL; // Already set to NULL after fread
-    }
-    if (jpegBuf) {
-        free(jpegBuf);
-        jpegBuf = NULL;
-    }
-    if (handle) {
-        tjDestroy(handle);
-        handle = NULL;
+    if (info != NULL) {
+        info->orig_width = origin_width;
+        info->orig_height = origin_height;
+        info->scale_num = scale.num;
+        info->scale_denom = scale.denom;
     }
-    // IMPORTANT: sw_out_buf (image->virt_addr) is *not* freed here if `ret` is 0 (success).
-    // It's now owned by the `image_buffer_t` struct, which the caller is responsible for.
-    // If it was allocated locally (image->virt_addr was NULL initially) AND an error occurred AFTER
-    // its allocation, it should have been freed at the point of the error, *before* goto out.
-
-    return ret; // Return the determined success/failure status
+    return 0;
 }
 
 static int write_image_jpeg(const char* path, int quality, const image_buffer_t* image)
@@ -226,6 +307,11 @@ static int write_image_jpeg(const char* path, int quality, const image_buffer_t*
     // Determine pixel format based on image->format
     if (image->format == IMAGE_FORMAT_RGB888) {
         pixelFormat = TJPF_RGB;
+    } else if (image->format == IMAGE_FORMAT_RGBA8888) {
+        pixelFormat = TJPF_RGBA;
+    } else if (image->format == IMAGE_FORMAT_GRAY8) {
+        pixelFormat = TJPF_GRAY;
+        jpegSubsamp = TJSAMP_GRAY;
     } else {
         printf("write_image_jpeg: pixel format %d not supported for encoding.\n", image->format);
         goto write_out;
@@ -237,11 +323,12 @@ static int write_image_jpeg(const char* path, int quality, const image_buffer_t*
         goto write_out;
     }
 
-    ret = tjCompress2(handle, data, width, 0, height, pixelFormat, &jpegBuf, &jpegSize, jpegSubsamp, quality, flags);
+    ret = tjCompress2(handle, data, width, image_row_bytes(image), height, pixelFormat, &jpegBuf, &jpegSize,
+                      jpegSubsamp, quality, flags);
 
-    if (ret != 0 || tjGetErrorCode(handle) != 0) {
+    // tjGetErrorCode is only meaningful after a failed call, it can report TJERR_FATAL after a successful one
+    if (ret != 0) {
         printf("ERROR: tjCompress2 failed. ErrorStr: '%s', ErrorCode: %d\n", tjGetErrorStr(), tjGetErrorCode(handle)); // FIXED
-    // ... (previous code) ...
         ret = -1; // Ensure error return
         goto write_out;
     }
@@ -272,11 +359,6 @@ write_out: // Cleanup for write_image_jpeg
 }
 #endif
 
-// Original `image_file_filter`, `read_image_raw`, `read_image_stb`
-// and `convert_image` related functions remain as they were,
-// assuming they are correct or their issues are out of this scope.
-// Only included here for completeness of the file.
-
 static int image_file_filter(const struct dirent *entry)
 {
     const char ** filter;
@@ -289,44 +371,205 @@ static int image_file_filter(const struct dirent *entry)
     return 0;
 }
 
-static int read_image_raw(const char* path, image_buffer_t* image)
+static int append_image_path(char*** files, int* num_files, int* capacity, const char* dir, const char* name)
+{
+    if (*num_files == *capacity) {
+        int new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+        char** new_files = (char**)realloc(*files, new_capacity * sizeof(char*));
+        if (new_files == NULL) {
+            return -1;
+        }
+        *files = new_files;
+        *capacity = new_capacity;
+    }
+    size_t len = (dir != NULL ? strlen(dir) + 1 : 0) + strlen(name) + 1;
+    char* path = (char*)malloc(len);
+    if (path == NULL) {
+        return -1;
+    }
+    if (dir != NULL) {
+        snprintf(path, len, "%s/%s", dir, name);
+    } else {
+        snprintf(path, len, "%s", name);
+    }
+    (*files)[(*num_files)++] = path;
+    return 0;
+}
+
+static int list_image_dir(const char* dir, char*** files, int* num_files, int* capacity)
+{
+    struct dirent** entries = NULL;
+    int num = scandir(dir, &entries, image_file_filter, alphasort);
+    if (num < 0) {
+        printf("ERROR: scan image directory %s fail\n", dir);
+        return -1;
+    }
+    int ret = 0;
+    for (int i = 0; i < num; i++) {
+        if (ret == 0 && append_image_path(files, num_files, capacity, dir, entries[i]->d_name) != 0) {
+            ret = -1;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
+
+// One path per line, empty lines and lines starting with '#' are skipped
+static int list_image_file_list(const char* list_path, char*** files, int* num_files, int* capacity)
+{
+    FILE* fp = fopen(list_path, "r");
+    if (fp == NULL) {
+        printf("ERROR: open image list %s fail\n", list_path);
+        return -1;
+    }
+    char line[4096];
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        ret = append_image_path(files, num_files, capacity, NULL, line);
+    }
+    fclose(fp);
+    return ret;
+}
+
+int list_image_files(const char* path, char*** files, int* num_files)
+{
+    struct stat st;
+    int capacity = 0;
+    int ret;
+
+    *files = NULL;
+    *num_files = 0;
+    if (stat(path, &st) != 0) {
+        printf("ERROR: %s does not exist\n", path);
+        return -1;
+    }
+    const char* ext = strrchr(path, '.');
+    int is_list = S_ISDIR(st.st_mode) || (ext != NULL && (strcmp(ext, ".txt") == 0 || strcmp(ext, ".list") == 0));
+    if (S_ISDIR(st.st_mode)) {
+        ret = list_image_dir(path, files, num_files, &capacity);
+    } else if (is_list) {
+        ret = list_image_file_list(path, files, num_files, &capacity);
+    } else {
+        ret = append_image_path(files, num_files, &capacity, NULL, path);
+    }
+    if (ret != 0) {
+        free_image_files(*files, *num_files);
+        *files = NULL;
+        *num_files = 0;
+        return -1;
+    }
+    return is_list;
+}
+
+void free_image_files(char** files, int num_files)
+{
+    if (files == NULL) {
+        return;
+    }
+    for (int i = 0; i < num_files; i++) {
+        free(files[i]);
+    }
+    free(files);
+}
+
+static int read_fd(int fd, unsigned char* data, int size)
+{
+    int done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, data + done, size - done);
+        if (n <= 0) {
+            return -1;
+        }
+        done += (int)n;
+    }
+    return 0;
+}
+
+// A .data file with a raw frame header (see image_raw.h) gives its first frame and geometry, a
+// headerless one is read as is and the caller fills in the geometry
+static int read_image_raw(image_decoder_t* decoder, const char* path, image_buffer_t* image, int pooled)
 {
-    FILE *fp = fopen(path, "rb");
-    if(fp == NULL) {
-        printf("fopen %s fail!\n", path);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("open %s fail!\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("stat %s fail!\n", path);
+        close(fd);
         return -1;
     }
-    fseek(fp, 0, SEEK_END);
-    int file_size = ftell(fp);
-    unsigned char *data = image->virt_addr;
-    if (image->virt_addr == NULL) {
-        data = (unsigned char *)malloc(file_size+1);
+    uint64_t file_size = (uint64_t)st.st_size;
+    off_t data_offset = 0;
+    uint64_t data_bytes = file_size;
+    unsigned char head[IMAGE_RAW_HEADER_SIZE];
+    image_raw_header_t header;
+    int has_header = file_size >= IMAGE_RAW_HEADER_SIZE && read_fd(fd, head, IMAGE_RAW_HEADER_SIZE) == 0 &&
+                     image_raw_parse_header(head, file_size, &header) == 0;
+    if (has_header) {
+        // only the first frame of a multi-frame capture is read, image_raw_open maps all of them
+        if (header.header_size > file_size || header.payload_size > file_size - header.header_size) {
+            printf("raw frame %s is truncated!\n", path);
+            close(fd);
+            return -1;
+        }
+        // the pixels without trailing payload bytes, parse_header bounds the strides so this fits an int
+        image_buffer_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.width = (int)header.width_stride;
+        frame.height = (int)header.height_stride;
+        frame.format = (image_format_t)header.format;
+        data_offset = (off_t)header.header_size;
+        data_bytes = (uint64_t)get_image_size(&frame);
+    } else if (data_bytes > INT_MAX) {
+        printf("raw file %s is too large for one image, use image_raw_open!\n", path);
+        close(fd);
+        return -1;
     }
-    data[file_size] = 0; // Null-terminate, common for text/raw, but care for binary.
-    fseek(fp, 0, SEEK_SET);
-    if(file_size != fread(data, 1, file_size, fp)) {
-        printf("fread %s fail!\n", path);
-        free(data); // Free if allocation was here
-        fclose(fp); // Close file on error
+    int data_size = (int)data_bytes;
+    int allocated = 0;
+    unsigned char *data = decoder_output(decoder, image, data_size, pooled, &allocated);
+    if (data == NULL) {
+        close(fd);
         return -1;
     }
-    if(fp) {
-        fclose(fp);
+    if (lseek(fd, data_offset, SEEK_SET) != data_offset || read_fd(fd, data, data_size) != 0) {
+        printf("read %s fail!\n", path);
+        if (allocated) {
+            free(data);
+        }
+        close(fd);
+        return -1;
     }
-    if (image->virt_addr == NULL) {
-        image->virt_addr = data;
-        image->size = file_size;
+    close(fd);
+    if (has_header) {
+        image->width = (int)header.width;
+        image->height = (int)header.height;
+        image->width_stride = (int)header.width_stride;
+        image->height_stride = (int)header.height_stride;
+        image->format = (image_format_t)header.format;
+        image->color_space = (image_color_space_t)header.color_space;
     }
+    image->virt_addr = data;
+    image->size = data_size;
 
     return 0;
 }
 
-static int read_image_stb(const char* path, image_buffer_t* image)
+static int read_image_stb(image_decoder_t* decoder, const unsigned char* file_buf, size_t file_size, const char* path,
+                          image_buffer_t* image, int pooled)
 {
     // 默认图像为3通道
     int w, h, c;
     // STB_IMAGE loads into an RGB (or RGBA) buffer always
-    unsigned char* pixeldata = stbi_load(path, &w, &h, &c, 0);
+    unsigned char* pixeldata = stbi_load_from_memory(file_buf, (int)file_size, &w, &h, &c, 0);
     if (!pixeldata) {
         printf("error: read image %s fail\n", path);
         return -1;
@@ -335,14 +578,23 @@ static int read_image_stb(const char* path, image_buffer_t* image)
     int size = w * h * c;
 
     // 设置图像数据
-    if (image->virt_addr != NULL) {
-        memcpy(image->virt_addr, pixeldata, size);
+    if (image->virt_addr != NULL || pooled) {
+        int allocated;
+        unsigned char* out = decoder_output(decoder, image, size, 1, &allocated);
+        if (out == NULL) {
+            stbi_image_free(pixeldata);
+            return -1;
+        }
+        memcpy(out, pixeldata, size);
         stbi_image_free(pixeldata); // Free STB-allocated buffer as we copied it
+        image->virt_addr = out;
     } else {
         image->virt_addr = pixeldata; // Assign STB-allocated buffer
     }
     image->width = w;
     image->height = h;
+    image->width_stride = 0;
+    image->height_stride = 0;
     if (c == 4) {
         image->format = IMAGE_FORMAT_RGBA8888;
     } else if (c == 1) {
@@ -354,8 +606,10 @@ static int read_image_stb(const char* path, image_buffer_t* image)
     return 0;
 }
 
-int read_image(const char* path, image_buffer_t* image)
+static int decoder_read(image_decoder_t* decoder, const char* path, image_buffer_t* image,
+                        const image_read_options_t* options, image_read_info_t* info, int pooled)
 {
+    int ret;
     const char* _ext = strrchr(path, '.');
     if (!_ext) {
         // missing extension
@@ -363,24 +617,210 @@ int read_image(const char* path, image_buffer_t* image)
         return -1;
     }
     if (strcmp(_ext, ".data") == 0) {
-        return read_image_raw(path, image);
+        ret = read_image_raw(decoder, path, image, pooled);
+    } else {
+        size_t file_size = 0;
+        if (decoder_load_file(decoder, path, &file_size) != 0) {
+            return -1;
+        }
 #ifndef DISABLE_LIBJPEG
-    } else if (strcmp(_ext, ".jpg") == 0 || strcmp(_ext, ".jpeg") == 0 || strcmp(_ext, ".JPG") == 0 ||
-        strcmp(_ext, ".JPEG") == 0) {
-        return read_image_jpeg(path, image);
+        if (strcmp(_ext, ".jpg") == 0 || strcmp(_ext, ".jpeg") == 0 || strcmp(_ext, ".JPG") == 0 ||
+            strcmp(_ext, ".JPEG") == 0) {
+            return read_image_jpeg(decoder, path, decoder->file_buf, file_size, image, options, info, pooled);
+        }
+#endif
+        // Fallback to STB for PNG and other formats
+        ret = read_image_stb(decoder, decoder->file_buf, file_size, path, image, pooled);
+    }
+    // only JPEG decodes at a reduced size
+    if (ret == 0 && info != NULL) {
+        info->orig_width = image->width;
+        info->orig_height = image->height;
+        info->scale_num = 1;
+        info->scale_denom = 1;
+    }
+    return ret;
+}
+
+image_decoder_t* image_decoder_create(void)
+{
+    image_decoder_t* decoder = (image_decoder_t*)calloc(1, sizeof(image_decoder_t));
+    if (decoder == NULL) {
+        printf("ERROR: Failed to allocate image decoder\n");
+    }
+    return decoder;
+}
+
+void image_decoder_destroy(image_decoder_t* decoder)
+{
+    if (decoder == NULL) {
+        return;
+    }
+#ifndef DISABLE_LIBJPEG
+    if (decoder->handle != NULL) {
+        tjDestroy(decoder->handle);
+    }
+#endif
+    image_pool_release(decoder->file_buf);
+    image_pool_release(decoder->out_buf);
+    image_pool_release(decoder->tmp_buf);
+    free(decoder);
+}
+
+int image_decoder_read(image_decoder_t* decoder, const char* path, image_buffer_t* image,
+                       const image_read_options_t* options, image_read_info_t* info)
+{
+    if (decoder == NULL || path == NULL || image == NULL) {
+        return -1;
+    }
+    return decoder_read(decoder, path, image, options, info, 1);
+}
+
+int image_decoder_decode(image_decoder_t* decoder, const unsigned char* data, size_t size, image_buffer_t* image,
+                         const image_read_options_t* options, image_read_info_t* info)
+{
+    if (decoder == NULL || data == NULL || size < 2 || image == NULL) {
+        return -1;
+    }
+#ifndef DISABLE_LIBJPEG
+    if (data[0] == 0xFF && data[1] == 0xD8) {
+        return read_image_jpeg(decoder, "<memory>", data, (unsigned long)size, image, options, info, 1);
+    }
 #endif
-    } else { // Fallback to STB for PNG and other formats
-        return read_image_stb(path, image);
+    int ret = read_image_stb(decoder, data, size, "<memory>", image, 1);
+    if (ret == 0 && info != NULL) {
+        info->orig_width = image->width;
+        info->orig_height = image->height;
+        info->scale_num = 1;
+        info->scale_denom = 1;
+    }
+    return ret;
+}
+
+// read_image/read_image_ex keep one decoder per thread, released when the thread exits
+static pthread_key_t g_decoder_key;
+static pthread_once_t g_decoder_key_once = PTHREAD_ONCE_INIT;
+
+static void destroy_thread_decoder(void* decoder)
+{
+    image_decoder_destroy((image_decoder_t*)decoder);
+}
+
+static void create_decoder_key(void)
+{
+    pthread_key_create(&g_decoder_key, destroy_thread_decoder);
+}
+
+static image_decoder_t* get_thread_decoder(void)
+{
+    pthread_once(&g_decoder_key_once, create_decoder_key);
+    image_decoder_t* decoder = (image_decoder_t*)pthread_getspecific(g_decoder_key);
+    if (decoder == NULL) {
+        decoder = image_decoder_create();
+        if (decoder != NULL) {
+            pthread_setspecific(g_decoder_key, decoder);
+        }
+    }
+    return decoder;
+}
+
+int read_image_ex(const char* path, image_buffer_t* image, const image_read_options_t* options, image_read_info_t* info)
+{
+    image_decoder_t* decoder = get_thread_decoder();
+    if (decoder == NULL) {
+        return -1;
+    }
+    return decoder_read(decoder, path, image, options, info, 0);
+}
+
+int read_image(const char* path, image_buffer_t* image)
+{
+    return read_image_ex(path, image, NULL, NULL);
+}
+
+// PNG with the Up filter on every row and the caller's deflate level. stbi_write_png tries all five
+// filters on every row and takes its level from a global, which encoder threads cannot share.
+static int write_image_png_fast(const char* path, const image_buffer_t* image, int channel, int level)
+{
+    static const unsigned char sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    static const int ctype[5] = { -1, 0, 4, 2, 6 };
+    int row_bytes = image->width * channel;
+    int stride = image_row_bytes(image);
+    int filt_len = (row_bytes + 1) * image->height;
+    // frame sized, taken from the default pool so writer threads reuse them instead of hitting malloc
+    unsigned char* filt = (unsigned char*)image_pool_alloc(image_pool_default(), filt_len, NULL);
+    if (filt == NULL) {
+        return -1;
+    }
+    for (int y = 0; y < image->height; y++) {
+        const unsigned char* row = image->virt_addr + (size_t)y * stride;
+        unsigned char* out = filt + (size_t)y * (row_bytes + 1);
+        if (y == 0) {
+            out[0] = 0;
+            memcpy(out + 1, row, row_bytes);
+            continue;
+        }
+        const unsigned char* prev = row - stride;
+        out[0] = 2;
+        for (int x = 0; x < row_bytes; x++) {
+            out[1 + x] = (unsigned char)(row[x] - prev[x]);
+        }
+    }
+    int zlen = 0;
+    unsigned char* zlib = stbi_zlib_compress(filt, filt_len, &zlen, level);
+    image_pool_release(filt);
+    if (zlib == NULL) {
+        return -1;
+    }
+
+    int len = 8 + 12 + 13 + 12 + zlen + 12;
+    unsigned char* png = (unsigned char*)image_pool_alloc(image_pool_default(), len, NULL);
+    if (png == NULL) {
+        free(zlib);
+        return -1;
     }
+    unsigned char* o = png;
+    memcpy(o, sig, 8);
+    o += 8;
+    stbiw__wp32(o, 13);
+    stbiw__wptag(o, "IHDR");
+    stbiw__wp32(o, image->width);
+    stbiw__wp32(o, image->height);
+    *o++ = 8;
+    *o++ = (unsigned char)ctype[channel];
+    *o++ = 0;
+    *o++ = 0;
+    *o++ = 0;
+    stbiw__wpcrc(&o, 13);
+    stbiw__wp32(o, zlen);
+    stbiw__wptag(o, "IDAT");
+    memcpy(o, zlib, zlen);
+    o += zlen;
+    free(zlib);
+    stbiw__wpcrc(&o, zlen);
+    stbiw__wp32(o, 0);
+    stbiw__wptag(o, "IEND");
+    stbiw__wpcrc(&o, 0);
+
+    int ret = write_data_to_file(path, (const char*)png, len);
+    image_pool_release(png);
+    return ret;
 }
 
 int write_image(const char* path, const image_buffer_t* img)
+{
+    return write_image_ex(path, img, NULL);
+}
+
+int write_image_ex(const char* path, const image_buffer_t* img, const image_write_options_t* options)
 {
     int ret;
     int width = img->width;
     int height = img->height;
     int channel;
     void* data = img->virt_addr;
+    int jpeg_quality = options != NULL && options->jpeg_quality > 0 ? options->jpeg_quality : 95;
+    int png_level = options != NULL ? options->png_level : 0;
 
     // Determine channel count based on format
     if (img->format == IMAGE_FORMAT_RGB888) {
@@ -394,9 +834,6 @@ int write_image(const char* path, const image_buffer_t* img)
         return -1;
     }
 
-    printf("write_image path: %s width=%d height=%d channel=%d data=%p\n",
-        path, width, height, channel, data);
-
     const char* _ext = strrchr(path, '.');
     if (!_ext) {
         // missing extension
@@ -404,14 +841,17 @@ int write_image(const char* path, const image_buffer_t* img)
     }
 
     if (strcmp(_ext, ".png") == 0 || strcmp(_ext, ".PNG") == 0) { // Fixed logical OR to ||
-        ret = stbi_write_png(path, width, height, channel, data, width * channel); // Added stride
+        if (png_level > 0) {
+            ret = write_image_png_fast(path, img, channel, png_level);
+        } else {
+            ret = stbi_write_png(path, width, height, channel, data, image_row_bytes(img)) ? 0 : -1;
+        }
     } else if (strcmp(_ext, ".jpg") == 0 || strcmp(_ext, ".jpeg") == 0 || strcmp(_ext, ".JPG") == 0 ||
         strcmp(_ext, ".JPEG") == 0) {
-        int quality = 95;
 #ifndef DISABLE_LIBJPEG
-        ret = write_image_jpeg(path, quality, img);
+        ret = write_image_jpeg(path, jpeg_quality, img);
 #else
-        ret = stbi_write_jpg(path, width, height, channel, data, quality);
+        ret = stbi_write_jpg(path, width, height, channel, data, jpeg_quality) ? 0 : -1;
 #endif
     } else if (strcmp(_ext, ".data") == 0 || strcmp(_ext, ".DATA") == 0) { // Fixed logical OR to ||
         int size = get_image_size(img);
@@ -424,107 +864,247 @@ int write_image(const char* path, const image_buffer_t* img)
     return ret;
 }
 
-static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width, int src_height,
+// Destination rows of one resize, split into bands on the shared thread pool. Bands restart the
+// row cache at their first row, every row is computed the same way so the output does not
+// depend on the number of threads.
+typedef struct {
+    const resize_table_t* table;
+    const resize_table_t* uv_table;     // chroma tables of resize_to_rgb888
+    int to_rgb888;                      // src_format -> RGB888 with resize_to_rgb888
+    image_format_t src_format;
+    const unsigned char* src;
+    int src_stride;
+    const unsigned char* src_uv;        // U or UV plane
+    const unsigned char* src_v;         // V plane of YUV420P
+    int uv_stride;
+    image_color_space_t color_space;
+    unsigned char* dst;
+    int dst_stride;
+    short* scratch;                     // scratch_size elements per worker
+    int scratch_size;
+} resize_job_t;
+
+#define RESIZE_MIN_BAND_ROWS 32
+
+static int resize_job_workers(void)
+{
+    return thread_pool_size(thread_pool_shared()) + 1;
+}
+
+static void resize_job_band(void* arg, int begin, int end, int worker)
+{
+    resize_job_t* job = (resize_job_t*)arg;
+    short* scratch = job->scratch + (size_t)worker * job->scratch_size;
+    if (job->to_rgb888) {
+        const uint8_t* planes[3] = {job->src, job->src_uv, job->src_v};
+        int strides[3] = {job->src_stride, job->uv_stride, job->uv_stride};
+        resize_to_rgb888(job->src_format, job->table, job->uv_table, planes, strides, job->color_space,
+                         job->dst, job->dst_stride, begin, end, scratch);
+    } else {
+        resize_bilinear(job->table, job->src, job->src_stride, job->dst, job->dst_stride, begin, end, scratch);
+    }
+}
+
+static void run_resize_job(resize_job_t* job)
+{
+    thread_pool_parallel_for(thread_pool_shared(), job->table->dst_height, RESIZE_MIN_BAND_ROWS, resize_job_band, job);
+}
+
+// Scratch for every worker of the shared thread pool, from the default image pool so repeated
+// conversions without a letterbox plan reuse the same buffer
+static int run_resize_job_alloc(resize_job_t* job)
+{
+    job->scratch = (short*)image_pool_alloc(image_pool_default(),
+                                            (size_t)job->scratch_size * resize_job_workers() * sizeof(short), NULL);
+    if (job->scratch == NULL) {
+        printf("ERROR: alloc resize scratch fail!\n");
+        return -1;
+    }
+    run_resize_job(job);
+    image_pool_release(job->scratch);
+    job->scratch = NULL;
+    return 0;
+}
+
+static int crop_and_scale_image_c(int channel, unsigned char *src, int src_stride, int src_width, int src_height,
                                    int crop_x, int crop_y, int crop_width, int crop_height,
-                                   unsigned char *dst, int dst_width, int dst_height,
-                                   int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
+                                   unsigned char *dst, int dst_stride,
+                                   int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height, resize_isa_t isa) {
     if (dst == NULL || src == NULL) { // Added src == NULL check
         printf("src or dst buffer is null\n");
         return -1;
     }
 
-    float x_ratio = (float)crop_width / (float)dst_box_width;
-    float y_ratio = (float)crop_height / (float)dst_box_height;
+    // keep the crop inside the source image, sampling positions are clamped to the crop edge
+    if (crop_x < 0) crop_x = 0;
+    if (crop_y < 0) crop_y = 0;
+    if (crop_x + crop_width > src_width) crop_width = src_width - crop_x;
+    if (crop_y + crop_height > src_height) crop_height = src_height - crop_y;
 
     // printf("src_width=%d src_height=%d crop_x=%d crop_y=%d crop_width=%d crop_height=%d\n",
     //      src_width, src_height, crop_x, crop_y, crop_width, crop_height);
     // printf("dst_width=%d dst_height=%d dst_box_x=%d dst_box_y=%d dst_box_width=%d dst_box_height=%d\n",
     //      dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
-    // printf("channel=%d x_ratio=%f y_ratio=%f\n", channel, x_ratio, y_ratio);
 
     // From original image specified area, bilinearly scale to target specified area
-    for (int dst_y = dst_box_y; dst_y < dst_box_y + dst_box_height; dst_y++) {
-        for (int dst_x = dst_box_x; dst_x < dst_box_x + dst_box_width; dst_x++) {
-            int dst_x_offset = dst_x - dst_box_x;
-            int dst_y_offset = dst_y - dst_box_y;
-
-            // Calculate source coordinates
-            float src_x_float = dst_x_offset * x_ratio;
-            float src_y_float = dst_y_offset * y_ratio;
-
-            int src_x1 = (int)src_x_float;
-            int src_y1 = (int)src_y_float;
-            int src_x2 = (src_x1 + 1 < crop_width) ? src_x1 + 1 : src_x1; // Clamp x2
-            int src_y2 = (src_y1 + 1 < crop_height) ? src_y1 + 1 : src_y1; // Clamp y2
-
-            float x_diff = src_x_float - src_x1;
-            float y_diff = src_y_float - src_y1;
-
-            // Calculate global source indices
-            int global_src_x1 = crop_x + src_x1;
-            int global_src_y1 = crop_y + src_y1;
-            int global_src_x2 = crop_x + src_x2;
-            int global_src_y2 = crop_y + src_y2;
-
-            // Ensure indices are within bounds of the original source image
-            global_src_x1 = fmax(0, fmin(global_src_x1, src_width - 1));
-            global_src_y1 = fmax(0, fmin(global_src_y1, src_height - 1));
-            global_src_x2 = fmax(0, fmin(global_src_x2, src_width - 1));
-            global_src_y2 = fmax(0, fmin(global_src_y2, src_height - 1));
-
-
-            int index_A = global_src_y1 * src_width * channel + global_src_x1 * channel;
-            int index_B = global_src_y1 * src_width * channel + global_src_x2 * channel; // Right
-            int index_C = global_src_y2 * src_width * channel + global_src_x1 * channel; // Down
-            int index_D = global_src_y2 * src_width * channel + global_src_x2 * channel; // Down-Right
-
-            for (int c = 0; c < channel; c++) {
-                unsigned char A = src[index_A + c];
-                unsigned char B = src[index_B + c];
-                unsigned char C = src[index_C + c];
-                unsigned char D = src[index_D + c];
-
-                // Bilinear interpolation
-                unsigned char pixel = (unsigned char)(
-                    A * (1.0f - x_diff) * (1.0f - y_diff) +
-                    B * x_diff * (1.0f - y_diff) +
-                    C * (1.0f - x_diff) * y_diff +
-                    D * x_diff * y_diff
-                );
-
-                dst[(dst_y * dst_width + dst_x) * channel + c] = pixel;
-            }
-        }
+    resize_table_t table;
+    memset(&table, 0, sizeof(resize_table_t));
+    if (resize_table_init(&table, channel, crop_width, crop_height, dst_box_width, dst_box_height) != 0) {
+        return -1;
     }
-    return 0;
+    table.isa = isa;
+    resize_job_t job;
+    memset(&job, 0, sizeof(resize_job_t));
+    job.table = &table;
+    job.src = src + crop_y * src_stride + crop_x * channel;
+    job.src_stride = src_stride;
+    job.dst = dst + dst_box_y * dst_stride + dst_box_x * channel;
+    job.dst_stride = dst_stride;
+    job.scratch_size = resize_scratch_size(&table);
+    int ret = run_resize_job_alloc(&job);
+    resize_table_release(&table);
+    return ret;
 }
 
-static int crop_and_scale_image_yuv420sp(unsigned char *src, int src_width, int src_height,
-                                         int crop_x, int crop_y, int crop_width, int crop_height,
-                                         unsigned char *dst, int dst_width, int dst_height,
-                                         int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
-
-    unsigned char* src_y = src;
-    unsigned char* src_uv = src + src_width * src_height;
-
-    unsigned char* dst_y = dst;
-    unsigned char* dst_uv = dst + dst_width * dst_height;
+static int crop_and_scale_image_yuv420sp(image_buffer_t *src, int crop_x, int crop_y, int crop_width, int crop_height,
+                                         image_buffer_t *dst, int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height,
+                                         resize_isa_t isa) {
+    int src_stride = image_row_bytes(src);
+    int dst_stride = image_row_bytes(dst);
 
     // Process Y plane (full resolution)
-    crop_and_scale_image_c(1, src_y, src_width, src_height, crop_x, crop_y, crop_width, crop_height,
-        dst_y, dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+    int ret = crop_and_scale_image_c(1, src->virt_addr, src_stride, src->width, src->height,
+        crop_x, crop_y, crop_width, crop_height,
+        dst->virt_addr, dst_stride, dst_box_x, dst_box_y, dst_box_width, dst_box_height, isa);
+    if (ret != 0) {
+        return ret;
+    }
 
-    // Process UV plane (half resolution, x2 channels for UV interleaved)
+    // Process UV plane (half resolution, x2 channels for UV interleaved, same row pitch as Y)
     // Ensure all coordinates are even for UV plane
-    crop_and_scale_image_c(2, src_uv, src_width / 2, src_height / 2,
+    return crop_and_scale_image_c(2, image_uv_plane(src), src_stride, src->width / 2, src->height / 2,
         crop_x / 2, crop_y / 2, crop_width / 2, crop_height / 2, // Half-res coordinates
-        dst_uv, dst_width / 2, dst_height / 2,
-        dst_box_x / 2, dst_box_y / 2, dst_box_width / 2, dst_box_height / 2); // Half-res dest box
+        image_uv_plane(dst), dst_stride,
+        dst_box_x / 2, dst_box_y / 2, dst_box_width / 2, dst_box_height / 2, isa); // Half-res dest box
+}
 
-    return 0;
+// Bands of the destination outside box: top, bottom, left, right. Empty bands are skipped.
+static int get_pad_rects(int dst_width, int dst_height, int box_x, int box_y, int box_w, int box_h, image_rect_t rects[4])
+{
+    int n = 0;
+    int bands[4][4] = {
+        {0, 0, dst_width - 1, box_y - 1},
+        {0, box_y + box_h, dst_width - 1, dst_height - 1},
+        {0, box_y, box_x - 1, box_y + box_h - 1},
+        {box_x + box_w, box_y, dst_width - 1, box_y + box_h - 1},
+    };
+    for (int i = 0; i < 4; i++) {
+        if (bands[i][2] < bands[i][0] || bands[i][3] < bands[i][1]) {
+            continue;
+        }
+        rects[n].left = bands[i][0];
+        rects[n].top = bands[i][1];
+        rects[n].right = bands[i][2];
+        rects[n].bottom = bands[i][3];
+        n++;
+    }
+    return n;
 }
 
-static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rect_t *src_box, image_rect_t *dst_box, char color) {
+// Fill the pad bands on the CPU, for YUV420SP both planes get the color like a full memset would
+static void fill_pad_rects_cpu(image_buffer_t* dst, const image_rect_t* rects, int num_rects, char color)
+{
+    int pixel_size = 1;
+    int yuv420sp = 0;
+    switch (dst->format) {
+    case IMAGE_FORMAT_RGB888:
+    case IMAGE_FORMAT_BGR888:
+        pixel_size = 3;
+        break;
+    case IMAGE_FORMAT_RGBA8888:
+        pixel_size = 4;
+        break;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+        yuv420sp = 1;
+        break;
+    default:
+        break;
+    }
+    int stride = image_row_bytes(dst);
+    unsigned char* uv = image_uv_plane(dst);
+    for (int i = 0; i < num_rects; i++) {
+        const image_rect_t* r = &rects[i];
+        int w = r->right - r->left + 1;
+        for (int y = r->top; y <= r->bottom; y++) {
+            memset(dst->virt_addr + y * stride + r->left * pixel_size, color, w * pixel_size);
+        }
+        if (yuv420sp) {
+            // chroma rows cover two luma rows, bands start on even coordinates
+            for (int y = r->top / 2; y <= r->bottom / 2; y++) {
+                memset(uv + y * stride + (r->left / 2) * 2, color, ((w + 1) / 2) * 2);
+            }
+        }
+    }
+}
+
+// Planes of the source starting at pixel (x, y) for resize_to_rgb888, x and y even for subsampled chroma
+static void set_job_source(resize_job_t* job, const image_buffer_t* src, int x, int y)
+{
+    int pixel_size = image_row_bytes(src) / image_width_stride(src);
+    job->src_format = src->format;
+    job->color_space = src->color_space;
+    job->src_stride = image_row_bytes(src);
+    job->src = src->virt_addr + y * job->src_stride + x * pixel_size;
+    if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21) {
+        job->uv_stride = job->src_stride;
+        job->src_uv = image_uv_plane(src) + (y / 2) * job->uv_stride + x;
+    } else if (src->format == IMAGE_FORMAT_YUV420P) {
+        job->uv_stride = image_width_stride(src) / 2;
+        int plane_size = job->uv_stride * (image_height_stride(src) / 2);
+        job->src_uv = image_uv_plane(src) + (y / 2) * job->uv_stride + x / 2;
+        job->src_v = job->src_uv + plane_size;
+    }
+}
+
+// Any resize_to_rgb888 format -> RGB888 resize in one pass, no full resolution RGB intermediate
+static int crop_and_scale_to_rgb888(image_buffer_t *src, int crop_x, int crop_y, int crop_width, int crop_height,
+                                    image_buffer_t *dst, int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height,
+                                    resize_isa_t isa) {
+    // chroma is subsampled by 2, keep the crop origin on even coordinates
+    if (src->format != IMAGE_FORMAT_BGR888 && src->format != IMAGE_FORMAT_RGB565) {
+        crop_x &= ~1;
+        crop_y &= ~1;
+    }
+    if (crop_x < 0) crop_x = 0;
+    if (crop_y < 0) crop_y = 0;
+    if (crop_x + crop_width > src->width) crop_width = src->width - crop_x;
+    if (crop_y + crop_height > src->height) crop_height = src->height - crop_y;
+
+    resize_table_t table, uv_table;
+    memset(&table, 0, sizeof(resize_table_t));
+    memset(&uv_table, 0, sizeof(resize_table_t));
+    if (resize_to_rgb888_tables_init(src->format, &table, &uv_table, crop_width, crop_height, dst_box_width, dst_box_height) != 0) {
+        return -1;
+    }
+    table.isa = isa;
+    resize_job_t job;
+    memset(&job, 0, sizeof(resize_job_t));
+    job.table = &table;
+    job.uv_table = &uv_table;
+    job.to_rgb888 = 1;
+    set_job_source(&job, src, crop_x, crop_y);
+    job.dst_stride = image_row_bytes(dst);
+    job.dst = dst->virt_addr + dst_box_y * job.dst_stride + dst_box_x * 3;
+    job.scratch_size = resize_to_rgb888_scratch_size(src->format, &table, &uv_table);
+    int ret = run_resize_job_alloc(&job);
+    resize_table_release(&table);
+    resize_table_release(&uv_table);
+    return ret;
+}
+
+// Crop and scale on the CPU, the pad area around dst_box is left untouched
+static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rect_t *src_box, image_rect_t *dst_box, resize_isa_t isa) {
     int ret = 0; // Initialize ret
     if (dst->virt_addr == NULL) {
         printf("ERROR: Destination buffer is NULL.\n");
@@ -534,9 +1114,10 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rec
         printf("ERROR: Source buffer is NULL.\n");
         return -1;
     }
-    if (src->format != dst->format) {
+    int to_rgb = src->format != dst->format && dst->format == IMAGE_FORMAT_RGB888 && resize_to_rgb888_supported(src->format);
+    if (src->format != dst->format && !to_rgb) {
         printf("ERROR: Source and destination formats (%d vs %d) do not match for CPU conversion.\n", src->format, dst->format);
-        // Note: For actual format conversion, you'd need more complex logic or RGA.
+        // Note: only conversions to RGB888 are done on the CPU, anything else needs RGA.
         return -1;
     }
 
@@ -561,33 +1142,27 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rec
         dst_box_h = dst_box->bottom - dst_box->top + 1;
     }
 
-    // fill pad color if destination box is smaller than the whole destination image
-    if (dst_box_w != dst->width || dst_box_h != dst->height || dst_box_x != 0 || dst_box_y != 0) { // Check all components
-        int dst_size = get_image_size(dst);
-        memset(dst->virt_addr, color, dst_size);
-        printf("DEBUG: Filled destination image with pad color 0x%02X.\n", (unsigned int)color);
-    }
-
-    if (src->format == IMAGE_FORMAT_RGB888) {
-        ret = crop_and_scale_image_c(3, src->virt_addr, src->width, src->height,
+    if (to_rgb) {
+        ret = crop_and_scale_to_rgb888(src, src_box_x, src_box_y, src_box_w, src_box_h,
+                                       dst, dst_box_x, dst_box_y, dst_box_w, dst_box_h, isa);
+    } else if (src->format == IMAGE_FORMAT_RGB888 || src->format == IMAGE_FORMAT_BGR888) {
+        ret = crop_and_scale_image_c(3, src->virt_addr, image_row_bytes(src), src->width, src->height,
                                      src_box_x, src_box_y, src_box_w, src_box_h,
-                                     dst->virt_addr, dst->width, dst->height,
-                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+                                     dst->virt_addr, image_row_bytes(dst),
+                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h, isa);
     } else if (src->format == IMAGE_FORMAT_RGBA8888) {
-        ret = crop_and_scale_image_c(4, src->virt_addr, src->width, src->height,
+        ret = crop_and_scale_image_c(4, src->virt_addr, image_row_bytes(src), src->width, src->height,
                                      src_box_x, src_box_y, src_box_w, src_box_h,
-                                     dst->virt_addr, dst->width, dst->height,
-                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+                                     dst->virt_addr, image_row_bytes(dst),
+                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h, isa);
     } else if (src->format == IMAGE_FORMAT_GRAY8) {
-        ret = crop_and_scale_image_c(1, src->virt_addr, src->width, src->height,
+        ret = crop_and_scale_image_c(1, src->virt_addr, image_row_bytes(src), src->width, src->height,
                                      src_box_x, src_box_y, src_box_w, src_box_h,
-                                     dst->virt_addr, dst->width, dst->height,
-                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+                                     dst->virt_addr, image_row_bytes(dst),
+                                     dst_box_x, dst_box_y, dst_box_w, dst_box_h, isa);
     } else if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21) {
-        ret = crop_and_scale_image_yuv420sp(src->virt_addr, src->width, src->height,
-                                            src_box_x, src_box_y, src_box_w, src_box_h,
-                                            dst->virt_addr, dst->width, dst->height,
-                                            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+        ret = crop_and_scale_image_yuv420sp(src, src_box_x, src_box_y, src_box_w, src_box_h,
+                                            dst, dst_box_x, dst_box_y, dst_box_w, dst_box_h, isa);
     } else {
         printf("ERROR: No support for format %d in convert_image_cpu.\n", src->format);
         ret = -1; // Indicate error
@@ -596,7 +1171,6 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst, image_rec
         printf("ERROR: crop_and_scale_image_c/yuv420sp fail with code %d\n", ret);
         return -1;
     }
-    printf("DEBUG: CPU image conversion finished.\n");
     return 0;
 }
 
@@ -605,23 +1179,31 @@ int get_image_size(const image_buffer_t* image)
     if (image == NULL) {
         return 0;
     }
+    int width = image_width_stride(image);
+    int height = image_height_stride(image);
     switch (image->format)
     {
     case IMAGE_FORMAT_GRAY8:
-        return image->width * image->height;
+        return width * height;
     case IMAGE_FORMAT_RGB888:
-        return image->width * image->height * 3;
+    case IMAGE_FORMAT_BGR888:
+        return width * height * 3;
     case IMAGE_FORMAT_RGBA8888:
-        return image->width * image->height * 4;
+        return width * height * 4;
+    case IMAGE_FORMAT_YUYV:
+    case IMAGE_FORMAT_RGB565:
+        return width * height * 2;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        return image->width * image->height * 3 / 2;
+    case IMAGE_FORMAT_YUV420P:
+        return width * height * 3 / 2;
     default:
         printf("WARNING: Unknown image format %d, cannot determine size.\n", image->format);
         return 0; // Return 0 or -1 for unknown format
     }
 }
 
+#if !defined(DISABLE_RGA)
 static int get_rga_fmt(image_format_t fmt) {
     switch (fmt)
     {
@@ -633,229 +1215,174 @@ static int get_rga_fmt(image_format_t fmt) {
         return RK_FORMAT_YCbCr_420_SP;
     case IMAGE_FORMAT_YUV420SP_NV21:
         return RK_FORMAT_YCrCb_420_SP;
+    case IMAGE_FORMAT_YUV420P:
+        return RK_FORMAT_YCbCr_420_P;
+    case IMAGE_FORMAT_BGR888:
+        return RK_FORMAT_BGR_888;
+    case IMAGE_FORMAT_YUYV:
+        return RK_FORMAT_YUYV_422;
+    case IMAGE_FORMAT_RGB565:
+        return RK_FORMAT_RGB_565;
     default:
         printf("ERROR: Unsupported image format %d for RGA.\n", fmt);
         return -1;
     }
 }
 
+// RGA view of an image: an imported handle (LIBRGA_IM2D_HANDLE) or a wrapped fd/address
+typedef struct {
+    rga_buffer_t buf;
+    rga_buffer_handle_t handle;
+} rga_image_t;
 
-static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color)
+static int rga_image_wrap(const image_buffer_t* img, rga_image_t* rga_img)
 {
-    int ret = 0; // Default to success for RGA processing
-
-    int srcWidth = src_img->width;
-    int srcHeight = src_img->height;
-    void *src = src_img->virt_addr;
-    int src_fd = src_img->fd;
-    void *src_phy = NULL; // Assuming this is not used or handled externally
-    int srcFmt = get_rga_fmt(src_img->format);
-    if (srcFmt == -1) goto err;
-
-    int dstWidth = dst_img->width;
-    int dstHeight = dst_img->height;
-    void *dst = dst_img->virt_addr;
-    int dst_fd = dst_img->fd;
-    void *dst_phy = NULL; // Assuming this is not used or handled externally
-    int dstFmt = get_rga_fmt(dst_img->format);
-    if (dstFmt == -1) goto err;
-
-
-    int rotate = 0; // Default rotate
-    int use_handle = 0;
+    memset(rga_img, 0, sizeof(rga_image_t));
+    int fmt = get_rga_fmt(img->format);
+    if (fmt == -1) {
+        return -1;
+    }
+    int width_stride = image_width_stride(img);
+    int height_stride = image_height_stride(img);
 #if defined(LIBRGA_IM2D_HANDLE)
-    use_handle = 1;
-#endif
-
-    // printf("src width=%d height=%d fmt=0x%x virAddr=0x%p fd=%d\n",
-    //      srcWidth, srcHeight, srcFmt, src, src_fd);
-    // printf("dst width=%d height=%d fmt=0x%x virAddr=0x%p fd=%d\n",
-    //      dstWidth, dstHeight, dstFmt, dst, dst_fd);
-    // printf("rotate=%d\n", rotate);
-
-    int usage = 0;
-    IM_STATUS ret_rga = IM_STATUS_NOERROR;
-
-    // set rga usage
-    usage |= rotate; // Only rotate flag used
-
-    // set rga rect
-    im_rect srect;
-    im_rect drect;
-    im_rect prect; // Pad rect, usually 0 for scaling ops
-    memset(&prect, 0, sizeof(im_rect)); // Initialize prect
-
-    if (src_box != NULL) {
-        srect.x = src_box->left;
-        srect.y = src_box->top;
-        srect.width = src_box->right - src_box->left + 1;
-        srect.height = src_box->bottom - src_box->top + 1;
+    // imported buffers span the whole stride area
+    rga_img->handle = rga_handle_cache_acquire(img->fd, img->virt_addr, width_stride, height_stride, fmt);
+    if (rga_img->handle <= 0) {
+        printf("ERROR: rga handle error %d\n", rga_img->handle);
+        rga_img->handle = 0;
+        return -1;
+    }
+    rga_img->buf = wrapbuffer_handle(rga_img->handle, img->width, img->height, fmt, width_stride, height_stride);
+#else
+    if (img->fd > 0) {
+        rga_img->buf = wrapbuffer_fd(img->fd, img->width, img->height, fmt, width_stride, height_stride);
     } else {
-        srect.x = 0;
-        srect.y = 0;
-        srect.width = srcWidth;
-        srect.height = srcHeight;
+        rga_img->buf = wrapbuffer_virtualaddr(img->virt_addr, img->width, img->height, fmt, width_stride, height_stride);
     }
+#endif
+    return 0;
+}
 
-    if (dst_box != NULL) {
-        drect.x = dst_box->left;
-        drect.y = dst_box->top;
-        drect.width = dst_box->right - dst_box->left + 1;
-        drect.height = dst_box->bottom - dst_box->top + 1;
-    } else {
-        drect.x = 0;
-        drect.y = 0;
-        drect.width = dstWidth;
-        drect.height = dstHeight;
+static void rga_image_release(rga_image_t* rga_img)
+{
+    if (rga_img->handle > 0) {
+        rga_handle_cache_release(rga_img->handle);
+        rga_img->handle = 0;
     }
+}
 
-    // set rga buffer
-    rga_buffer_t rga_buf_src;
-    rga_buffer_t rga_buf_dst;
-    rga_buffer_t pat; // Pattern buffer, not used for simple scale/crop
-    memset(&pat, 0, sizeof(rga_buffer_t)); // Initialize pat
-
-    im_handle_param_t in_param;
-    in_param.width = srcWidth;
-    in_param.height = srcHeight;
-    in_param.format = srcFmt;
-
-    im_handle_param_t dst_param;
-    dst_param.width = dstWidth;
-    dst_param.height = dstHeight;
-    dst_param.format = dstFmt;
-
-    rga_buffer_handle_t rga_handle_src = 0; // Initialize
-    rga_buffer_handle_t rga_handle_dst = 0; // Initialize
-
-    if (use_handle) {
-        if (src_phy != NULL) {
-            rga_handle_src = importbuffer_physicaladdr((uint64_t)src_phy, &in_param);
-        } else if (src_fd > 0) {
-            rga_handle_src = importbuffer_fd(src_fd, &in_param);
-        } else {
-            rga_handle_src = importbuffer_virtualaddr(src, &in_param);
-        }
-        if (rga_handle_src <= 0) {
-            printf("ERROR: src handle error %d\n", rga_handle_src);
-            ret = -1;
-            goto err;
-        }
-        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+static im_rect rga_rect(const image_rect_t* box, const image_buffer_t* img)
+{
+    im_rect rect;
+    if (box != NULL) {
+        rect.x = box->left;
+        rect.y = box->top;
+        rect.width = box->right - box->left + 1;
+        rect.height = box->bottom - box->top + 1;
     } else {
-        if (src_phy != NULL) {
-            rga_buf_src = wrapbuffer_physicaladdr(src_phy, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
-        } else if (src_fd > 0) {
-            rga_buf_src = wrapbuffer_fd(src_fd, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
-        } else {
-            rga_buf_src = wrapbuffer_virtualaddr(src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
-        }
+        rect.x = 0;
+        rect.y = 0;
+        rect.width = img->width;
+        rect.height = img->height;
     }
+    return rect;
+}
 
-    if (use_handle) {
-        if (dst_phy != NULL) {
-            rga_handle_dst = importbuffer_physicaladdr((uint64_t)dst_phy, &dst_param);
-        } else if (dst_fd > 0) {
-            rga_handle_dst = importbuffer_fd(dst_fd, &dst_param);
-        } else {
-            rga_handle_dst = importbuffer_virtualaddr(dst, &dst_param);
-        }
-        if (rga_handle_dst <= 0) {
-            printf("ERROR: dst handle error %d\n", rga_handle_dst);
-            ret = -1;
-            goto err;
-        }
-        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
-    } else {
-        if (dst_phy != NULL) {
-            rga_buf_dst = wrapbuffer_physicaladdr(dst_phy, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
-        } else if (dst_fd > 0) {
-            rga_buf_dst = wrapbuffer_fd(dst_fd, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
-        } else {
-            rga_buf_dst = wrapbuffer_virtualaddr(dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
-        }
+// YUV -> RGB matrix, RGA has no BT.709 full range mode
+static int rga_usage(const image_buffer_t* src_img)
+{
+    if (src_img->format != IMAGE_FORMAT_YUV420SP_NV12 && src_img->format != IMAGE_FORMAT_YUV420SP_NV21 &&
+        src_img->format != IMAGE_FORMAT_YUV420P && src_img->format != IMAGE_FORMAT_YUYV) {
+        return 0;
+    }
+    switch (src_img->color_space) {
+    case IMAGE_COLOR_SPACE_BT601_FULL:
+        return IM_YUV_TO_RGB_BT601_FULL;
+    case IMAGE_COLOR_SPACE_BT709_LIMITED:
+    case IMAGE_COLOR_SPACE_BT709_FULL:
+        return IM_YUV_TO_RGB_BT709_LIMIT;
+    default:
+        return IM_YUV_TO_RGB_BT601_LIMIT;
     }
+}
 
-    // Fill pad color if destination box is smaller than the whole destination image
-    if (drect.width != dstWidth || drect.height != dstHeight || drect.x != 0 || drect.y != 0) {
-        im_rect dst_whole_rect = {0, 0, dstWidth, dstHeight};
-        int imcolor = (color << 24) | (color << 16) | (color << 8) | color; // Assuming ARGB for RGA fill color
-        printf("DEBUG: Filling dst image (x=%d y=%d w=%d h=%d) with color=0x%x\n",
-            dst_whole_rect.x, dst_whole_rect.y, dst_whole_rect.width, dst_whole_rect.height, imcolor);
-        ret_rga = imfill(rga_buf_dst, dst_whole_rect, imcolor);
-        if (ret_rga <= 0) {
-            if (dst != NULL) {
-                size_t dst_size = get_image_size(dst_img);
-                memset(dst, color, dst_size); // Fallback to CPU memset if RGA fill fails
-                printf("WARNING: RGA imfill failed, fallback to CPU memset for padding.\n");
-            } else {
-                printf("WARNING: Can not fill color on target image (dst is NULL).\n");
-            }
-        }
+static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box)
+{
+    int ret = 0;
+    rga_image_t rga_src, rga_dst;
+    if (rga_image_wrap(src_img, &rga_src) != 0) {
+        return -1;
     }
+    if (rga_image_wrap(dst_img, &rga_dst) != 0) {
+        rga_image_release(&rga_src);
+        return -1;
+    }
+
+    rga_buffer_t pat; // Pattern buffer, not used for simple scale/crop
+    memset(&pat, 0, sizeof(rga_buffer_t));
+    im_rect prect; // Pad rect, usually 0 for scaling ops
+    memset(&prect, 0, sizeof(im_rect));
+    im_rect srect = rga_rect(src_box, src_img);
+    im_rect drect = rga_rect(dst_box, dst_img);
 
     // RGA process
-    ret_rga = improcess(rga_buf_src, rga_buf_dst, pat, srect, drect, prect, usage);
+    IM_STATUS ret_rga = improcess(rga_src.buf, rga_dst.buf, pat, srect, drect, prect, rga_usage(src_img));
     if (ret_rga <= 0) {
         printf("ERROR: RGA improcess failed. STATUS=%d, message: %s\n", ret_rga, imStrError((IM_STATUS)ret_rga));
         ret = -1;
-    } else {
-        printf("DEBUG: RGA improcess finished successfully.\n");
     }
 
-err: // Cleanup for convert_image_rga
-    if (rga_handle_src > 0) {
-        releasebuffer_handle(rga_handle_src);
+    rga_image_release(&rga_src);
+    rga_image_release(&rga_dst);
+    return ret;
+}
+
+static int fill_rects_rga(image_buffer_t* dst_img, const image_rect_t* rects, int num_rects, char color)
+{
+    rga_image_t rga_dst;
+    if (rga_image_wrap(dst_img, &rga_dst) != 0) {
+        return -1;
     }
-    if (rga_handle_dst > 0) {
-        releasebuffer_handle(rga_handle_dst);
+    int ret = 0;
+    int imcolor = (color << 24) | (color << 16) | (color << 8) | color; // Assuming ARGB for RGA fill color
+    for (int i = 0; i < num_rects; i++) {
+        im_rect band = {rects[i].left, rects[i].top,
+                        rects[i].right - rects[i].left + 1, rects[i].bottom - rects[i].top + 1};
+        IM_STATUS ret_rga = imfill(rga_dst.buf, band, imcolor);
+        if (ret_rga <= 0) {
+            if (dst_img->virt_addr != NULL) {
+                fill_pad_rects_cpu(dst_img, rects, num_rects, color); // Fallback to CPU if RGA fill fails
+                printf("WARNING: RGA imfill failed, fallback to CPU for padding.\n");
+            } else {
+                printf("WARNING: Can not fill color on target image (dst is NULL).\n");
+                ret = -1;
+            }
+            break;
+        }
     }
+    rga_image_release(&rga_dst);
     return ret;
 }
 
-int convert_image(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color)
+static int rga_supports(const image_buffer_t* src_img, const image_buffer_t* dst_img)
 {
-    int ret;
-#if defined(DISABLE_RGA)
-    printf("DEBUG: convert_image using CPU path (RGA disabled).\n");
-    ret = convert_image_cpu(src_img, dst_img, src_box, dst_box, color);
-#else // RGA is enabled
-    // RGA width alignment check
+    // RGA width alignment check, it applies to the row stride so padded camera buffers qualify
 #if defined(RV1106_1103)
     // RV1106/1103 might have a 4-pixel alignment requirement
-    if(src_img->width % 4 == 0 && dst_img->width % 4 == 0 &&
-       get_rga_fmt(src_img->format) != -1 && get_rga_fmt(dst_img->format) != -1) {
+    int align = 4;
 #else
     // Other platforms might have a 16-pixel alignment requirement
-    if(src_img->width % 16 == 0 && dst_img->width % 16 == 0 &&
-       get_rga_fmt(src_img->format) != -1 && get_rga_fmt(dst_img->format) != -1) {
+    int align = 16;
 #endif
-        printf("DEBUG: Attempting convert_image using RGA.\n");
-        ret = convert_image_rga(src_img, dst_img, src_box, dst_box, color);
-        if (ret != 0) {
-            printf("WARNING: RGA conversion failed (%d), falling back to CPU.\n", ret);
-            ret = convert_image_cpu(src_img, dst_img, src_box, dst_box, color);
-        }
-    } else {
-#if defined(RV1106_1103)
-        printf("DEBUG: Source/Destination width not 4-aligned or unsupported format for RGA, falling back to CPU.\n");
-#else
-        printf("DEBUG: Source/Destination width not 16-aligned or unsupported format for RGA, falling back to CPU.\n");
-#endif
-        ret = convert_image_cpu(src_img, dst_img, src_box, dst_box, color);
-    }
-#endif
-    return ret;
+    return image_width_stride(src_img) % align == 0 && image_width_stride(dst_img) % align == 0 &&
+           get_rga_fmt(src_img->format) != -1 && get_rga_fmt(dst_img->format) != -1;
 }
+#endif
 
-int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color)
+// Compute the centered destination box and the letterbox for scaling src_w x src_h into dst_w x dst_h
+static void compute_letterbox(int src_w, int src_h, int dst_w, int dst_h, image_rect_t* dst_box, letterbox_t* letterbox)
 {
-    int ret = 0;
     int allow_slight_change = 1;
-    int src_w = src_image->width;
-    int src_h = src_image->height;
-    int dst_w = dst_image->width;
-    int dst_h = dst_image->height;
     int resize_w = dst_w;
     int resize_h = dst_h;
 
@@ -866,17 +1393,10 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
     int _top_offset = 0;
     float scale = 1.0f; // Use float literal
 
-    image_rect_t src_box;
-    src_box.left = 0;
-    src_box.top = 0;
-    src_box.right = src_image->width - 1;
-    src_box.bottom = src_image->height - 1;
-
-    image_rect_t dst_box;
-    dst_box.left = 0;
-    dst_box.top = 0;
-    dst_box.right = dst_image->width - 1;
-    dst_box.bottom = dst_image->height - 1;
+    dst_box->left = 0;
+    dst_box->top = 0;
+    dst_box->right = dst_w - 1;
+    dst_box->bottom = dst_h - 1;
 
     float _scale_w = (float)dst_w / src_w;
     float _scale_h = (float)dst_h / src_h;
@@ -906,52 +1426,53 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
 
     // center
     if (_scale_w < _scale_h) { // Height is constrained, pad width
-        dst_box.top = padding_h / 2;
+        dst_box->top = padding_h / 2;
         // Ensure top offset is even for YUV formats
-        if (dst_box.top % 2 != 0) {
-            dst_box.top -= 1; // Round down to nearest even
-            if (dst_box.top < 0) dst_box.top = 0; // Don't go below 0
+        if (dst_box->top % 2 != 0) {
+            dst_box->top -= 1; // Round down to nearest even
+            if (dst_box->top < 0) dst_box->top = 0; // Don't go below 0
         }
-        dst_box.bottom = dst_box.top + resize_h - 1;
-        _top_offset = dst_box.top;
-        dst_box.left = (dst_w - resize_w) / 2; // Center horizontally
-        if (dst_box.left % 2 != 0) { // Ensure left offset is even
-            dst_box.left -= 1;
-            if (dst_box.left < 0) dst_box.left = 0;
+        dst_box->bottom = dst_box->top + resize_h - 1;
+        _top_offset = dst_box->top;
+        dst_box->left = (dst_w - resize_w) / 2; // Center horizontally
+        if (dst_box->left % 2 != 0) { // Ensure left offset is even
+            dst_box->left -= 1;
+            if (dst_box->left < 0) dst_box->left = 0;
         }
-        dst_box.right = dst_box.left + resize_w - 1;
-        _left_offset = dst_box.left;
+        dst_box->right = dst_box->left + resize_w - 1;
+        _left_offset = dst_box->left;
 
     } else { // Width is constrained, pad height
-        dst_box.left = padding_w / 2;
+        dst_box->left = padding_w / 2;
         // Ensure left offset is even
-        if (dst_box.left % 2 != 0) {
-            dst_box.left -= 1; // Round down to nearest even
-            if (dst_box.left < 0) dst_box.left = 0; // Don't go below 0
+        if (dst_box->left % 2 != 0) {
+            dst_box->left -= 1; // Round down to nearest even
+            if (dst_box->left < 0) dst_box->left = 0; // Don't go below 0
         }
-        dst_box.right = dst_box.left + resize_w - 1;
-        _left_offset = dst_box.left;
-        dst_box.top = (dst_h - resize_h) / 2; // Center vertically
-        if (dst_box.top % 2 != 0) { // Ensure top offset is even
-            dst_box.top -= 1;
-            if (dst_box.top < 0) dst_box.top = 0;
+        dst_box->right = dst_box->left + resize_w - 1;
+        _left_offset = dst_box->left;
+        dst_box->top = (dst_h - resize_h) / 2; // Center vertically
+        if (dst_box->top % 2 != 0) { // Ensure top offset is even
+            dst_box->top -= 1;
+            if (dst_box->top < 0) dst_box->top = 0;
         }
-        dst_box.bottom = dst_box.top + resize_h - 1;
-        _top_offset = dst_box.top;
+        dst_box->bottom = dst_box->top + resize_h - 1;
+        _top_offset = dst_box->top;
     }
 
     printf("scale=%f dst_box=(%d %d %d %d) allow_slight_change=%d _left_offset=%d _top_offset=%d padding_w=%d padding_h=%d\n",
-        scale, dst_box.left, dst_box.top, dst_box.right, dst_box.bottom, allow_slight_change,
+        scale, dst_box->left, dst_box->top, dst_box->right, dst_box->bottom, allow_slight_change,
         _left_offset, _top_offset, padding_w, padding_h);
 
-    //set offset and scale
-    if(letterbox != NULL){
-        letterbox->scale = scale;
-        letterbox->x_pad = _left_offset;
-        letterbox->y_pad = _top_offset;
-    }
-    // alloc memory buffer for dst image,
-    // remember to free
+    letterbox->scale = scale;
+    letterbox->x_pad = _left_offset;
+    letterbox->y_pad = _top_offset;
+}
+
+// alloc memory buffer for dst image if the caller did not provide one,
+// remember to free
+static int prepare_letterbox_dst(image_buffer_t* dst_image)
+{
     if (dst_image->virt_addr == NULL && dst_image->fd <= 0) {
         int dst_size = get_image_size(dst_image);
         if (dst_size == 0) {
@@ -972,6 +1493,652 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
             return -1;
         }
     }
+    return 0;
+}
+
+int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color)
+{
+    int ret = 0;
+    letterbox_t _letterbox;
+
+    image_rect_t src_box;
+    src_box.left = 0;
+    src_box.top = 0;
+    src_box.right = src_image->width - 1;
+    src_box.bottom = src_image->height - 1;
+
+    image_rect_t dst_box;
+    compute_letterbox(src_image->width, src_image->height, dst_image->width, dst_image->height, &dst_box, &_letterbox);
+
+    //set offset and scale
+    if(letterbox != NULL){
+        *letterbox = _letterbox;
+    }
+    ret = prepare_letterbox_dst(dst_image);
+    if (ret != 0) {
+        return ret;
+    }
     ret = convert_image(src_image, dst_image, &src_box, &dst_box, color);
     return ret;
 }
+
+void letterbox_plan_release(letterbox_plan_t* plan)
+{
+    if (plan == NULL) {
+        return;
+    }
+    resize_table_release(&plan->table);
+    resize_table_release(&plan->uv_table);
+    if (plan->scratch != NULL) {
+        free(plan->scratch);
+    }
+    memset(plan, 0, sizeof(letterbox_plan_t));
+}
+
+int letterbox_plan_prepare(letterbox_plan_t* plan, const image_buffer_t* src_image, const image_buffer_t* dst_image)
+{
+    if (plan == NULL || src_image == NULL || dst_image == NULL) {
+        return -1;
+    }
+    if (plan->valid && plan->src_width == src_image->width && plan->src_height == src_image->height &&
+        plan->src_format == src_image->format && plan->dst_width == dst_image->width &&
+        plan->dst_height == dst_image->height && plan->dst_format == dst_image->format) {
+        return 0;
+    }
+    letterbox_plan_release(plan);
+    if (src_image->width <= 0 || src_image->height <= 0 || dst_image->width <= 0 || dst_image->height <= 0) {
+        printf("ERROR: invalid letterbox geometry %dx%d -> %dx%d\n",
+            src_image->width, src_image->height, dst_image->width, dst_image->height);
+        return -1;
+    }
+
+    plan->src_width = src_image->width;
+    plan->src_height = src_image->height;
+    plan->src_format = src_image->format;
+    plan->dst_width = dst_image->width;
+    plan->dst_height = dst_image->height;
+    plan->dst_format = dst_image->format;
+
+    plan->src_box.left = 0;
+    plan->src_box.top = 0;
+    plan->src_box.right = src_image->width - 1;
+    plan->src_box.bottom = src_image->height - 1;
+    compute_letterbox(src_image->width, src_image->height, dst_image->width, dst_image->height,
+                      &plan->dst_box, &plan->letterbox);
+
+    image_rect_t* box = &plan->dst_box;
+    int box_w = box->right - box->left + 1;
+    int box_h = box->bottom - box->top + 1;
+    plan->num_pad_rects = get_pad_rects(dst_image->width, dst_image->height, box->left, box->top, box_w, box_h, plan->pad_rects);
+
+    // sampling tables are only needed when the CPU does the resize, formats it can not handle
+    // keep an empty table and are rejected at conversion time
+    int src_yuv = src_image->format == IMAGE_FORMAT_YUV420SP_NV12 || src_image->format == IMAGE_FORMAT_YUV420SP_NV21;
+    int scratch_size = 0;
+    if (src_image->format != dst_image->format && dst_image->format == IMAGE_FORMAT_RGB888 &&
+        resize_to_rgb888_supported(src_image->format)) {
+        if (resize_to_rgb888_tables_init(src_image->format, &plan->table, &plan->uv_table,
+                                         src_image->width, src_image->height, box_w, box_h) != 0) {
+            goto fail;
+        }
+        scratch_size = resize_to_rgb888_scratch_size(src_image->format, &plan->table, &plan->uv_table);
+    } else if (src_image->format == dst_image->format) {
+        int channels = 0;
+        switch (src_image->format) {
+        case IMAGE_FORMAT_GRAY8:
+        case IMAGE_FORMAT_YUV420SP_NV12:
+        case IMAGE_FORMAT_YUV420SP_NV21:
+            channels = 1;
+            break;
+        case IMAGE_FORMAT_RGB888:
+        case IMAGE_FORMAT_BGR888:
+            channels = 3;
+            break;
+        case IMAGE_FORMAT_RGBA8888:
+            channels = 4;
+            break;
+        default:
+            break;
+        }
+        if (channels > 0) {
+            if (resize_table_init(&plan->table, channels, src_image->width, src_image->height, box_w, box_h) != 0) {
+                goto fail;
+            }
+            scratch_size = resize_scratch_size(&plan->table);
+        }
+        if (channels > 0 && src_yuv) {
+            if (resize_table_init(&plan->uv_table, 2, src_image->width / 2, src_image->height / 2, box_w / 2, box_h / 2) != 0) {
+                goto fail;
+            }
+            if (resize_scratch_size(&plan->uv_table) > scratch_size) {
+                scratch_size = resize_scratch_size(&plan->uv_table);
+            }
+        }
+    }
+    plan->scratch_size = scratch_size;
+    plan->valid = 1;
+    return 1;
+
+fail:
+    letterbox_plan_release(plan);
+    return -1;
+}
+
+static int convert_image_cpu_plan(image_buffer_t* src, image_buffer_t* dst, letterbox_plan_t* plan, resize_isa_t isa)
+{
+    if (src->virt_addr == NULL || dst->virt_addr == NULL) {
+        printf("ERROR: Source or destination buffer is NULL.\n");
+        return -1;
+    }
+    if (plan->table.x_ofs == NULL) {
+        printf("ERROR: No CPU support for format %d -> %d in letterbox.\n", src->format, dst->format);
+        return -1;
+    }
+
+    // scratch for every worker, only grows when the shared pool gets more threads
+    int workers = resize_job_workers();
+    if (workers > plan->scratch_workers) {
+        short* scratch = (short*)realloc(plan->scratch, (size_t)plan->scratch_size * workers * sizeof(short));
+        if (scratch == NULL) {
+            printf("ERROR: malloc letterbox scratch fail!\n");
+            return -1;
+        }
+        plan->scratch = scratch;
+        plan->scratch_workers = workers;
+    }
+
+    plan->table.isa = isa;
+    plan->uv_table.isa = isa;
+    const resize_table_t* table = &plan->table;
+    resize_job_t job;
+    memset(&job, 0, sizeof(resize_job_t));
+    job.table = table;
+    job.scratch = plan->scratch;
+    job.scratch_size = plan->scratch_size;
+    if (src->format != dst->format) {
+        // -> RGB888, table and uv_table come from resize_to_rgb888_tables_init
+        job.uv_table = &plan->uv_table;
+        job.to_rgb888 = 1;
+        set_job_source(&job, src, 0, 0);
+        job.dst_stride = image_row_bytes(dst);
+        job.dst = dst->virt_addr + plan->dst_box.top * job.dst_stride + plan->dst_box.left * 3;
+        run_resize_job(&job);
+        return 0;
+    }
+    job.src = src->virt_addr;
+    job.src_stride = image_row_bytes(src);
+    job.dst_stride = image_row_bytes(dst);
+    job.dst = dst->virt_addr + plan->dst_box.top * job.dst_stride + plan->dst_box.left * table->channels;
+    run_resize_job(&job);
+
+    if (plan->uv_table.x_ofs != NULL) {
+        job.table = &plan->uv_table;
+        job.src = image_uv_plane(src);
+        job.dst = image_uv_plane(dst) + (plan->dst_box.top / 2) * job.dst_stride + (plan->dst_box.left / 2) * 2;
+        run_resize_job(&job);
+    }
+    return 0;
+}
+
+// Image processing backends: convert crops, scales and changes the format of src_box into dst_box,
+// fill paints the pad bands. plan is NULL for convert_image, CPU backends reuse its tables otherwise.
+typedef struct {
+    const char* name;
+    int cpu_access;             // reads and writes the pixels through virt_addr
+    int (*available)(void);
+    int (*supports)(const image_buffer_t* src, const image_buffer_t* dst);
+    int (*convert)(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                   letterbox_plan_t* plan);
+    int (*fill)(image_buffer_t* dst, const image_rect_t* rects, int num_rects, char color);
+} image_backend_ops_t;
+
+static int backend_always_available(void)
+{
+    return 1;
+}
+
+static int cpu_simd_available(void)
+{
+    return resize_get_isa() != RESIZE_ISA_C;
+}
+
+static int cpu_supports(const image_buffer_t* src, const image_buffer_t* dst)
+{
+    if (src->virt_addr == NULL || dst->virt_addr == NULL) {
+        return 0;
+    }
+    int src_yuv = src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21;
+    if (src->format != dst->format && dst->format == IMAGE_FORMAT_RGB888) {
+        return resize_to_rgb888_supported(src->format);
+    }
+    return src->format == dst->format && (src_yuv || src->format == IMAGE_FORMAT_GRAY8 || src->format == IMAGE_FORMAT_RGB888 ||
+                                          src->format == IMAGE_FORMAT_BGR888 || src->format == IMAGE_FORMAT_RGBA8888);
+}
+
+static int cpu_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                       letterbox_plan_t* plan, resize_isa_t isa)
+{
+    if (plan != NULL && plan->table.x_ofs != NULL) {
+        return convert_image_cpu_plan(src, dst, plan, isa);
+    }
+    return convert_image_cpu(src, dst, src_box, dst_box, isa);
+}
+
+static int cpu_c_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                         letterbox_plan_t* plan)
+{
+    return cpu_convert(src, dst, src_box, dst_box, plan, RESIZE_ISA_C);
+}
+
+static int cpu_simd_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                            letterbox_plan_t* plan)
+{
+    // follows resize_set_isa, so a forced instruction set applies here too
+    return cpu_convert(src, dst, src_box, dst_box, plan, RESIZE_ISA_AUTO);
+}
+
+static int cpu_fill(image_buffer_t* dst, const image_rect_t* rects, int num_rects, char color)
+{
+    fill_pad_rects_cpu(dst, rects, num_rects, color);
+    return 0;
+}
+
+#if !defined(DISABLE_RGA)
+static int rga_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                       letterbox_plan_t* plan)
+{
+    (void)plan; // the CPU resize tables do not apply, RGA scales in hardware
+    return convert_image_rga(src, dst, src_box, dst_box);
+}
+#endif
+
+#if defined(ENABLE_OPENCV_BACKEND)
+static int opencv_convert(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                          letterbox_plan_t* plan)
+{
+    (void)plan; // OpenCV does its own resize
+    return opencv_backend_convert(src, dst, src_box, dst_box);
+}
+#endif
+
+static const image_backend_ops_t g_backends[IMAGE_BACKEND_NUM] = {
+    [IMAGE_BACKEND_AUTO] = {"auto", 0, NULL, NULL, NULL, NULL},
+    [IMAGE_BACKEND_CPU_C] = {"cpu-c", 1, backend_always_available, cpu_supports, cpu_c_convert, cpu_fill},
+    [IMAGE_BACKEND_CPU_SIMD] = {"cpu-simd", 1, cpu_simd_available, cpu_supports, cpu_simd_convert, cpu_fill},
+#if !defined(DISABLE_RGA)
+    [IMAGE_BACKEND_RGA] = {"rga", 0, backend_always_available, rga_supports, rga_convert, fill_rects_rga},
+#else
+    [IMAGE_BACKEND_RGA] = {"rga", 0, NULL, NULL, NULL, NULL},
+#endif
+#if defined(ENABLE_OPENCV_BACKEND)
+    [IMAGE_BACKEND_OPENCV] = {"opencv", 1, backend_always_available, opencv_backend_supports, opencv_convert,
+                              opencv_backend_fill},
+#else
+    [IMAGE_BACKEND_OPENCV] = {"opencv", 0, NULL, NULL, NULL, NULL},
+#endif
+};
+
+// Everything the backend choice depends on, all ints so keys compare with memcmp
+typedef struct {
+    int src_width;
+    int src_height;
+    int src_width_stride;
+    int src_height_stride;
+    int src_format;
+    int src_color_space;
+    int src_has_addr;
+    int dst_width;
+    int dst_height;
+    int dst_width_stride;
+    int dst_height_stride;
+    int dst_format;
+    int dst_has_addr;
+    int src_box_width;
+    int src_box_height;
+    int dst_box_width;
+    int dst_box_height;
+} backend_key_t;
+
+typedef struct {
+    backend_key_t key;
+    image_backend_t backend;
+    unsigned long long last_use;
+} backend_choice_t;
+
+#define BACKEND_CHOICE_CACHE_SIZE 16
+#define BACKEND_BENCH_RUNS 3
+
+static pthread_mutex_t g_backend_lock = PTHREAD_MUTEX_INITIALIZER;
+static image_backend_t g_backend_mode = IMAGE_BACKEND_AUTO;
+static backend_choice_t g_backend_choices[BACKEND_CHOICE_CACHE_SIZE];
+static int g_num_backend_choices = 0;
+static unsigned long long g_backend_clock = 0;
+
+static int backend_usable(image_backend_t id, const image_buffer_t* src, const image_buffer_t* dst)
+{
+    const image_backend_ops_t* ops = &g_backends[id];
+    return ops->available != NULL && ops->available() && ops->supports(src, dst);
+}
+
+static void backend_make_key(const image_buffer_t* src, const image_buffer_t* dst, const image_rect_t* src_box,
+                             const image_rect_t* dst_box, backend_key_t* key)
+{
+    memset(key, 0, sizeof(backend_key_t));
+    key->src_width = src->width;
+    key->src_height = src->height;
+    key->src_width_stride = image_width_stride(src);
+    key->src_height_stride = image_height_stride(src);
+    key->src_format = src->format;
+    key->src_color_space = src->color_space;
+    key->src_has_addr = src->virt_addr != NULL;
+    key->dst_width = dst->width;
+    key->dst_height = dst->height;
+    key->dst_width_stride = image_width_stride(dst);
+    key->dst_height_stride = image_height_stride(dst);
+    key->dst_format = dst->format;
+    key->dst_has_addr = dst->virt_addr != NULL;
+    key->src_box_width = src_box != NULL ? src_box->right - src_box->left + 1 : src->width;
+    key->src_box_height = src_box != NULL ? src_box->bottom - src_box->top + 1 : src->height;
+    key->dst_box_width = dst_box != NULL ? dst_box->right - dst_box->left + 1 : dst->width;
+    key->dst_box_height = dst_box != NULL ? dst_box->bottom - dst_box->top + 1 : dst->height;
+}
+
+// Mode of image_backend_set, read under the lock as conversions run on other threads (image_async)
+static image_backend_t backend_mode(void)
+{
+    pthread_mutex_lock(&g_backend_lock);
+    image_backend_t mode = g_backend_mode;
+    pthread_mutex_unlock(&g_backend_lock);
+    return mode;
+}
+
+// Cached backend for the key, IMAGE_BACKEND_AUTO if not decided yet
+static image_backend_t backend_lookup(const backend_key_t* key)
+{
+    image_backend_t backend = IMAGE_BACKEND_AUTO;
+    pthread_mutex_lock(&g_backend_lock);
+    for (int i = 0; i < g_num_backend_choices; i++) {
+        if (memcmp(&g_backend_choices[i].key, key, sizeof(backend_key_t)) == 0) {
+            g_backend_choices[i].last_use = ++g_backend_clock;
+            backend = g_backend_choices[i].backend;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_backend_lock);
+    return backend;
+}
+
+static void backend_store(const backend_key_t* key, image_backend_t backend)
+{
+    pthread_mutex_lock(&g_backend_lock);
+    int slot = -1;
+    for (int i = 0; i < g_num_backend_choices; i++) {
+        if (memcmp(&g_backend_choices[i].key, key, sizeof(backend_key_t)) == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 && g_num_backend_choices < BACKEND_CHOICE_CACHE_SIZE) {
+        slot = g_num_backend_choices++;
+    }
+    if (slot < 0) {
+        // full, replace the least recently used geometry
+        slot = 0;
+        for (int i = 1; i < g_num_backend_choices; i++) {
+            if (g_backend_choices[i].last_use < g_backend_choices[slot].last_use) {
+                slot = i;
+            }
+        }
+    }
+    g_backend_choices[slot].key = *key;
+    g_backend_choices[slot].backend = backend;
+    g_backend_choices[slot].last_use = ++g_backend_clock;
+    pthread_mutex_unlock(&g_backend_lock);
+}
+
+// CPU backend that handles the pair, IMAGE_BACKEND_NUM if none
+static image_backend_t backend_cpu_fallback(const image_buffer_t* src, const image_buffer_t* dst)
+{
+    if (backend_usable(IMAGE_BACKEND_CPU_SIMD, src, dst)) {
+        return IMAGE_BACKEND_CPU_SIMD;
+    }
+    if (backend_usable(IMAGE_BACKEND_CPU_C, src, dst)) {
+        return IMAGE_BACKEND_CPU_C;
+    }
+    return IMAGE_BACKEND_NUM;
+}
+
+static double backend_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+// CPU backends go through the CPU cache, pool buffers from a cached DMA heap are synced around them
+// so the CPU reads what a device wrote and the device sees the CPU writes. RGA works on the dma-buf
+// directly and needs no sync.
+static int backend_exec(const image_backend_ops_t* ops, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                        image_rect_t* dst_box, const image_rect_t* pad_rects, int num_pad_rects, char color,
+                        letterbox_plan_t* plan)
+{
+    if (ops->cpu_access && (image_pool_begin_cpu_access(src->virt_addr) != 0 ||
+                            image_pool_begin_cpu_access(dst->virt_addr) != 0)) {
+        return -1;
+    }
+    int ret = 0;
+    if (num_pad_rects > 0) {
+        ret = ops->fill(dst, pad_rects, num_pad_rects, color);
+    }
+    if (ret == 0) {
+        ret = ops->convert(src, dst, src_box, dst_box, plan);
+    }
+    if (ops->cpu_access) {
+        image_pool_end_cpu_access(src->virt_addr);
+        if (image_pool_end_cpu_access(dst->virt_addr) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+// Time every usable backend on this frame and keep the fastest, the pad area is not touched
+static image_backend_t backend_benchmark(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                                         image_rect_t* dst_box, letterbox_plan_t* plan)
+{
+    image_backend_t best = IMAGE_BACKEND_NUM;
+    double best_us = 0;
+    char report[256];
+    int len = 0;
+    report[0] = '\0';
+    for (int id = IMAGE_BACKEND_AUTO + 1; id < IMAGE_BACKEND_NUM; id++) {
+        if (!backend_usable((image_backend_t)id, src, dst)) {
+            continue;
+        }
+        const image_backend_ops_t* ops = &g_backends[id];
+        // first run builds tables and imports buffers, it is not timed
+        if (backend_exec(ops, src, dst, src_box, dst_box, NULL, 0, 0, plan) != 0) {
+            continue;
+        }
+        double start = backend_now_us();
+        int ret = 0;
+        for (int i = 0; i < BACKEND_BENCH_RUNS && ret == 0; i++) {
+            ret = backend_exec(ops, src, dst, src_box, dst_box, NULL, 0, 0, plan);
+        }
+        if (ret != 0) {
+            continue;
+        }
+        double us = (backend_now_us() - start) / BACKEND_BENCH_RUNS;
+        if (len < (int)sizeof(report)) {
+            len += snprintf(report + len, sizeof(report) - len, " %s=%.2fms", ops->name, us / 1000.0);
+        }
+        if (best == IMAGE_BACKEND_NUM || us < best_us) {
+            best = (image_backend_t)id;
+            best_us = us;
+        }
+    }
+    if (best != IMAGE_BACKEND_NUM) {
+        printf("image backend: %dx%d fmt %d -> %dx%d fmt %d uses %s (%s )\n", src->width, src->height, src->format,
+               dst->width, dst->height, dst->format, g_backends[best].name, report);
+    }
+    return best;
+}
+
+static image_backend_t backend_select(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                                      image_rect_t* dst_box, letterbox_plan_t* plan, const backend_key_t* key)
+{
+    image_backend_t backend = backend_lookup(key);
+    if (backend != IMAGE_BACKEND_AUTO) {
+        return backend;
+    }
+    // decided once per geometry, so the messages below are printed once and not every frame
+    image_backend_t mode = backend_mode();
+    if (mode == IMAGE_BACKEND_AUTO) {
+        backend = backend_benchmark(src, dst, src_box, dst_box, plan);
+    } else if (backend_usable(mode, src, dst)) {
+        backend = mode;
+    } else {
+        backend = backend_cpu_fallback(src, dst);
+        if (backend != IMAGE_BACKEND_NUM) {
+            printf("WARNING: image backend %s can not convert %dx%d fmt %d -> %dx%d fmt %d (stride %d -> %d), using %s\n",
+                   g_backends[mode].name, src->width, src->height, src->format, dst->width, dst->height, dst->format,
+                   image_width_stride(src), image_width_stride(dst), g_backends[backend].name);
+        }
+    }
+    if (backend == IMAGE_BACKEND_NUM) {
+        printf("ERROR: no image backend supports format %d -> %d\n", src->format, dst->format);
+        return backend;
+    }
+    backend_store(key, backend);
+    return backend;
+}
+
+static int backend_run(image_backend_t backend, image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box,
+                       image_rect_t* dst_box, const image_rect_t* pad_rects, int num_pad_rects, char color,
+                       letterbox_plan_t* plan)
+{
+    return backend_exec(&g_backends[backend], src, dst, src_box, dst_box, pad_rects, num_pad_rects, color, plan);
+}
+
+// Convert with the backend chosen for this geometry, a failing backend is replaced by the CPU for good
+static int convert_image_backend(image_buffer_t* src, image_buffer_t* dst, image_rect_t* src_box, image_rect_t* dst_box,
+                                 const image_rect_t* pad_rects, int num_pad_rects, char color, letterbox_plan_t* plan)
+{
+    if (src == NULL || dst == NULL) {
+        return -1;
+    }
+    backend_key_t key;
+    backend_make_key(src, dst, src_box, dst_box, &key);
+    image_backend_t backend = backend_select(src, dst, src_box, dst_box, plan, &key);
+    if (backend == IMAGE_BACKEND_NUM) {
+        return -1;
+    }
+    int ret = backend_run(backend, src, dst, src_box, dst_box, pad_rects, num_pad_rects, color, plan);
+    if (ret != 0) {
+        image_backend_t fallback = backend_cpu_fallback(src, dst);
+        if (fallback == IMAGE_BACKEND_NUM || fallback == backend) {
+            return -1;
+        }
+        printf("WARNING: %s conversion failed (%d), falling back to %s for this geometry.\n",
+               g_backends[backend].name, ret, g_backends[fallback].name);
+        backend_store(&key, fallback);
+        ret = backend_run(fallback, src, dst, src_box, dst_box, pad_rects, num_pad_rects, color, plan);
+    }
+    return ret;
+}
+
+int image_backend_set(image_backend_t backend)
+{
+    if (backend < IMAGE_BACKEND_AUTO || backend >= IMAGE_BACKEND_NUM) {
+        printf("ERROR: invalid image backend %d\n", backend);
+        return -1;
+    }
+    if (backend != IMAGE_BACKEND_AUTO && !image_backend_available(backend)) {
+        printf("ERROR: image backend %s not available in this build\n", image_backend_name(backend));
+        return -1;
+    }
+    pthread_mutex_lock(&g_backend_lock);
+    g_backend_mode = backend;
+    g_num_backend_choices = 0;
+    pthread_mutex_unlock(&g_backend_lock);
+    return 0;
+}
+
+image_backend_t image_backend_get(void)
+{
+    return backend_mode();
+}
+
+int image_backend_available(image_backend_t backend)
+{
+    if (backend <= IMAGE_BACKEND_AUTO || backend >= IMAGE_BACKEND_NUM) {
+        return 0;
+    }
+    return g_backends[backend].available != NULL && g_backends[backend].available();
+}
+
+const char* image_backend_name(image_backend_t backend)
+{
+    if (backend < IMAGE_BACKEND_AUTO || backend >= IMAGE_BACKEND_NUM) {
+        return "unknown";
+    }
+    return g_backends[backend].name;
+}
+
+void image_backend_reset(void)
+{
+    pthread_mutex_lock(&g_backend_lock);
+    g_num_backend_choices = 0;
+    pthread_mutex_unlock(&g_backend_lock);
+}
+
+int convert_image(image_buffer_t* src_img, image_buffer_t* dst_img, image_rect_t* src_box, image_rect_t* dst_box, char color)
+{
+    if (src_img == NULL || dst_img == NULL) {
+        return -1;
+    }
+    // fill pad color only around the destination box, the box itself is overwritten
+    image_rect_t box;
+    if (dst_box != NULL) {
+        box = *dst_box;
+    } else {
+        box.left = 0;
+        box.top = 0;
+        box.right = dst_img->width - 1;
+        box.bottom = dst_img->height - 1;
+    }
+    image_rect_t pad_rects[4];
+    int num_pad_rects = get_pad_rects(dst_img->width, dst_img->height, box.left, box.top,
+                                      box.right - box.left + 1, box.bottom - box.top + 1, pad_rects);
+    return convert_image_backend(src_img, dst_img, src_box, dst_box, pad_rects, num_pad_rects, color, NULL);
+}
+
+int convert_image_with_letterbox_plan(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_plan_t* plan,
+                                      letterbox_t* letterbox, char color)
+{
+    int ret = letterbox_plan_prepare(plan, src_image, dst_image);
+    if (ret < 0) {
+        return -1;
+    }
+    if (letterbox != NULL) {
+        *letterbox = plan->letterbox;
+    }
+    ret = prepare_letterbox_dst(dst_image);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // the box is fully rewritten every frame, the pad bands only when the destination changed
+    int fill_pad = !(plan->padded && plan->padded_addr == dst_image->virt_addr && plan->padded_fd == dst_image->fd &&
+                     plan->padded_color == color);
+
+    ret = convert_image_backend(src_image, dst_image, &plan->src_box, &plan->dst_box, plan->pad_rects,
+                                fill_pad ? plan->num_pad_rects : 0, color, plan);
+    if (ret == 0) {
+        plan->padded = 1;
+        plan->padded_addr = dst_image->virt_addr;
+        plan->padded_fd = dst_image->fd;
+        plan->padded_color = color;
+    }
+    return ret;
+}
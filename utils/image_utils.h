@@ -7,6 +7,7 @@ extern "C" {
 #endif
 
 #include "common.h"
+#include "image_resize.h"
 
 /**
  * @brief LetterBox
@@ -18,6 +19,64 @@ typedef struct {
     float scale;
 } letterbox_t;
 
+/**
+ * @brief Options of read_image_ex
+ *
+ */
+typedef struct {
+    int target_width;   // size the image will be letterboxed to, 0: decode at full resolution
+    int target_height;
+    image_format_t yuv_format;  // IMAGE_FORMAT_YUV420SP_NV12, _NV21 or IMAGE_FORMAT_YUV420P: decode 4:2:0 JPEG
+                                // without color conversion (full range BT.601), other values: RGB888
+} image_read_options_t;
+
+/**
+ * @brief What read_image_ex actually decoded
+ *
+ */
+typedef struct {
+    int orig_width;     // size stored in the file
+    int orig_height;
+    int scale_num;      // decoded size is ceil(orig * scale_num / scale_denom)
+    int scale_denom;
+} image_read_info_t;
+
+/**
+ * @brief Letterbox geometry and sampling tables for one (src WxH, format, dst WxH, format)
+ *
+ * Built on first use and reused for every following frame with the same geometry,
+ * rebuilt automatically when the geometry changes. Zero-initialize before first use.
+ */
+typedef struct {
+    // geometry the plan was built for
+    int src_width;
+    int src_height;
+    image_format_t src_format;
+    int dst_width;
+    int dst_height;
+    image_format_t dst_format;
+    int valid;
+
+    letterbox_t letterbox;
+    image_rect_t src_box;
+    image_rect_t dst_box;
+    image_rect_t pad_rects[4];  // top, bottom, left, right bands around dst_box, empty bands skipped
+    int num_pad_rects;
+
+    resize_table_t table;       // packed pixels, or Y plane of YUV420SP
+    resize_table_t uv_table;    // interleaved UV plane of YUV420SP
+    short* scratch;
+    int scratch_size;           // elements per worker of the shared thread pool
+    int scratch_workers;
+
+    // destination whose pad bands already hold padded_color, later frames into it skip the fill;
+    // callers that draw into the pad area must call letterbox_plan_release or change the buffer
+    int padded;
+    unsigned char* padded_addr;
+    int padded_fd;
+    char padded_color;
+} letterbox_plan_t;
+
 /**
  * @brief Read image file (support png/jpeg/bmp)
  * 
@@ -27,15 +86,182 @@ typedef struct {
  */
 int read_image(const char* path, image_buffer_t* image);
 
+/**
+ * @brief Read image file, JPEG is decoded at a reduced size when a target size allows it
+ *
+ * JPEG picks the largest 1/2, 1/4 or 1/8 DCT scaling that keeps the image at or above the
+ * letterboxed size for target_width x target_height, other formats are read at full resolution.
+ * With yuv_format set, 4:2:0 JPEGs with even decoded size come back as YUV, others as RGB888.
+ * Coordinates in the decoded image map back to the file by orig_width / image->width.
+ * A .data file with a raw frame header (image_raw.h) gives a copy of its first frame with its
+ * geometry, image_raw_open maps multi-frame files without copying.
+ *
+ * @param path [in] Image path
+ * @param image [out] Read image
+ * @param options [in] Read options, NULL for full resolution
+ * @param info [out] Original size and applied scale, can be NULL
+ * @return int 0: success; -1: error
+ */
+int read_image_ex(const char* path, image_buffer_t* image, const image_read_options_t* options, image_read_info_t* info);
+
+/**
+ * @brief Reusable decoder state: JPEG decompressor, file buffer and pooled output pixels
+ *
+ * read_image/read_image_ex use one per thread internally, batch jobs can keep their own so that
+ * decoding many images performs no allocation once the buffers reached the largest image size.
+ * Not thread safe, use one decoder per thread.
+ */
+typedef struct image_decoder_t image_decoder_t;
+
+/**
+ * @brief Create a decoder, buffers are allocated on first use
+ *
+ * @return image_decoder_t* Decoder, NULL on error
+ */
+image_decoder_t* image_decoder_create(void);
+
+/**
+ * @brief Free the decoder and its pooled output, images still pointing at it become invalid
+ *
+ * @param decoder [in] Decoder
+ */
+void image_decoder_destroy(image_decoder_t* decoder);
+
+/**
+ * @brief Read image file like read_image_ex, reusing the decoder buffers
+ *
+ * With image->virt_addr set the pixels go to that buffer (image->size must be large enough).
+ * With image->virt_addr NULL, or still pointing at the pooled output of a previous read, they go to
+ * the decoder's pooled output: owned by the decoder, do not free it, valid until the next read.
+ *
+ * @param decoder [in] Decoder
+ * @param path [in] Image path
+ * @param image [out] Read image
+ * @param options [in] Read options, NULL for full resolution
+ * @param info [out] Original size and applied scale, can be NULL
+ * @return int 0: success; -1: error
+ */
+int image_decoder_read(image_decoder_t* decoder, const char* path, image_buffer_t* image,
+                       const image_read_options_t* options, image_read_info_t* info);
+
+/**
+ * @brief Decode an image held in memory (JPEG, PNG, BMP), same options and output rules as image_decoder_read
+ *
+ * data is only read during the call, e.g. frames cut out of an MJPEG stream.
+ *
+ * @param decoder [in] Decoder
+ * @param data [in] Encoded image
+ * @param size [in] Bytes of data
+ * @param image [out] Decoded image
+ * @param options [in] Read options, NULL for full resolution
+ * @param info [out] Original size and applied scale, can be NULL
+ * @return int 0: success; -1: error
+ */
+int image_decoder_decode(image_decoder_t* decoder, const unsigned char* data, size_t size, image_buffer_t* image,
+                         const image_read_options_t* options, image_read_info_t* info);
+
+/**
+ * @brief Expand an input path into image paths
+ *
+ * A directory gives its image files (jpg/png/data) sorted by name, a .txt or .list file gives one
+ * path per line ('#' starts a comment line), anything else is taken as a single image.
+ *
+ * @param path [in] Image, directory or list file
+ * @param files [out] Image paths, free with free_image_files
+ * @param num_files [out] Number of image paths
+ * @return int 0: single image; 1: directory or list; -1: error
+ */
+int list_image_files(const char* path, char*** files, int* num_files);
+
+/**
+ * @brief Free the paths returned by list_image_files
+ *
+ * @param files [in] Image paths
+ * @param num_files [in] Number of image paths
+ */
+void free_image_files(char** files, int num_files);
+
 /**
  * @brief Write image file (support jpg/png)
  * 
  * @param path [in] Image path
- * @param image [in] Image for write (only support IMAGE_FORMAT_RGB888)
+ * @param image [in] Image for write (IMAGE_FORMAT_RGB888, IMAGE_FORMAT_RGBA8888 or IMAGE_FORMAT_GRAY8)
  * @return int 0: success; -1: error
  */
 int write_image(const char* path, const image_buffer_t* image);
 
+/**
+ * @brief Options of write_image_ex
+ *
+ */
+typedef struct {
+    int jpeg_quality;   // 1..100, 0: 95
+    int png_level;      // 0: stb default (filter searched per row, level 8); 1..9: Up filter on every row and
+                        // this deflate level, 1 is about 1.5x faster than the default (stb treats 1..4 as 5)
+} image_write_options_t;
+
+/**
+ * @brief Same as write_image with encoder options, thread safe and quiet
+ *
+ * @param path [in] Image path, the extension selects the encoder
+ * @param image [in] Image for write
+ * @param options [in] Options, NULL for the write_image defaults
+ * @return int 0: success; -1: error
+ */
+int write_image_ex(const char* path, const image_buffer_t* image, const image_write_options_t* options);
+
+/**
+ * @brief Implementation behind convert_image and the letterbox functions
+ *
+ */
+typedef enum {
+    IMAGE_BACKEND_AUTO = 0,     // fastest one per geometry, timed on the first frame of that geometry
+    IMAGE_BACKEND_CPU_C,        // portable C resize
+    IMAGE_BACKEND_CPU_SIMD,     // SSE2/AVX2/NEON resize, resize_set_isa picks the instruction set
+    IMAGE_BACKEND_RGA,          // not available with DISABLE_RGA
+    IMAGE_BACKEND_OPENCV,       // 3rdparty/opencv, only built with ENABLE_OPENCV_BACKEND
+    IMAGE_BACKEND_NUM,
+} image_backend_t;
+
+/**
+ * @brief Select the backend for all following conversions and forget the per geometry choices
+ *
+ * A forced backend that can not handle a geometry (format, stride alignment, fd only buffer)
+ * falls back to the CPU for that geometry, with one message when the geometry is first seen.
+ *
+ * @param backend [in] Backend, IMAGE_BACKEND_AUTO (default) to benchmark
+ * @return int 0: success; -1: backend not available in this build
+ */
+int image_backend_set(image_backend_t backend);
+
+/**
+ * @brief Backend mode set by image_backend_set
+ *
+ * @return image_backend_t Backend
+ */
+image_backend_t image_backend_get(void);
+
+/**
+ * @brief Check whether a backend is compiled in and usable on this CPU
+ *
+ * @param backend [in] Backend
+ * @return int 1: available; 0: not available
+ */
+int image_backend_available(image_backend_t backend);
+
+/**
+ * @brief Name of a backend for logs
+ *
+ * @param backend [in] Backend
+ * @return const char* Name
+ */
+const char* image_backend_name(image_backend_t backend);
+
+/**
+ * @brief Forget the per geometry choices, the next frame of every geometry is benchmarked again
+ */
+void image_backend_reset(void);
+
 /**
  * @brief Convert image for resize and pixel format change
  * 
@@ -59,6 +285,36 @@ int convert_image(image_buffer_t* src_image, image_buffer_t* dst_image, image_re
  */
 int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_t* letterbox, char color);
 
+/**
+ * @brief Make sure the plan matches the source and destination geometry, rebuilding it if needed
+ *
+ * @param plan [in/out] Letterbox plan
+ * @param src_image [in] Source Image
+ * @param dst_image [in] Target Image
+ * @return int 0: plan reused; 1: plan rebuilt; -1: error
+ */
+int letterbox_plan_prepare(letterbox_plan_t* plan, const image_buffer_t* src_image, const image_buffer_t* dst_image);
+
+/**
+ * @brief Release the plan tables, the plan can be prepared again afterwards
+ *
+ * @param plan [in] Letterbox plan
+ */
+void letterbox_plan_release(letterbox_plan_t* plan);
+
+/**
+ * @brief Convert image with letterbox, reusing a plan across frames
+ *
+ * @param src_image [in] Source Image
+ * @param dst_image [out] Target Image
+ * @param plan [in/out] Letterbox plan, prepared from src_image and dst_image
+ * @param letterbox [out] Letterbox
+ * @param color [in] Fill color on target image
+ * @return int 0: success; -1: error
+ */
+int convert_image_with_letterbox_plan(image_buffer_t* src_image, image_buffer_t* dst_image, letterbox_plan_t* plan,
+                                      letterbox_t* letterbox, char color);
+
 /**
  * @brief Get the image size
  * 
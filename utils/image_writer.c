@@ -0,0 +1,247 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_pool.h"
+#include "image_writer.h"
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_FILLING,       // submit copies the image in
+    SLOT_QUEUED,
+    SLOT_WRITING,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    uint64_t seq;               // submission order, the oldest queued image is written first
+    image_buffer_t image;       // points into pixels
+    unsigned char* pixels;      // grows to the largest image submitted
+    size_t pixels_cap;
+    char* path;
+    size_t path_cap;
+} writer_slot_t;
+
+struct image_writer_t {
+    image_write_options_t options;
+    writer_slot_t* slots;
+    int num_slots;
+    pthread_t* threads;
+    int num_threads;            // started encoder threads
+
+    pthread_mutex_t lock;
+    pthread_cond_t queued_cond; // an image was queued or stop was set
+    pthread_cond_t idle_cond;   // an image was written
+    uint64_t next_seq;
+    int stop;
+    image_writer_stats_t stats;
+};
+
+static writer_slot_t* oldest_queued(image_writer_t* writer)
+{
+    writer_slot_t* oldest = NULL;
+    for (int i = 0; i < writer->num_slots; i++) {
+        writer_slot_t* slot = &writer->slots[i];
+        if (slot->state == SLOT_QUEUED && (oldest == NULL || slot->seq < oldest->seq)) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+static void* writer_thread(void* arg)
+{
+    image_writer_t* writer = (image_writer_t*)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        writer_slot_t* slot = NULL;
+        while ((slot = oldest_queued(writer)) == NULL && !writer->stop) {
+            pthread_cond_wait(&writer->queued_cond, &writer->lock);
+        }
+        // destroy only stops the threads once the queue is written
+        if (slot == NULL) {
+            break;
+        }
+        slot->state = SLOT_WRITING;
+        pthread_mutex_unlock(&writer->lock);
+
+        int ret = write_image_ex(slot->path, &slot->image, &writer->options);
+        if (ret != 0) {
+            printf("ERROR: write %s fail\n", slot->path);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        if (ret != 0) {
+            writer->stats.images_failed++;
+        } else {
+            writer->stats.images_written++;
+        }
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&writer->idle_cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+image_writer_t* image_writer_create(const image_writer_config_t* config)
+{
+    image_writer_t* writer = (image_writer_t*)calloc(1, sizeof(image_writer_t));
+    if (writer == NULL) {
+        return NULL;
+    }
+    int num_threads = config != NULL && config->num_threads > 0 ? config->num_threads : 1;
+    writer->num_slots = config != NULL && config->queue_depth > 0 ? config->queue_depth : 4;
+    if (config != NULL) {
+        writer->options = config->options;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued_cond, NULL);
+    pthread_cond_init(&writer->idle_cond, NULL);
+
+    writer->slots = (writer_slot_t*)calloc(writer->num_slots, sizeof(writer_slot_t));
+    writer->threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    if (writer->slots == NULL || writer->threads == NULL) {
+        printf("ERROR: allocate image writer fail\n");
+        image_writer_destroy(writer);
+        return NULL;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&writer->threads[i], NULL, writer_thread, writer) != 0) {
+            printf("ERROR: create image writer thread fail\n");
+            image_writer_destroy(writer);
+            return NULL;
+        }
+        writer->num_threads++;
+    }
+    return writer;
+}
+
+int image_writer_submit(image_writer_t* writer, const char* path, const image_buffer_t* image)
+{
+    if (writer == NULL || path == NULL || image == NULL || image->virt_addr == NULL) {
+        return -1;
+    }
+    int size = get_image_size(image);
+    if (size <= 0) {
+        printf("ERROR: image writer: invalid image %dx%d format %d\n", image->width, image->height, image->format);
+        return -1;
+    }
+
+    writer_slot_t* slot = NULL;
+    pthread_mutex_lock(&writer->lock);
+    for (int i = 0; i < writer->num_slots; i++) {
+        if (writer->slots[i].state == SLOT_FREE) {
+            slot = &writer->slots[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        writer->stats.images_dropped++;
+        pthread_mutex_unlock(&writer->lock);
+        return 1;
+    }
+    slot->state = SLOT_FILLING;
+    slot->seq = writer->next_seq++;
+    pthread_mutex_unlock(&writer->lock);
+
+    // the copy runs outside the lock, encoder threads keep taking queued images meanwhile
+    int ret = 0;
+    size_t path_len = strlen(path) + 1;
+    if ((size_t)size > slot->pixels_cap) {
+        unsigned char* pixels = (unsigned char*)image_pool_alloc(image_pool_default(), size, NULL);
+        if (pixels == NULL) {
+            ret = -1;
+        } else {
+            image_pool_release(slot->pixels);
+            slot->pixels = pixels;
+            slot->pixels_cap = size;
+        }
+    }
+    if (ret == 0 && path_len > slot->path_cap) {
+        char* path_buf = (char*)realloc(slot->path, path_len);
+        if (path_buf == NULL) {
+            ret = -1;
+        } else {
+            slot->path = path_buf;
+            slot->path_cap = path_len;
+        }
+    }
+    if (ret == 0) {
+        memcpy(slot->pixels, image->virt_addr, size);
+        memcpy(slot->path, path, path_len);
+        slot->image = *image;
+        slot->image.virt_addr = slot->pixels;
+        slot->image.size = size;
+        slot->image.fd = -1;
+    } else {
+        printf("ERROR: allocate %d bytes for queued image fail\n", size);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    if (ret == 0) {
+        slot->state = SLOT_QUEUED;
+        pthread_cond_signal(&writer->queued_cond);
+    } else {
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&writer->idle_cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return ret;
+}
+
+void image_writer_flush(image_writer_t* writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        int busy = 0;
+        for (int i = 0; i < writer->num_slots; i++) {
+            busy |= writer->slots[i].state != SLOT_FREE;
+        }
+        if (!busy) {
+            break;
+        }
+        pthread_cond_wait(&writer->idle_cond, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void image_writer_get_stats(image_writer_t* writer, image_writer_stats_t* stats)
+{
+    if (writer == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&writer->lock);
+    *stats = writer->stats;
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void image_writer_destroy(image_writer_t* writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_broadcast(&writer->queued_cond);
+    pthread_mutex_unlock(&writer->lock);
+    for (int i = 0; i < writer->num_threads; i++) {
+        pthread_join(writer->threads[i], NULL);
+    }
+    if (writer->slots != NULL) {
+        for (int i = 0; i < writer->num_slots; i++) {
+            image_pool_release(writer->slots[i].pixels);
+            free(writer->slots[i].path);
+        }
+    }
+    pthread_cond_destroy(&writer->queued_cond);
+    pthread_cond_destroy(&writer->idle_cond);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->slots);
+    free(writer->threads);
+    free(writer);
+}
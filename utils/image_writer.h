@@ -0,0 +1,81 @@
+#ifndef _RKNN_MODEL_ZOO_IMAGE_WRITER_H_
+#define _RKNN_MODEL_ZOO_IMAGE_WRITER_H_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "image_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct image_writer_t image_writer_t;
+
+/**
+ * @brief Configuration of image_writer_create
+ *
+ */
+typedef struct {
+    int num_threads;                // encoder threads, <= 0: 1
+    int queue_depth;                // images copied and not written yet, <= 0: 4. Memory stays below
+                                    // queue_depth copies of the largest image submitted
+    image_write_options_t options;  // JPEG quality and PNG level of every image
+} image_writer_config_t;
+
+typedef struct {
+    uint64_t images_written;
+    uint64_t images_dropped;        // submitted while the queue was full
+    uint64_t images_failed;         // encode or file errors
+} image_writer_stats_t;
+
+/**
+ * @brief Start the encoder threads that write submitted images in the background
+ *
+ * Encoding stays off the calling thread: a 1080p PNG takes several hundred milliseconds, a JPEG
+ * through libjpeg-turbo around ten. Use .jpg paths for frames written every iteration.
+ *
+ * @param config [in] Configuration, NULL: 1 thread, 4 queued images, write_image quality
+ * @return image_writer_t* Writer, NULL on error
+ */
+image_writer_t* image_writer_create(const image_writer_config_t* config);
+
+/**
+ * @brief Copy an image into a pooled buffer and queue it for writing, never waits for the encoders
+ *
+ * The caller can reuse the image as soon as the call returns.
+ *
+ * @param writer [in] Writer
+ * @param path [in] Output path, the extension selects the encoder like write_image
+ * @param image [in] Image for write
+ * @return int 0: queued; 1: queue full, dropped and counted; -1: error
+ */
+int image_writer_submit(image_writer_t* writer, const char* path, const image_buffer_t* image);
+
+/**
+ * @brief Wait until every queued image is written
+ *
+ * @param writer [in] Writer
+ */
+void image_writer_flush(image_writer_t* writer);
+
+/**
+ * @brief Write and drop counters
+ *
+ * @param writer [in] Writer
+ * @param stats [out] Counters
+ */
+void image_writer_get_stats(image_writer_t* writer, image_writer_stats_t* stats);
+
+/**
+ * @brief Write the queued images, stop the encoder threads and free the pool
+ *
+ * @param writer [in] Writer
+ */
+void image_writer_destroy(image_writer_t* writer);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_IMAGE_WRITER_H_
@@ -0,0 +1,712 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mjpeg_source.h"
+
+#define MJPEG_BUFFER_SIZE (4 * 1024 * 1024)     // stream buffer, holds many frames so reads stay large
+#define MJPEG_MAX_FRAME_SIZE (64 * 1024 * 1024) // a frame growing past this is treated as garbage
+#define MJPEG_MAX_HTTP_HEADER 16384
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_LOADING,       // reader copies the JPEG in
+    SLOT_FILLED,        // waiting for a decode thread
+    SLOT_DECODING,
+    SLOT_READY,
+    SLOT_HELD,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    image_decoder_t* decoder;   // tjhandle and pooled output pixels of this slot
+    unsigned char* jpeg;        // grows to the largest frame
+    size_t jpeg_size;
+    size_t jpeg_cap;
+    mjpeg_frame_t frame;
+} mjpeg_slot_t;
+
+// Position in the JPEG syntax while cutting a frame out of the stream
+typedef enum {
+    SCAN_SOI = 0,       // looking for FF D8
+    SCAN_MARKER,        // pos is on the next marker of the frame
+    SCAN_ENTROPY,       // inside entropy coded data after SOS
+} scan_state_t;
+
+struct mjpeg_source_t {
+    int fd;
+    int own_fd;
+    int is_http;
+    int wake_fds[2];            // written by destroy to interrupt a reader waiting on an idle stream
+    mjpeg_source_config_t config;
+
+    // stream buffer, only used by the reader thread
+    unsigned char* buf;
+    size_t cap;
+    size_t fill;
+    size_t pos;
+    size_t frame_start;
+    scan_state_t scan;
+    uint64_t skipped;
+
+    mjpeg_slot_t* slots;
+    int num_slots;
+    pthread_t reader;
+    int reader_started;
+    pthread_t* workers;
+    int num_workers;            // started decode threads
+
+    pthread_mutex_t lock;
+    pthread_cond_t free_cond;   // a slot was released or stop was set
+    pthread_cond_t filled_cond; // a frame waits for decoding or stop was set
+    pthread_cond_t ready_cond;  // a frame was decoded, or the stream ended
+    uint64_t next_index;
+    int eof;
+    int error;
+    int stop;
+    mjpeg_source_stats_t stats;
+};
+
+static void scan_resync(mjpeg_source_t* source)
+{
+    // not a valid frame after all, look for the next SOI right after this one
+    source->skipped++;
+    source->pos = source->frame_start + 1;
+    source->scan = SCAN_SOI;
+}
+
+// Advance through the buffered bytes, 1: [start, end) is a complete JPEG; 0: more data needed
+static int scan_frame(mjpeg_source_t* source, size_t* start, size_t* end)
+{
+    unsigned char* buf = source->buf;
+    while (1) {
+        size_t p = source->pos;
+        if (source->scan == SCAN_SOI) {
+            while (p + 1 < source->fill) {
+                unsigned char* ff = (unsigned char*)memchr(buf + p, 0xFF, source->fill - p - 1);
+                if (ff == NULL) {
+                    p = source->fill - 1;
+                    break;
+                }
+                p = ff - buf;
+                if (buf[p + 1] == 0xD8) {
+                    break;
+                }
+                p++;
+            }
+            if (p + 1 >= source->fill) {
+                // a trailing FF may be the start of the next SOI
+                p = source->fill > 0 && buf[source->fill - 1] == 0xFF ? source->fill - 1 : source->fill;
+                if (p < source->pos) {
+                    p = source->pos;
+                }
+                source->skipped += p - source->pos;
+                source->pos = p;
+                return 0;
+            }
+            source->skipped += p - source->pos;
+            source->frame_start = p;
+            source->pos = p + 2;
+            source->scan = SCAN_MARKER;
+        } else if (source->scan == SCAN_MARKER) {
+            if (p + 2 > source->fill) {
+                return 0;
+            }
+            unsigned char marker = buf[p + 1];
+            if (buf[p] != 0xFF) {
+                scan_resync(source);
+            } else if (marker == 0xFF) {
+                source->pos = p + 1;    // fill byte
+            } else if (marker == 0xD9) {
+                *start = source->frame_start;
+                *end = p + 2;
+                source->pos = p + 2;
+                source->scan = SCAN_SOI;
+                return 1;
+            } else if (marker == 0xD8) {
+                // truncated frame followed by a new one
+                source->skipped += p - source->frame_start;
+                source->frame_start = p;
+                source->pos = p + 2;
+            } else if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+                source->pos = p + 2;    // markers without a length
+            } else {
+                if (p + 4 > source->fill) {
+                    return 0;
+                }
+                size_t length = ((size_t)buf[p + 2] << 8) | buf[p + 3];
+                if (length < 2) {
+                    scan_resync(source);
+                } else {
+                    // segments (EXIF thumbnails included) are skipped whole, pos may lie past the buffered bytes
+                    source->pos = p + 2 + length;
+                    if (marker == 0xDA) {
+                        source->scan = SCAN_ENTROPY;
+                    }
+                }
+            }
+        } else {
+            // entropy coded data ends at the first FF that is not stuffing (FF 00) or a restart marker
+            while (1) {
+                if (p >= source->fill) {
+                    return 0;
+                }
+                unsigned char* ff = (unsigned char*)memchr(buf + p, 0xFF, source->fill - p);
+                if (ff == NULL) {
+                    source->pos = source->fill;
+                    return 0;
+                }
+                p = ff - buf;
+                if (p + 1 >= source->fill) {
+                    source->pos = p;
+                    return 0;
+                }
+                unsigned char next = buf[p + 1];
+                if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+                    p += 2;
+                } else if (next == 0xFF) {
+                    p += 1;
+                } else {
+                    break;
+                }
+            }
+            source->pos = p;
+            source->scan = SCAN_MARKER;
+        }
+    }
+}
+
+// Wait for data and append it to the buffer, > 0: bytes read; 0: end of stream; -1: error or stop
+static ssize_t read_more(mjpeg_source_t* source)
+{
+    struct pollfd fds[2];
+    fds[0].fd = source->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = source->wake_fds[0];
+    fds[1].events = POLLIN;
+    while (1) {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        int ret = poll(fds, 2, -1);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 || fds[1].revents != 0) {
+            return -1;
+        }
+        ssize_t bytes = read(source->fd, source->buf + source->fill, source->cap - source->fill);
+        if (bytes < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            printf("ERROR: mjpeg read fail: %s\n", strerror(errno));
+            return -1;
+        }
+        source->fill += (size_t)bytes;
+        return bytes;
+    }
+}
+
+// Make room at the end of the buffer: drop consumed bytes, grow for frames larger than the buffer
+static int make_room(mjpeg_source_t* source)
+{
+    size_t keep = source->scan == SCAN_SOI ? source->pos : source->frame_start;
+    if (keep > 0 && (keep >= source->cap / 2 || source->fill == source->cap)) {
+        memmove(source->buf, source->buf + keep, source->fill - keep);
+        source->fill -= keep;
+        source->pos -= keep;
+        source->frame_start = source->frame_start > keep ? source->frame_start - keep : 0;
+    }
+    if (source->fill < source->cap) {
+        return 0;
+    }
+    if (source->cap >= MJPEG_MAX_FRAME_SIZE) {
+        printf("WARNING: mjpeg frame larger than %d bytes, skipped\n", MJPEG_MAX_FRAME_SIZE);
+        scan_resync(source);
+        return make_room(source);
+    }
+    unsigned char* buf = (unsigned char*)realloc(source->buf, source->cap * 2 + 1);
+    if (buf == NULL) {
+        printf("ERROR: grow mjpeg buffer to %zu bytes fail\n", source->cap * 2);
+        return -1;
+    }
+    source->buf = buf;
+    source->cap *= 2;
+    return 0;
+}
+
+// Skip the HTTP response header, the multipart body after it is scanned like any other stream
+static int skip_http_header(mjpeg_source_t* source)
+{
+    while (1) {
+        source->buf[source->fill] = 0;
+        char* end = strstr((char*)source->buf, "\r\n\r\n");
+        if (end != NULL) {
+            int status = 0;
+            if (sscanf((char*)source->buf, "HTTP/%*d.%*d %d", &status) != 1 || status != 200) {
+                printf("ERROR: mjpeg http status %d\n", status);
+                return -1;
+            }
+            source->pos = (unsigned char*)end + 4 - source->buf;
+            return 0;
+        }
+        if (source->fill >= MJPEG_MAX_HTTP_HEADER || read_more(source) <= 0) {
+            printf("ERROR: mjpeg http response without header\n");
+            return -1;
+        }
+    }
+}
+
+static mjpeg_slot_t* oldest_slot(mjpeg_source_t* source, slot_state_t state)
+{
+    mjpeg_slot_t* oldest = NULL;
+    for (int i = 0; i < source->num_slots; i++) {
+        mjpeg_slot_t* slot = &source->slots[i];
+        if (slot->state == state && (oldest == NULL || slot->frame.index < oldest->frame.index)) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+static mjpeg_slot_t* find_slot(mjpeg_source_t* source, slot_state_t state)
+{
+    for (int i = 0; i < source->num_slots; i++) {
+        if (source->slots[i].state == state) {
+            return &source->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Copy a frame into a slot for the decode threads, -1 when stopped
+static int queue_frame(mjpeg_source_t* source, const unsigned char* jpeg, size_t size)
+{
+    mjpeg_slot_t* slot = NULL;
+    pthread_mutex_lock(&source->lock);
+    source->stats.frames_found++;
+    source->stats.bytes_skipped += source->skipped;
+    source->skipped = 0;
+    uint64_t index = source->next_index++;
+    while (!source->stop && (slot = find_slot(source, SLOT_FREE)) == NULL) {
+        if (source->config.policy == FRAME_SOURCE_DROP_OLDEST) {
+            // a decoded frame nobody took yet, or else this one
+            slot = oldest_slot(source, SLOT_READY);
+            source->stats.frames_dropped++;
+            if (slot == NULL) {
+                pthread_mutex_unlock(&source->lock);
+                return 0;
+            }
+            break;
+        }
+        pthread_cond_wait(&source->free_cond, &source->lock);
+    }
+    if (source->stop) {
+        pthread_mutex_unlock(&source->lock);
+        return -1;
+    }
+    slot->state = SLOT_LOADING;
+    slot->frame.index = index;
+    pthread_mutex_unlock(&source->lock);
+
+    int ok = 1;
+    if (size > slot->jpeg_cap) {
+        unsigned char* jpeg_buf = (unsigned char*)realloc(slot->jpeg, size);
+        if (jpeg_buf == NULL) {
+            printf("ERROR: allocate %zu bytes for mjpeg frame fail\n", size);
+            ok = 0;
+        } else {
+            slot->jpeg = jpeg_buf;
+            slot->jpeg_cap = size;
+        }
+    }
+    if (ok) {
+        memcpy(slot->jpeg, jpeg, size);
+        slot->jpeg_size = size;
+    }
+
+    pthread_mutex_lock(&source->lock);
+    if (ok) {
+        slot->state = SLOT_FILLED;
+        pthread_cond_signal(&source->filled_cond);
+    } else {
+        slot->state = SLOT_FREE;
+        source->stats.frames_failed++;
+    }
+    pthread_mutex_unlock(&source->lock);
+    return 0;
+}
+
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Sleep until the frame is due at the configured rate, -1 when stopped meanwhile
+static int pace_frame(mjpeg_source_t* source, long long start_us, uint64_t frames)
+{
+    long long due = start_us + (long long)(frames * 1000000.0 / source->config.fps);
+    long long wait_us = due - now_us();
+    if (wait_us <= 0) {
+        return 0;
+    }
+    struct pollfd wake;
+    wake.fd = source->wake_fds[0];
+    wake.events = POLLIN;
+    wake.revents = 0;
+    return poll(&wake, 1, (int)((wait_us + 999) / 1000)) > 0 ? -1 : 0;
+}
+
+static void* mjpeg_reader(void* arg)
+{
+    mjpeg_source_t* source = (mjpeg_source_t*)arg;
+    int ret = 0;
+    uint64_t frames = 0;
+    long long start_us = now_us();
+
+    if (source->is_http && skip_http_header(source) != 0) {
+        ret = -1;
+    }
+    while (ret == 0) {
+        size_t start, end;
+        while (scan_frame(source, &start, &end)) {
+            if (queue_frame(source, source->buf + start, end - start) != 0) {
+                ret = -1;
+                break;
+            }
+            frames++;
+            if (source->config.fps > 0 && pace_frame(source, start_us, frames) != 0) {
+                ret = -1;
+                break;
+            }
+        }
+        if (ret != 0) {
+            break;
+        }
+        if (source->scan != SCAN_SOI && source->pos - source->frame_start > MJPEG_MAX_FRAME_SIZE) {
+            printf("WARNING: mjpeg frame larger than %d bytes, skipped\n", MJPEG_MAX_FRAME_SIZE);
+            scan_resync(source);
+            continue;
+        }
+        if (make_room(source) != 0) {
+            ret = -1;
+            break;
+        }
+        ssize_t bytes = read_more(source);
+        if (bytes <= 0) {
+            ret = bytes < 0 ? -1 : 1;
+        }
+    }
+
+    pthread_mutex_lock(&source->lock);
+    if (source->scan != SCAN_SOI && ret > 0) {
+        printf("WARNING: mjpeg stream ended inside a frame\n");
+    }
+    source->stats.bytes_skipped += source->skipped;
+    source->skipped = 0;
+    source->eof = 1;
+    source->error = ret < 0 && !source->stop;
+    pthread_cond_broadcast(&source->ready_cond);
+    pthread_mutex_unlock(&source->lock);
+    return NULL;
+}
+
+static void* mjpeg_decoder(void* arg)
+{
+    mjpeg_source_t* source = (mjpeg_source_t*)arg;
+
+    pthread_mutex_lock(&source->lock);
+    while (1) {
+        mjpeg_slot_t* slot = NULL;
+        while (!source->stop && (slot = oldest_slot(source, SLOT_FILLED)) == NULL) {
+            pthread_cond_wait(&source->filled_cond, &source->lock);
+        }
+        if (source->stop) {
+            break;
+        }
+        slot->state = SLOT_DECODING;
+        pthread_mutex_unlock(&source->lock);
+
+        mjpeg_frame_t* frame = &slot->frame;
+        memset(&frame->image, 0, sizeof(frame->image));
+        memset(&frame->info, 0, sizeof(frame->info));
+        int status = image_decoder_decode(slot->decoder, slot->jpeg, slot->jpeg_size, &frame->image,
+                                          &source->config.read_options, &frame->info);
+        if (status != 0) {
+            printf("ERROR: decode mjpeg frame %llu fail\n", (unsigned long long)frame->index);
+            memset(&frame->image, 0, sizeof(frame->image));
+        }
+
+        pthread_mutex_lock(&source->lock);
+        frame->status = status;
+        if (status != 0) {
+            source->stats.frames_failed++;
+        }
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&source->ready_cond);
+    }
+    pthread_mutex_unlock(&source->lock);
+    return NULL;
+}
+
+// Connect and send the request, the response is read by the reader thread
+static int open_http(const char* url)
+{
+    char host[256];
+    char port[16] = "80";
+    const char* path = "/";
+    const char* p = url + strlen("http://");
+    size_t host_len = strcspn(p, ":/");
+    if (host_len == 0 || host_len >= sizeof(host)) {
+        printf("ERROR: invalid mjpeg url %s\n", url);
+        return -1;
+    }
+    memcpy(host, p, host_len);
+    host[host_len] = 0;
+    p += host_len;
+    if (*p == ':') {
+        size_t port_len = strcspn(p + 1, "/");
+        if (port_len == 0 || port_len >= sizeof(port)) {
+            printf("ERROR: invalid mjpeg url %s\n", url);
+            return -1;
+        }
+        memcpy(port, p + 1, port_len);
+        port[port_len] = 0;
+        p += 1 + port_len;
+    }
+    if (*p == '/') {
+        path = p;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo* addrs = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &addrs) != 0) {
+        printf("ERROR: resolve %s fail\n", host);
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* ai = addrs; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0) {
+        printf("ERROR: connect %s:%s fail\n", host, port);
+        return -1;
+    }
+
+    // HTTP/1.0 so the server sends the body as is, without chunked transfer encoding
+    char request[1024];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: %s\r\n\r\n", path, host);
+    if (len >= (int)sizeof(request) || write(fd, request, len) != len) {
+        printf("ERROR: send mjpeg request fail\n");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+mjpeg_source_t* mjpeg_source_create(const char* url, const mjpeg_source_config_t* config)
+{
+    if (url == NULL) {
+        return NULL;
+    }
+    mjpeg_source_t* source = (mjpeg_source_t*)calloc(1, sizeof(mjpeg_source_t));
+    if (source == NULL) {
+        return NULL;
+    }
+    source->fd = -1;
+    source->wake_fds[0] = -1;
+    source->wake_fds[1] = -1;
+    if (config != NULL) {
+        source->config = *config;
+    }
+    if (source->config.num_threads <= 0) {
+        source->config.num_threads = 1;
+    }
+    source->num_slots = source->config.num_slots > source->config.num_threads ? source->config.num_slots
+                                                                              : source->config.num_threads + 2;
+    pthread_mutex_init(&source->lock, NULL);
+    pthread_cond_init(&source->free_cond, NULL);
+    pthread_cond_init(&source->filled_cond, NULL);
+    pthread_cond_init(&source->ready_cond, NULL);
+
+    if (strncmp(url, "http://", strlen("http://")) == 0) {
+        source->fd = open_http(url);
+        source->is_http = 1;
+    } else if (strcmp(url, "-") == 0) {
+        source->fd = STDIN_FILENO;
+    } else {
+        source->fd = open(url, O_RDONLY | O_CLOEXEC);
+        if (source->fd < 0) {
+            printf("ERROR: open %s fail: %s\n", url, strerror(errno));
+        }
+    }
+    if (source->fd < 0) {
+        mjpeg_source_destroy(source);
+        return NULL;
+    }
+    source->own_fd = source->fd != STDIN_FILENO;
+
+    // one spare byte for the terminator of the HTTP header search
+    source->cap = MJPEG_BUFFER_SIZE;
+    source->buf = (unsigned char*)malloc(source->cap + 1);
+    source->slots = (mjpeg_slot_t*)calloc(source->num_slots, sizeof(mjpeg_slot_t));
+    source->workers = (pthread_t*)calloc(source->config.num_threads, sizeof(pthread_t));
+    if (source->buf == NULL || source->slots == NULL || source->workers == NULL) {
+        printf("ERROR: allocate mjpeg source fail\n");
+        mjpeg_source_destroy(source);
+        return NULL;
+    }
+    for (int i = 0; i < source->num_slots; i++) {
+        source->slots[i].decoder = image_decoder_create();
+        if (source->slots[i].decoder == NULL) {
+            mjpeg_source_destroy(source);
+            return NULL;
+        }
+    }
+    if (pipe(source->wake_fds) != 0) {
+        printf("ERROR: mjpeg source pipe fail: %s\n", strerror(errno));
+        source->wake_fds[0] = -1;
+        source->wake_fds[1] = -1;
+        mjpeg_source_destroy(source);
+        return NULL;
+    }
+
+    for (int i = 0; i < source->config.num_threads; i++) {
+        if (pthread_create(&source->workers[i], NULL, mjpeg_decoder, source) != 0) {
+            printf("ERROR: create mjpeg decode thread fail\n");
+            mjpeg_source_destroy(source);
+            return NULL;
+        }
+        source->num_workers++;
+    }
+    if (pthread_create(&source->reader, NULL, mjpeg_reader, source) != 0) {
+        printf("ERROR: create mjpeg reader thread fail\n");
+        mjpeg_source_destroy(source);
+        return NULL;
+    }
+    source->reader_started = 1;
+    return source;
+}
+
+int mjpeg_source_next(mjpeg_source_t* source, mjpeg_frame_t** frame)
+{
+    if (source == NULL || frame == NULL) {
+        return -1;
+    }
+    int ret;
+    pthread_mutex_lock(&source->lock);
+    while (1) {
+        // the oldest frame still in flight goes first, even when later ones finished decoding
+        mjpeg_slot_t* first = NULL;
+        for (int i = 0; i < source->num_slots; i++) {
+            mjpeg_slot_t* slot = &source->slots[i];
+            if (slot->state != SLOT_FREE && slot->state != SLOT_HELD &&
+                (first == NULL || slot->frame.index < first->frame.index)) {
+                first = slot;
+            }
+        }
+        if (first != NULL && first->state == SLOT_READY) {
+            first->state = SLOT_HELD;
+            *frame = &first->frame;
+            ret = 0;
+            break;
+        }
+        if (first == NULL && source->eof) {
+            ret = source->error ? -1 : 1;
+            break;
+        }
+        pthread_cond_wait(&source->ready_cond, &source->lock);
+    }
+    pthread_mutex_unlock(&source->lock);
+    return ret;
+}
+
+void mjpeg_source_release(mjpeg_source_t* source, mjpeg_frame_t* frame)
+{
+    if (source == NULL || frame == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    for (int i = 0; i < source->num_slots; i++) {
+        if (&source->slots[i].frame == frame && source->slots[i].state == SLOT_HELD) {
+            source->slots[i].state = SLOT_FREE;
+            pthread_cond_signal(&source->free_cond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&source->lock);
+}
+
+void mjpeg_source_get_stats(mjpeg_source_t* source, mjpeg_source_stats_t* stats)
+{
+    if (source == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    *stats = source->stats;
+    pthread_mutex_unlock(&source->lock);
+}
+
+void mjpeg_source_destroy(mjpeg_source_t* source)
+{
+    if (source == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&source->lock);
+    source->stop = 1;
+    pthread_cond_broadcast(&source->free_cond);
+    pthread_cond_broadcast(&source->filled_cond);
+    pthread_mutex_unlock(&source->lock);
+    if (source->wake_fds[1] >= 0) {
+        char wake = 0;
+        if (write(source->wake_fds[1], &wake, 1) < 0) {
+            printf("WARNING: mjpeg source wake fail: %s\n", strerror(errno));
+        }
+    }
+    if (source->reader_started) {
+        pthread_join(source->reader, NULL);
+    }
+    for (int i = 0; i < source->num_workers; i++) {
+        pthread_join(source->workers[i], NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (source->wake_fds[i] >= 0) {
+            close(source->wake_fds[i]);
+        }
+    }
+    if (source->own_fd) {
+        close(source->fd);
+    }
+    if (source->slots != NULL) {
+        for (int i = 0; i < source->num_slots; i++) {
+            image_decoder_destroy(source->slots[i].decoder);
+            free(source->slots[i].jpeg);
+        }
+    }
+    pthread_cond_destroy(&source->free_cond);
+    pthread_cond_destroy(&source->filled_cond);
+    pthread_cond_destroy(&source->ready_cond);
+    pthread_mutex_destroy(&source->lock);
+    free(source->slots);
+    free(source->workers);
+    free(source->buf);
+    free(source);
+}
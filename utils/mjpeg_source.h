@@ -0,0 +1,97 @@
+#ifndef _RKNN_MODEL_ZOO_MJPEG_SOURCE_H_
+#define _RKNN_MODEL_ZOO_MJPEG_SOURCE_H_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "image_utils.h"
+#include "frame_source.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mjpeg_source_t mjpeg_source_t;
+
+/**
+ * @brief Configuration of mjpeg_source_create
+ *
+ */
+typedef struct {
+    int num_threads;                    // decode threads, <= 0: 1
+    int num_slots;                      // frames between reader, decoders and consumer, <= num_threads: num_threads + 2
+    image_read_options_t read_options;  // target size for DCT scaled decoding, YUV output
+    frame_source_policy_t policy;       // when every slot is busy: wait, or drop the oldest decoded frame
+                                        // (the new frame when none is decoded yet)
+    float fps;                          // > 0: hand out frames of a recorded file at this rate, like a live camera
+} mjpeg_source_config_t;
+
+/**
+ * @brief One decoded frame, owned by the source until mjpeg_source_release
+ *
+ */
+typedef struct {
+    uint64_t index;             // position in the stream, dropped frames leave gaps
+    int status;                 // 0: decoded; -1: corrupt frame, image is empty
+    image_buffer_t image;
+    image_read_info_t info;
+} mjpeg_frame_t;
+
+typedef struct {
+    uint64_t frames_found;      // complete JPEGs cut out of the stream
+    uint64_t frames_dropped;
+    uint64_t frames_failed;     // decode errors
+    uint64_t bytes_skipped;     // garbage and multipart headers between frames
+} mjpeg_source_stats_t;
+
+/**
+ * @brief Open an MJPEG stream and start cutting and decoding frames in the background
+ *
+ * The stream is any sequence of JPEGs with anything in between: concatenated .mjpeg dumps,
+ * multipart/x-mixed-replace bodies, pipes and FIFOs. Frames are found by walking the JPEG marker
+ * segments, so embedded EXIF thumbnails do not split a frame. Every slot keeps its own decoder,
+ * once the slots have seen the largest frame no allocation happens per frame.
+ *
+ * @param url [in] File or FIFO path, "-" for stdin, or http://host[:port]/path
+ * @param config [in] Configuration, NULL: 1 thread, full resolution, blocking
+ * @return mjpeg_source_t* Source, NULL on error
+ */
+mjpeg_source_t* mjpeg_source_create(const char* url, const mjpeg_source_config_t* config);
+
+/**
+ * @brief Wait for the next frame in stream order
+ *
+ * @param source [in] Source
+ * @param frame [out] Frame, check its status
+ * @return int 0: frame returned; 1: end of stream; -1: read error
+ */
+int mjpeg_source_next(mjpeg_source_t* source, mjpeg_frame_t** frame);
+
+/**
+ * @brief Give a frame back, its slot and pixels are reused for a following frame
+ *
+ * @param source [in] Source
+ * @param frame [in] Frame from mjpeg_source_next
+ */
+void mjpeg_source_release(mjpeg_source_t* source, mjpeg_frame_t* frame);
+
+/**
+ * @brief Stream counters
+ *
+ * @param source [in] Source
+ * @param stats [out] Counters
+ */
+void mjpeg_source_get_stats(mjpeg_source_t* source, mjpeg_source_stats_t* stats);
+
+/**
+ * @brief Stop the reader and decode threads and free everything, outstanding frames become invalid
+ *
+ * @param source [in] Source
+ */
+void mjpeg_source_destroy(mjpeg_source_t* source);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_MJPEG_SOURCE_H_
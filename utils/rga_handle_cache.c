@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "im2d.h"
+#include "rga_handle_cache.h"
+
+typedef struct {
+    int fd;
+    void* virt_addr;
+    int width_stride;
+    int height_stride;
+    int format;
+    rga_buffer_handle_t handle;
+    unsigned long long last_use;
+    int refs;           // acquired and not released yet, never evicted while > 0
+    int stale;          // invalidated while in use, released when refs drops to 0
+} cache_entry_t;
+
+static rga_buffer_handle_t librga_import_fd(int fd, im_handle_param_t* param)
+{
+    return importbuffer_fd(fd, param);
+}
+
+static rga_buffer_handle_t librga_import_virtualaddr(void* va, im_handle_param_t* param)
+{
+    return importbuffer_virtualaddr(va, param);
+}
+
+static IM_STATUS librga_release(rga_buffer_handle_t handle)
+{
+    return releasebuffer_handle(handle);
+}
+
+static const rga_handle_ops_t g_librga_ops = {
+    librga_import_fd,
+    librga_import_virtualaddr,
+    librga_release,
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static rga_handle_ops_t g_ops = {
+    librga_import_fd,
+    librga_import_virtualaddr,
+    librga_release,
+};
+static cache_entry_t g_entries[RGA_HANDLE_CACHE_MAX];
+static int g_num_entries = 0;
+static int g_capacity = 0;
+static unsigned long long g_clock = 0;
+static rga_handle_cache_stats_t g_stats;
+
+static rga_buffer_handle_t import_buffer(int fd, void* virt_addr, int width_stride, int height_stride, int format)
+{
+    im_handle_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.width = width_stride;
+    param.height = height_stride;
+    param.format = format;
+    if (fd > 0) {
+        return g_ops.import_fd(fd, &param);
+    }
+    return g_ops.import_virtualaddr(virt_addr, &param);
+}
+
+// Caller holds g_lock
+static void remove_entry(int index)
+{
+    g_ops.release(g_entries[index].handle);
+    g_entries[index] = g_entries[--g_num_entries];
+}
+
+// Release unused entries until at most capacity are left, caller holds g_lock
+static void evict_to(int capacity)
+{
+    while (g_num_entries > capacity) {
+        int oldest = -1;
+        for (int i = 0; i < g_num_entries; i++) {
+            if (g_entries[i].refs == 0 &&
+                (oldest < 0 || g_entries[i].last_use < g_entries[oldest].last_use)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            // everything is in use, the extra entries go away on release
+            return;
+        }
+        remove_entry(oldest);
+        g_stats.evictions++;
+    }
+}
+
+void rga_handle_cache_set_ops(const rga_handle_ops_t* ops)
+{
+    rga_handle_cache_clear();
+    pthread_mutex_lock(&g_lock);
+    g_ops = ops != NULL ? *ops : g_librga_ops;
+    pthread_mutex_unlock(&g_lock);
+}
+
+int rga_handle_cache_set_capacity(int capacity)
+{
+    if (capacity < 0 || capacity > RGA_HANDLE_CACHE_MAX) {
+        printf("ERROR: rga handle cache capacity %d out of range [0, %d]\n", capacity, RGA_HANDLE_CACHE_MAX);
+        return -1;
+    }
+    pthread_mutex_lock(&g_lock);
+    g_capacity = capacity;
+    evict_to(capacity);
+    pthread_mutex_unlock(&g_lock);
+    return 0;
+}
+
+rga_buffer_handle_t rga_handle_cache_acquire(int fd, void* virt_addr, int width_stride, int height_stride, int format)
+{
+    if (fd <= 0 && virt_addr == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&g_lock);
+    if (g_capacity == 0) {
+        rga_buffer_handle_t handle = import_buffer(fd, virt_addr, width_stride, height_stride, format);
+        pthread_mutex_unlock(&g_lock);
+        return handle;
+    }
+    for (int i = 0; i < g_num_entries; i++) {
+        cache_entry_t* entry = &g_entries[i];
+        if (!entry->stale && entry->fd == fd && entry->virt_addr == virt_addr &&
+            entry->width_stride == width_stride && entry->height_stride == height_stride && entry->format == format) {
+            entry->refs++;
+            entry->last_use = ++g_clock;
+            g_stats.hits++;
+            pthread_mutex_unlock(&g_lock);
+            return entry->handle;
+        }
+    }
+    g_stats.misses++;
+    rga_buffer_handle_t handle = import_buffer(fd, virt_addr, width_stride, height_stride, format);
+    if (handle != 0) {
+        evict_to(g_capacity - 1);
+        if (g_num_entries < RGA_HANDLE_CACHE_MAX) {
+            cache_entry_t* entry = &g_entries[g_num_entries++];
+            entry->fd = fd;
+            entry->virt_addr = virt_addr;
+            entry->width_stride = width_stride;
+            entry->height_stride = height_stride;
+            entry->format = format;
+            entry->handle = handle;
+            entry->last_use = ++g_clock;
+            entry->refs = 1;
+            entry->stale = 0;
+        }
+        // else: table full of handles in use, rga_handle_cache_release frees this one directly
+    }
+    pthread_mutex_unlock(&g_lock);
+    return handle;
+}
+
+void rga_handle_cache_release(rga_buffer_handle_t handle)
+{
+    if (handle == 0) {
+        return;
+    }
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < g_num_entries; i++) {
+        cache_entry_t* entry = &g_entries[i];
+        if (entry->handle == handle && entry->refs > 0) {
+            entry->refs--;
+            if (entry->refs == 0 && entry->stale) {
+                remove_entry(i);
+            }
+            evict_to(g_capacity);
+            pthread_mutex_unlock(&g_lock);
+            return;
+        }
+    }
+    // not cached
+    g_ops.release(handle);
+    pthread_mutex_unlock(&g_lock);
+}
+
+void rga_handle_cache_invalidate(int fd, const void* virt_addr)
+{
+    pthread_mutex_lock(&g_lock);
+    for (int i = g_num_entries - 1; i >= 0; i--) {
+        cache_entry_t* entry = &g_entries[i];
+        if ((fd > 0 && entry->fd == fd) || (virt_addr != NULL && entry->virt_addr == virt_addr)) {
+            if (entry->refs > 0) {
+                entry->stale = 1;
+            } else {
+                remove_entry(i);
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void rga_handle_cache_clear(void)
+{
+    pthread_mutex_lock(&g_lock);
+    for (int i = g_num_entries - 1; i >= 0; i--) {
+        if (g_entries[i].refs > 0) {
+            g_entries[i].stale = 1;
+        } else {
+            remove_entry(i);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void rga_handle_cache_get_stats(rga_handle_cache_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_lock);
+    *stats = g_stats;
+    stats->entries = g_num_entries;
+    pthread_mutex_unlock(&g_lock);
+}
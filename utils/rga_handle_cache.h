@@ -0,0 +1,94 @@
+#ifndef _RKNN_MODEL_ZOO_RGA_HANDLE_CACHE_H_
+#define _RKNN_MODEL_ZOO_RGA_HANDLE_CACHE_H_
+
+#include "im2d_version.h"
+#include "im2d_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RGA_HANDLE_CACHE_MAX 64
+
+/**
+ * @brief librga buffer import functions, replaceable to test without RGA hardware
+ *
+ */
+typedef struct {
+    rga_buffer_handle_t (*import_fd)(int fd, im_handle_param_t* param);
+    rga_buffer_handle_t (*import_virtualaddr)(void* va, im_handle_param_t* param);
+    IM_STATUS (*release)(rga_buffer_handle_t handle);
+} rga_handle_ops_t;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    int entries;
+} rga_handle_cache_stats_t;
+
+/**
+ * @brief Replace the import functions, releases every cached handle first
+ *
+ * @param ops [in] Import functions, NULL restores librga
+ */
+void rga_handle_cache_set_ops(const rga_handle_ops_t* ops);
+
+/**
+ * @brief Number of imported buffers kept alive, least recently used ones are released first
+ *
+ * 0 (default) disables caching: every acquire imports and every release frees the handle.
+ * With caching on, a cached buffer must be invalidated before it is freed or unmapped, a new
+ * allocation at the same address would otherwise reuse the stale handle.
+ *
+ * @param capacity [in] Cached handles, at most RGA_HANDLE_CACHE_MAX
+ * @return int 0: success; -1: error
+ */
+int rga_handle_cache_set_capacity(int capacity);
+
+/**
+ * @brief Get a handle for a buffer, importing it on a miss
+ *
+ * Buffers are keyed by (fd or virt_addr, width_stride, height_stride, format).
+ *
+ * @param fd [in] dma-buf fd, <= 0 to import virt_addr
+ * @param virt_addr [in] CPU address, used when fd <= 0
+ * @param width_stride [in] Pixels per row
+ * @param height_stride [in] Rows per plane
+ * @param format [in] RK_FORMAT_*
+ * @return rga_buffer_handle_t Handle, 0 on error; give it back with rga_handle_cache_release
+ */
+rga_buffer_handle_t rga_handle_cache_acquire(int fd, void* virt_addr, int width_stride, int height_stride, int format);
+
+/**
+ * @brief Give back a handle from rga_handle_cache_acquire
+ *
+ * @param handle [in] Handle
+ */
+void rga_handle_cache_release(rga_buffer_handle_t handle);
+
+/**
+ * @brief Drop the cached handles of a buffer that is about to be freed
+ *
+ * @param fd [in] dma-buf fd, <= 0 to match on virt_addr only
+ * @param virt_addr [in] CPU address, NULL to match on fd only
+ */
+void rga_handle_cache_invalidate(int fd, const void* virt_addr);
+
+/**
+ * @brief Release every cached handle
+ */
+void rga_handle_cache_clear(void);
+
+/**
+ * @brief Hit/miss counters since the process started
+ *
+ * @param stats [out] Counters
+ */
+void rga_handle_cache_get_stats(rga_handle_cache_stats_t* stats);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_RGA_HANDLE_CACHE_H_
@@ -0,0 +1,236 @@
+// frame_source on a temp file and a FIFO: frame order and content, frames_read, a truncated last
+// frame, BLOCK against DROP_OLDEST with a slow consumer, and complete frames kept at end of stream.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frame_source.h"
+
+#define WIDTH 64
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT)
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+static void fill_frame(unsigned char* data, int index)
+{
+    for (int i = 0; i < FRAME_SIZE; i++) {
+        data[i] = (unsigned char)(index * 7 + i);
+    }
+}
+
+static int frame_is(const unsigned char* data, int index)
+{
+    unsigned char expect[FRAME_SIZE];
+    fill_frame(expect, index);
+    return memcmp(data, expect, FRAME_SIZE) == 0;
+}
+
+// num_frames whole frames followed by tail_bytes of one more
+static int write_frames(int fd, int num_frames, int tail_bytes)
+{
+    unsigned char data[FRAME_SIZE];
+    for (int i = 0; i <= num_frames; i++) {
+        fill_frame(data, i);
+        int size = i < num_frames ? FRAME_SIZE : tail_bytes;
+        for (int done = 0; done < size;) {
+            ssize_t n = write(fd, data + done, size - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return -1;
+            }
+            done += (int)n;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    const char* path;
+    int num_frames;
+    int tail_bytes;
+} writer_args_t;
+
+static void* fifo_writer(void* arg)
+{
+    writer_args_t* args = (writer_args_t*)arg;
+    int fd = open(args->path, O_WRONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    write_frames(fd, args->num_frames, args->tail_bytes);
+    close(fd);
+    return NULL;
+}
+
+static frame_source_config_t make_config(frame_source_policy_t policy, int num_slots, int batch_frames)
+{
+    frame_source_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.width = WIDTH;
+    config.height = HEIGHT;
+    config.format = IMAGE_FORMAT_GRAY8;
+    config.num_slots = num_slots;
+    config.batch_frames = batch_frames;
+    config.policy = policy;
+    return config;
+}
+
+typedef struct {
+    int delivered;
+    int last_index;
+    int in_order;
+    int content_ok;
+    int end_ret;
+    frame_source_stats_t stats;
+} consume_result_t;
+
+// Take every frame, sleeping consumer_us per frame, until the end of the stream
+static void consume(frame_source_t* source, int consumer_us, consume_result_t* result)
+{
+    memset(result, 0, sizeof(*result));
+    result->last_index = -1;
+    result->in_order = 1;
+    result->content_ok = 1;
+    frame_source_frame_t* frame;
+    int ret;
+    while ((ret = frame_source_next(source, &frame)) == 0) {
+        if ((int)frame->index <= result->last_index) {
+            result->in_order = 0;
+        }
+        if (!frame_is(frame->image.virt_addr, (int)frame->index)) {
+            result->content_ok = 0;
+        }
+        result->last_index = (int)frame->index;
+        result->delivered++;
+        if (consumer_us > 0) {
+            usleep(consumer_us);
+        }
+        frame_source_release(source, frame);
+    }
+    result->end_ret = ret;
+    frame_source_get_stats(source, &result->stats);
+}
+
+static void test_file(const char* dir)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/frames.raw", dir);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    CHECK(fd >= 0 && write_frames(fd, 12, FRAME_SIZE / 2) == 0);
+    close(fd);
+
+    // a file is read at the consumer's pace with BLOCK, the half frame at the end is dropped
+    frame_source_config_t config = make_config(FRAME_SOURCE_BLOCK, 3, 2);
+    frame_source_t* source = frame_source_create(path, &config);
+    CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+    consume_result_t result;
+    consume(source, 1000, &result);
+    frame_source_destroy(source);
+    CHECK(result.delivered == 12);
+    CHECK(result.last_index == 11);
+    CHECK(result.in_order && result.content_ok);
+    CHECK(result.end_ret == 1);
+    CHECK(result.stats.frames_read == 12);
+    CHECK(result.stats.frames_dropped == 0);
+    unlink(path);
+}
+
+static void run_fifo(const char* path, frame_source_policy_t policy, int num_slots, int num_frames, int tail_bytes,
+                     int consumer_us, int consume_after_us, consume_result_t* result)
+{
+    writer_args_t args = {path, num_frames, tail_bytes};
+    pthread_t writer;
+    pthread_create(&writer, NULL, fifo_writer, &args);
+    frame_source_config_t config = make_config(policy, num_slots, 1);
+    frame_source_t* source = frame_source_create(path, &config);
+    CHECK(source != NULL);
+    if (source == NULL) {
+        pthread_join(writer, NULL);
+        memset(result, 0, sizeof(*result));
+        return;
+    }
+    if (consume_after_us > 0) {
+        pthread_join(writer, NULL);
+        usleep(consume_after_us);
+    }
+    consume(source, consumer_us, result);
+    frame_source_destroy(source);
+    if (consume_after_us <= 0) {
+        pthread_join(writer, NULL);
+    }
+}
+
+static void test_fifo(const char* dir)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/frames.fifo", dir);
+    CHECK(mkfifo(path, 0600) == 0);
+    consume_result_t result;
+
+    // BLOCK throttles the writer, every frame arrives and the truncated tail ends the stream cleanly
+    run_fifo(path, FRAME_SOURCE_BLOCK, 3, 30, 100, 2000, 0, &result);
+    CHECK(result.delivered == 30);
+    CHECK(result.last_index == 29);
+    CHECK(result.in_order && result.content_ok);
+    CHECK(result.end_ret == 1);
+    CHECK(result.stats.frames_read == 30);
+    CHECK(result.stats.frames_dropped == 0);
+
+    // DROP_OLDEST keeps reading, the slow consumer sees gaps but always the newest frames
+    run_fifo(path, FRAME_SOURCE_DROP_OLDEST, 3, 30, 100, 5000, 0, &result);
+    CHECK(result.stats.frames_read == 30);
+    CHECK(result.stats.frames_dropped > 0);
+    CHECK(result.delivered + (int)result.stats.frames_dropped == 30);
+    CHECK(result.last_index == 29);
+    CHECK(result.in_order && result.content_ok);
+    CHECK(result.end_ret == 1);
+
+    // a full ring at the end of the stream: no frame is stolen for data that never comes
+    run_fifo(path, FRAME_SOURCE_DROP_OLDEST, 2, 2, 0, 0, 100000, &result);
+    CHECK(result.delivered == 2);
+    CHECK(result.stats.frames_read == 2);
+    CHECK(result.stats.frames_dropped == 0);
+    CHECK(result.in_order && result.content_ok);
+
+    // same with a truncated frame after the full ring: the partly overwritten frame is the dropped one
+    run_fifo(path, FRAME_SOURCE_DROP_OLDEST, 2, 2, FRAME_SIZE / 2, 0, 100000, &result);
+    CHECK(result.stats.frames_read == 2);
+    CHECK(result.delivered + (int)result.stats.frames_dropped == 2);
+    CHECK(result.delivered == 1 && result.last_index == 1);
+    CHECK(result.in_order && result.content_ok);
+    unlink(path);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/frame_source_test_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        printf("FAIL: mkdtemp: %s\n", strerror(errno));
+        return 1;
+    }
+    test_file(dir);
+    test_fifo(dir);
+    rmdir(dir);
+    printf("frame source: %s\n", g_failures == 0 ? "ok" : "FAILED");
+    return g_failures == 0 ? 0 : 1;
+}
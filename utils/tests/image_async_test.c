@@ -0,0 +1,163 @@
+// image_async with a mock delay: more jobs than queue_depth, completion in submission order,
+// poll/wait results and destroy draining the queued jobs. Runs on any host, RGA is not needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "image_async.h"
+
+#define QUEUE_DEPTH 3
+#define MOCK_DELAY_US 20000
+#define NUM_JOBS 10
+#define SRC_WIDTH 64
+#define SRC_HEIGHT 48
+#define DST_SIZE 32
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void init_image(image_buffer_t* image, int width, int height, unsigned char* pixels)
+{
+    memset(image, 0, sizeof(image_buffer_t));
+    image->width = width;
+    image->height = height;
+    image->format = IMAGE_FORMAT_RGB888;
+    image->virt_addr = pixels;
+    image->size = width * height * 3;
+}
+
+typedef struct {
+    unsigned char pixels[DST_SIZE * DST_SIZE * 3];
+    image_buffer_t image;
+    letterbox_t letterbox;
+} job_output_t;
+
+static void reset_output(job_output_t* out)
+{
+    memset(out->pixels, 0xAA, sizeof(out->pixels));
+    init_image(&out->image, DST_SIZE, DST_SIZE, out->pixels);
+    memset(&out->letterbox, 0, sizeof(letterbox_t));
+    out->letterbox.scale = -1.0f;
+}
+
+static int output_matches(const job_output_t* out, const job_output_t* ref)
+{
+    return memcmp(out->pixels, ref->pixels, sizeof(out->pixels)) == 0 && out->letterbox.scale == ref->letterbox.scale &&
+           out->letterbox.x_pad == ref->letterbox.x_pad && out->letterbox.y_pad == ref->letterbox.y_pad;
+}
+
+// More jobs than queue_depth go through a full queue, finished ones keep submission order
+static void test_queue(image_buffer_t* src, const job_output_t* ref)
+{
+    image_async_config_t config = {QUEUE_DEPTH, MOCK_DELAY_US};
+    image_async_t* async = image_async_create(&config);
+    CHECK(async != NULL);
+    if (async == NULL) {
+        return;
+    }
+    letterbox_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    static job_output_t outputs[NUM_JOBS];
+    image_async_token_t tokens[NUM_JOBS];
+    int num_waited = 0;
+    long long start = now_us();
+    for (int i = 0; i < NUM_JOBS; i++) {
+        reset_output(&outputs[i]);
+        if (i - num_waited == QUEUE_DEPTH) {
+            image_async_token_t extra;
+            CHECK(image_async_letterbox(async, src, &outputs[i].image, &plan, &outputs[i].letterbox, 114, &extra) != 0);
+            // the newest outstanding job finishes last, every earlier one is done by then
+            CHECK(image_async_wait(async, tokens[i - 1]) == 0);
+            for (int j = num_waited; j < i - 1; j++) {
+                CHECK(image_async_poll(async, tokens[j]) == 1);
+                CHECK(image_async_wait(async, tokens[j]) == 0);
+            }
+            num_waited = i;
+        }
+        CHECK(image_async_letterbox(async, src, &outputs[i].image, &plan, &outputs[i].letterbox, 114, &tokens[i]) == 0);
+        CHECK(i == 0 || tokens[i] > tokens[i - 1]);
+    }
+    // the last job was just queued behind a mock delay
+    CHECK(image_async_poll(async, tokens[NUM_JOBS - 1]) == 0);
+    for (int i = num_waited; i < NUM_JOBS; i++) {
+        CHECK(image_async_wait(async, tokens[i]) == 0);
+    }
+    long long elapsed = now_us() - start;
+    CHECK(elapsed >= (long long)NUM_JOBS * MOCK_DELAY_US);
+    for (int i = 0; i < NUM_JOBS; i++) {
+        CHECK(output_matches(&outputs[i], ref));
+    }
+    // waited tokens are released
+    CHECK(image_async_poll(async, tokens[0]) == -1);
+    CHECK(image_async_wait(async, tokens[NUM_JOBS - 1]) == -1);
+    CHECK(image_async_poll(async, 0) == -1);
+    image_async_destroy(async);
+    letterbox_plan_release(&plan);
+}
+
+// destroy runs the jobs still queued before it stops the worker
+static void test_destroy_drains(image_buffer_t* src, const job_output_t* ref)
+{
+    image_async_config_t config = {QUEUE_DEPTH, MOCK_DELAY_US};
+    image_async_t* async = image_async_create(&config);
+    CHECK(async != NULL);
+    if (async == NULL) {
+        return;
+    }
+    letterbox_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    static job_output_t outputs[QUEUE_DEPTH];
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        image_async_token_t token;
+        reset_output(&outputs[i]);
+        CHECK(image_async_letterbox(async, src, &outputs[i].image, &plan, &outputs[i].letterbox, 114, &token) == 0);
+    }
+    long long start = now_us();
+    image_async_destroy(async);
+    CHECK(now_us() - start >= (long long)(QUEUE_DEPTH - 1) * MOCK_DELAY_US);
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        CHECK(output_matches(&outputs[i], ref));
+    }
+    letterbox_plan_release(&plan);
+}
+
+int main(void)
+{
+    static unsigned char src_pixels[SRC_WIDTH * SRC_HEIGHT * 3];
+    unsigned int seed = 1;
+    for (size_t i = 0; i < sizeof(src_pixels); i++) {
+        seed = seed * 1103515245u + 12345u;
+        src_pixels[i] = (unsigned char)(seed >> 16);
+    }
+    image_buffer_t src;
+    init_image(&src, SRC_WIDTH, SRC_HEIGHT, src_pixels);
+
+    // reference from the synchronous path
+    static job_output_t ref;
+    letterbox_plan_t plan;
+    memset(&plan, 0, sizeof(plan));
+    reset_output(&ref);
+    CHECK(convert_image_with_letterbox_plan(&src, &ref.image, &plan, &ref.letterbox, 114) == 0);
+    letterbox_plan_release(&plan);
+
+    test_queue(&src, &ref);
+    test_destroy_drains(&src, &ref);
+    printf("image async: %s\n", g_failures == 0 ? "ok" : "FAILED");
+    return g_failures == 0 ? 0 : 1;
+}
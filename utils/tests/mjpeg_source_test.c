@@ -0,0 +1,340 @@
+// mjpeg_source frame cutting on a generated stream: EXIF segments holding a thumbnail, FF 00 stuffing,
+// restart markers, a truncated frame followed by a new SOI and garbage between frames. The same bytes
+// are read from a file and from a loopback HTTP server, which also covers the response header.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "jpeglib.h"
+#include "turbojpeg.h"
+#include "mjpeg_source.h"
+
+#define FRAME_WIDTH 48
+#define FRAME_HEIGHT 32
+#define THUMB_SIZE 16
+#define MAX_FRAMES 4
+#define STREAM_CAP (256 * 1024)
+#define HTTP_CHUNK 37
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+typedef struct {
+    unsigned char* data;
+    unsigned long size;
+} jpeg_blob_t;
+
+// Noise compresses badly, so the entropy coded data is full of FF bytes that need stuffing
+static jpeg_blob_t make_jpeg(int width, int height, unsigned int seed, int restart_interval, const jpeg_blob_t* thumb)
+{
+    unsigned char* pixels = (unsigned char*)malloc(width * height * 3);
+    for (int i = 0; i < width * height * 3; i++) {
+        seed = seed * 1103515245u + 12345u;
+        pixels[i] = (unsigned char)(seed >> 16);
+    }
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_blob_t blob = {NULL, 0};
+    jpeg_mem_dest(&cinfo, &blob.data, &blob.size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    cinfo.restart_interval = restart_interval;
+    jpeg_start_compress(&cinfo, TRUE);
+    if (thumb != NULL) {
+        // EXIF APP1 carrying a whole JPEG, its SOI and EOI must not split the frame
+        static unsigned char exif[65533];
+        static const unsigned char header[] = {'E', 'x', 'i', 'f', 0, 0, 'I', 'I', 42, 0, 8, 0, 0, 0};
+        memcpy(exif, header, sizeof(header));
+        memcpy(exif + sizeof(header), thumb->data, thumb->size);
+        jpeg_write_marker(&cinfo, JPEG_APP0 + 1, exif, (unsigned int)(sizeof(header) + thumb->size));
+    }
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = pixels + cinfo.next_scanline * width * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(pixels);
+    return blob;
+}
+
+// Offset of the entropy coded data after the SOS segment
+static size_t entropy_start(const jpeg_blob_t* jpeg)
+{
+    size_t p = 2;
+    while (p + 4 <= jpeg->size) {
+        size_t length = ((size_t)jpeg->data[p + 2] << 8) | jpeg->data[p + 3];
+        if (jpeg->data[p + 1] == 0xDA) {
+            return p + 2 + length;
+        }
+        p += 2 + length;
+    }
+    return jpeg->size;
+}
+
+// 1 if FF followed by a byte in [lo, hi] occurs in the entropy coded data
+static int has_entropy_marker(const jpeg_blob_t* jpeg, unsigned char lo, unsigned char hi)
+{
+    for (size_t p = entropy_start(jpeg); p + 1 < jpeg->size; p++) {
+        if (jpeg->data[p] == 0xFF && jpeg->data[p + 1] >= lo && jpeg->data[p + 1] <= hi) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    unsigned char data[STREAM_CAP];
+    size_t size;
+    size_t garbage;                     // bytes outside complete frames
+    int num_frames;
+    jpeg_blob_t frames[MAX_FRAMES];     // the complete frames in stream order
+} stream_t;
+
+static void append(stream_t* stream, const void* data, size_t size, int is_garbage)
+{
+    if (stream->size + size > STREAM_CAP) {
+        printf("FAIL: test stream larger than %d bytes\n", STREAM_CAP);
+        g_failures++;
+        return;
+    }
+    memcpy(stream->data + stream->size, data, size);
+    stream->size += size;
+    if (is_garbage) {
+        stream->garbage += size;
+    }
+}
+
+static void append_frame(stream_t* stream, jpeg_blob_t frame)
+{
+    append(stream, frame.data, frame.size, 0);
+    stream->frames[stream->num_frames++] = frame;
+}
+
+static void build_stream(stream_t* stream, jpeg_blob_t* thumb, jpeg_blob_t* truncated)
+{
+    // multipart boundaries, stray FF bytes that start no SOI, and text that ends the stream
+    static const char part[] = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: 0\r\n\r\n";
+    static const unsigned char noise[] = {0x00, 0xFF, 0x00, 0xFF, 0xD9, 0xFF, 0xFF, 0xC0, 0x12, 0xD8, 0xFF, 0x01};
+    static const char tail[] = "\r\n--frame--\r\n";
+
+    memset(stream, 0, sizeof(*stream));
+    *thumb = make_jpeg(THUMB_SIZE, THUMB_SIZE, 7, 0, NULL);
+    append(stream, part, strlen(part), 1);
+    append_frame(stream, make_jpeg(FRAME_WIDTH, FRAME_HEIGHT, 1, 1, thumb));
+    append(stream, noise, sizeof(noise), 1);
+    append(stream, part, strlen(part), 1);
+
+    // cut inside the entropy coded data, the next SOI starts over
+    *truncated = make_jpeg(FRAME_WIDTH, FRAME_HEIGHT, 2, 2, NULL);
+    size_t start = entropy_start(truncated);
+    append(stream, truncated->data, start + (truncated->size - start) / 2, 1);
+    append_frame(stream, make_jpeg(FRAME_WIDTH, FRAME_HEIGHT, 3, 2, NULL));
+
+    append(stream, part, strlen(part), 1);
+    append_frame(stream, make_jpeg(FRAME_WIDTH, FRAME_HEIGHT, 4, 0, thumb));
+    append(stream, tail, strlen(tail), 1);
+}
+
+static void free_stream(stream_t* stream, jpeg_blob_t* thumb, jpeg_blob_t* truncated)
+{
+    for (int i = 0; i < stream->num_frames; i++) {
+        free(stream->frames[i].data);
+    }
+    free(thumb->data);
+    free(truncated->data);
+}
+
+// Read every frame and compare it with a plain TurboJPEG decode of the frame it was cut from
+static void check_source(const char* url, const stream_t* stream)
+{
+    mjpeg_source_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.num_threads = 2;
+    config.policy = FRAME_SOURCE_BLOCK;
+    mjpeg_source_t* source = mjpeg_source_create(url, &config);
+    CHECK(source != NULL);
+    if (source == NULL) {
+        return;
+    }
+    static unsigned char expect[FRAME_WIDTH * FRAME_HEIGHT * 3];
+    tjhandle tj = tjInitDecompress();
+    int num_frames = 0;
+    mjpeg_frame_t* frame;
+    int ret;
+    while ((ret = mjpeg_source_next(source, &frame)) == 0) {
+        int i = num_frames++;
+        CHECK(i < stream->num_frames);
+        CHECK(frame->index == (uint64_t)i);
+        CHECK(frame->status == 0);
+        if (i < stream->num_frames && frame->status == 0) {
+            CHECK(frame->image.width == FRAME_WIDTH && frame->image.height == FRAME_HEIGHT);
+            CHECK(frame->image.format == IMAGE_FORMAT_RGB888);
+            CHECK(tjDecompress2(tj, stream->frames[i].data, stream->frames[i].size, expect, FRAME_WIDTH, 0,
+                                FRAME_HEIGHT, TJPF_RGB, 0) == 0);
+            CHECK(frame->image.virt_addr != NULL && memcmp(frame->image.virt_addr, expect, sizeof(expect)) == 0);
+        }
+        mjpeg_source_release(source, frame);
+    }
+    tjDestroy(tj);
+    CHECK(ret == 1);
+    CHECK(num_frames == stream->num_frames);
+    mjpeg_source_stats_t stats;
+    mjpeg_source_get_stats(source, &stats);
+    CHECK(stats.frames_found == (uint64_t)stream->num_frames);
+    CHECK(stats.frames_dropped == 0);
+    CHECK(stats.frames_failed == 0);
+    CHECK(stats.bytes_skipped == stream->garbage);
+    mjpeg_source_destroy(source);
+}
+
+static void test_file(const stream_t* stream)
+{
+    char path[] = "/tmp/mjpeg_source_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+    CHECK(write(fd, stream->data, stream->size) == (ssize_t)stream->size);
+    close(fd);
+    check_source(path, stream);
+    unlink(path);
+}
+
+typedef struct {
+    int listen_fd;
+    const char* status_line;
+    const stream_t* stream;
+} server_args_t;
+
+// One connection: read the request, answer with a multipart response in small pieces
+static void* http_server(void* arg)
+{
+    server_args_t* args = (server_args_t*)arg;
+    int fd = accept(args->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    char request[1024];
+    size_t got = 0;
+    while (got < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+        request[got] = 0;
+        if (strstr(request, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "%s\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\n\r\n", args->status_line);
+    send(fd, header, len, MSG_NOSIGNAL);
+    // small pieces with pauses, frames and segments arrive split across reads
+    for (size_t p = 0; p < args->stream->size; p += HTTP_CHUNK) {
+        size_t size = args->stream->size - p < HTTP_CHUNK ? args->stream->size - p : HTTP_CHUNK;
+        if (send(fd, args->stream->data + p, size, MSG_NOSIGNAL) != (ssize_t)size) {
+            break;
+        }
+        if (p % (HTTP_CHUNK * 16) == 0) {
+            usleep(200);
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+// Loopback listener on a free port, the url is written to url
+static int start_server(server_args_t* args, pthread_t* thread, char* url, size_t url_size)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    args->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (args->listen_fd < 0 || bind(args->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(args->listen_fd, 1) != 0 || getsockname(args->listen_fd, (struct sockaddr*)&addr, &addr_len) != 0) {
+        printf("FAIL: loopback listener: %s\n", strerror(errno));
+        g_failures++;
+        if (args->listen_fd >= 0) {
+            close(args->listen_fd);
+        }
+        return -1;
+    }
+    snprintf(url, url_size, "http://127.0.0.1:%d/stream.mjpg", ntohs(addr.sin_port));
+    pthread_create(thread, NULL, http_server, args);
+    return 0;
+}
+
+static void test_http(const stream_t* stream)
+{
+    server_args_t args = {-1, "HTTP/1.0 200 OK", stream};
+    pthread_t thread;
+    char url[64];
+    if (start_server(&args, &thread, url, sizeof(url)) != 0) {
+        return;
+    }
+    check_source(url, stream);
+    pthread_join(thread, NULL);
+    close(args.listen_fd);
+
+    // an error response ends the stream with a read error instead of scanning the body
+    server_args_t error_args = {-1, "HTTP/1.0 404 Not Found", stream};
+    if (start_server(&error_args, &thread, url, sizeof(url)) != 0) {
+        return;
+    }
+    mjpeg_source_t* source = mjpeg_source_create(url, NULL);
+    CHECK(source != NULL);
+    if (source != NULL) {
+        mjpeg_frame_t* frame;
+        CHECK(mjpeg_source_next(source, &frame) == -1);
+        mjpeg_source_stats_t stats;
+        mjpeg_source_get_stats(source, &stats);
+        CHECK(stats.frames_found == 0);
+        mjpeg_source_destroy(source);
+    }
+    pthread_join(thread, NULL);
+    close(error_args.listen_fd);
+}
+
+int main(void)
+{
+    static stream_t stream;
+    jpeg_blob_t thumb, truncated;
+    build_stream(&stream, &thumb, &truncated);
+    // the fixture really holds what the scanner has to step over
+    CHECK(stream.num_frames == 3);
+    CHECK(has_entropy_marker(&stream.frames[0], 0x00, 0x00));
+    CHECK(has_entropy_marker(&stream.frames[0], 0xD0, 0xD7));
+    CHECK(has_entropy_marker(&stream.frames[1], 0xD0, 0xD7));
+    CHECK(!has_entropy_marker(&stream.frames[2], 0xD0, 0xD7));
+
+    test_file(&stream);
+    test_http(&stream);
+    free_stream(&stream, &thumb, &truncated);
+    printf("mjpeg source: %s\n", g_failures == 0 ? "ok" : "FAILED");
+    return g_failures == 0 ? 0 : 1;
+}
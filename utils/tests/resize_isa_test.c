@@ -0,0 +1,201 @@
+// Bit exactness of the SIMD resize paths: every instruction set supported by this build and CPU
+// must write exactly the bytes of RESIZE_ISA_C, for odd sizes, padded strides, up and down scaling.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_resize.h"
+
+typedef struct {
+    int src_width;
+    int src_height;
+    int dst_width;
+    int dst_height;
+} geometry_t;
+
+static const geometry_t g_geometries[] = {
+    {1, 1, 1, 1},
+    {2, 2, 3, 3},
+    {7, 5, 3, 2},
+    {33, 17, 65, 31},
+    {640, 480, 319, 241},
+    {1279, 721, 640, 640},
+    {101, 203, 100, 202},
+    {97, 61, 389, 247},
+};
+
+#define NUM_GEOMETRIES ((int)(sizeof(g_geometries) / sizeof(g_geometries[0])))
+// extra bytes per row, so the kernels never rely on tightly packed rows
+#define ROW_PAD 13
+
+static void fill_random(uint8_t* data, size_t size, unsigned int* seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(*seed >> 16);
+    }
+}
+
+static uint8_t* alloc_random(size_t size, unsigned int* seed)
+{
+    uint8_t* data = (uint8_t*)malloc(size);
+    if (data != NULL) {
+        fill_random(data, size, seed);
+    }
+    return data;
+}
+
+static int compare(const char* what, resize_isa_t isa, const geometry_t* g, const uint8_t* ref, const uint8_t* out,
+                   size_t size)
+{
+    if (memcmp(ref, out, size) == 0) {
+        return 0;
+    }
+    size_t i = 0;
+    while (ref[i] == out[i]) {
+        i++;
+    }
+    printf("FAIL %s %s %dx%d -> %dx%d: byte %zu is %d, c gives %d\n", what, resize_isa_name(isa), g->src_width,
+           g->src_height, g->dst_width, g->dst_height, i, out[i], ref[i]);
+    return -1;
+}
+
+static int test_bilinear(resize_isa_t isa, const geometry_t* g, int channels, unsigned int* seed)
+{
+    resize_table_t table;
+    if (resize_table_init(&table, channels, g->src_width, g->src_height, g->dst_width, g->dst_height) != 0) {
+        return -1;
+    }
+    int src_stride = g->src_width * channels + ROW_PAD;
+    int dst_stride = g->dst_width * channels + ROW_PAD;
+    size_t dst_size = (size_t)dst_stride * g->dst_height;
+    uint8_t* src = alloc_random((size_t)src_stride * g->src_height, seed);
+    uint8_t* ref = alloc_random(dst_size, seed);
+    uint8_t* out = (uint8_t*)malloc(dst_size);
+    short* scratch = (short*)malloc(resize_scratch_size(&table) * sizeof(short));
+    int ret = -1;
+    if (src != NULL && ref != NULL && out != NULL && scratch != NULL) {
+        // the padding must come through untouched too
+        memcpy(out, ref, dst_size);
+        resize_table_set_isa(&table, RESIZE_ISA_C);
+        resize_bilinear(&table, src, src_stride, ref, dst_stride, 0, g->dst_height, scratch);
+        resize_table_set_isa(&table, isa);
+        resize_bilinear(&table, src, src_stride, out, dst_stride, 0, g->dst_height, scratch);
+        char what[32];
+        snprintf(what, sizeof(what), "bilinear c%d", channels);
+        ret = compare(what, isa, g, ref, out, dst_size);
+    }
+    free(src);
+    free(ref);
+    free(out);
+    free(scratch);
+    resize_table_release(&table);
+    return ret;
+}
+
+static int test_to_rgb888(resize_isa_t isa, const geometry_t* g, image_format_t format, unsigned int* seed)
+{
+    // chroma subsampled formats work on even source areas
+    int src_width = g->src_width;
+    int src_height = g->src_height;
+    int is_yuv420 = format == IMAGE_FORMAT_YUV420SP_NV12 || format == IMAGE_FORMAT_YUV420SP_NV21 ||
+                    format == IMAGE_FORMAT_YUV420P;
+    if (is_yuv420 || format == IMAGE_FORMAT_YUYV) {
+        src_width = (src_width + 1) & ~1;
+    }
+    if (is_yuv420) {
+        src_height = (src_height + 1) & ~1;
+    }
+    resize_table_t table;
+    resize_table_t uv_table;
+    if (resize_to_rgb888_tables_init(format, &table, &uv_table, src_width, src_height, g->dst_width, g->dst_height) != 0) {
+        return -1;
+    }
+
+    int bpp = format == IMAGE_FORMAT_BGR888 ? 3 : (format == IMAGE_FORMAT_RGB565 || format == IMAGE_FORMAT_YUYV) ? 2 : 1;
+    int strides[3] = {src_width * bpp + ROW_PAD, 0, 0};
+    size_t plane_size[3] = {(size_t)strides[0] * src_height, 0, 0};
+    if (format == IMAGE_FORMAT_YUV420SP_NV12 || format == IMAGE_FORMAT_YUV420SP_NV21) {
+        strides[1] = src_width + ROW_PAD;
+        plane_size[1] = (size_t)strides[1] * (src_height / 2);
+    } else if (format == IMAGE_FORMAT_YUV420P) {
+        strides[1] = src_width / 2 + ROW_PAD;
+        plane_size[1] = (size_t)strides[1] * (src_height / 2);
+        plane_size[2] = plane_size[1];
+    }
+    uint8_t* planes[3] = {NULL, NULL, NULL};
+    for (int i = 0; i < 3; i++) {
+        if (plane_size[i] > 0) {
+            planes[i] = alloc_random(plane_size[i], seed);
+        }
+    }
+    int dst_stride = g->dst_width * 3 + ROW_PAD;
+    size_t dst_size = (size_t)dst_stride * g->dst_height;
+    uint8_t* ref = alloc_random(dst_size, seed);
+    uint8_t* out = (uint8_t*)malloc(dst_size);
+    short* scratch = (short*)malloc(resize_to_rgb888_scratch_size(format, &table, &uv_table) * sizeof(short));
+    int ret = -1;
+    if (planes[0] != NULL && ref != NULL && out != NULL && scratch != NULL) {
+        const uint8_t* const src[3] = {planes[0], planes[1], planes[2]};
+        memcpy(out, ref, dst_size);
+        resize_table_set_isa(&table, RESIZE_ISA_C);
+        resize_table_set_isa(&uv_table, RESIZE_ISA_C);
+        resize_to_rgb888(format, &table, &uv_table, src, strides, IMAGE_COLOR_SPACE_BT601_LIMITED, ref, dst_stride, 0,
+                         g->dst_height, scratch);
+        resize_table_set_isa(&table, isa);
+        resize_table_set_isa(&uv_table, isa);
+        resize_to_rgb888(format, &table, &uv_table, src, strides, IMAGE_COLOR_SPACE_BT601_LIMITED, out, dst_stride, 0,
+                         g->dst_height, scratch);
+        char what[32];
+        snprintf(what, sizeof(what), "to_rgb888 fmt %d", format);
+        ret = compare(what, isa, g, ref, out, dst_size);
+    }
+    for (int i = 0; i < 3; i++) {
+        free(planes[i]);
+    }
+    free(ref);
+    free(out);
+    free(scratch);
+    resize_table_release(&table);
+    resize_table_release(&uv_table);
+    return ret;
+}
+
+int main(void)
+{
+    static const resize_isa_t isas[] = {RESIZE_ISA_SSE2, RESIZE_ISA_AVX2, RESIZE_ISA_NEON};
+    static const image_format_t formats[] = {
+        IMAGE_FORMAT_BGR888, IMAGE_FORMAT_RGB565, IMAGE_FORMAT_YUYV, IMAGE_FORMAT_YUV420P,
+        IMAGE_FORMAT_YUV420SP_NV12, IMAGE_FORMAT_YUV420SP_NV21,
+    };
+    int failures = 0;
+    int tested = 0;
+    unsigned int seed = 1;
+    for (int i = 0; i < (int)(sizeof(isas) / sizeof(isas[0])); i++) {
+        resize_table_t probe;
+        memset(&probe, 0, sizeof(probe));
+        if (resize_table_set_isa(&probe, isas[i]) != 0) {
+            printf("skip %s: not supported by this build or CPU\n", resize_isa_name(isas[i]));
+            continue;
+        }
+        int isa_failures = 0;
+        for (int g = 0; g < NUM_GEOMETRIES; g++) {
+            for (int channels = 1; channels <= 4; channels++) {
+                isa_failures += test_bilinear(isas[i], &g_geometries[g], channels, &seed) != 0;
+            }
+            for (int f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++) {
+                if (resize_to_rgb888_supported(formats[f])) {
+                    isa_failures += test_to_rgb888(isas[i], &g_geometries[g], formats[f], &seed) != 0;
+                }
+            }
+        }
+        printf("%s: %s\n", resize_isa_name(isas[i]), isa_failures == 0 ? "bit exact" : "MISMATCH");
+        failures += isa_failures;
+        tested++;
+    }
+    if (tested == 0) {
+        printf("no SIMD instruction set to compare\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+// RGA handle cache against fake import/release ops: hit/miss counting, LRU eviction, invalidation of
+// a handle in use, capacity 0 passthrough and the full table path. No RGA hardware is needed.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rga_handle_cache.h"
+
+#define MAX_HANDLES 1024
+
+static int g_live[MAX_HANDLES];     // 1 while the fake RGA holds the handle
+static int g_next_handle = 1;
+static int g_imports = 0;
+static int g_releases = 0;
+static int g_failures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            g_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+static rga_buffer_handle_t fake_import(void)
+{
+    if (g_next_handle >= MAX_HANDLES) {
+        return 0;
+    }
+    g_imports++;
+    g_live[g_next_handle] = 1;
+    return (rga_buffer_handle_t)g_next_handle++;
+}
+
+static rga_buffer_handle_t fake_import_fd(int fd, im_handle_param_t* param)
+{
+    (void)fd;
+    (void)param;
+    return fake_import();
+}
+
+static rga_buffer_handle_t fake_import_virtualaddr(void* va, im_handle_param_t* param)
+{
+    (void)va;
+    (void)param;
+    return fake_import();
+}
+
+static IM_STATUS fake_release(rga_buffer_handle_t handle)
+{
+    if (handle == 0 || handle >= MAX_HANDLES || !g_live[handle]) {
+        printf("FAIL: release of handle %d that is not live\n", (int)handle);
+        g_failures++;
+        return IM_STATUS_INVALID_PARAM;
+    }
+    g_live[handle] = 0;
+    g_releases++;
+    return IM_STATUS_SUCCESS;
+}
+
+static const rga_handle_ops_t g_fake_ops = {
+    fake_import_fd,
+    fake_import_virtualaddr,
+    fake_release,
+};
+
+static int num_live(void)
+{
+    int n = 0;
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        n += g_live[i];
+    }
+    return n;
+}
+
+static char g_buffers[RGA_HANDLE_CACHE_MAX + 1][16];
+
+static rga_buffer_handle_t acquire(int buffer)
+{
+    return rga_handle_cache_acquire(0, g_buffers[buffer], 640, 480, 0);
+}
+
+// Stats are process wide, every case compares against the counters at its start
+static void begin_case(int capacity, rga_handle_cache_stats_t* start)
+{
+    rga_handle_cache_set_capacity(0);
+    CHECK(num_live() == 0);
+    rga_handle_cache_set_capacity(capacity);
+    rga_handle_cache_get_stats(start);
+}
+
+static void test_hit_miss(void)
+{
+    rga_handle_cache_stats_t start, stats;
+    begin_case(4, &start);
+    rga_buffer_handle_t a = acquire(0);
+    rga_handle_cache_release(a);
+    CHECK(acquire(0) == a);
+    rga_handle_cache_release(a);
+    rga_buffer_handle_t b = acquire(1);
+    CHECK(b != 0 && b != a);
+    rga_handle_cache_release(b);
+    // a different geometry of the same buffer is another entry
+    rga_buffer_handle_t c = rga_handle_cache_acquire(0, g_buffers[0], 320, 240, 0);
+    CHECK(c != a && c != b);
+    rga_handle_cache_release(c);
+    rga_handle_cache_get_stats(&stats);
+    CHECK(stats.hits - start.hits == 1);
+    CHECK(stats.misses - start.misses == 3);
+    CHECK(stats.entries == 3);
+    CHECK(g_live[a] && g_live[b] && g_live[c]);
+}
+
+static void test_lru_eviction(void)
+{
+    rga_handle_cache_stats_t start, stats;
+    begin_case(2, &start);
+    rga_buffer_handle_t a = acquire(0);
+    rga_handle_cache_release(a);
+    rga_buffer_handle_t b = acquire(1);
+    rga_handle_cache_release(b);
+    // touching a makes b the least recently used entry
+    CHECK(acquire(0) == a);
+    rga_handle_cache_release(a);
+    rga_buffer_handle_t c = acquire(2);
+    rga_handle_cache_release(c);
+    CHECK(g_live[a] && !g_live[b] && g_live[c]);
+    rga_handle_cache_get_stats(&stats);
+    CHECK(stats.evictions - start.evictions == 1);
+    CHECK(stats.entries == 2);
+    CHECK(acquire(0) == a);
+    rga_handle_cache_release(a);
+    rga_buffer_handle_t b2 = acquire(1);
+    CHECK(b2 != b);
+    rga_handle_cache_release(b2);
+    // a handle in use is never evicted, the cache runs over capacity until it is released
+    rga_handle_cache_set_capacity(1);
+    rga_buffer_handle_t held = acquire(1);
+    CHECK(held == b2);
+    rga_handle_cache_set_capacity(0);
+    CHECK(g_live[held]);
+    rga_handle_cache_release(held);
+    CHECK(!g_live[held]);
+}
+
+static void test_invalidate_held(void)
+{
+    rga_handle_cache_stats_t start, stats;
+    begin_case(4, &start);
+    rga_buffer_handle_t a = acquire(0);
+    rga_handle_cache_invalidate(0, g_buffers[0]);
+    // still in use by the caller, only marked stale
+    CHECK(g_live[a]);
+    rga_buffer_handle_t a2 = acquire(0);
+    CHECK(a2 != 0 && a2 != a);
+    rga_handle_cache_release(a);
+    CHECK(!g_live[a]);
+    CHECK(g_live[a2]);
+    rga_handle_cache_release(a2);
+    rga_handle_cache_get_stats(&stats);
+    CHECK(stats.hits == start.hits);
+    CHECK(stats.misses - start.misses == 2);
+    CHECK(stats.entries == 1);
+    // an unused entry is released at once
+    rga_handle_cache_invalidate(0, g_buffers[0]);
+    CHECK(!g_live[a2]);
+}
+
+static void test_passthrough(void)
+{
+    rga_handle_cache_stats_t start, stats;
+    begin_case(0, &start);
+    int imports = g_imports;
+    int releases = g_releases;
+    rga_buffer_handle_t a = acquire(0);
+    rga_handle_cache_release(a);
+    rga_buffer_handle_t b = acquire(0);
+    CHECK(b != a);
+    CHECK(g_live[b]);
+    rga_handle_cache_release(b);
+    CHECK(g_imports - imports == 2);
+    CHECK(g_releases - releases == 2);
+    CHECK(num_live() == 0);
+    rga_handle_cache_get_stats(&stats);
+    CHECK(stats.hits == start.hits && stats.misses == start.misses);
+    CHECK(stats.entries == 0);
+}
+
+static void test_table_full(void)
+{
+    rga_handle_cache_stats_t start, stats;
+    begin_case(RGA_HANDLE_CACHE_MAX, &start);
+    rga_buffer_handle_t handles[RGA_HANDLE_CACHE_MAX + 1];
+    for (int i = 0; i <= RGA_HANDLE_CACHE_MAX; i++) {
+        handles[i] = acquire(i);
+        CHECK(handles[i] != 0);
+    }
+    rga_handle_cache_get_stats(&stats);
+    CHECK(stats.entries == RGA_HANDLE_CACHE_MAX);
+    // every entry is in use, the last handle was handed out without being cached
+    rga_buffer_handle_t extra = handles[RGA_HANDLE_CACHE_MAX];
+    rga_handle_cache_release(extra);
+    CHECK(!g_live[extra]);
+    for (int i = 0; i < RGA_HANDLE_CACHE_MAX; i++) {
+        rga_handle_cache_release(handles[i]);
+        CHECK(g_live[handles[i]]);
+    }
+    CHECK(num_live() == RGA_HANDLE_CACHE_MAX);
+}
+
+int main(void)
+{
+    rga_handle_cache_set_ops(&g_fake_ops);
+    test_hit_miss();
+    test_lru_eviction();
+    test_invalidate_held();
+    test_passthrough();
+    test_table_full();
+    rga_handle_cache_clear();
+    CHECK(num_live() == 0);
+    rga_handle_cache_set_ops(NULL);
+    printf("rga handle cache: %s\n", g_failures == 0 ? "ok" : "FAILED");
+    return g_failures == 0 ? 0 : 1;
+}
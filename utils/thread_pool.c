@@ -0,0 +1,210 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread_pool.h"
+
+typedef struct {
+    thread_pool_t* pool;
+    pthread_t thread;
+    int index;      // 1-based, 0 is the thread calling parallel_for
+    int cpu_id;     // -1: no affinity
+} thread_pool_worker_t;
+
+struct thread_pool_t {
+    int num_threads;
+    thread_pool_worker_t* workers;
+
+    pthread_mutex_t submit_lock;    // one parallel_for at a time
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    unsigned int generation;        // bumped for every job
+    int stop;
+
+    // current job
+    parallel_for_fn fn;
+    void* arg;
+    int total;
+    int num_bands;
+    int pending;
+};
+
+static void get_band(int total, int num_bands, int band, int* begin, int* end)
+{
+    *begin = (int)((long long)total * band / num_bands);
+    *end = (int)((long long)total * (band + 1) / num_bands);
+}
+
+static void* thread_pool_worker(void* arg)
+{
+    thread_pool_worker_t* worker = (thread_pool_worker_t*)arg;
+    thread_pool_t* pool = worker->pool;
+    unsigned int seen = 0;
+
+#if defined(__linux__)
+    if (worker->cpu_id >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu_id, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            printf("WARNING: set affinity of worker %d to cpu %d fail\n", worker->index, worker->cpu_id);
+        }
+    }
+#endif
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        if (worker->index >= pool->num_bands) {
+            continue;
+        }
+        parallel_for_fn fn = pool->fn;
+        void* fn_arg = pool->arg;
+        int begin, end;
+        get_band(pool->total, pool->num_bands, worker->index, &begin, &end);
+        pthread_mutex_unlock(&pool->lock);
+
+        fn(fn_arg, begin, end, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool_t* thread_pool_create(int num_threads, const int* cpu_ids, int num_cpu_ids)
+{
+    if (num_threads <= 0) {
+        printf("ERROR: invalid thread pool size %d\n", num_threads);
+        return NULL;
+    }
+    thread_pool_t* pool = (thread_pool_t*)calloc(1, sizeof(thread_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = (thread_pool_worker_t*)calloc(num_threads, sizeof(thread_pool_worker_t));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->submit_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        thread_pool_worker_t* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i + 1;
+        worker->cpu_id = (cpu_ids != NULL && num_cpu_ids > 0) ? cpu_ids[i % num_cpu_ids] : -1;
+        if (pthread_create(&worker->thread, NULL, thread_pool_worker, worker) != 0) {
+            printf("ERROR: create thread pool worker %d fail\n", i);
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool_t* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->submit_lock);
+    free(pool->workers);
+    free(pool);
+}
+
+int thread_pool_size(const thread_pool_t* pool)
+{
+    return pool != NULL ? pool->num_threads : 0;
+}
+
+void thread_pool_parallel_for(thread_pool_t* pool, int total, int min_chunk, parallel_for_fn fn, void* arg)
+{
+    if (total <= 0) {
+        return;
+    }
+    if (min_chunk < 1) {
+        min_chunk = 1;
+    }
+    int num_bands = thread_pool_size(pool) + 1;
+    if (num_bands > total / min_chunk) {
+        num_bands = total / min_chunk;
+    }
+    if (num_bands <= 1) {
+        fn(arg, 0, total, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->submit_lock);
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->total = total;
+    pool->num_bands = num_bands;
+    pool->pending = num_bands - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    // the caller takes band 0
+    int begin, end;
+    get_band(total, num_bands, 0, &begin, &end);
+    fn(arg, begin, end, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->submit_lock);
+}
+
+static thread_pool_t* g_shared_pool = NULL;
+
+thread_pool_t* thread_pool_shared(void)
+{
+    return g_shared_pool;
+}
+
+int thread_pool_set_shared(int num_threads, const int* cpu_ids, int num_cpu_ids)
+{
+    thread_pool_t* pool = NULL;
+    if (num_threads > 0) {
+        pool = thread_pool_create(num_threads, cpu_ids, num_cpu_ids);
+        if (pool == NULL) {
+            return -1;
+        }
+    }
+    thread_pool_destroy(g_shared_pool);
+    g_shared_pool = pool;
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef _RKNN_MODEL_ZOO_THREAD_POOL_H_
+#define _RKNN_MODEL_ZOO_THREAD_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct thread_pool_t thread_pool_t;
+
+/**
+ * @brief Work on rows [begin, end), worker is in [0, thread_pool_size()] and 0 is the calling thread
+ *
+ */
+typedef void (*parallel_for_fn)(void* arg, int begin, int end, int worker);
+
+/**
+ * @brief Create a persistent pool of worker threads
+ *
+ * @param num_threads [in] Worker threads, the caller of parallel_for works as one more
+ * @param cpu_ids [in] CPUs the workers are pinned to (worker i uses cpu_ids[i % num_cpu_ids]), NULL for no affinity
+ * @param num_cpu_ids [in] Number of cpu_ids
+ * @return thread_pool_t* Pool, NULL on error
+ */
+thread_pool_t* thread_pool_create(int num_threads, const int* cpu_ids, int num_cpu_ids);
+
+/**
+ * @brief Stop and join the workers, then free the pool
+ *
+ * @param pool [in] Pool
+ */
+void thread_pool_destroy(thread_pool_t* pool);
+
+/**
+ * @brief Number of worker threads
+ *
+ * @param pool [in] Pool, NULL counts as 0
+ * @return int Worker threads
+ */
+int thread_pool_size(const thread_pool_t* pool);
+
+/**
+ * @brief Split [0, total) into contiguous bands of at least min_chunk rows and run them on the pool
+ *
+ * The split only depends on total, min_chunk and the pool size, so a kernel whose rows are
+ * independent gives the same result as a single-threaded run. Returns when all bands are done.
+ * Calls from several threads are serialized.
+ *
+ * @param pool [in] Pool, NULL runs everything on the calling thread
+ * @param total [in] Number of rows
+ * @param min_chunk [in] Minimum rows per band
+ * @param fn [in] Band function
+ * @param arg [in] Argument of fn
+ */
+void thread_pool_parallel_for(thread_pool_t* pool, int total, int min_chunk, parallel_for_fn fn, void* arg);
+
+/**
+ * @brief Pool shared by the image utils, NULL (single-threaded) until thread_pool_set_shared is called
+ *
+ * @return thread_pool_t* Shared pool
+ */
+thread_pool_t* thread_pool_shared(void);
+
+/**
+ * @brief Replace the shared pool, must not run concurrently with image conversions
+ *
+ * @param num_threads [in] Worker threads, 0 destroys the pool and goes back to single-threaded
+ * @param cpu_ids [in] CPUs the workers are pinned to, NULL for no affinity
+ * @param num_cpu_ids [in] Number of cpu_ids
+ * @return int 0: success; -1: error
+ */
+int thread_pool_set_shared(int num_threads, const int* cpu_ids, int num_cpu_ids);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif // _RKNN_MODEL_ZOO_THREAD_POOL_H_